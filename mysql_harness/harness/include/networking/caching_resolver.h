@@ -0,0 +1,155 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_HARNESS_NETWORKING_CACHING_RESOLVER_INCLUDED
+#define MYSQL_HARNESS_NETWORKING_CACHING_RESOLVER_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ip_address.h"
+#include "resolver.h"
+
+namespace mysql_harness {
+
+/**
+ * Resolver caching the IP addresses of hostnames
+ *
+ * Resolving a hostname may block for as long as the system resolver takes
+ * to answer. `CachingResolver` keeps the addresses of a hostname for `ttl`
+ * and the failure to resolve it for `negative_ttl`, so that only the first
+ * lookup of a name pays for the resolution. It is safe to use from several
+ * threads; a slow resolution only blocks the threads looking up the same
+ * name.
+ *
+ * Names which are looked up while cached are resolved again in a
+ * background thread shortly before they expire, so that lookups of names in
+ * use do not block. Names not looked up for `ttl` are dropped.
+ *
+ * IP addresses given as names are returned as they are, without caching.
+ *
+ * The routing plugin and the metadata cache share the instance returned by
+ * `instance()`.
+ */
+class CachingResolver : public Resolver {
+ public:
+  /** Function resolving a hostname, throwing std::invalid_argument on failure */
+  using ResolveFunction = std::function<std::vector<IPAddress>(const std::string &)>;
+
+  /** Default time for which addresses of a hostname are cached */
+  static constexpr std::chrono::milliseconds kDefaultTTL{std::chrono::seconds(60)};
+
+  /** Default time for which the failure to resolve a hostname is cached */
+  static constexpr std::chrono::milliseconds kDefaultNegativeTTL{std::chrono::seconds(5)};
+
+  /**
+   * Constructor
+   *
+   * @param ttl time for which addresses of a hostname are cached
+   * @param negative_ttl time for which failures to resolve are cached
+   * @param resolve function resolving hostnames; `Resolver::hostname()`
+   *        when not given
+   */
+  explicit CachingResolver(std::chrono::milliseconds ttl = kDefaultTTL,
+                           std::chrono::milliseconds negative_ttl = kDefaultNegativeTTL,
+                           ResolveFunction resolve = nullptr);
+
+  /** Destructor; stops the refresh thread */
+  ~CachingResolver();
+
+  CachingResolver(const CachingResolver &) = delete;
+  CachingResolver &operator=(const CachingResolver &) = delete;
+
+  /** Returns the resolver shared by the whole process */
+  static CachingResolver &instance();
+
+  /**
+   * Resolves the hostname to one or more IP addresses, using the cache
+   *
+   * @throws std::invalid_argument when the hostname could not be resolved
+   * @param name hostname to resolve
+   * @return a `std::vector` containing instances of `IPAddress`
+   */
+  std::vector<IPAddress> hostname(const std::string &name) const;
+
+  /** @overload */
+  std::vector<IPAddress> hostname(const char *name) const {
+    return hostname(std::string(name));
+  }
+
+  /**
+   * Sets the times for which results are cached
+   *
+   * Applies to results of resolutions done after the call.
+   */
+  void set_ttl(std::chrono::milliseconds ttl, std::chrono::milliseconds negative_ttl);
+
+  /** Drops all cached results */
+  void clear();
+
+  /** Returns number of cached hostnames */
+  size_t size() const;
+
+  /** Stops the refresh thread; lookups keep working, without refresh */
+  void stop();
+
+ private:
+  using clock_type = std::chrono::steady_clock;
+
+  struct Entry {
+    std::vector<IPAddress> addresses;
+    /** Resolver error; results are negative when not empty */
+    std::string error;
+    clock_type::time_point expires;
+    /** Whether the entry was looked up since it was last resolved */
+    bool used;
+    /** Whether a thread is resolving the name */
+    bool resolving;
+  };
+
+  /** Resolves `name` with resolve_ and stores the result, mutex_ held */
+  void resolve(std::unique_lock<std::mutex> &lock, const std::string &name) const;
+
+  /** Starts the refresh thread unless it runs, mutex_ held */
+  void start_refresher() const;
+
+  /** Main loop of the refresh thread */
+  void run() const noexcept;
+
+  ResolveFunction resolve_;
+  std::chrono::milliseconds ttl_;
+  std::chrono::milliseconds negative_ttl_;
+
+  mutable std::mutex mutex_;
+  /** Signalled when a resolution finished */
+  mutable std::condition_variable resolved_cond_;
+  /** Signalled when the refresh thread should stop */
+  mutable std::condition_variable refresh_cond_;
+  mutable std::map<std::string, Entry> cache_;
+  mutable std::thread refresh_thread_;
+  mutable bool stopping_;
+};
+
+}
+
+#endif // MYSQL_HARNESS_NETWORKING_CACHING_RESOLVER_INCLUDED
@@ -0,0 +1,134 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef MYSQL_HARNESS_PUBLISHED_PTR_INCLUDED
+#define MYSQL_HARNESS_PUBLISHED_PTR_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mysql_harness {
+
+/**
+ * Immutable object replaced as a whole, read without locking
+ *
+ * std::atomic_load() and std::atomic_store() of a std::shared_ptr take a
+ * lock in libstdc++. `PublishedPtr` keeps the shared_ptr in a holder which
+ * is never changed once published, and swaps an atomic pointer to it.
+ * Holders are reclaimed after a grace period, in the manner of RCU:
+ *
+ * - load() registers itself as a reader of the current epoch, loads the
+ *   pointer to the current holder, copies the shared_ptr out of it and
+ *   unregisters. It takes no lock and does not allocate; it only retries
+ *   its registration if a store() started the next epoch meanwhile.
+ * - store() swaps in a new holder, starts the next epoch and waits until
+ *   the readers of the previous epoch, the only ones which may have loaded
+ *   the old holder, are gone. Then it deletes the old holder.
+ *
+ * Readers keep the object they got for as long as they hold the
+ * shared_ptr. Stores are serialized with a mutex.
+ */
+template <class T>
+class PublishedPtr {
+ public:
+  using pointer = std::shared_ptr<const T>;
+
+  PublishedPtr() : PublishedPtr(pointer()) {}
+
+  explicit PublishedPtr(pointer ptr)
+      : current_(new Holder{std::move(ptr)}), epoch_(0) {
+    readers_[0] = 0;
+    readers_[1] = 0;
+  }
+
+  ~PublishedPtr() {
+    delete current_.load();
+  }
+
+  PublishedPtr(const PublishedPtr &) = delete;
+  PublishedPtr &operator=(const PublishedPtr &) = delete;
+
+  /**
+   * Returns the current object
+   */
+  pointer load() const noexcept {
+    size_t epoch;
+    while (true) {
+      epoch = epoch_.load();
+      readers_[epoch & 1].fetch_add(1);
+      // a store() which starts the next epoch from here on waits for us
+      if (epoch_.load() == epoch) {
+        break;
+      }
+      readers_[epoch & 1].fetch_sub(1);
+    }
+    pointer ptr = current_.load()->ptr;
+    readers_[epoch & 1].fetch_sub(1);
+    return ptr;
+  }
+
+  /**
+   * Replaces the current object
+   *
+   * Waits for readers which are copying the replaced object.
+   */
+  void store(pointer ptr) {
+    store_if(std::move(ptr), [](const pointer &) { return true; });
+  }
+
+  /**
+   * Replaces the current object if `should_replace(current)` is true
+   *
+   * Waits for readers which are copying the replaced object.
+   *
+   * @return whether the object was replaced
+   */
+  template <class Predicate>
+  bool store_if(pointer ptr, Predicate should_replace) {
+    std::unique_ptr<Holder> holder(new Holder{std::move(ptr)});
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!should_replace(current_.load()->ptr)) {
+      return false;
+    }
+    std::unique_ptr<Holder> old(current_.exchange(holder.release()));
+    // readers registering from now on see the new epoch and the new holder
+    size_t epoch = epoch_.fetch_add(1);
+    while (readers_[epoch & 1].load() != 0) {
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+ private:
+  struct Holder {
+    pointer ptr;
+  };
+
+  std::atomic<Holder *> current_;
+  std::atomic<size_t> epoch_;
+  /** Readers registered in even and odd epochs */
+  mutable std::atomic<size_t> readers_[2];
+
+  std::mutex mutex_;
+};
+
+}  // namespace mysql_harness
+
+#endif  // MYSQL_HARNESS_PUBLISHED_PTR_INCLUDED
@@ -0,0 +1,214 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "networking/caching_resolver.h"
+
+#include "common.h"
+
+#ifndef _WIN32
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#else
+#  include <ws2tcpip.h>
+#endif
+#include <algorithm>
+#include <stdexcept>
+
+namespace mysql_harness {
+
+constexpr std::chrono::milliseconds CachingResolver::kDefaultTTL;
+constexpr std::chrono::milliseconds CachingResolver::kDefaultNegativeTTL;
+
+// longest time between two checks for names to refresh
+static const std::chrono::milliseconds kMaxRefreshInterval{1000};
+static const std::chrono::milliseconds kMinRefreshInterval{10};
+
+static bool is_ip_address(const std::string &name) {
+  struct in6_addr addr;  // large enough for both families
+  return inet_pton(AF_INET, name.c_str(), &addr) == 1 ||
+         inet_pton(AF_INET6, name.c_str(), &addr) == 1;
+}
+
+CachingResolver::CachingResolver(std::chrono::milliseconds ttl,
+                                 std::chrono::milliseconds negative_ttl,
+                                 ResolveFunction resolve)
+    : resolve_(std::move(resolve)),
+      ttl_(ttl),
+      negative_ttl_(negative_ttl),
+      stopping_(false) {
+  if (!resolve_) {
+    resolve_ = [this](const std::string &name) {
+      return Resolver::hostname(name);
+    };
+  }
+}
+
+CachingResolver::~CachingResolver() {
+  stop();
+}
+
+CachingResolver &CachingResolver::instance() {
+  static CachingResolver resolver;
+  return resolver;
+}
+
+std::vector<IPAddress> CachingResolver::hostname(const std::string &name) const {
+  if (is_ip_address(name)) {
+    return {IPAddress(name)};
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    auto it = cache_.find(name);
+    if (it != cache_.end()) {
+      Entry &entry = it->second;
+      if (clock_type::now() < entry.expires) {
+        entry.used = true;
+        if (!entry.error.empty()) {
+          throw std::invalid_argument(entry.error);
+        }
+        return entry.addresses;
+      }
+      if (entry.resolving) {
+        // another thread resolves the name already, use its result
+        resolved_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    cache_[name].resolving = true;
+    start_refresher();
+    resolve(lock, name);
+
+    const Entry &entry = cache_[name];
+    if (!entry.error.empty()) {
+      throw std::invalid_argument(entry.error);
+    }
+    return entry.addresses;
+  }
+}
+
+void CachingResolver::set_ttl(std::chrono::milliseconds ttl,
+                              std::chrono::milliseconds negative_ttl) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ttl_ = ttl;
+  negative_ttl_ = negative_ttl;
+}
+
+void CachingResolver::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = cache_.begin(); it != cache_.end();) {
+    // names being resolved get the result of the running resolution
+    if (it->second.resolving) {
+      it->second.expires = clock_type::time_point();
+      ++it;
+    } else {
+      it = cache_.erase(it);
+    }
+  }
+}
+
+size_t CachingResolver::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.size();
+}
+
+void CachingResolver::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    refresh_cond_.notify_all();
+  }
+  if (refresh_thread_.joinable()) {
+    refresh_thread_.join();
+  }
+}
+
+void CachingResolver::resolve(std::unique_lock<std::mutex> &lock,
+                              const std::string &name) const {
+  std::vector<IPAddress> addresses;
+  std::string error;
+
+  lock.unlock();
+  try {
+    addresses = resolve_(name);
+  } catch (const std::exception &exc) {
+    error = exc.what();
+    if (error.empty()) {
+      error = "hostname resolve failed for " + name;
+    }
+  }
+  lock.lock();
+
+  Entry &entry = cache_[name];
+  auto now = clock_type::now();
+  // a failed refresh keeps the addresses until they expire
+  if (error.empty() || now >= entry.expires) {
+    entry.addresses = std::move(addresses);
+    entry.error = std::move(error);
+    entry.expires = now + (entry.error.empty() ? ttl_ : negative_ttl_);
+    entry.used = false;
+  }
+  entry.resolving = false;
+  resolved_cond_.notify_all();
+}
+
+void CachingResolver::start_refresher() const {
+  if (!stopping_ && !refresh_thread_.joinable()) {
+    refresh_thread_ = std::thread(&CachingResolver::run, this);
+  }
+}
+
+void CachingResolver::run() const noexcept {
+  rename_thread("DNS refresh");
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    // names are refreshed once less than a quarter of their TTL is left
+    auto margin = ttl_ / 4;
+    auto interval = std::min(std::max(margin / 2, kMinRefreshInterval), kMaxRefreshInterval);
+    refresh_cond_.wait_for(lock, interval, [this] { return stopping_; });
+    if (stopping_) break;
+
+    auto now = clock_type::now();
+    std::vector<std::string> names;
+    for (auto it = cache_.begin(); it != cache_.end();) {
+      const Entry &entry = it->second;
+      if (entry.resolving) {
+        ++it;
+      } else if (now >= entry.expires) {
+        // not used while cached or failed to refresh; resolved again on next lookup
+        it = cache_.erase(it);
+      } else {
+        if (entry.used && entry.error.empty() && entry.expires - now <= margin) {
+          names.push_back(it->first);
+        }
+        ++it;
+      }
+    }
+
+    for (const auto &name : names) {
+      if (stopping_) break;
+      auto it = cache_.find(name);
+      if (it == cache_.end() || it->second.resolving) continue;
+      it->second.resolving = true;
+      resolve(lock, name);
+    }
+  }
+}
+
+}
@@ -42,7 +42,7 @@ std::vector<IPAddress> Resolver::hostname(const char *name) const {
   hints.ai_family = AF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
 
-  if (auto err = getaddrinfo(name, nullptr, &hints, &result) != 0) {
+  if (auto err = getaddrinfo(name, nullptr, &hints, &result)) {
     throw std::invalid_argument(std::string("hostname resolve failed for ")
                                 + name + ": " + gai_strerror(err));
   }
@@ -0,0 +1,191 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "networking/caching_resolver.h"
+#include "networking/ip_address.h"
+
+////////////////////////////////////////
+// Third-party include files
+#include "gmock/gmock.h"
+
+////////////////////////////////////////
+// Standard include files
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mysql_harness::CachingResolver;
+using mysql_harness::IPAddress;
+using std::chrono::milliseconds;
+
+// resolver answering from a fixed address, counting its calls
+class FakeResolve {
+ public:
+  std::vector<IPAddress> operator()(const std::string &name) {
+    ++calls;
+    if (delay.count() > 0) {
+      std::this_thread::sleep_for(delay);
+    }
+    if (fail || name == "unknown.host") {
+      throw std::invalid_argument("hostname resolve failed for " + name);
+    }
+    return {IPAddress("192.168.1." + std::to_string(host))};
+  }
+
+  std::atomic<int> calls{0};
+  std::atomic<bool> fail{false};
+  milliseconds delay{0};
+  std::atomic<int> host{1};
+};
+
+static CachingResolver::ResolveFunction wrap(FakeResolve &fake) {
+  return [&fake](const std::string &name) { return fake(name); };
+}
+
+TEST(TestCachingResolver, CachesAddresses) {
+  FakeResolve fake;
+  CachingResolver resolver(milliseconds(60000), milliseconds(60000), wrap(fake));
+
+  EXPECT_THAT(resolver.hostname("db1.example"), ::testing::ElementsAre(IPAddress("192.168.1.1")));
+  EXPECT_THAT(resolver.hostname("db1.example"), ::testing::ElementsAre(IPAddress("192.168.1.1")));
+  EXPECT_EQ(1, fake.calls);
+  EXPECT_EQ(1u, resolver.size());
+
+  resolver.hostname("db2.example");
+  EXPECT_EQ(2, fake.calls);
+
+  resolver.clear();
+  EXPECT_EQ(0u, resolver.size());
+  resolver.hostname("db1.example");
+  EXPECT_EQ(3, fake.calls);
+}
+
+TEST(TestCachingResolver, CachesFailures) {
+  FakeResolve fake;
+  CachingResolver resolver(milliseconds(60000), milliseconds(60000), wrap(fake));
+
+  EXPECT_THROW(resolver.hostname("unknown.host"), std::invalid_argument);
+  EXPECT_THROW(resolver.hostname("unknown.host"), std::invalid_argument);
+  EXPECT_EQ(1, fake.calls);
+}
+
+TEST(TestCachingResolver, ExpiresEntries) {
+  FakeResolve fake;
+  CachingResolver resolver(milliseconds(50), milliseconds(50), wrap(fake));
+  resolver.stop();  // no refresh
+
+  resolver.hostname("db1.example");
+  EXPECT_THROW(resolver.hostname("unknown.host"), std::invalid_argument);
+  EXPECT_EQ(2, fake.calls);
+
+  std::this_thread::sleep_for(milliseconds(100));
+
+  resolver.hostname("db1.example");
+  EXPECT_THROW(resolver.hostname("unknown.host"), std::invalid_argument);
+  EXPECT_EQ(4, fake.calls);
+}
+
+TEST(TestCachingResolver, IPAddressesAreNotResolved) {
+  FakeResolve fake;
+  CachingResolver resolver(milliseconds(60000), milliseconds(60000), wrap(fake));
+
+  EXPECT_THAT(resolver.hostname("127.0.0.1"), ::testing::ElementsAre(IPAddress("127.0.0.1")));
+  EXPECT_THAT(resolver.hostname("::1"), ::testing::ElementsAre(IPAddress("::1")));
+  EXPECT_EQ(0, fake.calls);
+  EXPECT_EQ(0u, resolver.size());
+}
+
+TEST(TestCachingResolver, RefreshesNamesInUse) {
+  FakeResolve fake;
+  CachingResolver resolver(milliseconds(200), milliseconds(200), wrap(fake));
+
+  resolver.hostname("db1.example");
+  resolver.hostname("db2.example");
+  EXPECT_EQ(2, fake.calls);
+
+  // only db1.example is used again; the address of the host changes
+  fake.host = 2;
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_FALSE(resolver.hostname("db1.example").empty());
+    std::this_thread::sleep_for(milliseconds(50));
+  }
+
+  // db1.example was refreshed in the background and never resolved by a
+  // lookup, db2.example was dropped
+  EXPECT_THAT(resolver.hostname("db1.example"), ::testing::ElementsAre(IPAddress("192.168.1.2")));
+  EXPECT_EQ(1u, resolver.size());
+  EXPECT_GE(fake.calls, 4);
+  EXPECT_LE(fake.calls, 12);
+}
+
+TEST(TestCachingResolver, FailedRefreshKeepsAddresses) {
+  FakeResolve fake;
+  CachingResolver resolver(milliseconds(600), milliseconds(600), wrap(fake));
+
+  resolver.hostname("db1.example");
+  fake.fail = true;
+
+  // the refresh fails, the cached address is used until it expires
+  std::this_thread::sleep_for(milliseconds(200));
+  resolver.hostname("db1.example");
+  std::this_thread::sleep_for(milliseconds(300));
+  EXPECT_GE(fake.calls, 2);
+  EXPECT_THAT(resolver.hostname("db1.example"), ::testing::ElementsAre(IPAddress("192.168.1.1")));
+}
+
+TEST(TestCachingResolver, ConcurrentLookupsResolveOnce) {
+  FakeResolve fake;
+  fake.delay = milliseconds(100);
+  CachingResolver resolver(milliseconds(60000), milliseconds(60000), wrap(fake));
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&resolver] { resolver.hostname("db1.example"); });
+  }
+  for (auto &thr : threads) {
+    thr.join();
+  }
+  EXPECT_EQ(1, fake.calls);
+}
+
+TEST(TestCachingResolver, ResolvesLocalhost) {
+  using ::testing::Contains;
+  CachingResolver resolver;
+
+  // Some systems have both IPv4 and IPv6 for 'localhost'
+  IPAddress ip4("127.0.0.1");
+  IPAddress ip6("::1");
+  EXPECT_THAT(resolver.hostname("localhost"), ::testing::AnyOf(Contains(ip4), Contains(ip6)));
+  EXPECT_EQ(1u, resolver.size());
+}
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+  WSADATA wsaData;
+  int iResult;
+  iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+  if (iResult != 0) {
+    std::cout << "WSAStartup() failed\n";
+    return 1;
+  }
+#endif
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "published_ptr.h"
+
+////////////////////////////////////////
+// Third-party include files
+#include "gmock/gmock.h"
+
+////////////////////////////////////////
+// Standard include files
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using mysql_harness::PublishedPtr;
+
+// counts its live instances
+struct Counted {
+  explicit Counted(int v) : value(v) { ++alive; }
+  ~Counted() { --alive; }
+
+  const int value;
+  static std::atomic<int> alive;
+};
+
+std::atomic<int> Counted::alive{0};
+
+TEST(PublishedPtrTest, ReadersKeepWhatTheyLoaded) {
+  {
+    PublishedPtr<Counted> published(std::make_shared<Counted>(1));
+    std::shared_ptr<const Counted> first = published.load();
+
+    published.store(std::make_shared<Counted>(2));
+    EXPECT_EQ(1, first->value);
+    EXPECT_EQ(2, published.load()->value);
+    EXPECT_EQ(2, Counted::alive);
+
+    first.reset();
+    EXPECT_EQ(1, Counted::alive);
+  }
+  EXPECT_EQ(0, Counted::alive);
+}
+
+TEST(PublishedPtrTest, StoreIf) {
+  PublishedPtr<Counted> published;
+  EXPECT_EQ(nullptr, published.load());
+
+  auto newer = [](int value) {
+    return [value](const std::shared_ptr<const Counted> &current) {
+      return !current || current->value < value;
+    };
+  };
+  EXPECT_TRUE(published.store_if(std::make_shared<Counted>(2), newer(2)));
+  EXPECT_FALSE(published.store_if(std::make_shared<Counted>(1), newer(1)));
+  EXPECT_EQ(2, published.load()->value);
+  EXPECT_TRUE(published.store_if(std::make_shared<Counted>(3), newer(3)));
+  EXPECT_EQ(3, published.load()->value);
+}
+
+TEST(PublishedPtrTest, LoadWhileStoring) {
+  {
+    PublishedPtr<Counted> published(std::make_shared<Counted>(0));
+    std::atomic<bool> stop(false);
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+      readers.emplace_back([&published, &stop] {
+        int last = 0;
+        while (!stop) {
+          // a single writer stores increasing values
+          int value = published.load()->value;
+          EXPECT_GE(value, last);
+          last = value;
+        }
+      });
+    }
+    for (int i = 1; i <= 10000; ++i) {
+      published.store(std::make_shared<Counted>(i));
+    }
+    stop = true;
+    for (auto &reader : readers) {
+      reader.join();
+    }
+    EXPECT_EQ(10000, published.load()->value);
+    EXPECT_EQ(1, Counted::alive);
+  }
+  EXPECT_EQ(0, Counted::alive);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
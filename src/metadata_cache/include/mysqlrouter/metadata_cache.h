@@ -20,8 +20,11 @@
 
 #include <stdexcept>
 #include <exception>
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <map>
+#include <memory>
 #include <string>
 
 #include "mysqlrouter/utils.h"
@@ -49,6 +52,8 @@ extern const std::string kDefaultMetadataUser;
 extern const std::string kDefaultMetadataPassword;
 extern const unsigned int kDefaultMetadataTTL;
 extern const std::string kDefaultMetadataCluster;
+/** @brief Maximum number of replicasets whose status is queried at the same time */
+extern const unsigned int kMaxReplicasetRefreshThreads;
 
 enum class METADATA_API ReplicasetStatus {
   AvailableWritable,
@@ -119,6 +124,38 @@ public:
   bool single_primary_mode;
 };
 
+/** @class Topology
+ * Replicasets of the cluster as found by one refresh of the cache
+ *
+ * Topologies are never changed once published; a refresh which finds
+ * changes publishes a new one with a higher version. Holders of a
+ * TopologyPtr keep using the topology they got while the cache moves on.
+ */
+class METADATA_API Topology {
+public:
+  using ReplicaSetsByName = std::map<std::string, ManagedReplicaSet>;
+
+  /** @brief Constructor */
+  Topology(uint64_t version_, ReplicaSetsByName replicasets_) :
+  version(version_), replicasets(std::move(replicasets_)) { }
+
+  /** @brief Returns the replicaset of the given name, or nullptr */
+  const ManagedReplicaSet *get_replicaset(const std::string &replicaset_name) const noexcept {
+    auto it = replicasets.find(replicaset_name);
+    return it == replicasets.end() ? nullptr : &it->second;
+  }
+
+  /** @brief Number of the refresh which found this topology; 0 before the first one */
+  const uint64_t version;
+  /** @brief Replicasets keyed by name */
+  const ReplicaSetsByName replicasets;
+};
+
+using TopologyPtr = std::shared_ptr<const Topology>;
+
+/** @brief Called with the new topology whenever a refresh found changes */
+using TopologyListener = std::function<void(const TopologyPtr &topology)>;
+
 /** @class connection_error
  *
  * Class that represents all the exceptions thrown while trying to
@@ -145,15 +182,29 @@ public:
 /** @class LookupResult
  *
  * Class holding result after looking up data in the cache.
+ *
+ * Nothing is copied: the result refers to the members of the replicaset
+ * in the topology it holds.
  */
 class METADATA_API LookupResult {
 public:
-  /** @brief Constructor */
-  LookupResult(const std::vector<ManagedInstance> &instance_vector_) :
-  instance_vector(instance_vector_) { }
+  /** @brief Constructor
+   *
+   * @param topology_ topology the replicaset is looked up in
+   * @param replicaset_name name of the replicaset
+   */
+  LookupResult(TopologyPtr topology_, const std::string &replicaset_name);
+
+  /** @brief Returns the version of the topology the result comes from */
+  uint64_t version() const noexcept {
+    return topology->version;
+  }
 
-  /** @brief List of ManagedInstance objects */
-  const std::vector<metadata_cache::ManagedInstance> instance_vector;
+  /** @brief Topology the result comes from */
+  const TopologyPtr topology;
+
+  /** @brief List of ManagedInstance objects; empty for an unknown replicaset */
+  const std::vector<metadata_cache::ManagedInstance> &instance_vector;
 };
 
 /** @brief Initialize a MetadataCache object and start caching
@@ -195,6 +246,34 @@ void METADATA_API cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstr
  */
 LookupResult METADATA_API lookup_replicaset(const std::string &replicaset_name);
 
+/** @brief Returns the current topology of the cluster
+ *
+ * Cheap enough to be called for every connection: no data is copied.
+ *
+ * @return the topology found by the last refresh
+ */
+TopologyPtr METADATA_API get_topology();
+
+/** @brief Registers a function called whenever the topology changed
+ *
+ * Listeners are called from the refresh thread of the cache, right after
+ * a new topology was published and before failover waits are woken up.
+ * They should return quickly and must not add or remove listeners.
+ *
+ * @param listener function to call
+ * @return id to pass to remove_topology_listener()
+ */
+uint64_t METADATA_API add_topology_listener(TopologyListener listener);
+
+/** @brief Removes a listener added with add_topology_listener()
+ *
+ * Once this returns, the listener is not running and won't be called
+ * again.
+ *
+ * @param listener_id id returned by add_topology_listener()
+ */
+void METADATA_API remove_topology_listener(uint64_t listener_id);
+
 
 /** @brief Update the status of the instance
  *
@@ -211,7 +290,8 @@ void METADATA_API mark_instance_reachability(const std::string &instance_id,
 /** @brief Wait until there's a primary member in the replicaset
  *
  * To be called when the master of a single-master replicaset is down and
- * we want to wait until one becomes elected.
+ * we want to wait until one becomes elected. Returns as soon as a refresh
+ * found the new primary.
  *
  * @param timeout - amount of time to wait for a failover, in seconds
  * @return true if a primary member exists
@@ -35,6 +35,7 @@ const std::string kDefaultMetadataAddress{"127.0.0.1:" + mysqlrouter::to_string(
 const std::string kDefaultMetadataUser = "";
 const std::string kDefaultMetadataPassword = "";
 const std::string kDefaultMetadataCluster = ""; // blank cluster name means pick the 1st (and only) cluster
+const unsigned int kMaxReplicasetRefreshThreads = 8;
 
 /**
  * Initialize the metadata cache.
@@ -69,13 +70,44 @@ void cache_init(const std::vector<mysqlrouter::TCPAddress> &bootstrap_servers,
  */
 LookupResult lookup_replicaset(const std::string &replicaset_name) {
 
+  LookupResult result(get_topology(), replicaset_name);
+  if (!result.topology->get_replicaset(replicaset_name)) {
+    log_warning("Replicaset '%s' not available", replicaset_name.c_str());
+  }
+  return result;
+}
+
+TopologyPtr get_topology() {
+  if (g_metadata_cache == nullptr) {
+    throw std::runtime_error("Metadata Cache not initialized");
+  }
+
+  return g_metadata_cache->get_topology();
+}
+
+uint64_t add_topology_listener(TopologyListener listener) {
   if (g_metadata_cache == nullptr) {
     throw std::runtime_error("Metadata Cache not initialized");
   }
 
-  return LookupResult(g_metadata_cache->replicaset_lookup(replicaset_name));
+  return g_metadata_cache->add_topology_listener(std::move(listener));
 }
 
+void remove_topology_listener(uint64_t listener_id) {
+  if (g_metadata_cache == nullptr) {
+    throw std::runtime_error("Metadata Cache not initialized");
+  }
+
+  g_metadata_cache->remove_topology_listener(listener_id);
+}
+
+static const std::vector<ManagedInstance> kNoInstances;
+
+LookupResult::LookupResult(TopologyPtr topology_, const std::string &replicaset_name) :
+    topology(std::move(topology_)),
+    instance_vector(topology->get_replicaset(replicaset_name) ?
+                    topology->get_replicaset(replicaset_name)->members : kNoInstances) { }
+
 
 void mark_instance_reachability(const std::string &instance_id,
                                 InstanceStatus status) {
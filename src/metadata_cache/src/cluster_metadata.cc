@@ -19,6 +19,7 @@
 #include "dim.h"
 #include "group_replication_metadata.h"
 #include "logger.h"
+#include "networking/caching_resolver.h"
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/mysql_session.h"
 #include "mysqlrouter/uri.h"
@@ -28,6 +29,9 @@
 #include <cassert>
 #include <chrono>
 #include <cstdlib>
+#include <exception>
+#include <system_error>
+#include <thread>
 #include <vector>
 #include <sstream>
 #include <stdio.h>
@@ -92,9 +96,31 @@ ClusterMetadata::ClusterMetadata(const std::string &user,
  */
 ClusterMetadata::~ClusterMetadata() {}
 
+std::string ClusterMetadata::connect_host(const metadata_cache::ManagedInstance &mi) const {
+  if (mi.host == "localhost") {
+    return "127.0.0.1";
+  }
+  // the server certificate is checked against the hostname
+  if (ssl_mode_ == SSL_MODE_VERIFY_IDENTITY) {
+    return mi.host;
+  }
+
+  // use the cache shared with the routing plugin instead of letting the
+  // client library resolve the name on every connect
+  try {
+    auto addresses = mysql_harness::CachingResolver::instance().hostname(mi.host);
+    if (!addresses.empty()) {
+      return addresses.front().str();
+    }
+  } catch (const std::invalid_argument &) {
+    // the client library reports the error when connecting
+  }
+  return mi.host;
+}
+
 bool ClusterMetadata::do_connect(MySQLSession& connection, const metadata_cache::ManagedInstance &mi) {
 
-  std::string host = (mi.host == "localhost" ? "127.0.0.1" : mi.host);
+  std::string host = connect_host(mi);
   try {
     connection.set_ssl_options(ssl_mode_,
                                ssl_options_.tls_version,
@@ -148,37 +174,48 @@ bool ClusterMetadata::connect(const std::vector<metadata_cache::ManagedInstance>
   }
 }
 
-void ClusterMetadata::update_replicaset_status(const std::string &name,
-    metadata_cache::ManagedReplicaSet &replicaset) { // throws metadata_cache::metadata_error
+ClusterMetadata::ReplicasetRefreshStats ClusterMetadata::update_replicaset_status(const std::string &name,
+    metadata_cache::ManagedReplicaSet &replicaset,
+    std::chrono::steady_clock::time_point deadline) { // throws metadata_cache::metadata_error
   log_debug("Updating replicaset status from GR for '%s'", name.c_str());
+  auto started = std::chrono::steady_clock::now();
+  ReplicasetRefreshStats stats;
   // iterate over all cadidate nodes until we find the node that is part of quorum
   bool found_quorum = false;
 
+  // the metadata connection is lent to one replicaset at a time
+  bool borrowed_metadata_connection = false;
+  struct ReturnMetadataConnection {
+    std::atomic<bool> &busy;
+    bool &borrowed;
+    ~ReturnMetadataConnection() { if (borrowed) busy = false; }
+  } return_metadata_connection{metadata_connection_busy_, borrowed_metadata_connection};
+
   std::shared_ptr<MySQLSession> gr_member_connection;
   for (const metadata_cache::ManagedInstance& mi : replicaset.members) {
-    std::string mi_addr = (mi.host == "localhost" ? "127.0.0.1" : mi.host) + ":" + std::to_string(mi.port);
+    std::string mi_addr = connect_host(mi) + ":" + std::to_string(mi.port);
+
+    if (stats.members_tried > 0 && std::chrono::steady_clock::now() >= deadline) {
+      log_warning("Refresh deadline passed, not asking further members of replicaset '%s'", name.c_str());
+      stats.deadline_exceeded = true;
+      break;
+    }
+    ++stats.members_tried;
 
     // this function could test these in an if() instead of assert(),
     // but so far the logic that calls this function ensures this
     assert(metadata_connection_->is_connected());
 
     // connect to node
-    if (mi_addr == metadata_connection_->get_address()) { // optimisation: if node is the same as metadata server,
+    bool pooled = false;
+    if (mi_addr == metadata_connection_->get_address() &&  // optimisation: if node is the same as metadata server,
+        (borrowed_metadata_connection || !metadata_connection_busy_.exchange(true))) {
+      borrowed_metadata_connection = true;
       gr_member_connection = metadata_connection_;        //               share the established connection
-    } else {
-      try {
-        gr_member_connection = mysql_harness::DIM::instance().new_MySQLSession();
-      } catch (const std::logic_error& e) {
-        // defensive programming, shouldn't really happen. If it does, there's nothing we can do really, we give up
-        log_error("While updating metadata, could not initialise MySQL connetion structure");
-        throw metadata_cache::metadata_error(e.what());
-      }
-
-      if (!do_connect(*gr_member_connection, mi)) {
-        log_error("While updating metadata, could not establish a connection to replicaset '%s' through %s",
-                  name.c_str(), mi_addr.c_str());
-        continue; // server down, next!
-      }
+    } else if ((gr_member_connection = take_gr_member_session(mi_addr))) {
+      pooled = true;                                      // kept from an earlier refresh
+    } else if (!(gr_member_connection = connect_gr_member(name, mi, mi_addr))) {
+      continue; // server down, next!
     }
 
     assert(gr_member_connection->is_connected());
@@ -187,9 +224,27 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
       bool single_primary_mode = true;
 
       // this node's perspective: give status of all nodes you see
-      std::map<std::string, GroupReplicationMember> member_status =
-          fetch_group_replication_members(*gr_member_connection,
-                                          single_primary_mode); // throws metadata_cache::metadata_error
+      std::map<std::string, GroupReplicationMember> member_status;
+      try {
+        member_status = fetch_group_replication_members(*gr_member_connection,
+                                                        single_primary_mode); // throws metadata_cache::metadata_error
+      } catch (const metadata_cache::metadata_error& e) {
+        if (!pooled) {
+          throw;
+        }
+        // the server may have closed the session since the ping
+        log_debug("Session to %s of replicaset '%s' failed, reconnecting: %s",
+                  mi_addr.c_str(), name.c_str(), e.what());
+        if (!(gr_member_connection = connect_gr_member(name, mi, mi_addr))) {
+          continue; // server down, next!
+        }
+        member_status = fetch_group_replication_members(*gr_member_connection,
+                                                        single_primary_mode); // throws metadata_cache::metadata_error
+      }
+      // the session is healthy, keep it for the next refresh
+      if (gr_member_connection != metadata_connection_) {
+        return_gr_member_session(mi_addr, gr_member_connection);
+      }
       log_debug("Replicaset '%s' has %i members in metadata, %i in status table",
                 name.c_str(), replicaset.members.size(), member_status.size());
 
@@ -223,7 +278,11 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
     }
 
   } // for (const metadata_cache::ManagedInstance& mi : instances)
-  log_debug("End updating replicaset for '%s'", name.c_str());
+  stats.found_quorum = found_quorum;
+  stats.duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started);
+  log_debug("End updating replicaset for '%s' after %lld ms, %u member(s) tried", name.c_str(),
+            static_cast<long long>(stats.duration.count()), static_cast<unsigned>(stats.members_tried));
 
   if (!found_quorum) {
     std::string msg("Unable to fetch live group_replication member data from any server in replicaset '");
@@ -234,6 +293,52 @@ void ClusterMetadata::update_replicaset_status(const std::string &name,
     // route anything. Routing plugin is dumb, it has no idea what a quorum is, etc.
     replicaset.members.clear();
   }
+
+  return stats;
+}
+
+std::shared_ptr<MySQLSession> ClusterMetadata::connect_gr_member(const std::string &name,
+    const metadata_cache::ManagedInstance &mi, const std::string &mi_addr) { // throws metadata_cache::metadata_error
+  std::shared_ptr<MySQLSession> connection;
+  try {
+    connection = mysql_harness::DIM::instance().new_MySQLSession();
+  } catch (const std::logic_error& e) {
+    // defensive programming, shouldn't really happen. If it does, there's nothing we can do really, we give up
+    log_error("While updating metadata, could not initialise MySQL connetion structure");
+    throw metadata_cache::metadata_error(e.what());
+  }
+
+  if (!do_connect(*connection, mi)) {
+    log_error("While updating metadata, could not establish a connection to replicaset '%s' through %s",
+              name.c_str(), mi_addr.c_str());
+    return nullptr;
+  }
+  return connection;
+}
+
+std::shared_ptr<MySQLSession> ClusterMetadata::take_gr_member_session(const std::string &mi_addr) {
+  std::shared_ptr<MySQLSession> session;
+  {
+    std::lock_guard<std::mutex> lock(gr_member_sessions_mutex_);
+    auto it = gr_member_sessions_.find(mi_addr);
+    if (it == gr_member_sessions_.end()) {
+      return nullptr;
+    }
+    session = std::move(it->second.session);
+    gr_member_sessions_.erase(it);
+  }
+  // a round trip, but much cheaper than a failed query and a new session
+  if (!session->ping()) {
+    log_debug("Session to %s was closed while idle, reconnecting", mi_addr.c_str());
+    return nullptr;
+  }
+  return session;
+}
+
+void ClusterMetadata::return_gr_member_session(const std::string &mi_addr,
+                                               std::shared_ptr<MySQLSession> session) {
+  std::lock_guard<std::mutex> lock(gr_member_sessions_mutex_);
+  gr_member_sessions_[mi_addr] = PooledSession{std::move(session), refresh_count_};
 }
 
 metadata_cache::ReplicasetStatus ClusterMetadata::check_replicaset_status(
@@ -340,13 +445,121 @@ ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances(
 
   // now connect to each replicaset and query it for the list and status of its members.
   // (more precisely, foreach replicaset: search and connect to a member which is part of quorum to retrieve this data)
+  // Replicasets are queried in parallel, so that slow members of one do not
+  // delay the others; a refresh should be done before the next one is due.
+  {
+    std::lock_guard<std::mutex> lock(gr_member_sessions_mutex_);
+    ++refresh_count_;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  auto deadline = ttl_ == 0
+      ? std::chrono::steady_clock::time_point::max()
+      : started + std::chrono::seconds(std::max<int>(static_cast<int>(ttl_), connection_timeout_));
+
+  std::vector<ReplicaSetsByName::value_type *> pending;
   for (auto &&rs : replicasets) {
-    update_replicaset_status(rs.first, rs.second);  // throws metadata_cache::metadata_error
+    pending.push_back(&rs);
+  }
+  std::vector<ReplicasetRefreshStats> stats(pending.size());
+  std::atomic<size_t> next{0};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  auto work = [&] {
+    for (size_t i; (i = next++) < pending.size();) {
+      try {
+        stats[i] = update_replicaset_status(pending[i]->first, pending[i]->second, deadline);  // throws metadata_cache::metadata_error
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  // this thread is one of the workers; the others need the client library's
+  // per-thread state set up and freed again around their use of it
+  auto work_in_thread = [&work] {
+    if (mysql_thread_init()) {
+      // the other workers take over
+      log_warning("Could not initialize thread for refreshing replicasets");
+      return;
+    }
+    work();
+    mysql_thread_end();
+  };
+  size_t num_workers = std::min<size_t>(metadata_cache::kMaxReplicasetRefreshThreads, pending.size());
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < num_workers; ++i) {
+    try {
+      workers.emplace_back(work_in_thread);
+    } catch (const std::system_error &e) {
+      log_warning("Could not start thread for refreshing replicasets: %s", e.what());
+      break;
+    }
+  }
+  work();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  {
+    // members not asked this time are not likely to be asked next time
+    std::lock_guard<std::mutex> lock(gr_member_sessions_mutex_);
+    for (auto it = gr_member_sessions_.begin(); it != gr_member_sessions_.end();) {
+      if (it->second.refresh < refresh_count_) {
+        it = gr_member_sessions_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(refresh_stats_mutex_);
+    refresh_stats_.clear();
+    for (size_t i = 0; i < pending.size(); ++i) {
+      refresh_stats_[pending[i]->first] = stats[i];
+    }
+  }
+
+  // name the replicasets holding up the refresh, the total alone does not
+  // tell which members to look at
+  for (size_t i = 0; i < pending.size(); ++i) {
+    const ReplicasetRefreshStats &rs_stats = stats[i];
+    if (rs_stats.deadline_exceeded) {
+      log_warning("Refreshing the status of replicaset '%s' was given up after %lld ms, %u member(s) tried",
+                  pending[i]->first.c_str(), static_cast<long long>(rs_stats.duration.count()),
+                  static_cast<unsigned>(rs_stats.members_tried));
+    } else if (ttl_ > 0 && rs_stats.duration > std::chrono::seconds(ttl_)) {
+      log_warning("Refreshing the status of replicaset '%s' took %lld ms, longer than the TTL of %u s; "
+                  "%u member(s) tried, quorum %s",
+                  pending[i]->first.c_str(), static_cast<long long>(rs_stats.duration.count()), ttl_,
+                  static_cast<unsigned>(rs_stats.members_tried), rs_stats.found_quorum ? "found" : "not found");
+    }
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  auto duration = std::chrono::steady_clock::now() - started;
+  if (ttl_ > 0 && duration > std::chrono::seconds(ttl_)) {
+    log_warning("Refreshing the status of %u replicaset(s) took %lld ms, longer than the TTL of %u s",
+                static_cast<unsigned>(pending.size()),
+                static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()), ttl_);
   }
 
   return replicasets;
 }
 
+std::map<std::string, ClusterMetadata::ReplicasetRefreshStats> ClusterMetadata::get_refresh_stats() const {
+  std::lock_guard<std::mutex> lock(refresh_stats_mutex_);
+  return refresh_stats_;
+}
+
 // throws metadata_cache::metadata_error
 ClusterMetadata::ReplicaSetsByName ClusterMetadata::fetch_instances_from_metadata_server(
     const std::string &cluster_name) {
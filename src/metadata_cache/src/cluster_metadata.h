@@ -23,9 +23,12 @@
 #include "mysqlrouter/mysql_session.h"
 #include "metadata.h"
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <string>
 #include <string.h>
 
@@ -41,6 +44,18 @@ namespace mysqlrouter { class MySQLSession; }
  */
 class METADATA_API ClusterMetadata : public MetaData {
  public:
+  /** @brief How the status of a replicaset was fetched in the last refresh */
+  struct ReplicasetRefreshStats {
+    /** @brief Time spent on the replicaset */
+    std::chrono::milliseconds duration{0};
+    /** @brief Number of members asked for the status */
+    size_t members_tried = 0;
+    /** @brief Whether a member being part of the quorum answered */
+    bool found_quorum = false;
+    /** @brief Whether members were left untried as the refresh took too long */
+    bool deadline_exceeded = false;
+  };
+
   /** @brief Constructor
    *
    * @param user The user name used to authenticate to the metadata server.
@@ -76,6 +91,13 @@ class METADATA_API ClusterMetadata : public MetaData {
    */
   ReplicaSetsByName fetch_instances(const std::string &cluster_name) override; // throws metadata_cache::metadata_error
 
+  /** @brief Returns the per-replicaset metrics of the last fetch_instances()
+   *
+   * fetch_instances() logs a warning for each replicaset which took longer
+   * than the TTL or was given up.
+   */
+  std::map<std::string, ReplicasetRefreshStats> get_refresh_stats() const;
+
 #if 0 // not used so far
   /** @brief Returns the refresh interval provided by the metadata server.
    *
@@ -113,6 +135,32 @@ class METADATA_API ClusterMetadata : public MetaData {
    */
   bool do_connect(mysqlrouter::MySQLSession& connection, const metadata_cache::ManagedInstance &mi);
 
+  /** Opens a new session to a member of a replicaset
+   *
+   * @return the session, or nullptr if the member can not be connected to
+   */
+  std::shared_ptr<mysqlrouter::MySQLSession> connect_gr_member(const std::string &name,
+      const metadata_cache::ManagedInstance &mi, const std::string &mi_addr); // throws metadata_cache::metadata_error
+
+  /** Takes the session kept to a member from an earlier refresh, if any
+   *
+   * The caller has the session to itself until it returns it. The session
+   * is pinged first: one which the server closed while it was idle
+   * (restart, wait_timeout, KILL) is dropped and nullptr returned.
+   */
+  std::shared_ptr<mysqlrouter::MySQLSession> take_gr_member_session(const std::string &mi_addr);
+
+  /** Keeps a session to a member for the next refresh */
+  void return_gr_member_session(const std::string &mi_addr,
+                                std::shared_ptr<mysqlrouter::MySQLSession> session);
+
+  /** Returns the host to connect to for the given instance
+   *
+   * The hostname is resolved through the shared resolver cache, unless the
+   * server certificate has to be verified against it.
+   */
+  std::string connect_host(const metadata_cache::ManagedInstance &mi) const;
+
   /** @brief Queries the metadata server for the list of instances and
    * replicasets that belong to the desired cluster.
    */
@@ -127,9 +175,20 @@ class METADATA_API ClusterMetadata : public MetaData {
    * - get other metadata about the replicaset
    *
    * The information is pulled from GR maintained performance_schema tables.
+   *
+   * May be called for several replicasets at the same time; only one of
+   * them uses the connection to the metadata server. Sessions to other
+   * members are kept for the next call and only opened again after an error.
+   *
+   * @param name name of the replicaset
+   * @param replicaset replicaset to update
+   * @param deadline no further members are tried after it passed
+   * @return metrics of the update
    */
-  void update_replicaset_status(const std::string &name,
-      metadata_cache::ManagedReplicaSet &replicaset); // throws metadata_cache::metadata_error
+  ReplicasetRefreshStats update_replicaset_status(const std::string &name,
+      metadata_cache::ManagedReplicaSet &replicaset,
+      std::chrono::steady_clock::time_point deadline =
+          std::chrono::steady_clock::time_point::max()); // throws metadata_cache::metadata_error
 
   /** @brief Hard to summarise, please read the full description
    *
@@ -173,6 +232,21 @@ class METADATA_API ClusterMetadata : public MetaData {
   // connection to metadata server (it may also be shared with GR status queries for optimisation purposes)
   std::shared_ptr<mysqlrouter::MySQLSession> metadata_connection_;
 
+  // set while a GR status query uses metadata_connection_
+  std::atomic<bool> metadata_connection_busy_{false};
+
+  // idle sessions to GR members, by address; dropped when a refresh did not use them
+  struct PooledSession {
+    std::shared_ptr<mysqlrouter::MySQLSession> session;
+    uint64_t refresh;
+  };
+  std::mutex gr_member_sessions_mutex_;
+  std::map<std::string, PooledSession> gr_member_sessions_;
+  uint64_t refresh_count_ = 0;
+
+  mutable std::mutex refresh_stats_mutex_;
+  std::map<std::string, ReplicasetRefreshStats> refresh_stats_;
+
 #if 0 // not used so far
   // How many times we tried to reconnected (for logging purposes)
   size_t reconnect_tries_;
@@ -192,6 +266,7 @@ class METADATA_API ClusterMetadata : public MetaData {
   FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_Status_FailQueryOnNode1);
   FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_Status_FailQueryOnAllNodes);
   FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_SimpleSunnyDayScenario);
+  FRIEND_TEST(MetadataTest, UpdateReplicasetStatus_DeadlineExceeded);
 #endif
 };
 
@@ -37,7 +37,8 @@ MetadataCache::MetadataCache(
   std::shared_ptr<MetaData> cluster_metadata, // this could be changed to UniquePtr
   unsigned int ttl,
   const mysqlrouter::SSLOptions &ssl_options,
-  const std::string &cluster) {
+  const std::string &cluster) :
+    topology_(std::make_shared<metadata_cache::Topology>(0, metadata_cache::Topology::ReplicaSetsByName())) {
   std::string host;
   for (auto s : bootstrap_servers) {
     metadata_cache::ManagedInstance bootstrap_server_instance;
@@ -48,6 +49,7 @@ MetadataCache::MetadataCache(
   }
   ttl_ = ttl;
   cluster_name_ = cluster;
+  next_listener_id_ = 1;
   terminate_ = false;
   meta_data_ = cluster_metadata;
   ssl_options_ = ssl_options;
@@ -69,21 +71,24 @@ void MetadataCache::start() {
   auto refresh_loop = [this] {
     mysql_harness::rename_thread("MDC Refresh");
 
-    while (!terminate_) {
+    while (true) {
       refresh();
 
       // wait for up to TTL until next refresh, unless some replicaset
-      // loses the primary server.. in that case, we refresh every 1s
-      // until we detect a new one was elected
-      unsigned int seconds_waited = 0;
-      while (seconds_waited < ttl_) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        seconds_waited++;
-        {
-          std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
-          if (!lost_primary_replicasets_.empty())
-            break;
-        }
+      // loses the primary server.. in that case, we refresh right away and
+      // then every 1s until we detect a new one was elected
+      std::unique_lock<std::mutex> lock(lost_primary_replicasets_mutex_);
+      if (lost_primary_replicasets_.empty()) {
+        lost_primary_replicasets_cond_.wait_for(lock, std::chrono::seconds(ttl_), [this] {
+          return terminate_ || !lost_primary_replicasets_.empty();
+        });
+      } else {
+        lost_primary_replicasets_cond_.wait_for(lock, std::chrono::seconds(1), [this] {
+          return terminate_;
+        });
+      }
+      if (terminate_) {
+        break;
       }
     }
   };
@@ -94,7 +99,11 @@ void MetadataCache::start() {
  * Stop the refresh thread.
  */
 void MetadataCache::stop() {
-  terminate_ = true;
+  {
+    std::lock_guard<std::mutex> lock(lost_primary_replicasets_mutex_);
+    terminate_ = true;
+  }
+  lost_primary_replicasets_cond_.notify_all();
   if (refresh_thread_.joinable()) {
     refresh_thread_.join();
   }
@@ -107,14 +116,21 @@ void MetadataCache::stop() {
  */
 std::vector<metadata_cache::ManagedInstance> MetadataCache::replicaset_lookup(
   const std::string &replicaset_name) {
-  std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-  auto replicaset = replicaset_data_.find(replicaset_name);
+  auto topology = get_topology();
+  auto replicaset = topology->get_replicaset(replicaset_name);
 
-  if (replicaset == replicaset_data_.end()) {
+  if (!replicaset) {
     log_warning("Replicaset '%s' not available", replicaset_name.c_str());
     return {};
   }
-  return replicaset_data_[replicaset_name].members;
+  return replicaset->members;
+}
+
+void MetadataCache::publish(metadata_cache::Topology::ReplicaSetsByName replicasets) {
+  // cache_refreshing_mutex_ held
+  auto topology = std::make_shared<metadata_cache::Topology>(get_topology()->version + 1,
+                                                             std::move(replicasets));
+  topology_.store(std::move(topology));
 }
 
 bool metadata_cache::ManagedInstance::operator==(const ManagedInstance& other) const {
@@ -130,7 +146,7 @@ bool metadata_cache::ManagedInstance::operator==(const ManagedInstance& other) c
          xport == other.xport;
 }
 
-inline bool compare_instance_lists(const MetaData::ReplicaSetsByName &map_a,
+inline bool compare_instance_lists(const metadata_cache::Topology::ReplicaSetsByName &map_a,
                                    const MetaData::ReplicaSetsByName &map_b) {
   if (map_a.size() != map_b.size())
     return false;
@@ -173,12 +189,14 @@ void MetadataCache::refresh() {
       bool clearing;
       {
         std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-        clearing = !replicaset_data_.empty();
+        clearing = !get_topology()->replicasets.empty();
         if (clearing)
-          replicaset_data_.clear();
+          publish(metadata_cache::Topology::ReplicaSetsByName());
       }
-      if (clearing)
+      if (clearing) {
         log_info("... cleared current routing table as a precaution");
+        notify_listeners();
+      }
       return;
     }
   }
@@ -190,25 +208,26 @@ void MetadataCache::refresh() {
     bool changed = false;
 
     {
-      // Ensure that the refresh does not result in an inconsistency during the
-      // lookup.
+      // lookups keep using the previous topology until the new one is
+      // published
       std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-      if (!compare_instance_lists(replicaset_data_, replicaset_data_temp)) {
-        replicaset_data_ = replicaset_data_temp;
+      if (!compare_instance_lists(get_topology()->replicasets, replicaset_data_temp)) {
+        publish(std::move(replicaset_data_temp));
         changed = true;
       }
     }
 
     if (changed) {
-      log_info("Changes detected in cluster '%s' after metadata refresh",
-          cluster_name_.c_str());
+      auto topology = get_topology();
+      log_info("Changes detected in cluster '%s' after metadata refresh (version %llu)",
+          cluster_name_.c_str(), static_cast<unsigned long long>(topology->version));
       // dump some informational/debugging information about the replicasets
-      if (replicaset_data_.empty())
+      if (topology->replicasets.empty())
         log_error("Metadata for cluster '%s' is empty!", cluster_name_.c_str());
       else {
         log_info("Metadata for cluster '%s' has %i replicasets:",
-          cluster_name_.c_str(), (int)replicaset_data_.size());
-        for (auto &rs : replicaset_data_) {
+          cluster_name_.c_str(), (int)topology->replicasets.size());
+        for (auto &rs : topology->replicasets) {
           log_info("'%s' (%i members, %s)", rs.first.c_str(),
                     (int)rs.second.members.size(),
                     rs.second.single_primary_mode ? "single-master" : "multi-master");
@@ -232,6 +251,11 @@ void MetadataCache::refresh() {
           }
         }
       }
+
+      // destinations pick up the new topology before clients waiting for
+      // a failover retry
+      notify_listeners();
+      lost_primary_replicasets_cond_.notify_all();
     }
 
     /* Not sure about this, the metadata server could be stored elsewhere
@@ -256,11 +280,11 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
   // If the status is that the primary instance is physically unreachable,
   // we temporarily increase the refresh rate to 1/s until the replicaset
   // is back to having a primary instance.
-  std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
+  auto topology = get_topology();
   // the replicaset that the given instance belongs to
-  metadata_cache::ManagedInstance *instance = nullptr;
-  metadata_cache::ManagedReplicaSet *replicaset = nullptr;
-  for (auto &rs : replicaset_data_) {
+  const metadata_cache::ManagedInstance *instance = nullptr;
+  const metadata_cache::ManagedReplicaSet *replicaset = nullptr;
+  for (auto &rs : topology->replicasets) {
     for (auto &inst : rs.second.members) {
       if (inst.mysql_server_uuid == instance_id) {
         instance = &inst;
@@ -275,7 +299,7 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
   // We only care about loss of primary for the purpose of triggering
   // faster refreshes if we're in single primary mode
   if (replicaset && replicaset->single_primary_mode) {
-    std::lock_guard<std::mutex> lplock(lost_primary_replicasets_mutex_);
+    std::unique_lock<std::mutex> lplock(lost_primary_replicasets_mutex_);
     switch (status) {
       case metadata_cache::InstanceStatus::Reachable:
         break;
@@ -294,6 +318,9 @@ void MetadataCache::mark_instance_reachability(const std::string &instance_id,
       case metadata_cache::InstanceStatus::Unusable:
         break;
     }
+    lplock.unlock();
+    // the refresh thread fetches the new primary right away
+    lost_primary_replicasets_cond_.notify_all();
   }
 }
 
@@ -301,15 +328,32 @@ bool MetadataCache::wait_primary_failover(const std::string &replicaset_name,
                                           int timeout) {
   log_debug("Waiting for failover to happen in '%s' for %is",
             replicaset_name.c_str(), timeout);
-  time_t stime = std::time(NULL);
-  while (std::time(NULL) - stime <= timeout) {
-    {
-      std::lock_guard<std::mutex> lock(cache_refreshing_mutex_);
-      if (lost_primary_replicasets_.find(replicaset_name) == lost_primary_replicasets_.end()) {
-        return true;
-      }
+  std::unique_lock<std::mutex> lock(lost_primary_replicasets_mutex_);
+  return lost_primary_replicasets_cond_.wait_for(lock, std::chrono::seconds(timeout), [this, &replicaset_name] {
+    return lost_primary_replicasets_.find(replicaset_name) == lost_primary_replicasets_.end();
+  });
+}
+
+uint64_t MetadataCache::add_topology_listener(metadata_cache::TopologyListener listener) {
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  uint64_t listener_id = next_listener_id_++;
+  listeners_.emplace(listener_id, std::move(listener));
+  return listener_id;
+}
+
+void MetadataCache::remove_topology_listener(uint64_t listener_id) {
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  listeners_.erase(listener_id);
+}
+
+void MetadataCache::notify_listeners() {
+  auto topology = get_topology();
+  std::lock_guard<std::mutex> lock(listeners_mutex_);
+  for (auto &it : listeners_) {
+    try {
+      it.second(topology);
+    } catch (const std::exception &exc) {
+      log_error("Topology listener failed: %s", exc.what());
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
   }
-  return false;
 }
@@ -23,7 +23,9 @@
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -31,6 +33,7 @@
 #include <set>
 
 #include "logger.h"
+#include "published_ptr.h"
 
 class ClusterMetadata;
 
@@ -74,6 +77,24 @@ public:
   std::vector<metadata_cache::ManagedInstance> replicaset_lookup(
     const std::string &replicaset_name);
 
+  /** @brief Returns the topology found by the last refresh
+   *
+   * @return topology which is never changed; a refresh finding changes
+   *         publishes a new one
+   */
+  metadata_cache::TopologyPtr get_topology() const noexcept {
+    return topology_.load();
+  }
+
+  /** @brief Registers a function called whenever a refresh found changes
+   *
+   * @return id to pass to remove_topology_listener()
+   */
+  uint64_t add_topology_listener(metadata_cache::TopologyListener listener);
+
+  /** @brief Removes a listener; waits for it if it is running */
+  void remove_topology_listener(uint64_t listener_id);
+
   /** @brief Update the status of the instance
    *
    * Called when an instance from a replicaset cannot be reached for one reason or
@@ -98,15 +119,22 @@ public:
   bool wait_primary_failover(const std::string &replicaset_name, int timeout);
 private:
 
+  /** @brief Calls the listeners with the current topology */
+  void notify_listeners();
+
   /** @brief Refreshes the cache
    *
    * Refreshes the cache.
    */
   void refresh();
 
-  // Stores the list replicasets and their server instances.
-  // Keyed by replicaset name
-  std::map<std::string, metadata_cache::ManagedReplicaSet> replicaset_data_;
+  /** @brief Publishes the replicasets found by a refresh as the next version */
+  void publish(metadata_cache::Topology::ReplicaSetsByName replicasets);
+
+  // Stores the list replicasets and their server instances, keyed by
+  // replicaset name. Replaced as a whole and read without locking, use
+  // get_topology().
+  mysql_harness::PublishedPtr<metadata_cache::Topology> topology_;
 
   // The name of the cluster in the topology.
   std::string cluster_name_;
@@ -129,8 +157,8 @@ private:
   // Handle to the thread that refreshes the information in the metadata cache.
   std::thread refresh_thread_;
 
-  // This mutex is used to ensure that a lookup of the metadata is consistent
-  // with the changes in the metadata due to a cache refresh.
+  // This mutex serializes the publishing of topologies; lookups don't
+  // need it.
   std::mutex cache_refreshing_mutex_;
 
   #if 0 // not used so far
@@ -144,7 +172,18 @@ private:
 
   std::mutex lost_primary_replicasets_mutex_;
 
-  // Flag used to terminate the refresh thread.
+  // Signalled when a replicaset lost or got back its primary and when the
+  // cache is stopped; lost_primary_replicasets_mutex_ is used with it.
+  std::condition_variable lost_primary_replicasets_cond_;
+
+  // Functions called when the topology changed, keyed by id. The mutex is
+  // held while they are called.
+  std::map<uint64_t, metadata_cache::TopologyListener> listeners_;
+  uint64_t next_listener_id_;
+  std::mutex listeners_mutex_;
+
+  // Flag used to terminate the refresh thread; set holding
+  // lost_primary_replicasets_mutex_.
   bool terminate_;
 
 #ifdef FRIEND_TEST
@@ -152,6 +191,9 @@ private:
   FRIEND_TEST(FailoverTest, primary_failover);
   FRIEND_TEST(MetadataCacheTest2, basic_test);
   FRIEND_TEST(MetadataCacheTest2, metadata_server_connection_failures);
+  FRIEND_TEST(MetadataCacheTest2, topology_versions);
+  FRIEND_TEST(MetadataCacheTest2, topology_listeners);
+  FRIEND_TEST(FailoverTest, failover_wakes_up_waiters);
 #endif
 };
 
@@ -29,6 +29,9 @@
 
 #include "mysqlrouter/datatypes.h"
 
+#include <chrono>
+#include <thread>
+
 using namespace metadata_cache;
 
 class FailoverTest : public ::testing::Test {
@@ -243,3 +246,31 @@ TEST_F(FailoverTest, primary_failover) {
   EXPECT_EQ("uuid-server3", instances[2].mysql_server_uuid);
   EXPECT_EQ(ServerMode::ReadOnly, instances[2].mode);
 }
+
+
+TEST_F(FailoverTest, failover_wakes_up_waiters) {
+  expect_metadata_1();
+  expect_group_members_1();
+  init_cache();
+
+  cache->mark_instance_reachability("uuid-server1",
+                                    metadata_cache::InstanceStatus::Unreachable);
+
+  // GR picks a new primary while we wait for it
+  std::thread refresher([this] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    expect_metadata_1();
+    expect_group_members_1_primary_fail(nullptr, "uuid-server2");
+    cache->refresh();
+  });
+
+  // returns with the refresh, not after polling for a second
+  auto started = std::chrono::steady_clock::now();
+  EXPECT_TRUE(cache->wait_primary_failover("default", 5));
+  EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(900));
+  refresher.join();
+
+  auto instances = cache->replicaset_lookup("default");
+  ASSERT_EQ(3U, instances.size());
+  EXPECT_EQ(ServerMode::ReadWrite, instances[1].mode);
+}
@@ -27,6 +27,8 @@
 #include <memory>
 #include <map>
 #include <cmath>
+#include <chrono>
+#include <future>
 #include <algorithm>
 #include <set>
 
@@ -138,6 +140,15 @@ class MockMySQLSession: public MySQLSession {
       connect_fail(host, port); // throws Error
   }
 
+  // emulate a server which keeps the session open until told otherwise
+  bool ping() noexcept override {
+    return connected_ && !closed_by_server_;
+  }
+
+  void close_by_server() {
+    closed_by_server_ = true;
+  }
+
   void set_good_conns(std::set<std::string>&& conns) {
     good_conns_ = std::move(conns);
   }
@@ -179,6 +190,7 @@ class MockMySQLSession: public MySQLSession {
   }
 
   int connect_cnt_ = 0;
+  bool closed_by_server_ = false;
   std::set<std::string> good_conns_;
 };
 
@@ -1079,6 +1091,29 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_PrimaryMember_FailQueryOnAllNodes) {
   EXPECT_EQ(3, session_factory.create_cnt());          // +2 from new connections to localhost:3320 and :3330
 }
 
+TEST_F(MetadataTest, UpdateReplicasetStatus_DeadlineExceeded) {
+
+  connect_to_first_metadata_server();
+
+  // TEST SCENARIO:
+  //   iteration 1 (instance-1): query_primary_member FAILS
+  //   the refresh deadline passed already: instance-2 and instance-3 are not tried
+  unsigned session = 0;
+  EXPECT_CALL(session_factory.get(session), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_fail(session)));
+
+  ManagedReplicaSet replicaset = typical_replicaset;
+  ClusterMetadata::ReplicasetRefreshStats stats = metadata.update_replicaset_status(
+      "replicaset-1", replicaset, std::chrono::steady_clock::now());
+  EXPECT_TRUE(replicaset.members.empty());
+
+  EXPECT_EQ(1, session_factory.create_cnt());          // no new connections
+  EXPECT_EQ(1u, stats.members_tried);
+  EXPECT_FALSE(stats.found_quorum);
+  EXPECT_TRUE(stats.deadline_exceeded);
+}
+
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1235,8 +1270,6 @@ TEST_F(MetadataTest, UpdateReplicasetStatus_SimpleSunnyDayScenario) {
 // (this is the highest-level function, it calls everything tested above
 // except connect() (which is a separate step))
 //
-// TODO add tests for multiple replicasets here, when we begin supporting them
-//
 ////////////////////////////////////////////////////////////////////////////////
 
 TEST_F(MetadataTest, FetchInstances_1Replicaset_ok) {
@@ -1267,6 +1300,12 @@ TEST_F(MetadataTest, FetchInstances_1Replicaset_ok) {
   EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-1", "", ServerMode::ReadWrite, 0, 0, "", "localhost", 3310, 33100}, rs.at("replicaset-1").members.at(0)));
   EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-2", "", ServerMode::ReadOnly, 0, 0, "", "localhost", 3320, 33200}, rs.at("replicaset-1").members.at(1)));
   EXPECT_TRUE(cmp_mi_FI(ManagedInstance{"replicaset-1", "instance-3", "", ServerMode::ReadOnly, 0, 0, "", "localhost", 3330, 33300}, rs.at("replicaset-1").members.at(2)));
+
+  auto stats = metadata.get_refresh_stats();
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(1u, stats.at("replicaset-1").members_tried);
+  EXPECT_TRUE(stats.at("replicaset-1").found_quorum);
+  EXPECT_FALSE(stats.at("replicaset-1").deadline_exceeded);
 }
 
 TEST_F(MetadataTest, FetchInstances_1Replicaset_fail) {
@@ -1297,3 +1336,141 @@ TEST_F(MetadataTest, FetchInstances_1Replicaset_fail) {
   EXPECT_EQ(1u, rs.size());
   EXPECT_EQ(0u, rs.at("replicaset-1").members.size());
 }
+
+TEST_F(MetadataTest, FetchInstances_ReusesMemberSessions) {
+
+  connect_to_first_metadata_server();
+
+  auto resultset_metadata = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"replicaset-1", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-1", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-1", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+    });
+  };
+  // instance-1 (shared with metadata server) never answers, instance-2 does
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_metadata), _)).Times(3)
+    .WillRepeatedly(Invoke(resultset_metadata));
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_primary_member), _)).Times(3)
+    .WillRepeatedly(Invoke(query_primary_member_fail(0)));
+
+  // 1st refresh: connects to instance-2
+  enable_connection(1, 3320);
+  EXPECT_CALL(session_factory.get(1), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillOnce(Invoke(query_primary_member_ok(1)))
+    .WillOnce(Invoke(query_primary_member_ok(1)));
+  EXPECT_CALL(session_factory.get(1), query(StartsWith(query_status), _)).Times(2)
+    .WillOnce(Invoke(query_status_ok(1)))
+    .WillOnce(Invoke(query_status_fail(1)));
+  EXPECT_EQ(3u, metadata.fetch_instances("replicaset-1").at("replicaset-1").members.size());
+  EXPECT_EQ(2, session_factory.create_cnt());
+
+  // 2nd refresh: the session to instance-2 is used again, but fails;
+  // it is replaced right away
+  enable_connection(2, 3320);
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_ok(2)));
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_status), _)).Times(1)
+    .WillOnce(Invoke(query_status_ok(2)));
+  EXPECT_EQ(3u, metadata.fetch_instances("replicaset-1").at("replicaset-1").members.size());
+  EXPECT_EQ(3, session_factory.create_cnt());
+
+  // 3rd refresh: the new session is kept
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_ok(2)));
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_status), _)).Times(1)
+    .WillOnce(Invoke(query_status_ok(2)));
+  EXPECT_EQ(3u, metadata.fetch_instances("replicaset-1").at("replicaset-1").members.size());
+  EXPECT_EQ(3, session_factory.create_cnt());
+}
+
+TEST_F(MetadataTest, FetchInstances_ReplacesMemberSessionsClosedWhileIdle) {
+
+  connect_to_first_metadata_server();
+
+  auto resultset_metadata = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"replicaset-1", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-1", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-1", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+    });
+  };
+  // instance-1 (shared with metadata server) never answers, instance-2 does
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_metadata), _)).Times(2)
+    .WillRepeatedly(Invoke(resultset_metadata));
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_primary_member), _)).Times(2)
+    .WillRepeatedly(Invoke(query_primary_member_fail(0)));
+
+  // 1st refresh: connects to instance-2
+  enable_connection(1, 3320);
+  EXPECT_CALL(session_factory.get(1), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_ok(1)));
+  EXPECT_CALL(session_factory.get(1), query(StartsWith(query_status), _)).Times(1)
+    .WillOnce(Invoke(query_status_ok(1)));
+  EXPECT_EQ(3u, metadata.fetch_instances("replicaset-1").at("replicaset-1").members.size());
+  EXPECT_EQ(2, session_factory.create_cnt());
+
+  // 2nd refresh: instance-2 closed the session meanwhile; it is not
+  // queried, a new session is opened instead
+  session_factory.get(1).close_by_server();
+  enable_connection(2, 3320);
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke(query_primary_member_ok(2)));
+  EXPECT_CALL(session_factory.get(2), query(StartsWith(query_status), _)).Times(1)
+    .WillOnce(Invoke(query_status_ok(2)));
+  EXPECT_EQ(3u, metadata.fetch_instances("replicaset-1").at("replicaset-1").members.size());
+  EXPECT_EQ(3, session_factory.create_cnt());
+}
+
+TEST_F(MetadataTest, FetchInstances_2Replicasets_ok) {
+
+  connect_to_first_metadata_server();
+
+  auto resultset_metadata = [this](const std::string&, const MySQLSession::RowProcessor& processor) {
+    session_factory.get(0).query_impl(processor, {
+      {"replicaset-1", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-1", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-1", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+      {"replicaset-2", "instance-1", "HA", NULL, NULL, "blabla", "localhost:3310", NULL},
+      {"replicaset-2", "instance-2", "HA", NULL, NULL, "blabla", "localhost:3320", NULL},
+      {"replicaset-2", "instance-3", "HA", NULL, NULL, "blabla", "localhost:3330", NULL},
+    });
+  };
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_metadata), _)).Times(1)
+    .WillOnce(Invoke(resultset_metadata));
+
+  // both replicasets are queried at the same time: one shares the connection
+  // to the metadata server and waits until the other opened its own one
+  std::promise<void> second_queried;
+  std::shared_future<void> second_queried_future = second_queried.get_future().share();
+  enable_connection(1, 3310);
+  EXPECT_CALL(session_factory.get(0), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke([this, second_queried_future](const std::string &query,
+                                                    const MySQLSession::RowProcessor& processor) {
+      EXPECT_EQ(std::future_status::ready, second_queried_future.wait_for(std::chrono::seconds(5)));
+      query_primary_member_ok(0)(query, processor);
+    }));
+  EXPECT_CALL(session_factory.get(1), query(StartsWith(query_primary_member), _)).Times(1)
+    .WillOnce(Invoke([this, &second_queried](const std::string &query,
+                                             const MySQLSession::RowProcessor& processor) {
+      second_queried.set_value();
+      query_primary_member_ok(1)(query, processor);
+    }));
+  for (unsigned session : {0u, 1u}) {
+    EXPECT_CALL(session_factory.get(session), query(StartsWith(query_status), _)).Times(1)
+      .WillOnce(Invoke(query_status_ok(session)));
+  }
+
+  ClusterMetadata::ReplicaSetsByName rs = metadata.fetch_instances("replicaset-1");
+
+  EXPECT_EQ(2, session_factory.create_cnt());
+  EXPECT_EQ(2u, rs.size());
+  EXPECT_EQ(3u, rs.at("replicaset-1").members.size());
+  EXPECT_EQ(3u, rs.at("replicaset-2").members.size());
+  EXPECT_EQ(ServerMode::ReadWrite, rs.at("replicaset-2").members.at(0).mode);
+
+  auto stats = metadata.get_refresh_stats();
+  ASSERT_EQ(2u, stats.size());
+  EXPECT_TRUE(stats.at("replicaset-1").found_quorum);
+  EXPECT_TRUE(stats.at("replicaset-2").found_quorum);
+}
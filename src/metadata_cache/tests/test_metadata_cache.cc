@@ -207,3 +207,78 @@ TEST_F(MetadataCacheTest2, metadata_server_connection_failures) {
   expect_cluster_routable(mc); // lookup should see the cluster again
 }
 
+TEST_F(MetadataCacheTest2, topology_versions) {
+
+  MySQLSessionReplayer& m = *session;
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+  metadata_cache::TopologyPtr first = mc.get_topology();
+  EXPECT_EQ(1U, first->version);
+
+  // lookups refer to the topology instead of copying it
+  metadata_cache::LookupResult result(first, "cluster-1");
+  ASSERT_EQ(3U, result.instance_vector.size());
+  EXPECT_EQ(&first->get_replicaset("cluster-1")->members, &result.instance_vector);
+  EXPECT_TRUE(metadata_cache::LookupResult(first, "no-such-replicaset").instance_vector.empty());
+
+  // refresh without changes: same topology
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_EQ(first, mc.get_topology());
+
+  // all metadata servers down: routes are cleared in a new version
+  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3002, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  mc.refresh();
+  EXPECT_EQ(2U, mc.get_topology()->version);
+  EXPECT_TRUE(mc.get_topology()->replicasets.empty());
+
+  // the earlier topology is left as it was for whoever still holds it
+  EXPECT_EQ(3U, result.instance_vector.size());
+  EXPECT_EQ("uuid-server1", result.instance_vector[0].mysql_server_uuid);
+
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_EQ(3U, mc.get_topology()->version);
+  expect_cluster_routable(mc);
+}
+
+TEST_F(MetadataCacheTest2, topology_listeners) {
+
+  MySQLSessionReplayer& m = *session;
+
+  expect_sql_metadata();
+  expect_sql_members();
+  MetadataCache mc(metadata_servers, cmeta, 10, mysqlrouter::SSLOptions(), "cluster-1");
+
+  std::vector<uint64_t> versions;
+  uint64_t id = mc.add_topology_listener([&versions](const metadata_cache::TopologyPtr &topology) {
+    versions.push_back(topology->version);
+  });
+  EXPECT_NE(0U, id);
+
+  // no change, no notification
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_TRUE(versions.empty());
+
+  m.expect_connect("127.0.0.1", 3000, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3001, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  m.expect_connect("127.0.0.1", 3002, "admin", "admin", "").then_error("some fake bad connection message", 66);
+  mc.refresh();
+  ASSERT_EQ(1U, versions.size());
+  EXPECT_EQ(2U, versions[0]);
+
+  mc.remove_topology_listener(id);
+  expect_sql_metadata();
+  expect_sql_members();
+  mc.refresh();
+  EXPECT_EQ(3U, mc.get_topology()->version);
+  EXPECT_EQ(1U, versions.size());
+}
@@ -87,6 +87,14 @@ public:
     return (left.addr == right.addr) && (left.port == right.port);
   }
 
+  /** @brief Orders addresses by address, then port
+   *
+   * Allows using TCPAddress as key of ordered containers.
+   */
+  friend bool operator<(const TCPAddress &left, const TCPAddress &right) {
+    return (left.addr < right.addr) || (left.addr == right.addr && left.port < right.port);
+  }
+
   /** @brief Returns whether the TCPAddress is valid
    *
    * Returns whether the address and port are valid. This function also
@@ -129,6 +129,8 @@ class MySQLSession {
   virtual std::string quote(const std::string &s, char qchar = '\'') noexcept;
 
   virtual bool is_connected() noexcept { return connection_ && connected_; }
+  /** Checks that the server still answers the session (COM_PING); costs a round trip */
+  virtual bool ping() noexcept;
   const std::string& get_address() noexcept { return connection_address_; }
 
   virtual const char *last_error();
@@ -583,6 +583,10 @@ void MySQLSession::disconnect() {
   connection_address_.clear();
 }
 
+bool MySQLSession::ping() noexcept {
+  return is_connected() && mysql_ping(connection_) == 0;
+}
+
 void MySQLSession::execute(const std::string &q) {
   if (connected_) {
     MOCK_REC_EXECUTE(q);
@@ -21,9 +21,11 @@
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/plugin_config.h"
 
+#include <cerrno>
 #include <chrono>
 #include <map>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 # define WIN32_LEAN_AND_MEAN
@@ -51,6 +53,16 @@ extern const int kDefaultWaitTimeout;
 /** @brief Max number of active routes for this routing instance */
 extern const int kDefaultMaxConnections;
 
+/** @brief Highest value accepted for max_connections */
+extern const int kMaxConnectionsLimit;
+
+/** @brief File descriptors kept for the process besides routed connections
+ *
+ * Used when raising the limit of open files for routes; see
+ * reserve_file_descriptors().
+ */
+extern const unsigned int kReservedFileDescriptors;
+
 /** @brief Timeout connecting to destination (in seconds)
  *
  * Constant defining how long we wait to establish connection with the server before we give up.
@@ -96,6 +108,169 @@ extern const unsigned int kDefaultNetBufferLength;
  */
 extern const std::chrono::seconds kDefaultClientConnectTimeout;
 
+/** @brief Weight of a new measurement in the moving average of destination latencies */
+extern const double kLatencyWeight;
+
+/** @brief Time after which the latency measured for a destination is outdated
+ *
+ * With routing_strategy=lowest-latency, destinations without recent
+ * measurement are picked like the fastest ones, to measure them again.
+ */
+extern const std::chrono::seconds kLatencyMaxAge;
+
+/** @brief Time between two logs of the metrics of a route
+ *
+ * The admission queue, the worker pool and the outlier detection of a
+ * route are logged when they had something to do since the last log.
+ */
+extern const std::chrono::seconds kStatsLogInterval;
+
+/** @brief Time between two evaluations of the failure rates and latencies of destinations
+ *
+ * Failures and successes are counted per interval; a destination failing
+ * clearly more often than the others during an interval is ejected.
+ */
+extern const std::chrono::seconds kOutlierInterval;
+
+/** @brief Number of failures in a row after which a destination is ejected */
+extern const unsigned int kOutlierConsecutiveFailures;
+
+/** @brief Minimum number of connections of a destination in an interval to evaluate its failure rate */
+extern const unsigned int kOutlierMinRequests;
+
+/** @brief Minimum number of destinations to compare failure rates or latencies */
+extern const unsigned int kOutlierMinDestinations;
+
+/** @brief Success rates this many standard deviations below the mean are outliers */
+extern const double kOutlierSuccessRateStdevFactor;
+
+/** @brief Success rates this much below the mean are outliers
+ *
+ * With n destinations no rate can be more than sqrt(n - 1) standard
+ * deviations below the mean, so small pools would never reach
+ * kOutlierSuccessRateStdevFactor.
+ */
+extern const double kOutlierSuccessRateMargin;
+
+/** @brief Greeting latencies this many times the median are outliers */
+extern const double kOutlierLatencyFactor;
+
+/** @brief Maximum percentage of the destinations ejected at the same time
+ *
+ * One destination may always be ejected, unless it is the only one.
+ */
+extern const unsigned int kOutlierMaxEjectionPercent;
+
+/** @brief Time a destination is ejected for; multiplied by the number of times it was ejected */
+extern const std::chrono::seconds kOutlierBaseEjectionTime;
+
+/** @brief Maximum time a destination is ejected for */
+extern const std::chrono::seconds kOutlierMaxEjectionTime;
+
+/** @brief Server disconnecting a client within this time after the handshake counts as failure */
+extern const std::chrono::seconds kOutlierEarlyDisconnect;
+
+/** @brief Default way of checking whether quarantined destinations are back
+ *
+ * By default, a destination is taken out of quarantine once it accepts a
+ * TCP connection again.
+ */
+extern const std::string kDefaultQuarantineProbe;
+
+/** @brief Time after which a quarantined destination is probed first
+ *
+ * The time doubles with every failed probe, up to kMaxQuarantineProbeInterval.
+ */
+extern const std::chrono::milliseconds kQuarantineProbeInterval;
+
+/** @brief Maximum time between two probes of a quarantined destination */
+extern const std::chrono::milliseconds kMaxQuarantineProbeInterval;
+
+/** @brief Default I/O model
+ *
+ * By default, each client connection is handled in its own thread.
+ */
+extern const std::string kDefaultIoModel;
+
+/** @brief Default number of threads accepting client connections */
+extern const unsigned int kDefaultAcceptorThreads;
+
+/** @brief Maximum number of threads accepting client connections */
+extern const unsigned int kMaxAcceptorThreads;
+
+/** @brief Default size of the queue of connections waiting to be accepted */
+extern const int kDefaultListenBacklog;
+
+/** @brief Default number of threads kept by the pool servicing client connections */
+extern const unsigned int kDefaultMinWorkerThreads;
+
+/** @brief Default maximum number of threads of the pool servicing client connections
+ *
+ * 0 means that every client connection gets a thread of its own. With a
+ * pool and io_model=thread, every connection holds a thread until it is
+ * closed; max_worker_threads then limits the number of concurrent
+ * connections.
+ */
+extern const unsigned int kDefaultMaxWorkerThreads;
+
+/** @brief Number of threads connecting to destinations with a reactor
+ *
+ * Used when max_worker_threads is 0. With io_model=epoll and
+ * io_model=io_uring, the threads of the pool only connect clients to their
+ * destinations; max_worker_threads limits how many clients are connected
+ * at the same time.
+ */
+extern const unsigned int kDefaultReactorConnectThreads;
+
+/** @brief Default maximum number of connections kept ready per destination
+ *
+ * 0 means that destinations are connected to when a client connects.
+ */
+extern const unsigned int kDefaultPreconnectPoolSize;
+
+/** @brief Maximum number of connections kept ready per destination */
+extern const unsigned int kMaxPreconnectPoolSize;
+
+/** @brief Default time after which connections kept ready are closed
+ *
+ * Has to stay below connect_timeout of the servers (10 seconds by default).
+ */
+extern const std::chrono::seconds kDefaultPreconnectMaxAge;
+
+/** @brief Default maximum number of clients waiting for a free connection slot
+ *
+ * 0 means that clients arriving while max_connections are active get
+ * "Too many connections" right away.
+ */
+extern const unsigned int kDefaultAdmissionQueueSize;
+
+/** @brief Default maximum time a client waits for a free connection slot */
+extern const std::chrono::seconds kDefaultAdmissionQueueTimeout;
+
+/** @brief Time after which the admission queue checks for free slots it was not told about */
+extern const std::chrono::milliseconds kAdmissionQueueSweepInterval;
+
+/** @brief Default maximum number of connections routed to one destination
+ *
+ * 0 means that destinations take any number of connections.
+ */
+extern const unsigned int kDefaultMaxConnectionsPerDestination;
+
+/** @brief Default number of destinations connected to at the same time
+ *
+ * 1 means that destinations are tried one after the other.
+ */
+extern const unsigned int kDefaultConnectRaceSize;
+
+/** @brief Maximum number of destinations connected to at the same time */
+extern const unsigned int kMaxConnectRaceSize;
+
+/** @brief Time after which the next candidate of a racing connect is tried
+ *
+ * Same as the connection attempt delay of Happy Eyeballs (RFC 8305).
+ */
+extern const std::chrono::milliseconds kConnectRaceDelay;
+
 #ifdef _WIN32
   const SOCKET kInvalidSocket = INVALID_SOCKET;// windows defines INVALID_SOCKET already
 #else
@@ -123,6 +298,94 @@ AccessMode get_access_mode(const std::string&);
  */
 std::string get_access_mode_name(AccessMode access_mode) noexcept;
 
+/** @brief I/O models supported by Routing plugin
+ *
+ * kThread services every client connection in a thread of its own,
+ * kEpoll multiplexes all connections of a route over a fixed number
+ * of reactor threads using epoll (Linux only). kIoUring multiplexes them
+ * the same way, but every reactor thread queues the receives and sends
+ * of its connections on an io_uring of its own and submits them in
+ * batches (Linux 5.7 or later, when built with <linux/io_uring.h>).
+ */
+enum class IoModel {
+  kUndefined = 0,
+  kThread = 1,
+  kEpoll = 2,
+  kIoUring = 3,
+};
+
+void get_io_model_names(std::string*);
+IoModel get_io_model(const std::string&);
+
+/** @brief Returns literal name of given I/O model
+ *
+ * Returns literal name of given I/O model as a std:string. When
+ * the I/O model is not found, empty string is returned.
+ *
+ * @param io_model I/O model to look up
+ * @return Name of I/O model as std::string or empty string
+ */
+std::string get_io_model_name(IoModel io_model) noexcept;
+
+/** @brief Strategies picking the destination of a client connection
+ *
+ * kUndefined uses the default of the route: kFirstAvailable for
+ * read-write routes with a static list of destinations, kRoundRobin
+ * otherwise. kLeastConnections picks the destination with the fewest
+ * connections routed to it. kLowestLatency picks the faster of two
+ * random destinations, going by the moving average of the time they took
+ * to connect and greet. kConsistentHash sends a client, identified by its
+ * IP address, to the same destination as long as it is available.
+ */
+enum class RoutingStrategy {
+  kUndefined = 0,
+  kRoundRobin = 1,
+  kFirstAvailable = 2,
+  kLeastConnections = 3,
+  kLowestLatency = 4,
+  kConsistentHash = 5,
+};
+
+void get_routing_strategy_names(std::string*);
+RoutingStrategy get_routing_strategy(const std::string&);
+
+/** @brief Returns literal name of given routing strategy
+ *
+ * Returns literal name of given routing strategy as a std:string. When
+ * the routing strategy is not found, empty string is returned.
+ *
+ * @param routing_strategy routing strategy to look up
+ * @return Name of routing strategy as std::string or empty string
+ */
+std::string get_routing_strategy_name(RoutingStrategy routing_strategy) noexcept;
+
+/** @brief Ways of checking whether a quarantined destination is back
+ *
+ * kConnect takes the destination out of quarantine once it accepts a TCP
+ * connection. kGreeting also requires a server speaking the classic
+ * protocol to send its greeting, so that a server which accepts
+ * connections but does not handle them, or refuses them with an error
+ * packet, stays quarantined.
+ */
+enum class QuarantineProbe {
+  kUndefined = 0,
+  kConnect = 1,
+  kGreeting = 2,
+};
+
+void get_quarantine_probe_names(std::string*);
+QuarantineProbe get_quarantine_probe(const std::string&);
+
+/** @brief Returns literal name of given quarantine probe
+ *
+ * Returns literal name of given quarantine probe as a std:string. When
+ * the quarantine probe is not found, empty string is returned.
+ *
+ * @param quarantine_probe quarantine probe to look up
+ * @return Name of quarantine probe as std::string or empty string
+ */
+std::string get_quarantine_probe_name(QuarantineProbe quarantine_probe) noexcept;
+
 /**
  * Sets blocking flag for given socket
  *
@@ -131,6 +394,30 @@ std::string get_access_mode_name(AccessMode access_mode) noexcept;
  */
 void set_socket_blocking(int sock, bool blocking);
 
+/**
+ * Reserves file descriptors for a route
+ *
+ * What all routes of the process reserved and did not release yet, plus
+ * kReservedFileDescriptors, is added up and the soft RLIMIT_NOFILE is raised to cover it as far as
+ * the hard limit allows. The limit is never lowered.
+ *
+ * @param count number of file descriptors needed by the route
+ * @param total_reserved set to the number of file descriptors reserved
+ *        by the process so far
+ * @return number of file descriptors the process may open
+ */
+uint64_t reserve_file_descriptors(uint64_t count, uint64_t *total_reserved);
+
+/**
+ * Gives back file descriptors reserved with reserve_file_descriptors()
+ *
+ * Called when the route stops. The limit of open files stays as it is;
+ * routes reserving later take it into account again.
+ *
+ * @param count number of file descriptors the route reserved
+ */
+void release_file_descriptors(uint64_t count);
+
 /** @class SocketOperationsBase
  * @brief Base class to allow multiple SocketOperations implementations
  *        (at least one "real" and one mock for testing purposes)
@@ -140,6 +427,64 @@ class SocketOperationsBase {
 
   virtual ~SocketOperationsBase() = default;
   virtual int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout_ms, bool log = true) noexcept = 0;
+
+  /** @brief Connects to whichever of several MySQL servers answers first
+   *
+   * The default implementation tries the servers one after the other with
+   * get_mysql_socket().
+   *
+   * @param addrs servers to connect to, most preferred first
+   * @param connect_timeout time the race may take as a whole; servers
+   *        still connecting or not tried yet by then count as timed out
+   * @param delay time after which the next server is tried when the
+   *        previous ones did not answer yet
+   * @param winner set to the index in `addrs` of the server connected to
+   * @param failed when not nullptr, indexes of the servers which could not
+   *        be connected to are appended
+   * @param log whether to log errors or not
+   * @return a socket descriptor; see get_mysql_socket() for errors
+   */
+  virtual int connect_race(const std::vector<mysqlrouter::TCPAddress> &addrs,
+                           std::chrono::milliseconds connect_timeout,
+                           std::chrono::milliseconds delay,
+                           size_t *winner, std::vector<size_t> *failed,
+                           bool log = true) noexcept {
+    (void)delay;
+    const auto deadline = std::chrono::steady_clock::now() + connect_timeout;
+    int sock = -1;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      const auto remaining =
+          std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      sock = remaining.count() > 0 ? get_mysql_socket(addrs[i], remaining, log) : -2;
+      if (sock >= 0) {
+        *winner = i;
+        return sock;
+      }
+      if (failed) failed->push_back(i);
+    }
+    return sock;
+  }
+
+  /** @brief Connects to several MySQL servers at the same time
+   *
+   * The default implementation connects to the servers one after the
+   * other with get_mysql_socket().
+   *
+   * @param addrs servers to connect to
+   * @param connect_timeout timeout waiting for each connection
+   * @param log whether to log errors or not
+   * @return a socket descriptor for each server of `addrs`, in the same
+   *         order; negative for the servers which could not be connected to
+   */
+  virtual std::vector<int> connect_all(const std::vector<mysqlrouter::TCPAddress> &addrs,
+                                       std::chrono::milliseconds connect_timeout,
+                                       bool log = true) noexcept {
+    std::vector<int> socks;
+    for (const auto &addr : addrs) {
+      socks.push_back(get_mysql_socket(addr, connect_timeout, log));
+    }
+    return socks;
+  }
   virtual ssize_t write(int  fd, void *buffer, size_t nbyte) = 0;
   virtual ssize_t read(int fd, void *buffer, size_t nbyte) = 0;
   virtual void close(int fd) = 0;
@@ -169,6 +514,37 @@ class SocketOperationsBase {
   virtual int get_errno() = 0;
   virtual void set_errno(int) = 0;
   virtual int poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout) = 0;
+
+  /** @brief Creates a pipe used to move data between sockets with splice()
+   *
+   * Implementations which do not support splice() fail with ENOSYS.
+   *
+   * @param fds storage for the read end (fds[0]) and write end (fds[1])
+   * @return 0 on success; -1 on error
+   */
+  virtual int pipe(int fds[2]) {
+    (void)fds;
+    set_errno(ENOSYS);
+    return -1;
+  }
+
+  /** @brief Moves data between two descriptors without copying it to user space
+   *
+   * One of the descriptors must be a pipe. Implementations which do not
+   * support splice() fail with ENOSYS.
+   *
+   * @param fd_in descriptor to move data from
+   * @param fd_out descriptor to move data to
+   * @param nbyte maximum number of bytes to move
+   * @return number of bytes moved; 0 on end of file; -1 on error
+   */
+  virtual ssize_t splice(int fd_in, int fd_out, size_t nbyte) {
+    (void)fd_in;
+    (void)fd_out;
+    (void)nbyte;
+    set_errno(ENOSYS);
+    return -1;
+  }
 };
 
 /** @class SocketOperations
@@ -180,9 +556,8 @@ class SocketOperations : public SocketOperationsBase {
 
   /** @brief Returns socket descriptor of connected MySQL server
    *
-   * Iterates through all available connections (until it succesfully connects)
-   * to the selected address as returned by getaddrinfo()
-   * (see its documentation for the details).
+   * Races connects to all addresses the hostname resolves to (see
+   * connect_race()), keeping the first which succeeds.
    * If it's not able to connect via any path, it returns value < 0.
    *
    * Returns a socket descriptor for the connection to the MySQL Server or
@@ -197,6 +572,36 @@ class SocketOperations : public SocketOperationsBase {
    */
   int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout, bool log = true) noexcept override;
 
+  /** @brief Connects to whichever of several MySQL servers answers first
+   *
+   * In the spirit of Happy Eyeballs (RFC 8305): non-blocking connects are
+   * started to all addresses of the servers in order, the next one once
+   * the previous did not answer within `delay` or failed. The first
+   * connection established is kept and the others are closed.
+   *
+   * A server is reported as failed once the connects to all its addresses
+   * failed or timed out; servers which lost the race are not.
+   *
+   * @see SocketOperationsBase::connect_race()
+   */
+  int connect_race(const std::vector<mysqlrouter::TCPAddress> &addrs,
+                   std::chrono::milliseconds connect_timeout,
+                   std::chrono::milliseconds delay,
+                   size_t *winner, std::vector<size_t> *failed,
+                   bool log = true) noexcept override;
+
+  /** @brief Connects to several MySQL servers at the same time
+   *
+   * Non-blocking connects to all servers are started at once and waited
+   * for with a single poll(). When the connect to an address of a server
+   * fails, the next address of the server is tried right away.
+   *
+   * @see SocketOperationsBase::connect_all()
+   */
+  std::vector<int> connect_all(const std::vector<mysqlrouter::TCPAddress> &addrs,
+                               std::chrono::milliseconds connect_timeout,
+                               bool log = true) noexcept override;
+
   /** @brief Thin wrapper around socket library write() */
   ssize_t write(int fd, void *buffer, size_t nbyte) override;
 
@@ -233,6 +638,14 @@ class SocketOperations : public SocketOperationsBase {
    */
   int poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout) override;
 
+#ifdef __linux__
+  /** @brief Thin wrapper around pipe2() creating close-on-exec pipes */
+  int pipe(int fds[2]) override;
+
+  /** @brief Thin wrapper around splice() */
+  ssize_t splice(int fd_in, int fd_out, size_t nbyte) override;
+#endif
+
   /**
    * wait for a non-blocking connect() to finish
    *
@@ -0,0 +1,166 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "admission_queue.h"
+
+#include "common.h"
+#include "mysqlrouter/routing.h"
+
+#include <algorithm>
+#include <vector>
+
+AdmissionQueue::AdmissionQueue(const std::string &thread_name, size_t max_size,
+                               std::chrono::milliseconds timeout, Handler admit, Handler reject,
+                               std::function<bool()> has_room)
+    : thread_name_(thread_name),
+      max_size_(max_size),
+      timeout_(timeout),
+      admit_(std::move(admit)),
+      reject_(std::move(reject)),
+      has_room_(std::move(has_room)),
+      free_slots_(0),
+      stopping_(false),
+      max_length_(0),
+      queued_(0),
+      admitted_(0),
+      timed_out_(0),
+      rejected_(0),
+      total_wait_(0),
+      max_wait_(0) {}
+
+AdmissionQueue::~AdmissionQueue() {
+  stop();
+}
+
+void AdmissionQueue::start() {
+  thread_ = std::thread(&AdmissionQueue::run, this);
+}
+
+void AdmissionQueue::stop() {
+  std::deque<Client> waiting;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    std::swap(waiting, queue_);
+    cond_.notify_all();
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  for (const auto &client : waiting) {
+    reject_(client);
+  }
+}
+
+bool AdmissionQueue::push(int sock, const sockaddr_storage &addr, bool is_tcp) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stopping_ || queue_.size() >= max_size_) {
+    ++rejected_;
+    return false;
+  }
+  queue_.push_back(Client{sock, addr, is_tcp, clock_type::now()});
+  ++queued_;
+  max_length_ = std::max(max_length_, queue_.size());
+  cond_.notify_one();
+  return true;
+}
+
+bool AdmissionQueue::empty() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.empty();
+}
+
+void AdmissionQueue::slot_freed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // without waiting clients, the slot goes to the next client accepted
+  if (free_slots_ < queue_.size()) {
+    ++free_slots_;
+    cond_.notify_one();
+  }
+}
+
+AdmissionQueue::Stats AdmissionQueue::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Stats stats;
+  stats.length = queue_.size();
+  stats.max_length = max_length_;
+  stats.queued = queued_;
+  stats.admitted = admitted_;
+  stats.timed_out = timed_out_;
+  stats.rejected = rejected_;
+  stats.total_wait = total_wait_;
+  stats.max_wait = max_wait_;
+
+  return stats;
+}
+
+void AdmissionQueue::run() {
+  mysql_harness::rename_thread(thread_name_.c_str());
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    auto now = clock_type::now();
+    std::vector<Client> expired;
+    while (!queue_.empty() && now - queue_.front().queued_at >= timeout_) {
+      expired.push_back(queue_.front());
+      queue_.pop_front();
+      ++timed_out_;
+    }
+    free_slots_ = std::min(free_slots_, queue_.size());
+
+    std::vector<Client> admitted;
+    while (free_slots_ > 0) {
+      admitted.push_back(queue_.front());
+      queue_.pop_front();
+      --free_slots_;
+    }
+    for (const auto &client : admitted) {
+      auto wait = std::chrono::duration_cast<std::chrono::microseconds>(now - client.queued_at);
+      total_wait_ += wait;
+      max_wait_ = std::max(max_wait_, wait);
+      ++admitted_;
+    }
+
+    if (!expired.empty() || !admitted.empty()) {
+      lock.unlock();
+      for (const auto &client : expired) {
+        reject_(client);
+      }
+      for (const auto &client : admitted) {
+        admit_(client);
+      }
+      lock.lock();
+      continue;
+    }
+
+    auto wake_up = now + routing::kAdmissionQueueSweepInterval;
+    if (!queue_.empty()) {
+      wake_up = std::min(wake_up, queue_.front().queued_at + timeout_);
+    }
+    if (cond_.wait_until(lock, wake_up) == std::cv_status::timeout && !queue_.empty() && free_slots_ == 0) {
+      // no close told us about a free slot; admitted clients are counted
+      // only once connected, so take one at a time
+      lock.unlock();
+      bool has_room = has_room_();
+      lock.lock();
+      if (has_room && !queue_.empty()) {
+        ++free_slots_;
+      }
+    }
+  }
+}
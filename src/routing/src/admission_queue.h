@@ -0,0 +1,165 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_ADMISSION_QUEUE_INCLUDED
+#define ROUTING_ADMISSION_QUEUE_INCLUDED
+
+/** @file
+ * @brief Defining the class AdmissionQueue
+ *
+ * Used by MySQLRouting when a route is configured with
+ * `admission_queue_size` to let clients arriving while `max_connections`
+ * are active wait for a free slot instead of failing right away.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#else
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <winsock2.h>
+#endif
+
+/** @class AdmissionQueue
+ *  @brief Bounded FIFO of accepted clients waiting for a free connection slot
+ *
+ *  Clients are parked as sockets; no thread is held for them. A single
+ *  thread hands the oldest client over to `admit` whenever a connection
+ *  of the route closed, and gives clients which waited longer than
+ *  `timeout` to `reject`. In case closes were missed, it also admits one
+ *  client every routing::kAdmissionQueueSweepInterval while `has_room`
+ *  says the route is below its maximum.
+ */
+class AdmissionQueue {
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  /** @brief A parked client */
+  struct Client {
+    int sock;
+    sockaddr_storage addr;
+    bool is_tcp;
+    clock_type::time_point queued_at;
+  };
+
+  using Handler = std::function<void(const Client &)>;
+
+  /** @brief Snapshot of the metrics of the queue */
+  struct Stats {
+    /** @brief Number of clients waiting */
+    size_t length;
+    /** @brief Highest number of clients waiting so far */
+    size_t max_length;
+    /** @brief Number of clients parked so far */
+    uint64_t queued;
+    /** @brief Number of clients which got a slot */
+    uint64_t admitted;
+    /** @brief Number of clients given up on after the timeout */
+    uint64_t timed_out;
+    /** @brief Number of clients not parked as the queue was full */
+    uint64_t rejected;
+    /** @brief Sum of the time admitted clients waited */
+    std::chrono::microseconds total_wait;
+    /** @brief Longest time an admitted client waited */
+    std::chrono::microseconds max_wait;
+  };
+
+  /** @brief Constructor
+   *
+   * @param thread_name name given to the thread of the queue
+   * @param max_size maximum number of waiting clients
+   * @param timeout maximum time a client waits
+   * @param admit called for a client which got a slot
+   * @param reject called for a client which waited too long or is still
+   *        waiting when the queue stops
+   * @param has_room tells whether the route is below its maximum
+   */
+  AdmissionQueue(const std::string &thread_name, size_t max_size, std::chrono::milliseconds timeout,
+                 Handler admit, Handler reject, std::function<bool()> has_room);
+
+  /** @brief Destructor; stops the queue */
+  ~AdmissionQueue();
+
+  AdmissionQueue(const AdmissionQueue &) = delete;
+  AdmissionQueue &operator=(const AdmissionQueue &) = delete;
+
+  /** @brief Starts the thread of the queue
+   *
+   * Throws std::system_error when the thread can not be started.
+   */
+  void start();
+
+  /** @brief Stops the thread; clients still waiting are rejected */
+  void stop();
+
+  /** @brief Parks a client
+   *
+   * @return false when the queue is full or stopped; the client is not
+   *         parked then
+   */
+  bool push(int sock, const sockaddr_storage &addr, bool is_tcp);
+
+  /** @brief Returns whether no client is waiting */
+  bool empty() const;
+
+  /** @brief Tells the queue that a connection of the route closed
+   *
+   * The slot goes to the oldest waiting client, if any.
+   */
+  void slot_freed();
+
+  /** @brief Returns the metrics of the queue */
+  Stats get_stats() const;
+
+ private:
+  /** @brief Main loop of the thread */
+  void run();
+
+  const std::string thread_name_;
+  const size_t max_size_;
+  const std::chrono::milliseconds timeout_;
+  const Handler admit_;
+  const Handler reject_;
+  const std::function<bool()> has_room_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Client> queue_;
+  /** @brief Slots freed for waiting clients, not handed over yet */
+  size_t free_slots_;
+  bool stopping_;
+  std::thread thread_;
+
+  size_t max_length_;
+  uint64_t queued_;
+  uint64_t admitted_;
+  uint64_t timed_out_;
+  uint64_t rejected_;
+  std::chrono::microseconds total_wait_;
+  std::chrono::microseconds max_wait_;
+};
+
+#endif // ROUTING_ADMISSION_QUEUE_INCLUDED
@@ -0,0 +1,76 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_consistent_hash.h"
+#include "utils.h"
+
+#include <string>
+
+const size_t ConsistentHashRing::kDefaultPointsPerServer;
+
+void ConsistentHashRing::assign(const AddrVector &servers) {
+  servers_ = servers;
+  ring_.clear();
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    // points depend on the server only, not on its index or the other servers
+    const std::string name = servers_[i].str();
+    for (size_t n = 0; n < points_per_server_; ++n) {
+      const std::string point = name + "#" + std::to_string(n);
+      ring_.emplace(hash_bytes(point.data(), point.size()), i);
+    }
+  }
+}
+
+std::vector<size_t> ConsistentHashRing::lookup(uint64_t key, size_t max,
+                                               const std::function<bool(size_t)> &usable) const {
+  std::vector<size_t> result;
+  if (ring_.empty()) {
+    return result;
+  }
+
+  std::vector<bool> seen(servers_.size(), false);
+  size_t num_seen = 0;
+  auto it = ring_.lower_bound(key);
+  for (size_t n = 0; n < ring_.size() && result.size() < max && num_seen < servers_.size(); ++n, ++it) {
+    if (it == ring_.end()) {
+      it = ring_.begin();
+    }
+    size_t index = it->second;
+    if (seen[index]) {
+      continue;
+    }
+    seen[index] = true;
+    ++num_seen;
+    if (usable(index)) {
+      result.push_back(index);
+    }
+  }
+  return result;
+}
+
+std::vector<size_t> DestConsistentHash::select_candidates(const Snapshot &snapshot, size_t max, uint64_t client_key) {
+  std::shared_ptr<const PlacedRing> placed = std::atomic_load(&ring_);
+  if (!placed || placed->version != snapshot.version) {
+    // the destinations changed; threads racing here build the same ring
+    auto ring = std::make_shared<PlacedRing>();
+    ring->version = snapshot.version;
+    ring->ring.assign(snapshot.destinations);
+    placed = ring;
+    std::atomic_store(&ring_, placed);
+  }
+  return placed->ring.lookup(client_key, max, [&snapshot](size_t i) { return !snapshot.is_quarantined(i); });
+}
@@ -0,0 +1,104 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_DEST_CONSISTENT_HASH_INCLUDED
+#define ROUTING_DEST_CONSISTENT_HASH_INCLUDED
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "destination.h"
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/routing.h"
+
+/** @class ConsistentHashRing
+ * @brief Hash ring placing clients on servers
+ *
+ * Every server is placed at `points_per_server` pseudo-random points of a
+ * ring of 64-bit hash values. A client goes to the server owning the first
+ * point at or after the client's key. When a server is added or removed,
+ * only the clients between its points and the preceding ones move, about
+ * 1/N of all clients.
+ *
+ * Servers which cannot be used are skipped by continuing along the ring,
+ * so a client always gets the same replacement for a failed server, and
+ * gets its server back once it recovers.
+ *
+ * Not thread-safe.
+ */
+class ConsistentHashRing {
+ public:
+  using AddrVector = std::vector<mysqlrouter::TCPAddress>;
+
+  /** @brief Default number of points per server */
+  static const size_t kDefaultPointsPerServer = 160;
+
+  explicit ConsistentHashRing(size_t points_per_server = kDefaultPointsPerServer)
+      : points_per_server_(points_per_server) {}
+
+  /** @brief Places the servers on the ring, replacing the ones placed before */
+  void assign(const AddrVector &servers);
+
+  /** @brief Returns the servers placed on the ring */
+  const AddrVector &servers() const noexcept {
+    return servers_;
+  }
+
+  /** @brief Returns servers for a client, in the order to try them
+   *
+   * @param key key of the client, see client_key()
+   * @param max maximum number of servers to return
+   * @param usable tells whether the server at an index in servers() may be used
+   * @return indexes in servers(), the server owning the key first
+   */
+  std::vector<size_t> lookup(uint64_t key, size_t max, const std::function<bool(size_t)> &usable) const;
+
+ private:
+  const size_t points_per_server_;
+  AddrVector servers_;
+  /** @brief Point on the ring -> index in servers_ */
+  std::map<uint64_t, size_t> ring_;
+};
+
+/** @class DestConsistentHash
+ * @brief Routes a client to the same destination as long as it is available
+ *
+ * Clients keyed by their IP address are placed on the destinations with a
+ * ConsistentHashRing; quarantined destinations are skipped.
+ */
+class DestConsistentHash final : public RouteDestination {
+ public:
+  using RouteDestination::RouteDestination;
+
+ protected:
+  std::vector<size_t> select_candidates(const Snapshot &snapshot, size_t max, uint64_t client_key) override;
+
+ private:
+  struct PlacedRing {
+    /** @brief Snapshot::version of the destinations placed on the ring */
+    uint64_t version;
+    ConsistentHashRing ring;
+  };
+
+  /** @brief Destinations placed on the ring, replaced when they change */
+  std::shared_ptr<const PlacedRing> ring_;
+};
+
+#endif // ROUTING_DEST_CONSISTENT_HASH_INCLUDED
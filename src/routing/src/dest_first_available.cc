@@ -25,27 +25,49 @@
 #endif
 
 //IMPORT_LOG_FUNCTIONS() TODO:
-int DestFirstAvailable::get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept {
+int DestFirstAvailable::get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                          mysqlrouter::TCPAddress *address,
+                                          uint64_t /* client_key */) noexcept {
   // Say for example, that we have three servers: A, B and C.
   // The active server should be failed-over in such fashion:
   //
   //   A -> B -> C -> no more connections (regardless of whether A and B go back up or not)
   //
-  // This is what this function does.
+  // This is what this function does. Servers are not raced against each
+  // other: a slow A would otherwise be given up for B for good.
 
-  if (destinations_.empty()) {
+  SnapshotPtr current = snapshot();
+  const AddrVector &destinations = current->destinations;
+  if (destinations.empty()) {
     return -1;
   }
 
-  // We start the list at the currently available server
-  for (size_t i = current_pos_; i < destinations_.size(); ++i) {
-    auto addr = destinations_.at(i);
+  // We start the list at the currently available server. A server at
+  // max_connections_per_destination stays the active one; the connection
+  // spills over to the next.
+  bool spilled = false;
+  for (size_t i = current_pos_; i < destinations.size(); ++i) {
+    auto addr = destinations.at(i);
+    if (reserve_connections(AddrVector{addr}, 1).empty()) {
+      log_debug("Server %s (index %d) is at max_connections_per_destination", addr.str().c_str(), i);
+      spilled = true;
+      continue;
+    }
     log_debug("Trying server %s (index %d)", addr.str().c_str(), i);
     auto sock = get_mysql_socket(addr, connect_timeout);
     if (sock >= 0) {
-      current_pos_ = i;
+      assign_connection(sock, addr);
+      if (!spilled) {
+        current_pos_ = i;
+      }
+      if (address) *address = addr;
       return sock;
     }
+    release_connection(addr);
+  }
+  if (spilled) {
+    // the active server is only full, not down
+    return -1;
   }
 
   // We are out of destinations. Next time we will try from the beginning of the list.
@@ -54,6 +76,12 @@ int DestFirstAvailable::get_server_socket(std::chrono::milliseconds connect_time
 #else
   *error = WSAGetLastError();
 #endif
-  current_pos_ = destinations_.size();  // so for(..) above will no longer try to connect to a server
+  current_pos_ = destinations.size();  // so for(..) above will no longer try to connect to a server
   return -1;
 }
+
+bool DestFirstAvailable::is_available(const mysqlrouter::TCPAddress &address) noexcept {
+  size_t pos = current_pos_;
+  SnapshotPtr current = snapshot();
+  return pos < current->destinations.size() && current->destinations[pos] == address;
+}
@@ -29,7 +29,12 @@ class DestFirstAvailable final : public RouteDestination {
  public:
   using RouteDestination::RouteDestination;
 
-  int get_server_socket(std::chrono::milliseconds connect_timeout_ms, int *error) noexcept override;
+  int get_server_socket(std::chrono::milliseconds connect_timeout_ms, int *error,
+                        mysqlrouter::TCPAddress *address = nullptr,
+                        uint64_t client_key = 0) noexcept override;
+
+  /** @brief Returns whether the destination is the one currently used */
+  bool is_available(const mysqlrouter::TCPAddress &address) noexcept override;
 };
 
 
@@ -0,0 +1,66 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_least_connections.h"
+
+#include <algorithm>
+
+using mysqlrouter::TCPAddress;
+
+void DestLeastConnections::connection_opened(int sock, const TCPAddress &address) noexcept {
+  RouteDestination::connection_opened(sock, address);
+  load_.opened(sock, address);
+}
+
+void DestLeastConnections::connection_closed(int sock) noexcept {
+  RouteDestination::connection_closed(sock);
+  load_.closed(sock);
+}
+
+size_t DestLeastConnections::get_connections(const TCPAddress &address) {
+  return load_.connections(address);
+}
+
+std::vector<size_t> DestLeastConnections::select_candidates(const Snapshot &snapshot, size_t max,
+                                                            uint64_t /* client_key */) {
+  const AddrVector &destinations = snapshot.destinations;
+  // destinations added since the last change start without connections;
+  // adding one twice is harmless
+  if (counted_version_ != snapshot.version) {
+    for (const TCPAddress &address : destinations) {
+      load_.add(address);
+    }
+    counted_version_ = snapshot.version;
+  }
+
+  auto index_of = [&destinations](const TCPAddress &address) {
+    return static_cast<size_t>(std::find(destinations.begin(), destinations.end(), address) - destinations.begin());
+  };
+  std::vector<size_t> candidates;
+  for (const TCPAddress &address : load_.least_loaded(max, [&snapshot, &index_of](const TCPAddress &address) {
+         size_t i = index_of(address);
+         return i < snapshot.destinations.size() && !snapshot.is_quarantined(i);
+       })) {
+    candidates.push_back(index_of(address));
+  }
+  return candidates;
+}
+
+void DestLeastConnections::server_connected(const Snapshot &snapshot, size_t index, int sock,
+                                            std::chrono::microseconds /* connect_time */) noexcept {
+  load_.opened(sock, snapshot.destinations[index]);
+}
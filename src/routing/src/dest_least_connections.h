@@ -0,0 +1,181 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_DEST_LEAST_CONNECTIONS_INCLUDED
+#define ROUTING_DEST_LEAST_CONNECTIONS_INCLUDED
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "destination.h"
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/routing.h"
+
+/** @class ConnectionLoad
+ * @brief Number of connections routed to each destination, ordered by load
+ *
+ * Destinations are identified by `Key`. Picking the destinations with the
+ * fewest connections costs O(log n) plus the destinations skipped; counting
+ * an opened or closed connection costs O(log n). Among destinations with
+ * as many connections, the one picked least recently comes first, so that
+ * connections opened at the same time spread over them.
+ *
+ * Thread-safe.
+ */
+template <typename Key>
+class ConnectionLoad {
+ public:
+  /** @brief Starts counting connections to a destination, unless it is counted already */
+  void add(const Key &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    add_unlocked(key);
+  }
+
+  /** @brief Returns the destinations with the fewest connections
+   *
+   * @param max maximum number of destinations to return
+   * @param usable predicate telling whether a destination may be returned
+   * @return the destinations, fewest connections first
+   */
+  template <typename Predicate>
+  std::vector<Key> least_loaded(size_t max, Predicate usable) {
+    std::vector<Key> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = order_.begin(); it != order_.end() && result.size() < max; ++it) {
+      if (usable(std::get<2>(*it))) {
+        result.push_back(std::get<2>(*it));
+      }
+    }
+    if (!result.empty()) {
+      // the next caller prefers another destination with as many connections
+      update(result.front(), 0, ++picks_);
+    }
+    return result;
+  }
+
+  /** @brief Counts a connection to a destination */
+  void opened(int sock, const Key &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    add_unlocked(key);
+    auto res = sockets_.emplace(sock, key);
+    if (!res.second) {
+      // the socket was closed without being reported
+      update(res.first->second, -1, 0);
+      res.first->second = key;
+    }
+    update(key, 1, 0);
+  }
+
+  /** @brief Stops counting a connection; unknown sockets are ignored */
+  void closed(int sock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sockets_.find(sock);
+    if (it == sockets_.end()) {
+      return;
+    }
+    update(it->second, -1, 0);
+    sockets_.erase(it);
+  }
+
+  /** @brief Returns the number of connections to a destination */
+  size_t connections(const Key &key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = loads_.find(key);
+    return it == loads_.end() ? 0 : it->second.connections;
+  }
+
+ private:
+  struct Load {
+    size_t connections;
+    /** @brief When the destination was picked last, as value of picks_ */
+    uint64_t picked;
+  };
+
+  void add_unlocked(const Key &key) {
+    if (loads_.emplace(key, Load{0, 0}).second) {
+      order_.emplace(0, 0, key);
+    }
+  }
+
+  // moves the destination to its new place in order_; picked is kept when 0
+  void update(const Key &key, int delta, uint64_t picked) {
+    Load &load = loads_.at(key);
+    order_.erase(std::make_tuple(load.connections, load.picked, key));
+    if (delta < 0 && load.connections > 0) {
+      --load.connections;
+    } else if (delta > 0) {
+      ++load.connections;
+    }
+    if (picked > 0) {
+      load.picked = picked;
+    }
+    order_.emplace(load.connections, load.picked, key);
+  }
+
+  mutable std::mutex mutex_;
+  std::map<Key, Load> loads_;
+  /** @brief (connections, picked, destination), least loaded first */
+  std::set<std::tuple<size_t, uint64_t, Key>> order_;
+  /** @brief Destination of each counted connection */
+  std::map<int, Key> sockets_;
+  uint64_t picks_ = 0;
+};
+
+/** @class DestLeastConnections
+ * @brief Routes to the destination with the fewest connections
+ *
+ * Client connections are long-lived: with round-robin, a destination
+ * which was down gets hardly any of the connections moved away from it
+ * once it is back. DestLeastConnections counts the connections routed to
+ * each destination until they are closed and picks the least loaded
+ * destination which is not quarantined.
+ */
+class DestLeastConnections final : public RouteDestination {
+ public:
+  using RouteDestination::RouteDestination;
+
+  void connection_opened(int sock, const mysqlrouter::TCPAddress &address) noexcept override;
+
+  void connection_closed(int sock) noexcept override;
+
+  /** @brief Returns the number of connections to a destination */
+  size_t get_connections(const mysqlrouter::TCPAddress &address);
+
+ protected:
+  std::vector<size_t> select_candidates(const Snapshot &snapshot, size_t max, uint64_t client_key) override;
+
+  void server_connected(const Snapshot &snapshot, size_t index, int sock,
+                        std::chrono::microseconds connect_time) noexcept override;
+
+ private:
+  /** @brief Connections per destination
+   *
+   * Keyed by address rather than by position: positions change when
+   * destinations are removed, while connections to a destination stay
+   * counted until they are closed, even when it was removed meanwhile.
+   */
+  ConnectionLoad<mysqlrouter::TCPAddress> load_;
+
+  /** @brief Version of the last snapshot whose destinations were added to load_ */
+  std::atomic<uint64_t> counted_version_{0};
+};
+
+#endif // ROUTING_DEST_LEAST_CONNECTIONS_INCLUDED
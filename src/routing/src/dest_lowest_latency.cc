@@ -0,0 +1,48 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_lowest_latency.h"
+
+using mysqlrouter::TCPAddress;
+
+std::vector<size_t> DestLowestLatency::select_candidates(const Snapshot &snapshot, size_t max,
+                                                         uint64_t /* client_key */) {
+  std::vector<size_t> usable;
+  AddrVector addrs;
+  for (size_t i = 0; i < snapshot.destinations.size(); ++i) {
+    if (!snapshot.is_quarantined(i)) {
+      usable.push_back(i);
+      addrs.push_back(snapshot.destinations[i]);
+    }
+  }
+  if (usable.empty()) {
+    return usable;
+  }
+
+  // the picked destination is raced against the ones following it
+  size_t first = latency_.pick(addrs);
+  std::vector<size_t> candidates;
+  for (size_t n = 0; n < usable.size() && candidates.size() < max; ++n) {
+    candidates.push_back(usable[(first + n) % usable.size()]);
+  }
+  return candidates;
+}
+
+void DestLowestLatency::server_connected(const Snapshot &snapshot, size_t index, int sock,
+                                         std::chrono::microseconds connect_time) noexcept {
+  latency_.record(snapshot.destinations[index], connect_time + wait_for_greeting(sock, greeting_timeout_));
+}
@@ -0,0 +1,159 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_DEST_LOWEST_LATENCY_INCLUDED
+#define ROUTING_DEST_LOWEST_LATENCY_INCLUDED
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "destination.h"
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/routing.h"
+
+/** @class LatencyEstimate
+ * @brief Moving average of the latency of each destination
+ *
+ * Destinations are identified by `Key`. Every measurement is added to an
+ * exponentially weighted moving average (EWMA), so that the estimate
+ * follows a destination getting slower or faster.
+ *
+ * Destinations are picked with the power of two choices: out of two
+ * random candidates, the one with the lower estimate. Unlike always
+ * taking the fastest destination, this does not send every connection to
+ * one server while its estimate lags behind. Destinations never measured,
+ * or not for `max_age`, count as fastest so that they are measured again.
+ *
+ * Thread-safe.
+ */
+template <typename Key>
+class LatencyEstimate {
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  /** @brief Constructor
+   *
+   * @param weight weight of a new measurement in the average, between 0 and 1
+   * @param max_age time after which a measurement is outdated
+   */
+  LatencyEstimate(double weight = routing::kLatencyWeight,
+                  std::chrono::milliseconds max_age = routing::kLatencyMaxAge)
+      : weight_(weight), max_age_(max_age) {}
+
+  /** @brief Adds a measurement to the average of a destination */
+  void record(const Key &key, std::chrono::microseconds sample) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = clock_type::now();
+    auto it = estimates_.find(key);
+    if (it == estimates_.end() || now - it->second.updated > max_age_) {
+      estimates_[key] = Estimate{static_cast<double>(sample.count()), now};
+    } else {
+      it->second.average += weight_ * (static_cast<double>(sample.count()) - it->second.average);
+      it->second.updated = now;
+    }
+  }
+
+  /** @brief Returns the estimate of a destination; 0 when unknown or outdated */
+  std::chrono::microseconds get(const Key &key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return get_unlocked(key, clock_type::now());
+  }
+
+  /** @brief Picks the faster of two random candidates
+   *
+   * @param candidates destinations to pick from
+   * @return index in candidates; 0 when there are less than two
+   */
+  size_t pick(const std::vector<Key> &candidates) const {
+    if (candidates.size() < 2) {
+      return 0;
+    }
+    static thread_local std::minstd_rand random(std::random_device{}());
+    size_t first = random() % candidates.size();
+    size_t second = random() % (candidates.size() - 1);
+    if (second >= first) {
+      ++second;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = clock_type::now();
+    return get_unlocked(candidates[second], now) < get_unlocked(candidates[first], now) ? second : first;
+  }
+
+ private:
+  struct Estimate {
+    /** @brief Average in microseconds */
+    double average;
+    clock_type::time_point updated;
+  };
+
+  std::chrono::microseconds get_unlocked(const Key &key, clock_type::time_point now) const {
+    auto it = estimates_.find(key);
+    if (it == estimates_.end() || now - it->second.updated > max_age_) {
+      return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(static_cast<long long>(it->second.average));
+  }
+
+  const double weight_;
+  const std::chrono::milliseconds max_age_;
+
+  mutable std::mutex mutex_;
+  std::map<Key, Estimate> estimates_;
+};
+
+/** @class DestLowestLatency
+ * @brief Routes to destinations answering fast
+ *
+ * Measures the time each connection takes to be established and, for the
+ * classic protocol, to get the server's greeting. Connections go to the
+ * faster of two random destinations which are not quarantined (see
+ * LatencyEstimate).
+ */
+class DestLowestLatency final : public RouteDestination {
+ public:
+  /** @brief Constructor
+   *
+   * @param protocol protocol of the destinations
+   * @param sock_ops socket operations
+   * @param greeting_timeout maximum time to wait for the greeting of a server
+   */
+  DestLowestLatency(Protocol::Type protocol, routing::SocketOperationsBase *sock_ops,
+                    std::chrono::milliseconds greeting_timeout)
+      : RouteDestination(protocol, sock_ops), greeting_timeout_(greeting_timeout) {}
+
+  /** @brief Returns the latency estimate of a destination */
+  std::chrono::microseconds get_latency(const mysqlrouter::TCPAddress &address) const {
+    return latency_.get(address);
+  }
+
+ protected:
+  std::vector<size_t> select_candidates(const Snapshot &snapshot, size_t max, uint64_t client_key) override;
+
+  void server_connected(const Snapshot &snapshot, size_t index, int sock,
+                        std::chrono::microseconds connect_time) noexcept override;
+
+ private:
+  const std::chrono::milliseconds greeting_timeout_;
+
+  LatencyEstimate<mysqlrouter::TCPAddress> latency_;
+};
+
+#endif // ROUTING_DEST_LOWEST_LATENCY_INCLUDED
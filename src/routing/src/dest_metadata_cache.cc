@@ -39,7 +39,6 @@ using std::chrono::duration_cast;
 using std::chrono::system_clock;
 using std::chrono::seconds;
 
-using metadata_cache::lookup_replicaset;
 using metadata_cache::ManagedInstance;
 
 // if client wants a primary and there's none, we can wait up to this amount of
@@ -50,13 +49,14 @@ static const int kPrimaryFailoverTimeout = 10;
 
 DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache, const std::string &replicaset,
   const std::string &mode, const mysqlrouter::URIQuery &query,
-  const Protocol::Type protocol) :
+  const Protocol::Type protocol, routing::RoutingStrategy strategy) :
     RouteDestination(protocol),
     cache_name_(metadata_cache),
     ha_replicaset_(replicaset),
     uri_query_(query),
     allow_primary_reads_(false),
-    current_pos_(0) {
+    primary_reads_fallback_(false),
+    strategy_(strategy) {
   if (mode == "read-only")
     routing_mode_ = ReadOnly;
   else if (mode == "read-write")
@@ -66,30 +66,106 @@ DestMetadataCacheGroup::DestMetadataCacheGroup(const std::string &metadata_cache
   init();
 }
 
-std::vector<mysqlrouter::TCPAddress> DestMetadataCacheGroup::get_available(std::vector<std::string> *server_ids) {
-  auto managed_servers = lookup_replicaset(ha_replicaset_).instance_vector;
-  std::vector<mysqlrouter::TCPAddress> available;
-  for (auto &it: managed_servers) {
+// longest round-robin order computed from the server weights
+static const size_t kMaxScheduleLength = 1000;
+
+// share of connections a server may get off from what its weight asks for
+// before the weights are reported as not followed
+static const double kMaxWeightError = 0.1;
+
+DestMetadataCacheGroup::~DestMetadataCacheGroup() {
+  if (listener_id_ != 0) {
+    try {
+      metadata_cache::remove_topology_listener(listener_id_);
+    } catch (const std::runtime_error &) {
+      // the cache is gone already
+    }
+  }
+}
+
+DestMetadataCacheGroup::RoutingTablePtr DestMetadataCacheGroup::get_routing_table(bool with_primary) {
+  // the Metadata Cache may be started after the route; it can only be
+  // subscribed to once it exists
+  std::call_once(listen_once_, [this] {
+    listener_id_ = metadata_cache::add_topology_listener([this](const metadata_cache::TopologyPtr &topology) {
+      update_routing_tables(topology);
+    });
+  });
+
+  auto topology = metadata_cache::get_topology();
+  auto &cached = routing_tables_[with_primary ? 1 : 0];
+  RoutingTablePtr result = cached.load();
+  if (result && result->version >= topology->version) {
+    return result;
+  }
+
+  // missed a notification; threads racing here compute the same table
+  RoutingTablePtr table = make_routing_table(topology, with_primary);
+  cached.store_if(table, [&table](const RoutingTablePtr &current) {
+    return !current || current->version < table->version;
+  });
+  return table;
+}
+
+void DestMetadataCacheGroup::update_routing_tables(const metadata_cache::TopologyPtr &topology) {
+  for (bool with_primary : {false, true}) {
+    if (with_primary && !primary_reads_fallback_) {
+      continue;
+    }
+    RoutingTablePtr table = make_routing_table(topology, with_primary);
+    // a connection may have computed it already
+    routing_tables_[with_primary ? 1 : 0].store_if(table, [&table](const RoutingTablePtr &current) {
+      return !current || current->version < table->version;
+    });
+  }
+  log_debug("Routing tables for '%s' updated to topology version %llu", ha_replicaset_.c_str(),
+            static_cast<unsigned long long>(topology->version));
+}
+
+DestMetadataCacheGroup::RoutingTablePtr DestMetadataCacheGroup::make_routing_table(
+    const metadata_cache::TopologyPtr &topology, bool with_primary) const {
+  auto table = std::make_shared<RoutingTable>();
+  table->version = topology->version;
+  std::vector<float> weights;
+  metadata_cache::LookupResult lookup(topology, ha_replicaset_);
+  if (!topology->get_replicaset(ha_replicaset_)) {
+    log_warning("Replicaset '%s' not available", ha_replicaset_.c_str());
+  }
+  for (auto &it: lookup.instance_vector) {
     if (!(it.role == "HA")) {
       continue;
     }
     auto port = (protocol_ == Protocol::Type::kXProtocol) ? static_cast<uint16_t>(it.xport) : static_cast<uint16_t>(it.port);
     if (routing_mode_ == RoutingMode::ReadOnly && it.mode == metadata_cache::ServerMode::ReadOnly) {
       // Secondary read-only
-      available.push_back(mysqlrouter::TCPAddress(it.host, port));
-      if (server_ids)
-        server_ids->push_back(it.mysql_server_uuid);
+      table->addresses.push_back(mysqlrouter::TCPAddress(it.host, port));
+      table->server_ids.push_back(it.mysql_server_uuid);
+      weights.push_back(it.weight);
     } else if ((routing_mode_ == RoutingMode::ReadWrite &&
                 it.mode == metadata_cache::ServerMode::ReadWrite) ||
-               allow_primary_reads_) {
+               allow_primary_reads_ || with_primary) {
       // Primary and secondary read-write/write-only
-      available.push_back(mysqlrouter::TCPAddress(it.host, port));
-      if (server_ids)
-        server_ids->push_back(it.mysql_server_uuid);
+      table->addresses.push_back(mysqlrouter::TCPAddress(it.host, port));
+      table->server_ids.push_back(it.mysql_server_uuid);
+      weights.push_back(it.weight);
+    }
+  }
+
+  if (strategy_ == routing::RoutingStrategy::kConsistentHash) {
+    table->ring.assign(table->addresses);
+  } else if (strategy_ != routing::RoutingStrategy::kLeastConnections &&
+             strategy_ != routing::RoutingStrategy::kLowestLatency && !weights.empty()) {
+    double error = 0;
+    table->schedule = smooth_weighted_round_robin(weights, kMaxScheduleLength, &error);
+    if (error > kMaxWeightError) {
+      log_warning("Weights of the servers of '%s' can not be followed: they are used with a precision of 0.1 "
+                  "and a round-robin order of at most %zu connections; some server gets a share of "
+                  "connections off by %.0f%%",
+                  ha_replicaset_.c_str(), kMaxScheduleLength, error * 100);
     }
   }
 
-  return available;
+  return table;
 }
 
 void DestMetadataCacheGroup::init() {
@@ -101,6 +177,8 @@ void DestMetadataCacheGroup::init() {
       std::transform(value.begin(), value.end(), value.begin(), ::tolower);
       if (value == "yes") {
         allow_primary_reads_ = true;
+      } else if (value == "fallback") {
+        primary_reads_fallback_ = true;
       }
     } else {
       log_warning("allow_primary_reads only works with read-only mode");
@@ -108,38 +186,109 @@ void DestMetadataCacheGroup::init() {
   }
 }
 
-int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept {
+int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                              mysqlrouter::TCPAddress *address,
+                                              uint64_t client_key) noexcept {
+  auto deadline = std::chrono::steady_clock::now() + connect_timeout;
+  bool with_primary = false;
   while (true) {
     try {
-      std::vector<std::string> server_ids;
-      auto available = get_available(&server_ids);
+      RoutingTablePtr table = get_routing_table(with_primary);
+      const AddrVector &available = table->addresses;
       if (available.empty()) {
+        if (primary_reads_fallback_ && routing_mode_ == RoutingMode::ReadOnly && !with_primary) {
+          with_primary = true;
+          continue;
+        }
         log_warning("No available %s servers found for '%s'",
             routing_mode_ == RoutingMode::ReadWrite ? "RW" : "RO",
             ha_replicaset_.c_str());
         return -1;
       }
 
-      size_t next_up = 0;
-      {
-        std::lock_guard<std::mutex> lock(mutex_update_);
-        // round-robin between available nodes
-        next_up = current_pos_;
-        if (next_up >= available.size()) {
-          next_up = 0;
-          current_pos_ = 0;
+      // servers at max_connections_per_destination are passed over for the next ones
+      const size_t race_size = max_connections_per_destination_ > 0 ? available.size() : connect_race_size_.load();
+      std::vector<size_t> candidates;
+      AddrVector addrs;
+      if (strategy_ == routing::RoutingStrategy::kLeastConnections) {
+        // race the least loaded servers
+        for (auto &addr : available) {
+          load_.add(addr);
         }
-        ++current_pos_;
-        if (current_pos_ >= available.size()) {
-          current_pos_ = 0;
+        addrs = load_.least_loaded(race_size, [&available](const mysqlrouter::TCPAddress &addr) {
+          return std::find(available.begin(), available.end(), addr) != available.end();
+        });
+        for (auto &addr : addrs) {
+          candidates.push_back(static_cast<size_t>(
+              std::find(available.begin(), available.end(), addr) - available.begin()));
+        }
+      } else if (strategy_ == routing::RoutingStrategy::kConsistentHash) {
+        // race the server owning the client against the ones following it on the ring
+        candidates = table->ring.lookup(client_key, race_size, [](size_t) { return true; });
+        for (size_t i : candidates) {
+          addrs.push_back(available.at(i));
+        }
+      } else {
+        size_t next_up = 0;
+        if (strategy_ == routing::RoutingStrategy::kLowestLatency) {
+          // the faster of two random servers
+          next_up = latency_.pick(available);
+        } else {
+          // round-robin between available nodes by weight
+          next_up = table->schedule[table->next_pos++ % table->schedule.size()];
+        }
+
+        // race the following servers too
+        for (size_t n = 0; n < available.size() && n < race_size; ++n) {
+          candidates.push_back((next_up + n) % available.size());
+          addrs.push_back(available.at(candidates.back()));
         }
       }
 
-      int fd = get_mysql_socket(available.at(next_up), connect_timeout);
-      if (fd < 0) {
+      std::vector<size_t> reserved = reserve_connections(addrs, connect_race_size_);
+      if (reserved.empty()) {
+        if (primary_reads_fallback_ && routing_mode_ == RoutingMode::ReadOnly && !with_primary) {
+          // the secondaries are full; spill over to the primary
+          with_primary = true;
+          continue;
+        }
+        if (wait_for_connection_slot(addrs, deadline)) {
+          with_primary = false;
+          continue;
+        }
+        log_warning("All %s servers of '%s' are at max_connections_per_destination (%zu)",
+                    routing_mode_ == RoutingMode::ReadWrite ? "RW" : "RO", ha_replicaset_.c_str(),
+                    static_cast<size_t>(max_connections_per_destination_));
+        return -1;
+      }
+      if (reserved.size() < addrs.size()) {
+        std::vector<size_t> all_candidates;
+        std::swap(candidates, all_candidates);
+        AddrVector all_addrs;
+        std::swap(addrs, all_addrs);
+        for (size_t r : reserved) {
+          candidates.push_back(all_candidates[r]);
+          addrs.push_back(all_addrs[r]);
+        }
+      }
+
+      size_t winner = 0;
+      std::vector<size_t> failed;
+      auto started = std::chrono::steady_clock::now();
+      int fd = connect_race(addrs, connect_timeout, &winner, &failed);
+      for (size_t i = 0; i < addrs.size(); ++i) {
+        if (fd >= 0 && i == winner) {
+          assign_connection(fd, addrs[i]);
+        } else {
+          release_connection(addrs[i]);
+        }
+      }
+      for (size_t i : failed) {
         // Signal that we can't connect to the instance
-        metadata_cache::mark_instance_reachability(server_ids.at(next_up),
+        metadata_cache::mark_instance_reachability(table->server_ids.at(candidates[i]),
             metadata_cache::InstanceStatus::Unreachable);
+      }
+      if (fd < 0) {
         // if we're looking for a primary member, wait for there to be at least one
         if (routing_mode_ == RoutingMode::ReadWrite &&
             metadata_cache::wait_primary_failover(ha_replicaset_,
@@ -148,6 +297,17 @@ int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_
                    ha_replicaset_.c_str());
           continue; // retry
         }
+      } else {
+        if (strategy_ == routing::RoutingStrategy::kLeastConnections) {
+          load_.opened(fd, addrs[winner]);
+        } else if (strategy_ == routing::RoutingStrategy::kLowestLatency) {
+          auto connect_time = std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - started);
+          latency_.record(addrs[winner], connect_time + wait_for_greeting(fd, connect_timeout));
+        }
+        if (address) {
+          *address = addrs[winner];
+        }
       }
       return fd;
     } catch (std::runtime_error & re) {
@@ -160,3 +320,26 @@ int DestMetadataCacheGroup::get_server_socket(std::chrono::milliseconds connect_
   *error = errno;
   return -1;
 }
+
+void DestMetadataCacheGroup::connection_opened(int sock, const mysqlrouter::TCPAddress &address) noexcept {
+  RouteDestination::connection_opened(sock, address);
+  if (strategy_ == routing::RoutingStrategy::kLeastConnections) {
+    load_.opened(sock, address);
+  }
+}
+
+void DestMetadataCacheGroup::connection_closed(int sock) noexcept {
+  RouteDestination::connection_closed(sock);
+  if (strategy_ == routing::RoutingStrategy::kLeastConnections) {
+    load_.closed(sock);
+  }
+}
+
+bool DestMetadataCacheGroup::is_available(const mysqlrouter::TCPAddress &address) noexcept {
+  try {
+    auto table = get_routing_table();
+    return std::find(table->addresses.begin(), table->addresses.end(), address) != table->addresses.end();
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+}
@@ -19,12 +19,17 @@
 #define ROUTING_DEST_METADATA_CACHE_INCLUDED
 
 #include "destination.h"
+#include "dest_consistent_hash.h"
+#include "dest_least_connections.h"
+#include "dest_lowest_latency.h"
 #include "mysql_routing.h"
 #include "mysqlrouter/uri.h"
+#include "published_ptr.h"
 
 #include <thread>
 
 #include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/metadata_cache.h"
 #include "logger.h"
 
 class DestMetadataCacheGroup final : public RouteDestination {
@@ -39,7 +44,11 @@ public:
                           const std::string &replicaset,
                           const std::string &mode,
                           const mysqlrouter::URIQuery &query,
-                          const Protocol::Type protocol);
+                          const Protocol::Type protocol,
+                          routing::RoutingStrategy strategy = routing::RoutingStrategy::kRoundRobin);
+
+  /** @brief Destructor; stops listening to topology changes */
+  ~DestMetadataCacheGroup() override;
 
   /** @brief Copy constructor */
   DestMetadataCacheGroup(const DestMetadataCacheGroup &other) = delete;
@@ -53,10 +62,19 @@ public:
   /** @brief Move assignment */
   DestMetadataCacheGroup &operator=(DestMetadataCacheGroup &&) = delete;
 
-  int get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept override;
+  int get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                        mysqlrouter::TCPAddress *address = nullptr,
+                        uint64_t client_key = 0) noexcept override;
+
+  /** @brief Returns whether the Metadata Cache lists the destination for our mode */
+  bool is_available(const mysqlrouter::TCPAddress &address) noexcept override;
 
   void add(const std::string &, uint16_t) override { }
 
+  void connection_opened(int sock, const mysqlrouter::TCPAddress &address) noexcept override;
+
+  void connection_closed(int sock) noexcept override;
+
 
   /** @brief Returns whether there are destination servers
    *
@@ -77,7 +95,7 @@ public:
    * Metadata Cache.
    */
   void prepare() noexcept {
-    destinations_ = get_available(nullptr);
+    set_destinations(get_routing_table()->addresses);
   }
 
   /** @brief empty implementation
@@ -124,7 +142,9 @@ private:
    *     ..
    *     destination = metadata_cache:///cluster_name/replicaset_name?allow_primary_reads=yes
    *
-   * The 'allow_primary_reads' is part of uri_query_.
+   * The 'allow_primary_reads' is part of uri_query_. With
+   * `allow_primary_reads=fallback`, reads only go to the primary when no
+   * secondary is available or all are at max_connections_per_destination.
    */
   const mysqlrouter::URIQuery uri_query_;
 
@@ -135,18 +155,74 @@ private:
    */
   void init();
 
+  /** @brief Servers of the replicaset usable for our mode
+   *
+   * Computed once per version of the topology; connections only index
+   * into it.
+   */
+  struct RoutingTable {
+    /** @brief Version of the topology the servers were taken from */
+    uint64_t version;
+    AddrVector addresses;
+    /** @brief Server UUIDs, in the order of addresses */
+    std::vector<std::string> server_ids;
+    /** @brief Smooth weighted round-robin order by server weight, as indexes into addresses
+     *
+     * Only with RoutingStrategy::kRoundRobin.
+     */
+    std::vector<size_t> schedule;
+    /** @brief Position in schedule of the next connection */
+    mutable std::atomic<size_t> next_pos{0};
+    /** @brief Servers placed on the ring, with RoutingStrategy::kConsistentHash */
+    ConsistentHashRing ring;
+  };
+
+  using RoutingTablePtr = std::shared_ptr<const RoutingTable>;
+
   /** @brief Gets available destinations from Metadata Cache
    *
-   * This method gets the destinations using Metadata Cache information. It uses
-   * the `metadata_cache::lookup_replicaset()` function to get a list of current managed
-   * servers.
+   * This method gets the destinations using Metadata Cache information.
+   * Tables are computed again when the Metadata Cache notifies about a
+   * new topology, so connections normally find them up to date.
+   *
+   * @param with_primary whether read-only mode includes the primary
+   */
+  RoutingTablePtr get_routing_table(bool with_primary = false);
+
+  /** @brief Computes the tables for a new topology; called by the Metadata Cache */
+  void update_routing_tables(const metadata_cache::TopologyPtr &topology);
+
+  /** @brief Computes the routing table of a topology
    *
+   * @param topology topology to take the servers from
+   * @param with_primary whether read-only mode includes the primary
    */
-  std::vector<mysqlrouter::TCPAddress> get_available(std::vector<std::string> *server_ids);
+  RoutingTablePtr make_routing_table(const metadata_cache::TopologyPtr &topology, bool with_primary) const;
 
   /** @brief Whether we allow a read operations going to the primary (master) */
   bool allow_primary_reads_;
-  size_t current_pos_;
+  /** @brief Whether reads go to the primary when no secondary takes them */
+  bool primary_reads_fallback_;
+
+  /** @brief Last result of get_routing_table(), without and with the primary
+   *
+   * Read without locking by every connection.
+   */
+  mysql_harness::PublishedPtr<RoutingTable> routing_tables_[2];
+
+  /** @brief Registers the topology listener on first use */
+  std::once_flag listen_once_;
+  /** @brief Id of the topology listener; 0 while not registered */
+  uint64_t listener_id_ = 0;
+
+  /** @brief How the server of a connection is picked among the available ones */
+  const routing::RoutingStrategy strategy_;
+
+  /** @brief Connections per server, with RoutingStrategy::kLeastConnections */
+  ConnectionLoad<mysqlrouter::TCPAddress> load_;
+
+  /** @brief Latency per server, with RoutingStrategy::kLowestLatency */
+  LatencyEstimate<mysqlrouter::TCPAddress> latency_;
 };
 
 
@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <system_error>
 #ifndef _WIN32
 #  include <netdb.h>
 #  include <netinet/tcp.h>
@@ -43,10 +44,10 @@ using std::out_of_range;
 
 // Timeout for trying to connect with quarantined servers
 static constexpr std::chrono::milliseconds kQuarantinedConnectTimeout {1 * 1000};
-// How long we pause before checking quarantined servers again (seconds)
-static const int kQuarantineCleanupInterval = 3;
 // Make sure Quarantine Manager Thread is run even with nothing in quarantine
 static const int kTimeoutQuarantineConditional = 2;
+// Protocol version of the greeting (Handshake V10) of the classic protocol
+static const uint8_t kHandshakeProtocolVersion = 10;
 
 RouteDestination::~RouteDestination() {
 
@@ -57,14 +58,16 @@ RouteDestination::~RouteDestination() {
 }
 
 void RouteDestination::add(const TCPAddress dest) {
-  auto dest_end = destinations_.end();
-
-  auto compare = [&dest](TCPAddress &other) { return dest == other; };
-
-  if (std::find_if(destinations_.begin(), dest_end, compare) == dest_end) {
-    std::lock_guard<std::mutex> lock(mutex_update_);
-    destinations_.push_back(dest);
-  }
+  update_snapshot([&dest](Snapshot &snapshot) {
+    auto &destinations = snapshot.destinations;
+    if (std::find(destinations.begin(), destinations.end(), dest) != destinations.end()) {
+      return false;
+    }
+    destinations.push_back(dest);
+    snapshot.quarantined.push_back(false);
+    ++snapshot.version;
+    return true;
+  });
 }
 
 void RouteDestination::add(const std::string &address, uint16_t port) {
@@ -73,18 +76,29 @@ void RouteDestination::add(const std::string &address, uint16_t port) {
 
 void RouteDestination::remove(const std::string &address, uint16_t port) {
   TCPAddress to_remove(address, port);
-  std::lock_guard<std::mutex> lock(mutex_update_);
-
-  auto func_same = [&to_remove](TCPAddress a) {
-    return (a.addr == to_remove.addr && a.port == to_remove.port);
-  };
-  destinations_.erase(std::remove_if(destinations_.begin(), destinations_.end(), func_same), destinations_.end());
-
+  update_snapshot([&to_remove](Snapshot &snapshot) {
+    bool removed = false;
+    for (size_t i = snapshot.destinations.size(); i-- > 0;) {
+      const TCPAddress &a = snapshot.destinations[i];
+      if (a.addr == to_remove.addr && a.port == to_remove.port) {
+        if (snapshot.quarantined[i]) {
+          --snapshot.num_quarantined;
+        }
+        snapshot.destinations.erase(snapshot.destinations.begin() + static_cast<long>(i));
+        snapshot.quarantined.erase(snapshot.quarantined.begin() + static_cast<long>(i));
+        removed = true;
+      }
+    }
+    if (removed) {
+      ++snapshot.version;
+    }
+    return removed;
+  });
 }
 
 TCPAddress RouteDestination::get(const std::string &address, uint16_t port) {
   TCPAddress needle(address, port);
-  for (auto &it: destinations_) {
+  for (auto &it: snapshot()->destinations) {
     if (it == needle) {
       return it;
     }
@@ -93,63 +107,131 @@ TCPAddress RouteDestination::get(const std::string &address, uint16_t port) {
 }
 
 size_t RouteDestination::size() noexcept {
-  return destinations_.size();
+  return snapshot()->destinations.size();
 }
 
 void RouteDestination::clear() {
-  if (destinations_.empty()) {
-    return;
-  }
+  update_snapshot([](Snapshot &snapshot) {
+    if (snapshot.destinations.empty()) {
+      return false;
+    }
+    uint64_t version = snapshot.version;
+    snapshot = Snapshot();
+    snapshot.version = version + 1;
+    return true;
+  });
+}
+
+void RouteDestination::set_destinations(AddrVector destinations) {
+  update_snapshot([&destinations](Snapshot &snapshot) {
+    snapshot.quarantined.assign(destinations.size(), false);
+    snapshot.num_quarantined = 0;
+    snapshot.destinations = std::move(destinations);
+    ++snapshot.version;
+    return true;
+  });
+}
+
+bool RouteDestination::update_snapshot(const std::function<bool(Snapshot &)> &change) {
   std::lock_guard<std::mutex> lock(mutex_update_);
-  destinations_.clear();
+  std::shared_ptr<Snapshot> copy = std::make_shared<Snapshot>(*snapshot_.load());
+  if (!change(*copy)) {
+    return false;
+  }
+  snapshot_.store(std::move(copy));
+  return true;
 }
 
-int RouteDestination::get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept {
+int RouteDestination::get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                        TCPAddress *address, uint64_t client_key) noexcept {
 
-  if (destinations_.empty()) {
+  SnapshotPtr current = snapshot();
+  if (current->destinations.empty()) {
     log_warning("No destinations currently available for routing");
     return -1;  // no destination is available
   }
 
-  // We start the list at the currently available server
-  for (size_t i = current_pos_;
-       quarantined_.size() < destinations_.size() && i < destinations_.size();
-       i = (i+1) % destinations_.size()) {
+  // We start the list at the currently available server; as long as the
+  // servers tried fail, the next ones are tried
+  auto deadline = std::chrono::steady_clock::now() + connect_timeout;
+  while (true) {
+    // servers at max_connections_per_destination are passed over for the next ones
+    std::vector<size_t> candidates = select_candidates(
+        *current, max_connections_per_destination_ > 0 ? current->destinations.size() : connect_race_size_.load(),
+        client_key);
+    if (candidates.empty()) {
+      break;
+    }
 
-    // If server is quarantined, skip
-    {
-      std::lock_guard<std::mutex> lock(mutex_quarantine_);
-      if (is_quarantined(i)) {
-        continue;
+    AddrVector addrs;
+    for (size_t i : candidates) {
+      addrs.push_back(current->destinations.at(i));
+    }
+    std::vector<size_t> reserved = reserve_connections(addrs, connect_race_size_);
+    if (reserved.empty()) {
+      if (!wait_for_connection_slot(addrs, deadline)) {
+        log_warning("All destinations are at max_connections_per_destination (%zu)",
+                    static_cast<size_t>(max_connections_per_destination_));
+        break;
       }
+      current = snapshot();
+      continue;
     }
 
-    // Try server
-    TCPAddress addr;
-    addr = destinations_.at(i);
-    log_debug("Trying server %s (index %d)", addr.str().c_str(), i);
-    auto sock = get_mysql_socket(addr, connect_timeout);
-
-    if (sock >= 0) {
-      // Server is available
-      current_pos_ = (i + 1) % destinations_.size(); // Reset to 0 when current_pos_ == size()
-      return sock;
-    } else {
+    // Try servers
+    std::vector<size_t> all_candidates;
+    std::swap(candidates, all_candidates);
+    addrs.clear();
+    for (size_t r : reserved) {
+      candidates.push_back(all_candidates[r]);
+      addrs.push_back(current->destinations.at(candidates.back()));
+      log_debug("Trying server %s (index %d)", addrs.back().str().c_str(), candidates.back());
+    }
+    size_t winner = 0;
+    std::vector<size_t> failed;
+    auto started = std::chrono::steady_clock::now();
+    auto sock = connect_race(addrs, connect_timeout, &winner, &failed);
 #ifndef _WIN32
-      *error = errno;
+    int connect_error = errno;
 #else
-      *error = WSAGetLastError();
+    int connect_error = WSAGetLastError();
 #endif
-      if (errno != ENFILE && errno != EMFILE) {
-        // We failed to get a connection to the server; we quarantine.
-        std::lock_guard<std::mutex> lock(mutex_quarantine_);
-        add_to_quarantine(i);
-        if (quarantined_.size() == destinations_.size()) {
-          log_debug("No more destinations: all quarantined");
-          break;
-        }
-        continue; // try another destination
+
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      if (sock >= 0 && i == winner) {
+        assign_connection(sock, addrs[i]);
+      } else {
+        release_connection(addrs[i]);
       }
+    }
+
+    // out of file descriptors: the servers are not to blame
+    if (sock < 0 && (connect_error == ENFILE || connect_error == EMFILE)) {
+      *error = connect_error;
+      break;
+    }
+
+    // We failed to get a connection to these servers; we quarantine.
+    for (size_t i : failed) {
+      set_quarantined(addrs[i], true);
+    }
+
+    if (sock >= 0) {
+      // Server is available
+      server_connected(*current, candidates[winner], sock,
+                       std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - started));
+      if (address) *address = addrs[winner];
+      return sock;
+    }
+
+    *error = connect_error;
+    if (failed.empty()) {
+      break;
+    }
+    current = snapshot();
+    if (current->num_quarantined == current->destinations.size()) {
+      log_debug("No more destinations: all quarantined");
       break;
     }
   }
@@ -158,54 +240,414 @@ int RouteDestination::get_server_socket(std::chrono::milliseconds connect_timeou
   return -1; // no destination is available
 }
 
+std::vector<size_t> RouteDestination::select_candidates(const Snapshot &snapshot, size_t max,
+                                                        uint64_t /* client_key */) {
+  std::vector<size_t> candidates;
+  const size_t size = snapshot.destinations.size();
+  if (size == 0) {
+    return candidates;
+  }
+  // If server is quarantined, skip
+  for (size_t n = 0, i = current_pos_ % size; n < size && candidates.size() < max; ++n, i = (i + 1) % size) {
+    if (!snapshot.is_quarantined(i)) {
+      candidates.push_back(i);
+    }
+  }
+  return candidates;
+}
+
+void RouteDestination::server_connected(const Snapshot &snapshot, size_t index, int /* sock */,
+                                        std::chrono::microseconds /* connect_time */) noexcept {
+  current_pos_ = (index + 1) % snapshot.destinations.size(); // Reset to 0 when current_pos_ == size()
+}
+
+std::chrono::microseconds RouteDestination::wait_for_greeting(int sock, std::chrono::milliseconds timeout) noexcept {
+  if (protocol_ != Protocol::Type::kClassicProtocol) {
+    return std::chrono::microseconds(0);
+  }
+  auto started = std::chrono::steady_clock::now();
+  struct pollfd fds[] = {
+    {sock, POLLIN, 0},
+  };
+  socket_operations_->poll(fds, 1, timeout);
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+}
+
+void RouteDestination::connection_opened(int sock, const TCPAddress &address) noexcept {
+  if (max_connections_per_destination_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  // get_server_socket() counted it already
+  if (connection_destinations_.emplace(sock, address).second) {
+    ++open_connections_[address];
+  }
+}
+
+void RouteDestination::connection_closed(int sock) noexcept {
+  {
+    std::lock_guard<std::mutex> lock(mutex_connections_);
+    auto it = connection_destinations_.find(sock);
+    if (it == connection_destinations_.end()) {
+      return;
+    }
+    auto count = open_connections_.find(it->second);
+    if (count != open_connections_.end() && --count->second == 0) {
+      open_connections_.erase(count);
+    }
+    connection_destinations_.erase(it);
+  }
+  condvar_connections_.notify_all();
+}
+
+bool RouteDestination::below_connection_cap(const TCPAddress &address) const noexcept {
+  const size_t max = max_connections_per_destination_;
+  if (max == 0) {
+    return true;
+  }
+  return get_open_connections(address) < max;
+}
+
+size_t RouteDestination::get_open_connections(const TCPAddress &address) const noexcept {
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  auto it = open_connections_.find(address);
+  return it == open_connections_.end() ? 0 : it->second;
+}
+
+std::vector<size_t> RouteDestination::reserve_connections(const AddrVector &addrs, size_t max) noexcept {
+  std::vector<size_t> reserved;
+  const size_t cap = max_connections_per_destination_;
+  if (cap == 0) {
+    // nothing to count; keep connects free of the lock
+    for (size_t i = 0; i < addrs.size() && reserved.size() < max; ++i) {
+      reserved.push_back(i);
+    }
+    return reserved;
+  }
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  for (size_t i = 0; i < addrs.size() && reserved.size() < max; ++i) {
+    size_t &count = open_connections_[addrs[i]];
+    if (count >= cap) {
+      continue;
+    }
+    ++count;
+    reserved.push_back(i);
+  }
+  return reserved;
+}
+
+void RouteDestination::release_connection(const TCPAddress &address) noexcept {
+  if (max_connections_per_destination_ == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_connections_);
+    auto count = open_connections_.find(address);
+    if (count != open_connections_.end() && count->second > 0 && --count->second == 0) {
+      open_connections_.erase(count);
+    }
+  }
+  condvar_connections_.notify_all();
+}
+
+void RouteDestination::assign_connection(int sock, const TCPAddress &address) noexcept {
+  if (max_connections_per_destination_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_connections_);
+  auto res = connection_destinations_.emplace(sock, address);
+  if (!res.second) {
+    // the socket was closed without being reported
+    auto count = open_connections_.find(res.first->second);
+    if (count != open_connections_.end() && count->second > 0) {
+      --count->second;
+    }
+    res.first->second = address;
+  }
+}
+
+bool RouteDestination::wait_for_connection_slot(const AddrVector &addrs,
+                                                std::chrono::steady_clock::time_point deadline) noexcept {
+  if (max_connections_per_destination_ == 0) {
+    return !stopping_;
+  }
+  std::unique_lock<std::mutex> lock(mutex_connections_);
+  return condvar_connections_.wait_until(lock, deadline, [this, &addrs] {
+    const size_t cap = max_connections_per_destination_;
+    return stopping_ || std::any_of(addrs.begin(), addrs.end(), [this, cap](const TCPAddress &addr) {
+      auto it = open_connections_.find(addr);
+      return cap == 0 || it == open_connections_.end() || it->second < cap;
+    });
+  }) && !stopping_;
+}
+
+bool RouteDestination::is_available(const TCPAddress &address) noexcept {
+  SnapshotPtr current = snapshot();
+  for (size_t i = 0; i < current->destinations.size(); ++i) {
+    if (current->destinations[i] == address) {
+      return !current->is_quarantined(i);
+    }
+  }
+  return false;
+}
+
 int RouteDestination::get_mysql_socket(const TCPAddress &addr, const std::chrono::milliseconds connect_timeout, const bool log_errors) {
+  if (preconnect_pool_) {
+    int sock = preconnect_pool_->take(addr);
+    if (sock >= 0) {
+      return sock;
+    }
+  }
   return socket_operations_->get_mysql_socket(addr, connect_timeout, log_errors);
 }
 
+int RouteDestination::connect_race(const AddrVector &addrs, std::chrono::milliseconds connect_timeout,
+                                   size_t *winner, std::vector<size_t> *failed) {
+  if (addrs.size() == 1) {
+    int sock = get_mysql_socket(addrs.front(), connect_timeout);
+    if (sock >= 0) {
+      *winner = 0;
+    } else {
+      failed->push_back(0);
+    }
+    return sock;
+  }
+
+  if (preconnect_pool_) {
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      int sock = preconnect_pool_->take(addrs[i]);
+      if (sock >= 0) {
+        *winner = i;
+        return sock;
+      }
+    }
+  }
+  return socket_operations_->connect_race(addrs, connect_timeout, routing::kConnectRaceDelay, winner, failed);
+}
+
+void RouteDestination::enable_preconnect_pool(size_t max_size, std::chrono::milliseconds connect_timeout,
+                                              std::chrono::milliseconds max_age) {
+  preconnect_pool_.reset(new PreconnectPool(socket_operations_, max_size, connect_timeout, max_age));
+  preconnect_pool_->start();
+}
+
 void RouteDestination::add_to_quarantine(const size_t index) noexcept {
   assert(index < size());
-  if (index >= size()) {
+  SnapshotPtr current = snapshot();
+  if (index >= current->destinations.size()) {
     log_debug("Impossible server being quarantined (index %d)", index);
     return;
   }
-  if (!is_quarantined(index)) {
-    log_debug("Quarantine destination server %s (index %d)", destinations_.at(index).str().c_str(), index);
-    quarantined_.push_back(index);
+  set_quarantined(current->destinations[index], true);
+}
+
+bool RouteDestination::set_quarantined(const TCPAddress &address, bool quarantined) noexcept {
+  size_t index = 0;
+  bool changed = update_snapshot([&](Snapshot &snapshot) {
+    auto it = std::find(snapshot.destinations.begin(), snapshot.destinations.end(), address);
+    if (it == snapshot.destinations.end()) {
+      return false;
+    }
+    index = static_cast<size_t>(it - snapshot.destinations.begin());
+    if (snapshot.quarantined[index] == quarantined) {
+      return false;
+    }
+    snapshot.quarantined[index] = quarantined;
+    if (quarantined) {
+      ++snapshot.num_quarantined;
+    } else {
+      --snapshot.num_quarantined;
+    }
+    return true;
+  });
+  if (!changed) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_probe_schedule_);
+    if (quarantined) {
+      probe_schedule_[address] = ProbeSchedule{
+          0, std::chrono::steady_clock::now() + backoff_with_jitter(0, routing::kQuarantineProbeInterval,
+                                                                    routing::kMaxQuarantineProbeInterval)};
+    } else {
+      probe_schedule_.erase(address);
+    }
+  }
+
+  if (quarantined) {
+    log_debug("Quarantine destination server %s (index %d)", address.str().c_str(), index);
+    if (preconnect_pool_) {
+      preconnect_pool_->discard(address);
+    }
     condvar_quarantine_.notify_one();
+  } else {
+    log_debug("Unquarantine destination server %s (index %d)", address.str().c_str(), index);
+    if (preconnect_pool_) {
+      preconnect_pool_->resume(address);
+    }
   }
+  return true;
 }
 
 void RouteDestination::cleanup_quarantine() noexcept {
+  probe_quarantined(false);
+}
 
-  mutex_quarantine_.lock();
+void RouteDestination::probe_quarantined(bool only_due) noexcept {
+  // We work on a snapshot; updating the current one
+  SnapshotPtr current = snapshot();
   // Nothing to do when nothing quarantined
-  if (quarantined_.empty()) {
-    mutex_quarantine_.unlock();
+  if (current->num_quarantined == 0) {
     return;
   }
-  // We work on a copy; updating the original
-  auto cpy_quarantined(quarantined_);
-  mutex_quarantine_.unlock();
 
-  for (auto it = cpy_quarantined.begin(); it != cpy_quarantined.end(); ++it) {
-    if (stopping_) {
-      return;
+  auto now = std::chrono::steady_clock::now();
+  AddrVector due;
+  {
+    std::lock_guard<std::mutex> lock(mutex_probe_schedule_);
+    // forget destinations removed while quarantined
+    for (auto it = probe_schedule_.begin(); it != probe_schedule_.end();) {
+      auto found = std::find(current->destinations.begin(), current->destinations.end(), it->first);
+      if (found == current->destinations.end() ||
+          !current->is_quarantined(static_cast<size_t>(found - current->destinations.begin()))) {
+        it = probe_schedule_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (size_t i = 0; i < current->destinations.size(); ++i) {
+      if (!current->is_quarantined(i)) {
+        continue;
+      }
+      // ejected outliers stay out of rotation for the whole ejection
+      if (outlier_detector_.is_ejected(current->destinations[i], now)) {
+        continue;
+      }
+      auto it = probe_schedule_.find(current->destinations[i]);
+      if (!only_due || it == probe_schedule_.end() || it->second.next <= now) {
+        due.push_back(current->destinations[i]);
+      }
+    }
+  }
+
+  if (due.empty() || stopping_) {
+    return;
+  }
+
+  std::vector<bool> alive = probe(due);
+  for (size_t i = 0; i < due.size(); ++i) {
+    if (alive[i]) {
+      set_quarantined(due[i], false);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex_probe_schedule_);
+    auto it = probe_schedule_.find(due[i]);
+    if (it != probe_schedule_.end()) {
+      ++it->second.failures;
+      it->second.next = std::chrono::steady_clock::now() +
+                        backoff_with_jitter(it->second.failures, routing::kQuarantineProbeInterval,
+                                            routing::kMaxQuarantineProbeInterval);
+    }
+  }
+}
+
+std::vector<bool> RouteDestination::probe(const AddrVector &addrs) noexcept {
+  // a server not answering does not delay the probes of the others
+  std::vector<int> socks = socket_operations_->connect_all(addrs, kQuarantinedConnectTimeout, false);
+  std::vector<bool> alive(addrs.size(), false);
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    alive[i] = socks[i] >= 0;
+  }
+
+  if (quarantine_probe_ == routing::QuarantineProbe::kGreeting && protocol_ == Protocol::Type::kClassicProtocol) {
+    // packet header, then the protocol version of the greeting; an error
+    // packet starts with 0xff instead
+    struct Greeting {
+      uint8_t buffer[5];
+      size_t received;
+    };
+    std::vector<Greeting> greetings(addrs.size(), Greeting{{0}, 0});
+    std::vector<size_t> waiting;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      if (alive[i]) {
+        waiting.push_back(i);
+      }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + kQuarantinedConnectTimeout;
+    std::vector<struct pollfd> fds;
+    while (!waiting.empty()) {
+      auto now = std::chrono::steady_clock::now();
+      fds.clear();
+      for (size_t i : waiting) {
+        fds.push_back({socks[i], POLLIN, 0});
+      }
+      if (now >= deadline ||
+          socket_operations_->poll(fds.data(), static_cast<nfds_t>(fds.size()),
+                                   std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now)) <= 0) {
+        break;
+      }
+
+      std::vector<size_t> still_waiting;
+      for (size_t n = 0; n < waiting.size(); ++n) {
+        size_t i = waiting[n];
+        Greeting &greeting = greetings[i];
+        if (fds[n].revents != 0) {
+          ssize_t res = socket_operations_->read(socks[i], greeting.buffer + greeting.received,
+                                                 sizeof(greeting.buffer) - greeting.received);
+          if (res <= 0) {
+            continue;
+          }
+          greeting.received += static_cast<size_t>(res);
+        }
+        if (greeting.received < sizeof(greeting.buffer)) {
+          still_waiting.push_back(i);
+        }
+      }
+      std::swap(waiting, still_waiting);
     }
 
-    auto addr = destinations_.at(*it);
-    auto sock = get_mysql_socket(addr, kQuarantinedConnectTimeout, false);
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      if (!alive[i]) {
+        continue;
+      }
+      alive[i] = greetings[i].received == sizeof(greetings[i].buffer) &&
+                 greetings[i].buffer[4] == kHandshakeProtocolVersion;
+      if (!alive[i]) {
+        log_debug("Destination server %s did not greet", addrs[i].str().c_str());
+      }
+    }
+  }
 
+  for (int sock : socks) {
     if (sock >= 0) {
-#ifndef _WIN32
-      shutdown(sock, SHUT_RDWR);
-      close(sock);
-#else
-      shutdown(sock, SD_BOTH);
-      closesocket(sock);
-#endif
-      log_debug("Unquarantine destination server %s (index %d)", addr.str().c_str(), *it);
-      std::lock_guard<std::mutex> lock(mutex_quarantine_);
-      quarantined_.erase(std::remove(quarantined_.begin(), quarantined_.end(), *it));
+      socket_operations_->shutdown(sock);
+      socket_operations_->close(sock);
+    }
+  }
+  return alive;
+}
+
+void RouteDestination::report_success(const TCPAddress &address, std::chrono::microseconds greeting_time) noexcept {
+  eject(outlier_detector_.record_success(address, greeting_time, snapshot()->destinations.size()));
+}
+
+void RouteDestination::report_failure(const TCPAddress &address) noexcept {
+  eject(outlier_detector_.record_failure(address, snapshot()->destinations.size()));
+}
+
+void RouteDestination::eject(const std::vector<OutlierDetector::Ejection> &ejections) noexcept {
+  for (const auto &ejection : ejections) {
+    log_info("Ejecting destination server %s for %llds: failing or slow compared to the others",
+             ejection.address.str().c_str(),
+             static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(ejection.duration).count()));
+    // it may be quarantined already
+    set_quarantined(ejection.address, true);
+    std::lock_guard<std::mutex> lock(mutex_probe_schedule_);
+    auto it = probe_schedule_.find(ejection.address);
+    if (it != probe_schedule_.end()) {
+      it->second.next = std::max(it->second.next, std::chrono::steady_clock::now() + ejection.duration);
     }
   }
 }
@@ -215,18 +657,27 @@ void RouteDestination::quarantine_manager_thread() noexcept {
 
   std::unique_lock<std::mutex> lock(mutex_quarantine_manager_);
   while (!stopping_) {
-    condvar_quarantine_.wait_for(lock, std::chrono::seconds(kTimeoutQuarantineConditional),
-                                 [this] { return !quarantined_.empty(); });
+    // sleep until the next probe is due
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::seconds(kTimeoutQuarantineConditional));
+    if (snapshot()->num_quarantined > 0) {
+      std::lock_guard<std::mutex> schedule_lock(mutex_probe_schedule_);
+      auto now = std::chrono::steady_clock::now();
+      for (const auto &it : probe_schedule_) {
+        auto until = std::chrono::duration_cast<std::chrono::milliseconds>(it.second.next - now);
+        wait = std::max(std::chrono::milliseconds(0), std::min(wait, until));
+      }
+    }
+    if (wait > std::chrono::milliseconds(0)) {
+      condvar_quarantine_.wait_for(lock, wait);
+    }
 
     if (!stopping_) {
-      cleanup_quarantine();
-      // Temporize
-      std::this_thread::sleep_for(std::chrono::seconds(kQuarantineCleanupInterval));
+      probe_quarantined(true);
     }
   }
 }
 
 size_t RouteDestination::size_quarantine() {
-  std::lock_guard<std::mutex> lock(mutex_quarantine_);
-  return quarantined_.size();
+  return snapshot()->num_quarantined;
 }
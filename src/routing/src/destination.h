@@ -24,6 +24,9 @@
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -32,7 +35,10 @@
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/routing.h"
 #include "logger.h"
+#include "outlier_detector.h"
+#include "preconnect_pool.h"
 #include "protocol/protocol.h"
+#include "published_ptr.h"
 
 /** @class RouteDestination
  * @brief Manage destinations for a Connection Routing
@@ -45,17 +51,52 @@
  * RouteDestination is meant to be a base class and used to inherite and
  * create class which change the behavior. For example, the `get_next()`
  * method is usually changed to get the next server in the list.
+ *
+ * The destinations and their quarantine state are published as immutable
+ * snapshots: changes copy the current Snapshot, modify the copy and swap it
+ * in with a mysql_harness::PublishedPtr, so that get_server_socket() picks
+ * destinations without locking.
+ * Counting connections for max_connections_per_destination and reporting
+ * them to the OutlierDetector still take their own mutexes.
  */
 class RouteDestination {
 public:
 
   using AddrVector = std::vector<mysqlrouter::TCPAddress>;
 
+  /** @brief Destinations and the quarantined ones among them
+   *
+   * Never changed once published.
+   */
+  struct Snapshot {
+    /** @brief List of destinations */
+    AddrVector destinations;
+
+    /** @brief Bit per destination, set while it is quarantined */
+    std::vector<bool> quarantined;
+
+    /** @brief Number of bits set in `quarantined` */
+    size_t num_quarantined = 0;
+
+    /** @brief Incremented whenever `destinations` changes */
+    uint64_t version = 0;
+
+    bool is_quarantined(size_t index) const noexcept {
+      return index < quarantined.size() && quarantined[index];
+    }
+  };
+
+  using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
   /** @brief Default constructor */
   RouteDestination(Protocol::Type protocol = Protocol::get_default(),
                    routing::SocketOperationsBase *sock_ops =
                      routing::SocketOperations::instance()) // default = "real" (not mock) implementation
-      : current_pos_(0), stopping_(false), socket_operations_(sock_ops), protocol_(protocol) {}
+      : snapshot_(std::make_shared<Snapshot>()), current_pos_(0), stopping_(false),
+        socket_operations_(sock_ops), protocol_(protocol),
+        connect_race_size_(routing::kDefaultConnectRaceSize),
+        quarantine_probe_(routing::QuarantineProbe::kConnect),
+        max_connections_per_destination_(routing::kDefaultMaxConnectionsPerDestination) {}
 
   /** @brief Destructor */
   virtual ~RouteDestination();
@@ -116,9 +157,47 @@ public:
    *
    * @param connect_timeout timeout
    * @param error Pointer to int for storing errno
+   * @param address Pointer to store the address of the destination the
+   *        returned socket is connected to (optional)
+   * @param client_key hash identifying the client, see client_key()
    * @return a socket descriptor
    */
-  virtual int get_server_socket(std::chrono::milliseconds connect_timeout, int *error) noexcept;
+  virtual int get_server_socket(std::chrono::milliseconds connect_timeout, int *error,
+                                mysqlrouter::TCPAddress *address = nullptr,
+                                uint64_t client_key = 0) noexcept;
+
+  /** @brief Tells the destination that a client uses a server connection
+   *
+   * get_server_socket() calls it for the connections it returns; callers
+   * call it for connections obtained otherwise.
+   *
+   * Overrides must call it, as it counts the connection against
+   * the maximum set with set_max_connections_per_destination().
+   *
+   * @param sock socket connected to the destination
+   * @param address the destination
+   */
+  virtual void connection_opened(int sock, const mysqlrouter::TCPAddress &address) noexcept;
+
+  /** @brief Tells the destination that a server connection is no longer used
+   *
+   * Called before the socket is closed. Sockets not passed to
+   * connection_opened() are ignored.
+   * Overrides must call it.
+   *
+   * @param sock socket connected to the destination
+   */
+  virtual void connection_closed(int sock) noexcept;
+
+  /** @brief Returns whether a destination would currently be used
+   *
+   * Used to check whether a connection established earlier to the given
+   * destination may still be handed to a client.
+   *
+   * @param address destination to check
+   * @return true when the destination is in the list and not quarantined
+   */
+  virtual bool is_available(const mysqlrouter::TCPAddress &address) noexcept;
 
   /** @brief Gets the number of destinations
    *
@@ -133,7 +212,7 @@ public:
    * @return whether the destination is empty
    */
   virtual bool empty() const noexcept {
-    return destinations_.empty();
+    return snapshot()->destinations.empty();
   }
 
   /** @brief Returns number of quarantined servers
@@ -153,20 +232,107 @@ public:
     }
   }
 
-  AddrVector::iterator begin() {
-    return destinations_.begin();
+  /** @brief Keeps connections to the destinations ready for use
+   *
+   * Starts a PreconnectPool; get_mysql_socket() takes connections out of it
+   * before connecting on its own.
+   *
+   * @param max_size maximum number of connections kept per destination
+   * @param connect_timeout timeout connecting to a destination
+   * @param max_age time after which connections which were not used are closed
+   */
+  void enable_preconnect_pool(size_t max_size, std::chrono::milliseconds connect_timeout,
+                              std::chrono::milliseconds max_age = PreconnectPool::kDefaultMaxAge);
+
+  /** @brief Returns the pool of connections, or nullptr when not enabled */
+  const PreconnectPool *get_preconnect_pool() const noexcept {
+    return preconnect_pool_.get();
+  }
+
+  /** @brief Sets the number of destinations connected to at the same time
+   *
+   * get_server_socket() starts connecting to the next destination when the
+   * previous ones did not answer within routing::kConnectRaceDelay, so that
+   * an unresponsive server does not delay the client for the whole connect
+   * timeout.
+   *
+   * @param size number of destinations; 1 tries them one after the other
+   */
+  void set_connect_race_size(size_t size) noexcept {
+    connect_race_size_ = size < 1 ? 1 : size;
+  }
+
+  size_t get_connect_race_size() const noexcept {
+    return connect_race_size_;
+  }
+
+  /** @brief Sets how quarantined destinations are checked for recovery
+   *
+   * @param probe quarantine probe; see routing::QuarantineProbe
+   */
+  void set_quarantine_probe(routing::QuarantineProbe probe) noexcept {
+    quarantine_probe_ = probe;
+  }
+
+  routing::QuarantineProbe get_quarantine_probe() const noexcept {
+    return quarantine_probe_;
+  }
+
+  /** @brief Sets the maximum number of connections routed to one destination
+   *
+   * Destinations at the maximum are passed over for the next ones. When
+   * all are at the maximum, get_server_socket() waits up to its connect
+   * timeout for a connection to one of them to close. Connections are
+   * only counted while a maximum is set.
+   *
+   * @param max maximum number of connections; 0 for no maximum
+   */
+  void set_max_connections_per_destination(size_t max) noexcept {
+    max_connections_per_destination_ = max;
+  }
+
+  size_t get_max_connections_per_destination() const noexcept {
+    return max_connections_per_destination_;
   }
 
-  AddrVector::const_iterator begin() const {
-    return destinations_.begin();
+  /** @brief Returns whether another connection may be routed to a destination */
+  bool below_connection_cap(const mysqlrouter::TCPAddress &address) const noexcept;
+
+  /** @brief Returns the number of connections counted for a destination */
+  size_t get_open_connections(const mysqlrouter::TCPAddress &address) const noexcept;
+
+  /** @brief Returns the current destinations and their quarantine state */
+  SnapshotPtr snapshot() const noexcept {
+    return snapshot_.load();
   }
 
-  AddrVector::iterator end() {
-    return destinations_.end();
+  /** @brief Returns a copy of the list of destinations */
+  AddrVector get_destinations() const {
+    return snapshot()->destinations;
   }
 
-  AddrVector::const_iterator end() const {
-    return destinations_.end();
+  /** @brief Reports that a destination greeted a client in time
+   *
+   * Destinations failing or slow compared to the others are quarantined
+   * for a while; see OutlierDetector.
+   *
+   * @param address the destination
+   * @param greeting_time time from connecting to the greeting
+   */
+  void report_success(const mysqlrouter::TCPAddress &address, std::chrono::microseconds greeting_time) noexcept;
+
+  /** @brief Reports that a destination failed a client
+   *
+   * The destination did not greet the client, refused it with an error
+   * or disconnected it right after the handshake.
+   *
+   * @param address the destination
+   */
+  void report_failure(const mysqlrouter::TCPAddress &address) noexcept;
+
+  /** @brief Returns the counters of the outlier detection */
+  OutlierDetector::Stats get_outlier_stats() const {
+    return outlier_detector_.get_stats();
   }
 
 protected:
@@ -179,9 +345,44 @@ protected:
    * @return True if destination is quarantined
    */
   virtual bool is_quarantined(const size_t index) {
-    return std::find(quarantined_.begin(), quarantined_.end(), index) != quarantined_.end();
+    return snapshot()->is_quarantined(index);
   }
 
+  /** @brief Picks the destinations get_server_socket() tries next
+   *
+   * Called concurrently, without locks held. By default, the round-robin
+   * continues at `current_pos_`, skipping quarantined destinations.
+   *
+   * @param snapshot destinations to pick from
+   * @param max maximum number of destinations to pick
+   * @param client_key hash identifying the client
+   * @return indexes in `snapshot.destinations`, most preferred first
+   */
+  virtual std::vector<size_t> select_candidates(const Snapshot &snapshot, size_t max, uint64_t client_key);
+
+  /** @brief Called when get_server_socket() connected to a destination
+   *
+   * By default, the round-robin continues after the destination.
+   *
+   * @param snapshot destinations the destination was picked from
+   * @param index index of the destination in `snapshot.destinations`
+   * @param sock socket connected to the destination
+   * @param connect_time time it took to connect
+   */
+  virtual void server_connected(const Snapshot &snapshot, size_t index, int sock,
+                                std::chrono::microseconds connect_time) noexcept;
+
+  /** @brief Waits for a server to send its greeting
+   *
+   * Only servers speaking the classic protocol talk first; for others,
+   * it returns right away. The greeting is left to be read by the caller.
+   *
+   * @param sock socket connected to the server
+   * @param timeout maximum time to wait
+   * @return time waited
+   */
+  std::chrono::microseconds wait_for_greeting(int sock, std::chrono::milliseconds timeout) noexcept;
+
   /** @brief Adds server to quarantine
    *
    * Adds the given server address to the quarantine list. The index argument
@@ -191,28 +392,100 @@ protected:
    */
   virtual void add_to_quarantine(size_t index) noexcept;
 
-  /** @brief Worker checking and removing servers from quarantine
+  /** @brief Quarantines a destination or takes it out of quarantine
    *
-   * This method is meant to run in a thread and calling the
-   * `cleanup_quarantine()` method.
+   * Destinations no longer in the list are ignored.
    *
-   * The caller is responsible for locking and unlocking the
-   * mutex `mutex_quarantine_`.
+   * @param address the destination
+   * @param quarantined whether the destination is to be quarantined
+   * @return whether the quarantine state of the destination changed
+   */
+  bool set_quarantined(const mysqlrouter::TCPAddress &address, bool quarantined) noexcept;
+
+  /** @brief Replaces the list of destinations; none is quarantined */
+  void set_destinations(AddrVector destinations);
+
+  /** @brief Publishes a changed copy of the current snapshot
    *
+   * @param change modifies the copy; returns false to leave the current
+   *        snapshot in place
+   * @return whether a new snapshot was published
    */
-  virtual void quarantine_manager_thread() noexcept;
+  bool update_snapshot(const std::function<bool(Snapshot &)> &change);
 
-  /** @brief Checks and removes servers from quarantine
+  /** @brief Worker checking and removing servers from quarantine
    *
-   * This method removes servers from quarantine while trying to establish
-   * a connection. It is used in a seperate thread and will update the
-   * quarantine list, and will keep trying until the list is empty.
+   * This method is meant to run in a thread. It sleeps until the next
+   * probe of a quarantined server is due and calls `probe_quarantined()`.
    * A conditional variable is used to notify the thread servers were
    * quarantined.
+   */
+  virtual void quarantine_manager_thread() noexcept;
+
+  /** @brief Checks and removes servers from quarantine
    *
+   * Probes all quarantined servers at once, regardless of when their next
+   * probe is due.
    */
   virtual void cleanup_quarantine() noexcept;
 
+  /** @brief Probes quarantined servers at the same time
+   *
+   * Servers which pass probe() are taken out of quarantine. For the
+   * others, the time until the next probe backs off exponentially, with
+   * jitter, from routing::kQuarantineProbeInterval up to
+   * routing::kMaxQuarantineProbeInterval.
+   *
+   * @param only_due whether to skip servers whose next probe is not due yet
+   */
+  void probe_quarantined(bool only_due) noexcept;
+
+  /** @brief Checks whether quarantined servers are back
+   *
+   * Connects to all servers at the same time with
+   * SocketOperationsBase::connect_all(). With
+   * routing::QuarantineProbe::kGreeting, a server speaking the classic
+   * protocol must also send its greeting in time; the greetings are
+   * waited for with a single poll().
+   *
+   * @param addrs the servers
+   * @return whether each server of `addrs` may be taken out of quarantine
+   */
+  virtual std::vector<bool> probe(const AddrVector &addrs) noexcept;
+
+  /** @brief Reserves connections to the first destinations below their maximum
+   *
+   * Each reservation is either turned into a counted connection with
+   * assign_connection() or given back with release_connection().
+   *
+   * @param addrs destinations, most preferred first
+   * @param max maximum number of destinations to reserve
+   * @return indexes in `addrs` of the reserved destinations
+   */
+  std::vector<size_t> reserve_connections(const AddrVector &addrs, size_t max) noexcept;
+
+  /** @brief Gives back a reservation of reserve_connections() */
+  void release_connection(const mysqlrouter::TCPAddress &address) noexcept;
+
+  /** @brief Counts a reserved connection until connection_closed() */
+  void assign_connection(int sock, const mysqlrouter::TCPAddress &address) noexcept;
+
+  /** @brief Waits until one of the destinations is below its maximum
+   *
+   * @param addrs the destinations
+   * @param deadline when to give up
+   * @return whether one of them is below its maximum
+   */
+  bool wait_for_connection_slot(const AddrVector &addrs, std::chrono::steady_clock::time_point deadline) noexcept;
+
+  /** @brief Quarantines outliers until their ejection is over
+   *
+   * They are not probed before.
+   *
+   * @param ejections destinations returned by the OutlierDetector
+   */
+  void eject(const std::vector<OutlierDetector::Ejection> &ejections) noexcept;
+
   /** @brief Returns socket descriptor of connected MySQL server
    *
    * Returns a socket descriptor for the connection to the MySQL Server or
@@ -220,7 +493,8 @@ protected:
    *
    * This method normally calls SocketOperations::get_mysql_socket() (default
    * "real" implementation), but can be configured to call another implementation
-   * (e.g. a mock counterpart).
+   * (e.g. a mock counterpart). When the preconnect pool is enabled, a
+   * connection is taken from it first.
    *
    * @param addr information of the server we connect with
    * @param connect_timeout timeout waiting for connection
@@ -229,8 +503,24 @@ protected:
    */
   virtual int get_mysql_socket(const mysqlrouter::TCPAddress &addr, std::chrono::milliseconds connect_timeout, bool log_errors = true);
 
-  /** @brief List of destinations */
-  AddrVector destinations_;
+  /** @brief Returns socket descriptor connected to the first of several MySQL servers to answer
+   *
+   * Connections kept by the preconnect pool are used first. A single
+   * server is connected to with get_mysql_socket().
+   *
+   * @param addrs servers to connect to, most preferred first
+   * @param connect_timeout timeout waiting for each connection
+   * @param winner set to the index in `addrs` of the server connected to
+   * @param failed indexes of the servers which could not be connected to
+   *        are appended
+   * @return a socket descriptor, or a negative value when no server could
+   *         be connected to
+   */
+  int connect_race(const AddrVector &addrs, std::chrono::milliseconds connect_timeout, size_t *winner,
+                   std::vector<size_t> *failed);
+
+  /** @brief Destinations and their quarantine state; use snapshot() */
+  mysql_harness::PublishedPtr<Snapshot> snapshot_;
 
   /** @brief Destination which will be used next */
   std::atomic<size_t> current_pos_;
@@ -238,21 +528,15 @@ protected:
   /** @brief Whether we are stopping */
   std::atomic_bool stopping_;
 
-  /** @brief Mutex for updating destinations and iterator */
+  /** @brief Mutex serializing updates of `snapshot_` */
   std::mutex mutex_update_;
 
-  /** @brief List of destinations which are quarantined */
-  std::vector<size_t> quarantined_;
-
   /** @brief Conditional variable blocking quarantine manager thread */
   std::condition_variable condvar_quarantine_;
 
   /** @brief Mutex for quarantine manager thread */
   std::mutex mutex_quarantine_manager_;
 
-  /** @brief Mutex for updating quarantine */
-  std::mutex mutex_quarantine_;
-
   /** @brief Quarantine manager thread */
   std::thread quarantine_thread_;
 
@@ -261,6 +545,46 @@ protected:
 
   /** @brief Protocol for the destination */
   Protocol::Type protocol_;
+
+  /** @brief Connections established ahead of time, if enabled */
+  std::unique_ptr<PreconnectPool> preconnect_pool_;
+
+  /** @brief Number of destinations connected to at the same time */
+  std::atomic<size_t> connect_race_size_;
+
+  /** @brief How quarantined destinations are checked for recovery */
+  std::atomic<routing::QuarantineProbe> quarantine_probe_;
+
+  /** @brief When a quarantined destination is probed next */
+  struct ProbeSchedule {
+    /** @brief Number of probes which failed since it was quarantined */
+    unsigned int failures;
+    std::chrono::steady_clock::time_point next;
+  };
+
+  /** @brief Probe schedule of each quarantined destination */
+  std::map<mysqlrouter::TCPAddress, ProbeSchedule> probe_schedule_;
+
+  /** @brief Mutex for updating `probe_schedule_` */
+  std::mutex mutex_probe_schedule_;
+
+  /** @brief Decides which destinations fail too often or are too slow */
+  OutlierDetector outlier_detector_;
+
+  /** @brief Maximum number of connections routed to one destination; 0 for no maximum */
+  std::atomic<size_t> max_connections_per_destination_;
+
+  /** @brief Connections and reservations per destination */
+  std::map<mysqlrouter::TCPAddress, size_t> open_connections_;
+
+  /** @brief Destination of each counted connection */
+  std::map<int, mysqlrouter::TCPAddress> connection_destinations_;
+
+  /** @brief Mutex for `open_connections_` and `connection_destinations_` */
+  mutable std::mutex mutex_connections_;
+
+  /** @brief Notified when a counted connection closes */
+  std::condition_variable condvar_connections_;
 };
 
 
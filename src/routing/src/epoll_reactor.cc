@@ -0,0 +1,699 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef __linux__
+
+#include "epoll_reactor.h"
+
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/utils.h"
+#include "protocol/protocol.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using mysqlrouter::string_format;
+using mysqlrouter::to_string;
+using std::string;
+
+namespace {
+
+/** @brief Maximum number of events fetched with one epoll_wait() */
+constexpr int kMaxEvents = 256;
+
+/** @brief Maximum copy_packets() rounds for one connection per wakeup
+ *
+ * Sockets are edge-triggered, so a connection is served until its sockets
+ * are drained. To be fair to other connections of the same reactor thread
+ * we stop after this many rounds and continue after the next epoll_wait().
+ */
+constexpr int kMaxRoundsPerConnection = 16;
+
+/** @brief How often connections are checked for an expired client_connect_timeout */
+const std::chrono::milliseconds kTimeoutCheckInterval { 1000 };
+
+/** @class NonBlockingSocketOperations
+ * @brief Socket operations given to the protocol object of a reactor thread
+ *
+ * Writes to the sockets of the connection being served never block: what
+ * the kernel does not take is appended to the pending data of the receiver
+ * and reported as written.
+ *
+ * Reads never wait either. The reactor thread reads from the sender itself
+ * and hands the data over using set_input(); only when that is used up the
+ * socket is read again, which fails with EAGAIN when it has nothing.
+ */
+class NonBlockingSocketOperations : public routing::SocketOperationsBase {
+ public:
+  explicit NonBlockingSocketOperations(routing::SocketOperationsBase *socket_operations)
+      : so_(socket_operations), connection_(nullptr),
+        input_fd_(-1), input_(nullptr), input_size_(0), input_errno_(0) {}
+
+  void set_connection(EpollReactor::Connection *connection) noexcept {
+    connection_ = connection;
+  }
+
+  /** @brief Sets what the next reads from fd return
+   *
+   * @param fd socket descriptor the data was read from
+   * @param data data already read from fd
+   * @param size number of bytes in data
+   * @param read_errno error reading from fd once data is used up (0 for none)
+   */
+  void set_input(int fd, const uint8_t *data, size_t size, int read_errno) noexcept {
+    input_fd_ = fd;
+    input_ = data;
+    input_size_ = size;
+    input_errno_ = read_errno;
+  }
+
+  void clear_input() noexcept {
+    set_input(-1, nullptr, 0, 0);
+  }
+
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout,
+                       bool log = true) noexcept override {
+    return so_->get_mysql_socket(addr, connect_timeout, log);
+  }
+
+  int connect_race(const std::vector<mysqlrouter::TCPAddress> &addrs, std::chrono::milliseconds connect_timeout,
+                   std::chrono::milliseconds delay, size_t *winner, std::vector<size_t> *failed,
+                   bool log = true) noexcept override {
+    return so_->connect_race(addrs, connect_timeout, delay, winner, failed, log);
+  }
+
+  ssize_t write(int fd, void *buffer, size_t nbyte) override {
+    EpollReactor::Connection::Endpoint *endpoint = get_endpoint(fd);
+    if (endpoint == nullptr) {
+      return so_->write(fd, buffer, nbyte);
+    }
+
+    size_t written = 0;
+    // keep the order of the data: only write directly when nothing is pending
+    if (endpoint->pending.empty()) {
+      ssize_t res = so_->write(fd, buffer, nbyte);
+      if (res < 0) {
+        const int last_errno = so_->get_errno();
+        if (last_errno != EAGAIN && last_errno != EWOULDBLOCK) {
+          return -1;
+        }
+      } else {
+        written = static_cast<size_t>(res);
+      }
+    }
+
+    auto data = reinterpret_cast<const uint8_t*>(buffer);
+    endpoint->pending.insert(endpoint->pending.end(), data + written, data + nbyte);
+
+    return static_cast<ssize_t>(nbyte);
+  }
+
+  ssize_t read(int fd, void *buffer, size_t nbyte) override {
+    if (fd == input_fd_) {
+      if (input_size_ > 0) {
+        const size_t size = std::min(nbyte, input_size_);
+        // the input usually is in the buffer the protocol reads into already
+        if (buffer != input_) {
+          std::memmove(buffer, input_, size);
+        }
+        input_ += size;
+        input_size_ -= size;
+        return static_cast<ssize_t>(size);
+      } else if (input_errno_ != 0) {
+        so_->set_errno(input_errno_);
+        return -1;
+      }
+    }
+    return so_->read(fd, buffer, nbyte);
+  }
+
+  void close(int fd) override {
+    so_->close(fd);
+  }
+
+  void shutdown(int fd) override {
+    so_->shutdown(fd);
+  }
+
+  void freeaddrinfo(addrinfo *ai) override {
+    so_->freeaddrinfo(ai);
+  }
+
+  int getaddrinfo(const char *node, const char *service, const addrinfo *hints, addrinfo **res) override {
+    return so_->getaddrinfo(node, service, hints, res);
+  }
+
+  int bind(int fd, const struct sockaddr *addr, socklen_t len) override {
+    return so_->bind(fd, addr, len);
+  }
+
+  int socket(int domain, int type, int protocol) override {
+    return so_->socket(domain, type, protocol);
+  }
+
+  int setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen) override {
+    return so_->setsockopt(fd, level, optname, optval, optlen);
+  }
+
+  int listen(int fd, int n) override {
+    return so_->listen(fd, n);
+  }
+
+  int get_errno() override {
+    return so_->get_errno();
+  }
+
+  void set_errno(int e) override {
+    so_->set_errno(e);
+  }
+
+  int poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout) override {
+    return so_->poll(fds, nfds, timeout);
+  }
+
+ private:
+  EpollReactor::Connection::Endpoint *get_endpoint(int fd) noexcept {
+    if (connection_ == nullptr) {
+      return nullptr;
+    } else if (fd == connection_->client.fd) {
+      return &connection_->client;
+    } else if (fd == connection_->server.fd) {
+      return &connection_->server;
+    }
+    return nullptr;
+  }
+
+  routing::SocketOperationsBase *so_;
+  EpollReactor::Connection *connection_;
+
+  int input_fd_;
+  const uint8_t *input_;
+  size_t input_size_;
+  int input_errno_;
+};
+
+} // namespace
+
+EpollReactor::Connection::Connection(int client_fd, int server_fd, const sockaddr_storage &addr)
+    : client{this, client_fd, false, {}, {}},
+      server{this, server_fd, false, {}, {}},
+      client_addr(addr),
+      pktnr(0),
+      handshake_done(false),
+      bytes_up(0),
+      bytes_down(0),
+      last_activity(std::chrono::steady_clock::now()),
+      closed(false) {}
+
+/** @class EpollReactor::Worker
+ *  @brief A reactor thread with its own epoll instance and connections
+ */
+class EpollReactor::Worker {
+ public:
+  Worker(const std::string &thread_name, BaseProtocol::Type protocol_type,
+         routing::SocketOperationsBase *socket_operations,
+         unsigned int net_buffer_length,
+         std::chrono::milliseconds client_connect_timeout,
+         const CloseHandler &close_handler)
+      : thread_name_(thread_name),
+        protocol_type_(protocol_type),
+        socket_operations_(socket_operations),
+        nb_socket_operations_(socket_operations),
+        protocol_(Protocol::create(protocol_type, &nb_socket_operations_)),
+        buffer_(net_buffer_length),
+        client_connect_timeout_(client_connect_timeout),
+        close_handler_(close_handler),
+        epoll_fd_(-1),
+        event_fd_(-1),
+        stopping_(false) {}
+
+  ~Worker() {
+    stop();
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+    if (event_fd_ >= 0) ::close(event_fd_);
+  }
+
+  // throws std::runtime_error
+  void start() {
+    if ((epoll_fd_ = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      throw std::runtime_error("epoll_create1() failed: " + get_message_error(errno));
+    }
+    if ((event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      throw std::runtime_error("eventfd() failed: " + get_message_error(errno));
+    }
+
+    // the eventfd is the only registered fd not carrying an Endpoint
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev) < 0) {
+      throw std::runtime_error("epoll_ctl() failed: " + get_message_error(errno));
+    }
+
+    thread_ = std::thread(&Worker::run, this);
+  }
+
+  void stop() {
+    stopping_.store(true);
+    if (thread_.joinable()) {
+      wakeup();
+      thread_.join();
+    }
+  }
+
+  bool add(std::unique_ptr<Connection> connection) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_incoming_);
+      if (stopping_.load()) {
+        return false;
+      }
+      incoming_.push_back(std::move(connection));
+    }
+    wakeup();
+    return true;
+  }
+
+ private:
+  void wakeup() noexcept {
+    uint64_t one = 1;
+    if (::write(event_fd_, &one, sizeof(one)) < 0) {
+      // counter is already non-zero, the reactor thread will wake up anyway
+    }
+  }
+
+  void run() noexcept {
+    mysql_harness::rename_thread(thread_name_.c_str());
+
+    std::array<struct epoll_event, kMaxEvents> events;
+    // connections which still have input after their share of rounds
+    std::vector<Connection*> ready;
+    std::vector<Connection*> still_ready;
+    auto last_timeout_check = std::chrono::steady_clock::now();
+
+    while (!stopping_.load()) {
+      const int timeout_ms = ready.empty() ? static_cast<int>(kTimeoutCheckInterval.count()) : 0;
+      int nfds = epoll_wait(epoll_fd_, events.data(), kMaxEvents, timeout_ms);
+
+      if (nfds < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        log_error("[%s] epoll_wait() failed: %s", thread_name_.c_str(), get_message_error(errno).c_str());
+        break;
+      }
+
+      bool have_incoming = false;
+      for (int i = 0; i < nfds; ++i) {
+        if (events[i].data.ptr == nullptr) {
+          uint64_t value;
+          while (::read(event_fd_, &value, sizeof(value)) > 0) {}
+          have_incoming = true;
+          continue;
+        }
+
+        auto endpoint = static_cast<Connection::Endpoint*>(events[i].data.ptr);
+        Connection &connection = *endpoint->connection;
+        if (connection.closed) {
+          continue;
+        }
+
+        // closed sockets and errors are found out by reading from the socket
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+          endpoint->readable = true;
+        }
+        if ((events[i].events & EPOLLOUT) && !flush(*endpoint)) {
+          continue;
+        }
+        ready.push_back(&connection);
+      }
+
+      std::sort(ready.begin(), ready.end());
+      ready.erase(std::unique(ready.begin(), ready.end()), ready.end());
+
+      still_ready.clear();
+      for (Connection *connection : ready) {
+        if (!connection->closed && process(*connection)) {
+          still_ready.push_back(connection);
+        }
+      }
+      ready.swap(still_ready);
+
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_timeout_check >= kTimeoutCheckInterval) {
+        close_timed_out(now);
+        last_timeout_check = now;
+        ready.erase(std::remove_if(ready.begin(), ready.end(),
+                                   [](Connection *c) { return c->closed; }),
+                    ready.end());
+      }
+
+      // no event refers to closed connections anymore
+      for (Connection *connection : closed_) {
+        connections_.erase(connection);
+      }
+      closed_.clear();
+
+      if (have_incoming) {
+        register_incoming();
+      }
+    }
+
+    // close whatever is left
+    {
+      std::lock_guard<std::mutex> lock(mutex_incoming_);
+      for (auto &connection : incoming_) {
+        Connection *c = connection.get();
+        connections_.emplace(c, std::move(connection));
+      }
+      incoming_.clear();
+    }
+    for (auto &it : connections_) {
+      if (!it.second->closed) {
+        it.second->extra_msg = "route stopped";
+        close_connection(*it.second);
+      }
+    }
+    connections_.clear();
+    closed_.clear();
+  }
+
+  void register_incoming() {
+    std::vector<std::unique_ptr<Connection>> incoming;
+    {
+      std::lock_guard<std::mutex> lock(mutex_incoming_);
+      incoming.swap(incoming_);
+    }
+
+    for (auto &it : incoming) {
+      Connection &connection = *it;
+      connections_.emplace(&connection, std::move(it));
+
+      routing::set_socket_blocking(connection.client.fd, false);
+      routing::set_socket_blocking(connection.server.fd, false);
+
+      // data which arrived before the sockets got registered is reported
+      // right away, even with edge-triggered notification
+      if (!add_to_epoll(connection.server) || !add_to_epoll(connection.client)) {
+        connection.extra_msg = "epoll_ctl() failed: " + get_message_error(errno);
+        close_connection(connection);
+      }
+    }
+  }
+
+  bool add_to_epoll(Connection::Endpoint &endpoint) noexcept {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = &endpoint;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, endpoint.fd, &ev) == 0;
+  }
+
+  /** @brief Forwards data of a connection until it is drained
+   *
+   * Does what one iteration of the poll() loop in
+   * MySQLRouting::routing_select_thread() does, as long as there is data
+   * to read and the receiving side is not backed up.
+   *
+   * @return true when the connection still has data to read
+   */
+  bool process(Connection &connection) {
+    Connection::Endpoint &client = connection.client;
+    Connection::Endpoint &server = connection.server;
+
+    nb_socket_operations_.set_connection(&connection);
+    std::shared_ptr<void> exit_guard(nullptr, [this](void*) {
+      nb_socket_operations_.set_connection(nullptr);
+      nb_socket_operations_.clear_input();
+    });
+
+    for (int round = 0; round < kMaxRoundsPerConnection; ++round) {
+      // don't read more from a sender while its receiver has data pending
+      const bool server_has_input = server.readable && client.pending.empty();
+      const bool client_has_input = client.readable && server.pending.empty();
+
+      if (!server_has_input && !client_has_input) {
+        return false;
+      }
+
+      size_t bytes_read = 0;
+
+      // Handle traffic from Server to Client
+      const bool server_is_readable = server_has_input && receive(connection, server);
+      if (protocol_->copy_packets(server.fd, client.fd, server_is_readable,
+                                  buffer_, &connection.pktnr,
+                                  connection.handshake_done, &bytes_read, true) == -1) {
+        const int last_errno = nb_socket_operations_.get_errno();
+        if (last_errno > 0) {
+          connection.extra_msg = string("Copy server->client failed: " + to_string(get_message_error(last_errno)));
+        }
+        close_connection(connection);
+        return false;
+      }
+      nb_socket_operations_.clear_input();
+      connection.bytes_up += bytes_read;
+      size_t bytes_forwarded = bytes_read;
+
+      // Handle traffic from Client to Server
+      const bool client_is_readable = client_has_input && receive(connection, client);
+      if (protocol_->copy_packets(client.fd, server.fd, client_is_readable,
+                                  buffer_, &connection.pktnr,
+                                  connection.handshake_done, &bytes_read, false) == -1) {
+        const int last_errno = nb_socket_operations_.get_errno();
+        if (last_errno > 0) {
+          connection.extra_msg = string("Copy client->server failed: " + to_string(get_message_error(last_errno)));
+        } else if (!connection.handshake_done) {
+          connection.extra_msg = string("Copy client->server failed: unexpected connection close");
+        }
+        close_connection(connection);
+        return false;
+      }
+      nb_socket_operations_.clear_input();
+      connection.bytes_down += bytes_read;
+      bytes_forwarded += bytes_read;
+
+      // parts of a message trickling in don't keep a handshake alive
+      if (bytes_forwarded > 0) {
+        connection.last_activity = std::chrono::steady_clock::now();
+      }
+    }
+
+    return (server.readable && client.pending.empty()) ||
+           (client.readable && server.pending.empty());
+  }
+
+  /** @brief Reads what a readable sender has into buffer_
+   *
+   * The data is handed to copy_packets() through nb_socket_operations_.
+   * While handshaking, a message which arrived only partially is kept with
+   * the sender and completed with the data of one of the next EPOLLIN
+   * events, as the protocol code expects to get the remaining part of a
+   * message it started to read right away.
+   *
+   * @return false when there is nothing to forward yet
+   */
+  bool receive(Connection &connection, Connection::Endpoint &sender) {
+    size_t size = sender.partial.size();
+    if (size > 0) {
+      std::copy(sender.partial.begin(), sender.partial.end(), buffer_.begin());
+    }
+
+    const size_t wanted = buffer_.size() - size;
+    int read_errno = 0;
+    ssize_t res = socket_operations_->read(sender.fd, &buffer_[size], wanted);
+    if (res < 0) {
+      read_errno = socket_operations_->get_errno();
+      sender.readable = false;
+      if (read_errno == EAGAIN || read_errno == EWOULDBLOCK) {
+        // woken up for data which was read already
+        return false;
+      }
+    } else if (res == 0) {
+      sender.readable = false;
+    } else {
+      size += static_cast<size_t>(res);
+      // a full buffer may have left more behind; if not, the next read
+      // fails with EAGAIN
+      sender.readable = static_cast<size_t>(res) == wanted;
+
+      // messages too big for the buffer are left to the protocol code
+      if (!connection.handshake_done && size < buffer_.size() &&
+          !ends_with_complete_message(protocol_type_, &buffer_[0], size)) {
+        sender.partial.assign(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(size));
+        return false;
+      }
+    }
+
+    if (sender.partial.capacity() > 0) {
+      RoutingProtocolBuffer().swap(sender.partial);
+    }
+    nb_socket_operations_.set_input(sender.fd, &buffer_[0], size, read_errno);
+    return true;
+  }
+
+  /** @brief Writes pending data of an endpoint
+   *
+   * @return false when the connection had to be closed
+   */
+  bool flush(Connection::Endpoint &endpoint) {
+    while (!endpoint.pending.empty()) {
+      ssize_t res = socket_operations_->write(endpoint.fd, &endpoint.pending[0], endpoint.pending.size());
+      if (res < 0) {
+        const int last_errno = socket_operations_->get_errno();
+        if (last_errno == EAGAIN || last_errno == EWOULDBLOCK) {
+          break;
+        }
+        endpoint.connection->extra_msg = string("Write to fd=" + to_string(endpoint.fd) +
+                                                " failed: " + get_message_error(last_errno));
+        close_connection(*endpoint.connection);
+        return false;
+      }
+      endpoint.pending.erase(endpoint.pending.begin(), endpoint.pending.begin() + res);
+    }
+    // idle connections should not keep the memory of a past backlog
+    if (endpoint.pending.empty() && endpoint.pending.capacity() > 0) {
+      RoutingProtocolBuffer().swap(endpoint.pending);
+    }
+    return true;
+  }
+
+  void close_timed_out(std::chrono::steady_clock::time_point now) {
+    for (auto &it : connections_) {
+      Connection &connection = *it.second;
+      if (!connection.closed && !connection.handshake_done &&
+          now - connection.last_activity >= client_connect_timeout_) {
+        connection.extra_msg = string("client auth timed out");
+        close_connection(connection);
+      }
+    }
+  }
+
+  void close_connection(Connection &connection) {
+    connection.closed = true;
+    closed_.push_back(&connection);
+
+    for (Connection::Endpoint *endpoint : {&connection.server, &connection.client}) {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, endpoint->fd, nullptr);
+
+      // deliver what the socket takes right away; waiting for a slow peer
+      // would stall all other connections of this thread
+      if (!endpoint->pending.empty()) {
+        ssize_t res = socket_operations_->write(endpoint->fd, &endpoint->pending[0], endpoint->pending.size());
+        const size_t written = res < 0 ? 0 : static_cast<size_t>(res);
+        if (written < endpoint->pending.size()) {
+          log_debug("[%s] fd=%d dropping %zu bytes which could not be delivered before closing",
+                    thread_name_.c_str(), endpoint->fd, endpoint->pending.size() - written);
+        }
+        RoutingProtocolBuffer().swap(endpoint->pending);
+      }
+      RoutingProtocolBuffer().swap(endpoint->partial);
+    }
+
+    close_handler_(connection);
+  }
+
+  const std::string thread_name_;
+  const BaseProtocol::Type protocol_type_;
+  routing::SocketOperationsBase *socket_operations_;
+  NonBlockingSocketOperations nb_socket_operations_;
+  std::unique_ptr<BaseProtocol> protocol_;
+  /** @brief Buffer shared by all connections of this thread */
+  RoutingProtocolBuffer buffer_;
+  const std::chrono::milliseconds client_connect_timeout_;
+  const CloseHandler &close_handler_;
+
+  int epoll_fd_;
+  int event_fd_;
+  std::atomic<bool> stopping_;
+  std::thread thread_;
+
+  std::unordered_map<Connection*, std::unique_ptr<Connection>> connections_;
+  std::vector<Connection*> closed_;
+
+  std::mutex mutex_incoming_;
+  std::vector<std::unique_ptr<Connection>> incoming_;
+};
+
+EpollReactor::EpollReactor(const std::string &thread_name, size_t num_threads,
+                           BaseProtocol::Type protocol_type,
+                           routing::SocketOperationsBase *socket_operations,
+                           unsigned int net_buffer_length,
+                           std::chrono::milliseconds client_connect_timeout,
+                           CloseHandler close_handler)
+    : thread_name_(thread_name),
+      close_handler_(close_handler),
+      next_worker_(0),
+      running_(false) {
+  if (num_threads == 0) {
+    throw std::invalid_argument("EpollReactor needs at least one thread");
+  }
+
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new Worker(thread_name, protocol_type, socket_operations,
+                                     net_buffer_length, client_connect_timeout,
+                                     close_handler_));
+  }
+}
+
+EpollReactor::~EpollReactor() {
+  stop();
+}
+
+void EpollReactor::start() {
+  try {
+    for (auto &worker : workers_) {
+      worker->start();
+    }
+  } catch (const std::runtime_error &exc) {
+    for (auto &worker : workers_) {
+      worker->stop();
+    }
+    throw std::runtime_error(string_format("[%s] %s", thread_name_.c_str(), exc.what()));
+  }
+  running_.store(true);
+}
+
+void EpollReactor::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  for (auto &worker : workers_) {
+    worker->stop();
+  }
+}
+
+bool EpollReactor::add_connection(int client, int server, const sockaddr_storage &client_addr) {
+  if (!running_.load()) {
+    return false;
+  }
+
+  std::unique_ptr<Connection> connection(new Connection(client, server, client_addr));
+  const size_t ndx = next_worker_.fetch_add(1) % workers_.size();
+
+  return workers_[ndx]->add(std::move(connection));
+}
+
+#endif // __linux__
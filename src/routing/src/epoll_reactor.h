@@ -0,0 +1,146 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_EPOLL_REACTOR_INCLUDED
+#define ROUTING_EPOLL_REACTOR_INCLUDED
+
+/** @file
+ * @brief Defining the class EpollReactor
+ *
+ * EpollReactor is used by MySQLRouting when a route is configured with
+ * `io_model=epoll`. Instead of one thread per client connection, the
+ * client/server socket pairs of the route are spread over a fixed number
+ * of reactor threads, each waiting on its own edge-triggered epoll
+ * instance.
+ *
+ * Only available on Linux.
+ */
+
+#ifdef __linux__
+
+#include "mysqlrouter/routing.h"
+#include "protocol/base_protocol.h"
+#include "reactor.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+/** @class EpollReactor
+ *  @brief Multiplexes routed connections over a fixed set of threads
+ *
+ *  Data is forwarded using BaseProtocol::copy_packets() exactly like the
+ *  thread-per-connection model does, so handshake tracking and blocking of
+ *  client hosts keep working. Sockets are switched to non-blocking mode;
+ *  what cannot be written to a receiver right away is kept with the
+ *  connection and reading from the sender is paused until it was flushed.
+ */
+class EpollReactor : public Reactor {
+ public:
+  /** @brief State of a client connection and its server connection */
+  struct Connection {
+    /** @brief One side of the connection as registered with epoll */
+    struct Endpoint {
+      Connection *connection;
+      int fd;
+      /** @brief Whether the socket signalled data which was not read yet */
+      bool readable;
+      /** @brief Data forwarded to this socket which could not be written yet */
+      RoutingProtocolBuffer pending;
+      /** @brief Start of a handshake message read from this socket whose remaining part did not arrive yet */
+      RoutingProtocolBuffer partial;
+    };
+
+    Connection(int client_fd, int server_fd, const sockaddr_storage &addr);
+
+    Endpoint client;
+    Endpoint server;
+    sockaddr_storage client_addr;
+    int pktnr;
+    bool handshake_done;
+    size_t bytes_up;
+    size_t bytes_down;
+    /** @brief Last time data was forwarded (used for client_connect_timeout) */
+    std::chrono::steady_clock::time_point last_activity;
+    /** @brief Reason the connection was closed (for logging) */
+    std::string extra_msg;
+    bool closed;
+  };
+
+  /** @brief Called once for each connection when it is closed
+   *
+   * The handler owns the sockets of the connection from then on; it is
+   * expected to shut them down and close them. It runs in the reactor
+   * thread and the sockets are still non-blocking, so that whatever the
+   * handler writes to them can not stall the other connections of the
+   * thread. Data still pending for them was written as far as the sockets
+   * took it without blocking; the rest is dropped.
+   */
+  using CloseHandler = std::function<void(Connection &connection)>;
+
+  /** @brief Constructor
+   *
+   * @param thread_name name given to the reactor threads
+   * @param num_threads number of reactor threads
+   * @param protocol_type protocol of the route
+   * @param socket_operations object handling the operations on network sockets
+   * @param net_buffer_length size of the buffer used to forward data
+   * @param client_connect_timeout timeout waiting for the handshake to finish
+   * @param close_handler called when a connection is closed
+   */
+  EpollReactor(const std::string &thread_name, size_t num_threads,
+               BaseProtocol::Type protocol_type,
+               routing::SocketOperationsBase *socket_operations,
+               unsigned int net_buffer_length,
+               std::chrono::milliseconds client_connect_timeout,
+               CloseHandler close_handler);
+
+  ~EpollReactor();
+
+  /** @brief Starts the reactor threads
+   *
+   * Throws std::runtime_error when epoll could not be set up.
+   */
+  void start() override;
+
+  void stop() override;
+
+  bool add_connection(int client, int server, const sockaddr_storage &client_addr) override;
+
+  size_t size() const noexcept override {
+    return workers_.size();
+  }
+
+ private:
+  class Worker;
+
+  std::string thread_name_;
+  CloseHandler close_handler_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<size_t> next_worker_;
+  std::atomic<bool> running_;
+};
+
+#endif // __linux__
+
+#endif // ROUTING_EPOLL_REACTOR_INCLUDED
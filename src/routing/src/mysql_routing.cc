@@ -19,8 +19,12 @@
 #endif
 
 #include "common.h"
+#include "dest_consistent_hash.h"
 #include "dest_first_available.h"
+#include "dest_least_connections.h"
+#include "dest_lowest_latency.h"
 #include "dest_metadata_cache.h"
+#include "epoll_reactor.h"
 #include "logger.h"
 #include "mysql_routing.h"
 #include "mysqlrouter/metadata_cache.h"
@@ -29,6 +33,9 @@
 #include "mysqlrouter/utils.h"
 #include "plugin_config.h"
 #include "protocol/protocol.h"
+#include "splicer.h"
+#include "uring_reactor.h"
+#include "worker_pool.h"
 
 #include <algorithm>
 #include <array>
@@ -38,6 +45,7 @@
 #include <memory>
 #include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <sys/types.h>
 
@@ -73,7 +81,8 @@ using mysqlrouter::URIQuery;
 using mysqlrouter::TCPAddress;
 using mysqlrouter::is_valid_socket_name;
 
-static int kListenQueueSize = 1024;
+/** @brief Maximum number of connections accepted per poll() wakeup and listening socket */
+static const size_t kMaxAcceptsPerWakeup = 256;
 
 static const char *kDefaultReplicaSetName = "default";
 static const std::chrono::milliseconds kAcceptorStopPollInterval_ms { 1000 };
@@ -99,12 +108,28 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
       bind_address_(TCPAddress(bind_address, port)),
       bind_named_socket_(named_socket),
       service_tcp_(routing::kInvalidSocket),
+      acceptor_threads_(routing::kDefaultAcceptorThreads),
+      listen_backlog_(routing::kDefaultListenBacklog),
+      accepted_(new std::atomic<uint64_t>[routing::kDefaultAcceptorThreads]()),
+      acceptors_started_(0),
       service_named_socket_(routing::kInvalidSocket),
       stopping_(false),
       info_active_routes_(0),
       info_handled_routes_(0),
       socket_operations_(socket_operations),
-      protocol_(Protocol::create(protocol, socket_operations)) {
+      protocol_(Protocol::create(protocol, socket_operations)),
+      io_model_(routing::IoModel::kThread),
+      min_worker_threads_(0),
+      max_worker_threads_(0),
+      preconnect_pool_size_(routing::kDefaultPreconnectPoolSize),
+      preconnect_max_age_(routing::kDefaultPreconnectMaxAge),
+      connect_race_size_(routing::kDefaultConnectRaceSize),
+      routing_strategy_(routing::RoutingStrategy::kUndefined),
+      quarantine_probe_(routing::QuarantineProbe::kConnect),
+      max_connections_per_destination_(routing::kDefaultMaxConnectionsPerDestination),
+      admission_queue_size_(routing::kDefaultAdmissionQueueSize),
+      admission_queue_timeout_(routing::kDefaultAdmissionQueueTimeout),
+      logged_stats_{0, 0, 0, 0} {
 
   assert(socket_operations_ != nullptr);
 
@@ -127,6 +152,10 @@ MySQLRouting::~MySQLRouting() {
     socket_operations_->shutdown(service_tcp_);
     socket_operations_->close(service_tcp_);
   }
+  for (int sock : service_tcp_shards_) {
+    socket_operations_->shutdown(sock);
+    socket_operations_->close(sock);
+  }
 }
 
 bool MySQLRouting::block_client_host(const std::array<uint8_t, 16> &client_ip_array,
@@ -151,6 +180,13 @@ bool MySQLRouting::block_client_host(const std::array<uint8_t, 16> &client_ip_ar
   return blocked;
 }
 
+bool MySQLRouting::is_client_host_blocked(const std::array<uint8_t, 16> &client_ip_array) const {
+  std::lock_guard<std::mutex> lock(mutex_conn_errors_);
+
+  auto it = conn_error_counters_.find(client_ip_array);
+  return it != conn_error_counters_.end() && it->second >= max_connect_errors_;
+}
+
 const std::vector<std::array<uint8_t, 16>> MySQLRouting::get_blocked_client_hosts() const {
   std::lock_guard<std::mutex> lock(mutex_conn_errors_);
 
@@ -203,18 +239,10 @@ std::string MySQLRouting::make_thread_name(const std::string& config_name, const
   return thread_name;
 }
 
-void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& client_addr ) noexcept {
-  mysql_harness::rename_thread(make_thread_name(name, "RtS").c_str());  // "Rt select() thread" would be too long :(
-
+int MySQLRouting::connect_server(int client, uint64_t client_key, TCPAddress *address) noexcept {
   int error = 0;
-  size_t bytes_down = 0;
-  size_t bytes_up = 0;
-  size_t bytes_read = 0;
-  string extra_msg = "";
-  RoutingProtocolBuffer buffer(net_buffer_length_);
-  bool handshake_done = false;
 
-  int server = destination_->get_server_socket(destination_connect_timeout_, &error);
+  int server = destination_->get_server_socket(destination_connect_timeout_, &error, address, client_key);
 
   if ((server == routing::kInvalidSocket) ||
       (client == routing::kInvalidSocket)) {
@@ -228,7 +256,10 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
     protocol_->send_error(client, 2003, os.str(), "HY000", name);
 
     if (client != routing::kInvalidSocket) socket_operations_->shutdown(client);
-    if (server != routing::kInvalidSocket) socket_operations_->shutdown(server);
+    if (server != routing::kInvalidSocket) {
+      destination_->connection_closed(server);
+      socket_operations_->shutdown(server);
+    }
 
     if (client != routing::kInvalidSocket) {
       socket_operations_->close(client);
@@ -236,7 +267,8 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
     if (server != routing::kInvalidSocket) {
       socket_operations_->close(server);
     }
-    return;
+    connection_slot_unused();
+    return routing::kInvalidSocket;
   }
 
   std::pair<std::string, int> c_ip = get_peer_name(client);
@@ -262,10 +294,84 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
   ++info_active_routes_;
   ++info_handled_routes_;
 
+  return server;
+}
+
+void MySQLRouting::close_connection(int client, const sockaddr_storage &client_addr, int server,
+                                    bool handshake_done, size_t bytes_up, size_t bytes_down,
+                                    const std::string &extra_msg) noexcept {
+  if (!handshake_done) {
+    std::pair<std::string, int> c_ip = get_peer_name(&client_addr);
+
+    log_info("[%s] fd=%d Pre-auth socket failure %s: %s",
+        name.c_str(),
+        client,
+        c_ip.first.c_str(), extra_msg.c_str());
+     auto ip_array = in_addr_to_array(client_addr);
+     block_client_host(ip_array, c_ip.first.c_str(), server);
+  }
+
+  // Either client or server terminated
+  socket_operations_->shutdown(client);
+  socket_operations_->close(client);
+  if (server != routing::kInvalidSocket) {
+    if (destination_) destination_->connection_closed(server);
+    socket_operations_->shutdown(server);
+    socket_operations_->close(server);
+  }
+
+  --info_active_routes_;
+  connection_slot_unused();
+#ifndef _WIN32
+  log_debug("[%s] fd=%d connection closed (up: %zub; down: %zub) %s",
+      name.c_str(),
+      client, bytes_up, bytes_down, extra_msg.c_str());
+#else
+  log_debug("[%s] fd=%d connection closed (up: %Iub; down: %Iub) %s",
+      name.c_str(),
+      client, bytes_up, bytes_down, extra_msg.c_str());
+#endif
+}
+
+void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& client_addr ) noexcept {
+  mysql_harness::rename_thread(make_thread_name(name, "RtS").c_str());  // "Rt select() thread" would be too long :(
+
+  size_t bytes_down = 0;
+  size_t bytes_up = 0;
+  size_t bytes_read = 0;
+  string extra_msg = "";
+  RoutingProtocolBuffer buffer(net_buffer_length_);
+  bool handshake_done = false;
+
+  // outcome of the connection for the outlier detection of the destination;
+  // servers of the X protocol do not talk first and are not tracked
+  const bool track_outcome = protocol_->get_type() == Protocol::Type::kClassicProtocol;
+  TCPAddress server_address;
+  auto connected = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point handshake_finished;
+  bool greeted = false;
+  bool auth_failed = false;
+  bool server_closed = false;
+  bool timed_out = false;
+
+  int server = connect_server(client, client_key(client_addr), &server_address);
+  if (server == routing::kInvalidSocket) {
+    return;
+  }
+  connected = std::chrono::steady_clock::now();
+
+  // once the handshake is done, data is moved with splice() where possible
+  Splicer splicer(protocol_.get(), socket_operations_);
   int pktnr = 0;
 
   bool connection_is_ok = true;
   while (connection_is_ok) {
+    if (worker_pool_ && stopping()) {
+      // threads of the pool are joined when the route stops
+      extra_msg = "route stopped";
+      break;
+    }
+
     const size_t kClientEventIndex = 0;
     const size_t kServerEventIndex = 1;
 
@@ -299,6 +405,7 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
       // timeout
       if (!handshake_done) {
         connection_is_ok = false;
+        timed_out = true;
         extra_msg = string("client auth timed out");
 
         break;
@@ -319,9 +426,10 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
 
     // Handle traffic from Server to Client
     // Note: In classic protocol Server _always_ talks first
-    if (protocol_->copy_packets(server, client, server_is_readable,
-                                buffer, &pktnr,
-                                handshake_done, &bytes_read, true) == -1) {
+    const bool in_handshake = !handshake_done;
+    if (splicer.copy_packets(server, client, server_is_readable,
+                             buffer, &pktnr,
+                             handshake_done, &bytes_read, true) == -1) {
       const int last_errno = socket_operations_->get_errno();
       if (last_errno > 0) {
         // if read() against closed socket, errno will be 0. Don't log that.
@@ -329,14 +437,33 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
       }
 
       connection_is_ok = false;
+      server_closed = true;
     } else {
       bytes_up += bytes_read;
+      if (track_outcome && in_handshake && bytes_read > mysql_protocol::Packet::kHeaderSize) {
+        const bool is_error = buffer[mysql_protocol::Packet::kHeaderSize] == 0xff;
+        if (!greeted) {
+          // an error instead of the greeting: the server refuses clients
+          greeted = true;
+          if (is_error) {
+            destination_->report_failure(server_address);
+          } else {
+            destination_->report_success(server_address, std::chrono::duration_cast<std::chrono::microseconds>(
+                                                             std::chrono::steady_clock::now() - connected));
+          }
+        } else if (is_error) {
+          auth_failed = true;
+        }
+      }
+    }
+    if (handshake_done && handshake_finished == std::chrono::steady_clock::time_point()) {
+      handshake_finished = std::chrono::steady_clock::now();
     }
 
     // Handle traffic from Client to Server
-    if (protocol_->copy_packets(client, server, client_is_readable,
-                                buffer, &pktnr,
-                                handshake_done, &bytes_read, false) == -1) {
+    if (splicer.copy_packets(client, server, client_is_readable,
+                             buffer, &pktnr,
+                             handshake_done, &bytes_read, false) == -1) {
       const int last_errno = socket_operations_->get_errno();
       if (last_errno > 0) {
         extra_msg = string("Copy client->server failed: " + to_string(get_message_error(last_errno)));
@@ -351,31 +478,16 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
 
   } // while (true)
 
-  if (!handshake_done) {
-    log_info("[%s] fd=%d Pre-auth socket failure %s: %s",
-        name.c_str(),
-        client,
-        c_ip.first.c_str(), extra_msg.c_str());
-     auto ip_array = in_addr_to_array(client_addr);
-     block_client_host(ip_array, c_ip.first.c_str(), server);
+  if (track_outcome) {
+    if (!greeted && (server_closed || timed_out)) {
+      destination_->report_failure(server_address);
+    } else if (greeted && server_closed && handshake_done && !auth_failed &&
+               std::chrono::steady_clock::now() - handshake_finished < routing::kOutlierEarlyDisconnect) {
+      destination_->report_failure(server_address);
+    }
   }
 
-  // Either client or server terminated
-  socket_operations_->shutdown(client);
-  socket_operations_->shutdown(server);
-  socket_operations_->close(client);
-  socket_operations_->close(server);
-
-  --info_active_routes_;
-#ifndef _WIN32
-  log_debug("[%s] fd=%d connection closed (up: %zub; down: %zub) %s",
-      name.c_str(),
-      client, bytes_up, bytes_down, extra_msg.c_str());
-#else
-  log_debug("[%s] fd=%d connection closed (up: %Iub; down: %Iub) %s",
-      name.c_str(),
-      client, bytes_up, bytes_down, extra_msg.c_str());
-#endif
+  close_connection(client, client_addr, server, handshake_done, bytes_up, bytes_down, extra_msg);
 }
 
 void MySQLRouting::start() {
@@ -406,11 +518,97 @@ void MySQLRouting::start() {
   }
 #endif
   if (bind_address_.port > 0 || bind_named_socket_.is_set()) {
+#ifdef __linux__
+    if (io_model_ != routing::IoModel::kThread) {
+      try {
+        start_reactor();
+      } catch (const runtime_error &exc) {
+        stop();
+        throw runtime_error(string_format("Setting up %s reactor: %s",
+                                          routing::get_io_model_name(io_model_).c_str(), exc.what()));
+      }
+    }
+#endif
+    // with a reactor the threads of the pool connect to the destinations
+    // and hand the connections over to it
+    if (max_worker_threads_ > 0 || io_model_ != routing::IoModel::kThread) {
+      const unsigned int max_threads = max_worker_threads_ > 0 ? max_worker_threads_ : routing::kDefaultReactorConnectThreads;
+      try {
+        // clients get no greeting while they wait, so they don't wait longer
+        // than they would for the handshake to finish
+        worker_pool_.reset(new WorkerPool(make_thread_name(name, "RtW"), std::min(min_worker_threads_, max_threads),
+                                          max_threads, static_cast<size_t>(max_connections_),
+                                          std::chrono::seconds(60), client_connect_timeout_));
+      } catch (const std::system_error &exc) {
+        stop();
+        throw runtime_error(string_format("Setting up worker pool: %s", exc.what()));
+      }
+    }
+    if (admission_queue_size_ > 0) {
+      admission_queue_.reset(new AdmissionQueue(
+          make_thread_name(name, "RtAq"), admission_queue_size_, admission_queue_timeout_,
+          [this](const AdmissionQueue::Client &client) {
+            dispatch_client(client.sock, client.addr, client.is_tcp);
+          },
+          [this](const AdmissionQueue::Client &client) {
+            reject_client(client.sock);
+            log_warning("[%s] fd=%d no free connection slot within %llds", name.c_str(), client.sock,
+                        static_cast<long long>(admission_queue_timeout_.count()));
+          },
+          [this] { return info_active_routes_.load() < max_connections_; }));
+      try {
+        admission_queue_->start();
+      } catch (const std::system_error &exc) {
+        stop();
+        throw runtime_error(string_format("Setting up admission queue: %s", exc.what()));
+      }
+    }
+    // every routed connection has a client socket and, while connecting,
+    // a socket for each server raced
+    uint64_t per_connection = 1 + std::max(connect_race_size_, 1u);
+#ifdef __linux__
+    if (io_model_ == routing::IoModel::kThread) {
+      // and the pipe splice() moves the data through
+      per_connection += 2;
+    }
+#endif
+    // quarantined servers are probed one socket each, the preconnect pool
+    // keeps its sockets per server
+    const uint64_t destinations = destination_ ? destination_->size() : 0;
+    const uint64_t file_descriptors =
+        per_connection * static_cast<uint64_t>(max_connections_) + admission_queue_size_ +
+        (1 + static_cast<uint64_t>(preconnect_pool_size_)) * destinations;
+    uint64_t total_reserved;
+    uint64_t open_files_limit = routing::reserve_file_descriptors(file_descriptors, &total_reserved);
+    if (open_files_limit < total_reserved) {
+      log_warning("[%s] limit of open files is %llu, but routes need up to %llu; "
+                  "connections will fail once it is reached", name.c_str(),
+                  static_cast<unsigned long long>(open_files_limit),
+                  static_cast<unsigned long long>(total_reserved));
+    }
     //XXX this thread seems unnecessary, since we block on it right after anyway
-    thread_acceptor_ = std::thread(&MySQLRouting::start_acceptor, this);
+    try {
+      thread_acceptor_ = std::thread(&MySQLRouting::start_acceptor, this);
+    } catch (const std::system_error &) {
+      routing::release_file_descriptors(file_descriptors);
+      throw;
+    }
     if (thread_acceptor_.joinable()) {
       thread_acceptor_.join();
     }
+    if (admission_queue_) {
+      admission_queue_->stop();
+    }
+    if (worker_pool_) {
+      worker_pool_->stop();
+    }
+    log_stats(true);
+#ifdef __linux__
+    if (reactor_) {
+      reactor_->stop();
+    }
+#endif
+    routing::release_file_descriptors(file_descriptors);
 #ifndef _WIN32
     if (bind_named_socket_.is_set() && unlink(bind_named_socket_.str().c_str()) == -1) {
       if (errno != ENOENT)
@@ -464,13 +662,52 @@ static int unix_getpeercred(int sock, pid_t &peer_pid, uid_t &peer_uid) {
 void MySQLRouting::start_acceptor() {
   mysql_harness::rename_thread(make_thread_name(name, "RtA").c_str());  // "Rt Acceptor" would be too long :(
 
+  if (preconnect_pool_size_ > 0) {
+    destination_->enable_preconnect_pool(preconnect_pool_size_, destination_connect_timeout_, preconnect_max_age_);
+    log_info("[%s] keeping up to %u connections per destination ready for up to %llds", name.c_str(),
+             preconnect_pool_size_, static_cast<long long>(preconnect_max_age_.count()));
+  }
+  destination_->set_connect_race_size(connect_race_size_);
+  destination_->set_quarantine_probe(quarantine_probe_);
+  destination_->set_max_connections_per_destination(max_connections_per_destination_);
   destination_->start();
 
-  if (service_tcp_ != routing::kInvalidSocket) {
-    routing::set_socket_blocking(service_tcp_, false);
+  // the other acceptor threads only start once the destinations are set up
+  for (size_t i = 0; i < service_tcp_shards_.size(); ++i) {
+    try {
+      thread_acceptor_shards_.emplace_back([this, i] {
+        mysql_harness::rename_thread(make_thread_name(name, "RtA").c_str());
+        accept_connections(i + 1, service_tcp_shards_[i], routing::kInvalidSocket);
+      });
+    } catch (const std::system_error &exc) {
+      // the remaining listeners get no connections as the kernel only
+      // distributes over sockets that are listening
+      log_error("[%s] failed starting acceptor thread %zu: %s", name.c_str(), i + 1, exc.what());
+      for (size_t j = i; j < service_tcp_shards_.size(); ++j) {
+        socket_operations_->close(service_tcp_shards_[j]);
+      }
+      service_tcp_shards_.resize(i);
+      break;
+    }
   }
-  if (service_named_socket_ != routing::kInvalidSocket) {
-    routing::set_socket_blocking(service_named_socket_, false);
+  acceptors_started_ = 1 + service_tcp_shards_.size();
+
+  accept_connections(0, service_tcp_, service_named_socket_);
+
+  for (auto &thr : thread_acceptor_shards_) {
+    thr.join();
+  }
+  thread_acceptor_shards_.clear();
+
+  log_info("[%s] stopped", name.c_str());
+}
+
+void MySQLRouting::accept_connections(size_t shard, int service_tcp, int service_named_socket) {
+  if (service_tcp != routing::kInvalidSocket) {
+    routing::set_socket_blocking(service_tcp, false);
+  }
+  if (service_named_socket != routing::kInvalidSocket) {
+    routing::set_socket_blocking(service_named_socket, false);
   }
 
   const int kAcceptUnixSocketNdx = 0;
@@ -480,10 +717,19 @@ void MySQLRouting::start_acceptor() {
     { routing::kInvalidSocket, POLLIN, 0 },
   };
 
-  fds[kAcceptTcpNdx].fd = service_tcp_;
-  fds[kAcceptUnixSocketNdx].fd = service_named_socket_;
+  fds[kAcceptTcpNdx].fd = service_tcp;
+  fds[kAcceptUnixSocketNdx].fd = service_named_socket;
+
+  std::atomic<uint64_t> &accepted = accepted_[shard];
+  auto next_stats_log = std::chrono::steady_clock::now() + routing::kStatsLogInterval;
 
   while (!stopping()) {
+    // the first acceptor logs the metrics of the route
+    if (shard == 0 && std::chrono::steady_clock::now() >= next_stats_log) {
+      log_stats(false);
+      next_stats_log = std::chrono::steady_clock::now() + routing::kStatsLogInterval;
+    }
+
     // wait for the accept() sockets to become readable (POLLIN)
 
     int ready_fdnum = socket_operations_->poll(fds, sizeof(fds) / sizeof(fds[0]), kAcceptorStopPollInterval_ms);
@@ -512,117 +758,421 @@ void MySQLRouting::start_acceptor() {
 
       --ready_fdnum;
 
-      int sock_client = 0;
-      struct sockaddr_storage client_addr;
-      socklen_t sin_size = static_cast<socklen_t>(sizeof client_addr);
+      // drain the backlog, but give the other socket a chance now and then
+      for (size_t n = 0; n < kMaxAcceptsPerWakeup && !stopping(); ++n) {
+        struct sockaddr_storage client_addr;
+        socklen_t sin_size = static_cast<socklen_t>(sizeof client_addr);
 
+#ifdef __linux__
+        // sockets returned by accept4() are blocking unless SOCK_NONBLOCK is
+        // passed, whatever the listening socket is set to
+        int sock_client = accept4(fds[ndx].fd, (struct sockaddr *) &client_addr, &sin_size, SOCK_CLOEXEC);
+#else
+        int sock_client = static_cast<int>(accept(fds[ndx].fd, (struct sockaddr *) &client_addr, &sin_size));
+#endif
+        if (sock_client < 0) {
+          const int last_errno = socket_operations_->get_errno();
+#ifdef _WIN32
+          if (last_errno == WSAEWOULDBLOCK) {
+#else
+          if (last_errno == EAGAIN || last_errno == EWOULDBLOCK) {
+#endif
+            // backlog is empty
+            break;
+          }
+          if (last_errno == EINTR || last_errno == ECONNABORTED) {
+            continue;
+          }
+          log_error("[%s] Failed accepting connection: %s", name.c_str(), get_message_error(last_errno).c_str());
+          break;
+        }
 
-      if ((sock_client = accept(fds[ndx].fd, (struct sockaddr *) &client_addr, &sin_size)) < 0) {
-        log_error("[%s] Failed accepting connection: %s", name.c_str(), get_message_error(socket_operations_->get_errno()).c_str());
-        continue;
+        ++accepted;
+        handle_accepted_client(sock_client, client_addr, ndx == kAcceptTcpNdx);
       }
+    }
+  } // while (!stopping())
+}
 
-      bool is_tcp = (ndx == kAcceptTcpNdx);
-
-      if (is_tcp) {
-        log_debug("[%s] fd=%d connection accepted at %s", name.c_str(), sock_client, bind_address_.str().c_str());
-      } else {
+void MySQLRouting::handle_accepted_client(int sock_client, const sockaddr_storage &client_addr, bool is_tcp) {
+  if (is_tcp) {
+    log_debug("[%s] fd=%d connection accepted at %s", name.c_str(), sock_client, bind_address_.str().c_str());
+  } else {
 #if !defined(_WIN32)
-        pid_t peer_pid;
-        uid_t peer_uid;
-
-        // try to be helpful of who tried to connect to use and failed.
-        // who == PID + UID
-        //
-        // if we can't get the PID, we'll just show a simpler errormsg
-
-        if (0 == unix_getpeercred(sock_client, peer_pid, peer_uid)) {
-          log_debug("[%s] fd=%d connection accepted at %s from (pid=%d, uid=%d)",
-              name.c_str(), sock_client, bind_named_socket_.str().c_str(),
-              peer_pid, peer_uid);
-        } else
-          // fall through
+    pid_t peer_pid;
+    uid_t peer_uid;
+
+    // try to be helpful of who tried to connect to use and failed.
+    // who == PID + UID
+    //
+    // if we can't get the PID, we'll just show a simpler errormsg
+
+    if (0 == unix_getpeercred(sock_client, peer_pid, peer_uid)) {
+      log_debug("[%s] fd=%d connection accepted at %s from (pid=%d, uid=%d)",
+          name.c_str(), sock_client, bind_named_socket_.str().c_str(),
+          peer_pid, peer_uid);
+    } else
+      // fall through
 #endif
-        log_debug("[%s] fd=%d connection accepted at %s",
-            name.c_str(), sock_client, bind_named_socket_.str().c_str());
-      }
+    log_debug("[%s] fd=%d connection accepted at %s",
+        name.c_str(), sock_client, bind_named_socket_.str().c_str());
+  }
 
-      if (conn_error_counters_[in_addr_to_array(client_addr)] >= max_connect_errors_) {
-        std::stringstream os;
-        os << "Too many connection errors from " << get_peer_name(sock_client).first;
-        protocol_->send_error(sock_client, 1129, os.str(), "HY000", name);
-        log_info("%s", os.str().c_str());
-        socket_operations_->close(sock_client); // no shutdown() before close()
-        continue;
-      }
+  if (is_client_host_blocked(in_addr_to_array(client_addr))) {
+    std::stringstream os;
+    os << "Too many connection errors from " << get_peer_name(sock_client).first;
+    protocol_->send_error(sock_client, 1129, os.str(), "HY000", name);
+    log_info("%s", os.str().c_str());
+    socket_operations_->close(sock_client); // no shutdown() before close()
+    return;
+  }
 
-      if (info_active_routes_.load(std::memory_order_relaxed) >= max_connections_) {
-        protocol_->send_error(sock_client, 1040, "Too many connections", "HY000", name);
-        socket_operations_->close(sock_client); // no shutdown() before close()
-        log_warning("[%s] reached max active connections (%d max=%d)", name.c_str(),
-                   info_active_routes_.load(), max_connections_);
-        continue;
-      }
+  // clients which are waiting already go first
+  if (info_active_routes_.load(std::memory_order_relaxed) >= max_connections_ ||
+      (admission_queue_ && !admission_queue_->empty())) {
+    if (admission_queue_ && admission_queue_->push(sock_client, client_addr, is_tcp)) {
+      log_debug("[%s] fd=%d waiting for a free connection slot", name.c_str(), sock_client);
+      return;
+    }
+    reject_client(sock_client);
+    log_warning("[%s] reached max active connections (%d max=%d)", name.c_str(),
+               info_active_routes_.load(), max_connections_);
+    return;
+  }
 
-      int opt_nodelay = 1;
-      if (is_tcp && setsockopt(sock_client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char *>(&opt_nodelay), static_cast<socklen_t>(sizeof(int))) == -1) {
-        log_info("[%s] fd=%d client setsockopt(TCP_NODELAY) failed: %s", name.c_str(), sock_client, get_message_error(socket_operations_->get_errno()).c_str());
+  dispatch_client(sock_client, client_addr, is_tcp);
+}
 
-        // if it fails, it will be slower, but cause no harm
-      }
+void MySQLRouting::connection_slot_unused() noexcept {
+  if (admission_queue_) {
+    admission_queue_->slot_freed();
+  }
+}
 
-      // On some OS'es the socket will be non-blocking as a result of accept()
-      // on non-blocking socket. We need to make sure it's always blocking.
-      routing::set_socket_blocking(sock_client, true);
-
-      // launch client thread which will service this new connection
-      {
-        auto thread_spawn_failure_handler = [&](const std::system_error* exc) {
-          protocol_->send_error(sock_client, 1040,
-                                "Router couldn't spawn a new thread to service new client connection",
-                                "HY000", name);
-          socket_operations_->close(sock_client); // no shutdown() before close()
-
-          // we only want to log this message once, because in a low-resource situation, this would
-          // lead do a DoS against ourselves (heavy I/O and disk full)
-          static bool logged_this_before = false;
-          if (logged_this_before)
-            return;
-
-          logged_this_before = true;
-          if (exc)
-            log_error("Couldn't spawn a new thread to service new client connection from %s: %s."
-                      " This message will not be logged again until Router restarts.",
-                      get_peer_name(sock_client).first.c_str(), exc->what());
-          else
-            log_error("Couldn't spawn a new thread to service new client connection from %s."
-                      " This message will not be logged again until Router restarts.",
-                      get_peer_name(sock_client).first.c_str());
-        };
-
-        try {
-          std::thread(&MySQLRouting::routing_select_thread, this, sock_client, client_addr).detach();
-        } catch (const std::system_error& e) {
-          thread_spawn_failure_handler(&e);
-          continue;
-        } catch (...) {
-          // According to http://www.cplusplus.com/reference/thread/thread/thread/,
-          // depending on the library implementation, std::thread constructor may also throw other
-          // exceptions, such as bad_alloc or system_error with different a condition.
-          // Thus we have this catch(...) here to take care of the rest of them in a generic way.
-          thread_spawn_failure_handler(nullptr);
-          continue;
-        }
-      }
+AdmissionQueue::Stats MySQLRouting::get_admission_queue_stats() const {
+  if (admission_queue_) {
+    return admission_queue_->get_stats();
+  }
+  return AdmissionQueue::Stats();
+}
+
+WorkerPool::Stats MySQLRouting::get_worker_pool_stats() const {
+  if (worker_pool_) {
+    return worker_pool_->get_stats();
+  }
+  return WorkerPool::Stats();
+}
+
+OutlierDetector::Stats MySQLRouting::get_outlier_stats() const {
+  if (destination_) {
+    return destination_->get_outlier_stats();
+  }
+  return OutlierDetector::Stats();
+}
+
+std::vector<MySQLRouting::AcceptorStats> MySQLRouting::get_acceptor_stats() const {
+  std::vector<AcceptorStats> stats(acceptors_started_.load());
+  for (size_t i = 0; i < stats.size(); ++i) {
+    stats[i].accepted = accepted_[i].load();
+  }
+  return stats;
+}
+
+void MySQLRouting::log_stats(bool stopped) {
+  if (admission_queue_) {
+    AdmissionQueue::Stats stats = get_admission_queue_stats();
+    uint64_t activity = stats.queued + stats.rejected;
+    if (stopped || activity != logged_stats_.admission_queue) {
+      logged_stats_.admission_queue = activity;
+      log_info("[%s] admission queue: %zu clients waiting, %llu queued, %llu admitted, %llu timed out, "
+               "%llu rejected, max length %zu, wait avg %lldus max %lldus", name.c_str(), stats.length,
+               static_cast<unsigned long long>(stats.queued),
+               static_cast<unsigned long long>(stats.admitted),
+               static_cast<unsigned long long>(stats.timed_out),
+               static_cast<unsigned long long>(stats.rejected), stats.max_length,
+               static_cast<long long>(stats.admitted ? stats.total_wait.count() / static_cast<long long>(stats.admitted) : 0),
+               static_cast<long long>(stats.max_wait.count()));
     }
-  } // while (!stopping())
-  log_info("[%s] stopped", name.c_str());
+  }
+  if (worker_pool_) {
+    WorkerPool::Stats stats = get_worker_pool_stats();
+    uint64_t activity = stats.tasks_started + stats.tasks_rejected + stats.tasks_expired;
+    if (stopped || activity != logged_stats_.worker_pool) {
+      logged_stats_.worker_pool = activity;
+      log_info("[%s] worker pool: %zu threads (%zu idle), queue depth %zu, %llu connections serviced, "
+               "%llu rejected, %llu timed out, max queue depth %zu, queue wait avg %lldus max %lldus",
+               name.c_str(), stats.threads, stats.idle_threads, stats.queue_depth,
+               static_cast<unsigned long long>(stats.tasks_started),
+               static_cast<unsigned long long>(stats.tasks_rejected),
+               static_cast<unsigned long long>(stats.tasks_expired), stats.max_queue_depth,
+               static_cast<long long>(stats.tasks_started ? stats.total_wait.count() / static_cast<long long>(stats.tasks_started) : 0),
+               static_cast<long long>(stats.max_wait.count()));
+    }
+  }
+  if (acceptor_threads_ > 1) {
+    std::vector<AcceptorStats> acceptors = get_acceptor_stats();
+    uint64_t accepted = 0;
+    std::string per_acceptor;
+    for (const AcceptorStats &acceptor : acceptors) {
+      accepted += acceptor.accepted;
+      per_acceptor += (per_acceptor.empty() ? "" : ", ") + std::to_string(acceptor.accepted);
+    }
+    if (stopped || accepted != logged_stats_.accepted) {
+      logged_stats_.accepted = accepted;
+      log_info("[%s] acceptors: %llu connections accepted (%s)", name.c_str(),
+               static_cast<unsigned long long>(accepted), per_acceptor.c_str());
+    }
+  }
+  OutlierDetector::Stats stats = get_outlier_stats();
+  uint64_t activity = stats.ejections() + stats.ejections_skipped;
+  // nothing to tell as long as no destination was an outlier
+  if (activity > 0 && (stopped || activity != logged_stats_.outlier_detection)) {
+    logged_stats_.outlier_detection = activity;
+    log_info("[%s] outlier detection: %zu destinations ejected, %llu ejections (%llu consecutive failures, "
+             "%llu success rate, %llu latency), %llu skipped, %llu failures of %llu connections", name.c_str(),
+             stats.ejected,
+             static_cast<unsigned long long>(stats.ejections()),
+             static_cast<unsigned long long>(stats.consecutive_failure_ejections),
+             static_cast<unsigned long long>(stats.success_rate_ejections),
+             static_cast<unsigned long long>(stats.latency_ejections),
+             static_cast<unsigned long long>(stats.ejections_skipped),
+             static_cast<unsigned long long>(stats.failures),
+             static_cast<unsigned long long>(stats.successes + stats.failures));
+  }
+}
+
+void MySQLRouting::reject_client(int sock_client) {
+  protocol_->send_error(sock_client, 1040, "Too many connections", "HY000", name);
+  socket_operations_->close(sock_client); // no shutdown() before close()
+}
+
+void MySQLRouting::dispatch_client(int sock_client, const sockaddr_storage &client_addr, bool is_tcp) {
+#ifdef __linux__
+  (void)is_tcp;
+#endif
+
+  // on Linux, accept4() returns a blocking socket which inherited
+  // TCP_NODELAY from the listening socket
+#ifndef __linux__
+  int opt_nodelay = 1;
+  if (is_tcp && setsockopt(sock_client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char *>(&opt_nodelay), static_cast<socklen_t>(sizeof(int))) == -1) {
+    log_info("[%s] fd=%d client setsockopt(TCP_NODELAY) failed: %s", name.c_str(), sock_client, get_message_error(socket_operations_->get_errno()).c_str());
+
+    // if it fails, it will be slower, but cause no harm
+  }
+
+  // On some OS'es the socket will be non-blocking as a result of accept()
+  // on non-blocking socket. We need to make sure it's always blocking.
+  routing::set_socket_blocking(sock_client, true);
+#endif
+
+  if (worker_pool_) {
+    WorkerPool::Task task = [this, sock_client, client_addr] {
+      routing_select_thread(sock_client, client_addr);
+    };
+#ifdef __linux__
+    if (reactor_) {
+      // connecting may take up to destination_connect_timeout, which neither
+      // the acceptor nor the reactor threads should wait for
+      task = [this, sock_client, client_addr] {
+        connect_reactor_client(sock_client, client_addr);
+      };
+    }
+#endif
+    WorkerPool::Task on_expired = [this, sock_client] {
+      reject_client(sock_client);
+      connection_slot_unused();
+      log_warning("[%s] fd=%d rejected after waiting %lldms for a worker thread", name.c_str(), sock_client,
+                  static_cast<long long>(client_connect_timeout_.count()));
+    };
+    if (!worker_pool_->submit(std::move(task), std::move(on_expired))) {
+      reject_client(sock_client);
+      connection_slot_unused();
+      WorkerPool::Stats stats = worker_pool_->get_stats();
+      log_warning("[%s] worker pool exhausted (%llu of %llu threads busy, %llu connections waiting)", name.c_str(),
+                  static_cast<unsigned long long>(stats.threads - stats.idle_threads),
+                  static_cast<unsigned long long>(stats.threads),
+                  static_cast<unsigned long long>(stats.queue_depth));
+    }
+    return;
+  }
+
+  // launch client thread which will service this new connection
+  {
+    auto thread_spawn_failure_handler = [&](const std::system_error* exc) {
+      protocol_->send_error(sock_client, 1040,
+                            "Router couldn't spawn a new thread to service new client connection",
+                            "HY000", name);
+      socket_operations_->close(sock_client); // no shutdown() before close()
+      connection_slot_unused();
+
+      // we only want to log this message once, because in a low-resource situation, this would
+      // lead do a DoS against ourselves (heavy I/O and disk full)
+      static std::atomic<bool> logged_this_before{false};
+      if (logged_this_before.exchange(true))
+        return;
+
+      if (exc)
+        log_error("Couldn't spawn a new thread to service new client connection from %s: %s."
+                  " This message will not be logged again until Router restarts.",
+                  get_peer_name(sock_client).first.c_str(), exc->what());
+      else
+        log_error("Couldn't spawn a new thread to service new client connection from %s."
+                  " This message will not be logged again until Router restarts.",
+                  get_peer_name(sock_client).first.c_str());
+    };
+
+    try {
+      std::thread(&MySQLRouting::routing_select_thread, this, sock_client, client_addr).detach();
+    } catch (const std::system_error& e) {
+      thread_spawn_failure_handler(&e);
+      return;
+    } catch (...) {
+      // According to http://www.cplusplus.com/reference/thread/thread/thread/,
+      // depending on the library implementation, std::thread constructor may also throw other
+      // exceptions, such as bad_alloc or system_error with different a condition.
+      // Thus we have this catch(...) here to take care of the rest of them in a generic way.
+      thread_spawn_failure_handler(nullptr);
+      return;
+    }
+  }
 }
 
 void MySQLRouting::stop() {
   stopping_.store(true);
 }
 
+#ifdef __linux__
+void MySQLRouting::connect_reactor_client(int sock_client, const sockaddr_storage &client_addr) {
+  // the reactor only forwards data of established connections
+  int sock_server = connect_server(sock_client, client_key(client_addr));
+  if (sock_server != routing::kInvalidSocket &&
+      !reactor_->add_connection(sock_client, sock_server, client_addr)) {
+    close_connection(sock_client, client_addr, sock_server, true, 0, 0, "route stopped");
+  }
+}
+
+void MySQLRouting::start_reactor() {
+  const size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // connections closed because the route stops do not count as client errors.
+  // The sockets are non-blocking here: when the server does not take the
+  // fake handshake response of a blocked client host right away, it is
+  // dropped rather than stalling the reactor thread.
+#ifdef HAVE_IO_URING
+  if (io_model_ == routing::IoModel::kIoUring) {
+    reactor_.reset(new UringReactor(make_thread_name(name, "RtU"), num_threads,
+                                    protocol_->get_type(), socket_operations_,
+                                    net_buffer_length_, client_connect_timeout_,
+                                    [this](UringReactor::Connection &connection) {
+      close_connection(connection.client.fd, connection.client_addr, connection.server.fd,
+                       connection.handshake_done || stopping(),
+                       connection.bytes_up, connection.bytes_down, connection.extra_msg);
+    }));
+  }
+#endif
+  if (io_model_ == routing::IoModel::kEpoll) {
+    reactor_.reset(new EpollReactor(make_thread_name(name, "RtE"), num_threads,
+                                    protocol_->get_type(), socket_operations_,
+                                    net_buffer_length_, client_connect_timeout_,
+                                    [this](EpollReactor::Connection &connection) {
+      close_connection(connection.client.fd, connection.client_addr, connection.server.fd,
+                       connection.handshake_done || stopping(),
+                       connection.bytes_up, connection.bytes_down, connection.extra_msg);
+    }));
+  }
+  reactor_->start();
+
+  log_info("[%s] using %s I/O model with %u reactor threads and up to %u threads connecting to destinations",
+           name.c_str(), routing::get_io_model_name(io_model_).c_str(), static_cast<unsigned>(num_threads),
+           max_worker_threads_ > 0 ? max_worker_threads_ : routing::kDefaultReactorConnectThreads);
+}
+#endif
+
+void MySQLRouting::set_acceptor_threads(unsigned int threads) {
+  if (threads < 1 || threads > routing::kMaxAcceptorThreads) {
+    throw std::invalid_argument(string_format("[%s] tried to set acceptor_threads using invalid value, was '%u'",
+                                              name.c_str(), threads));
+  }
+#ifndef SO_REUSEPORT
+  if (threads > 1) {
+    throw std::invalid_argument(string_format("[%s] acceptor_threads > 1 is not supported on this platform",
+                                              name.c_str()));
+  }
+#endif
+  accepted_.reset(new std::atomic<uint64_t>[threads]());
+  acceptor_threads_ = threads;
+}
+
+void MySQLRouting::set_listen_backlog(int backlog) {
+  if (backlog < 1 || backlog > UINT16_MAX) {
+    throw std::invalid_argument(string_format("[%s] tried to set listen_backlog using invalid value, was '%d'",
+                                              name.c_str(), backlog));
+  }
+  listen_backlog_ = backlog;
+}
+
+void MySQLRouting::set_worker_threads(unsigned int min_threads, unsigned int max_threads) {
+  if (min_threads > max_threads) {
+    throw std::invalid_argument(string_format("[%s] min_worker_threads (%u) must not be greater than "
+                                              "max_worker_threads (%u)", name.c_str(), min_threads, max_threads));
+  }
+  min_worker_threads_ = min_threads;
+  max_worker_threads_ = max_threads;
+}
+
+void MySQLRouting::set_preconnect_pool_size(unsigned int size) {
+  if (size > routing::kMaxPreconnectPoolSize) {
+    throw std::invalid_argument(string_format("[%s] tried to set preconnect_pool_size using invalid value, was '%u'",
+                                              name.c_str(), size));
+  }
+  preconnect_pool_size_ = size;
+}
+
+void MySQLRouting::set_preconnect_max_age(std::chrono::seconds max_age) {
+  if (max_age.count() <= 0) {
+    throw std::invalid_argument(string_format("[%s] tried to set preconnect_max_age using invalid value, was '%lld'",
+                                              name.c_str(), static_cast<long long>(max_age.count())));
+  }
+  preconnect_max_age_ = max_age;
+}
+
+void MySQLRouting::set_connect_race_size(unsigned int size) {
+  if (size < 1 || size > routing::kMaxConnectRaceSize) {
+    throw std::invalid_argument(string_format("[%s] tried to set connect_race_size using invalid value, was '%u'",
+                                              name.c_str(), size));
+  }
+  connect_race_size_ = size;
+}
+
+void MySQLRouting::set_admission_queue(unsigned int size, std::chrono::seconds timeout) {
+  if (timeout.count() <= 0) {
+    throw std::invalid_argument(string_format("[%s] tried to set admission_queue_timeout using invalid value, was '%lld'",
+                                              name.c_str(), static_cast<long long>(timeout.count())));
+  }
+  admission_queue_size_ = size;
+  admission_queue_timeout_ = timeout;
+}
+
+void MySQLRouting::set_io_model(routing::IoModel io_model) {
+  if (io_model == routing::IoModel::kUndefined) {
+    throw std::invalid_argument(string_format("[%s] tried to set io_model using invalid value", name.c_str()));
+  }
+#ifndef __linux__
+  if (io_model == routing::IoModel::kEpoll) {
+    throw std::invalid_argument(string_format("[%s] io_model '%s' is not supported on this platform", name.c_str(),
+                                              routing::get_io_model_name(io_model).c_str()));
+  }
+#endif
+#ifndef HAVE_IO_URING
+  if (io_model == routing::IoModel::kIoUring) {
+    throw std::invalid_argument(string_format("[%s] io_model '%s' is not supported on this platform", name.c_str(),
+                                              routing::get_io_model_name(io_model).c_str()));
+  }
+#endif
+  io_model_ = io_model;
+}
+
 static int get_socket_errno() {
 #ifdef _WIN32
   return GetLastError();
@@ -693,6 +1243,27 @@ void MySQLRouting::setup_tcp_service() {
       continue;
     }
 #endif
+#ifdef SO_REUSEPORT
+    if (acceptor_threads_ > 1 &&
+        socket_operations_->setsockopt(service_tcp_, SOL_SOCKET, SO_REUSEPORT, &option_value,
+            static_cast<socklen_t>(sizeof(int))) == -1) {
+      error = get_message_error(get_socket_errno());
+      log_warning("[%s] setup_tcp_service() error from setsockopt(SO_REUSEPORT): %s", name.c_str(), error.c_str());
+      socket_operations_->close(service_tcp_);
+      service_tcp_ = routing::kInvalidSocket;
+      continue;
+    }
+#endif
+#ifdef __linux__
+    // accepted sockets inherit TCP_NODELAY from the listening socket, which
+    // saves a setsockopt() per connection
+    if (socket_operations_->setsockopt(service_tcp_, IPPROTO_TCP, TCP_NODELAY, &option_value,
+            static_cast<socklen_t>(sizeof(int))) == -1) {
+      log_info("[%s] setup_tcp_service() error from setsockopt(TCP_NODELAY): %s", name.c_str(),
+               get_message_error(get_socket_errno()).c_str());
+      // if it fails, it will be slower, but cause no harm
+    }
+#endif
 
     if (socket_operations_->bind(service_tcp_, info->ai_addr, info->ai_addrlen) == -1) {
       error = get_message_error(get_socket_errno());
@@ -709,9 +1280,43 @@ void MySQLRouting::setup_tcp_service() {
     throw runtime_error(string_format("[%s] Failed to setup service socket: %s", name.c_str(), error.c_str()));
   }
 
-  if (socket_operations_->listen(service_tcp_, kListenQueueSize) < 0) {
+  if (socket_operations_->listen(service_tcp_, listen_backlog_) < 0) {
     throw runtime_error(string_format("[%s] Failed to start listening for connections using TCP", name.c_str()));
   }
+
+  if (acceptor_threads_ > 1) {
+    setup_tcp_service_shards(info);
+  }
+}
+
+void MySQLRouting::setup_tcp_service_shards(const struct addrinfo *info) {
+#ifdef SO_REUSEPORT
+  for (unsigned int i = 1; i < acceptor_threads_; ++i) {
+    int sock = socket_operations_->socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (sock == -1) {
+      throw runtime_error(string_format("[%s] Failed to setup service socket for acceptor %u: %s",
+                                        name.c_str(), i, get_message_error(get_socket_errno()).c_str()));
+    }
+    service_tcp_shards_.push_back(sock);
+
+    int option_value = 1;
+    if (socket_operations_->setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &option_value,
+            static_cast<socklen_t>(sizeof(int))) == -1 ||
+        socket_operations_->setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &option_value,
+            static_cast<socklen_t>(sizeof(int))) == -1 ||
+#ifdef __linux__
+        socket_operations_->setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &option_value,
+            static_cast<socklen_t>(sizeof(int))) == -1 ||
+#endif
+        socket_operations_->bind(sock, info->ai_addr, info->ai_addrlen) == -1 ||
+        socket_operations_->listen(sock, listen_backlog_) < 0) {
+      throw runtime_error(string_format("[%s] Failed to setup service socket for acceptor %u: %s",
+                                        name.c_str(), i, get_message_error(get_socket_errno()).c_str()));
+    }
+  }
+#else
+  (void)info;
+#endif
 }
 
 #ifndef _WIN32
@@ -770,7 +1375,7 @@ retry:
 
   set_unix_socket_permissions(socket_file.c_str()); // throws std::runtime_error
 
-  if (listen(service_named_socket_, kListenQueueSize) < 0) {
+  if (listen(service_named_socket_, listen_backlog_) < 0) {
     throw runtime_error("Failed to start listening for connections using named socket");
   }
 }
@@ -787,9 +1392,16 @@ void MySQLRouting::set_destinations_from_uri(const URI &uri) {
     if (uri.query.find("role") == uri.query.end())
       throw runtime_error("Missing 'role' in routing destination specification");
 
+    if (routing_strategy_ == routing::RoutingStrategy::kFirstAvailable) {
+      throw runtime_error(string_format("routing_strategy '%s' is not supported with metadata-cache destinations",
+                                        routing::get_routing_strategy_name(routing_strategy_).c_str()));
+    }
     destination_.reset(new DestMetadataCacheGroup(uri.host, replicaset_name,
                                                   get_access_mode_name(mode_),
-                                                  uri.query, protocol_->get_type()));
+                                                  uri.query, protocol_->get_type(),
+                                                  routing_strategy_ == routing::RoutingStrategy::kUndefined
+                                                      ? routing::RoutingStrategy::kRoundRobin
+                                                      : routing_strategy_));
   } else {
     throw runtime_error(string_format("Invalid URI scheme; expecting: 'metadata-cache' is: '%s'",
                                       uri.scheme.c_str()));
@@ -802,12 +1414,28 @@ void MySQLRouting::set_destinations_from_csv(const string &csv) {
   std::pair<std::string, uint16_t> info;
 
 
-  if (AccessMode::kReadOnly == mode_) {
-    destination_.reset(new RouteDestination(protocol_->get_type(), socket_operations_));
-  } else if (AccessMode::kReadWrite == mode_) {
+  routing::RoutingStrategy strategy = routing_strategy_;
+  if (strategy == routing::RoutingStrategy::kUndefined) {
+    if (AccessMode::kReadOnly == mode_) {
+      strategy = routing::RoutingStrategy::kRoundRobin;
+    } else if (AccessMode::kReadWrite == mode_) {
+      strategy = routing::RoutingStrategy::kFirstAvailable;
+    } else {
+      throw std::runtime_error("Unknown mode");
+    }
+  }
+
+  if (strategy == routing::RoutingStrategy::kLeastConnections) {
+    destination_.reset(new DestLeastConnections(protocol_->get_type(), socket_operations_));
+  } else if (strategy == routing::RoutingStrategy::kConsistentHash) {
+    destination_.reset(new DestConsistentHash(protocol_->get_type(), socket_operations_));
+  } else if (strategy == routing::RoutingStrategy::kLowestLatency) {
+    destination_.reset(new DestLowestLatency(protocol_->get_type(), socket_operations_,
+                                             destination_connect_timeout_));
+  } else if (strategy == routing::RoutingStrategy::kFirstAvailable) {
     destination_.reset(new DestFirstAvailable(protocol_->get_type(), socket_operations_));
   } else {
-    throw std::runtime_error("Unknown mode");
+    destination_.reset(new RouteDestination(protocol_->get_type(), socket_operations_));
   }
   // Fall back to comma separated list of MySQL servers
   while (std::getline(ss, part, ',')) {
@@ -824,7 +1452,7 @@ void MySQLRouting::set_destinations_from_csv(const string &csv) {
   }
 
   // Check whether bind address is part of list of destinations
-  for (auto &it: *destination_) {
+  for (auto &it: destination_->get_destinations()) {
     if (it == bind_address_) {
       throw std::runtime_error("Bind Address can not be part of destinations");
     }
@@ -847,7 +1475,7 @@ std::chrono::milliseconds MySQLRouting::set_destination_connect_timeout(std::chr
 }
 
 int MySQLRouting::set_max_connections(int maximum) {
-  if (maximum <= 0 || maximum > UINT16_MAX) {
+  if (maximum <= 0 || maximum > routing::kMaxConnectionsLimit) {
     auto err = string_format("[%s] tried to set max_connections using invalid value, was '%d'", name.c_str(),
                              maximum);
     throw std::invalid_argument(err);
@@ -27,13 +27,16 @@
  */
 
 #include "protocol/base_protocol.h"
+#include "admission_queue.h"
 #include "config.h"
 #include "destination.h"
+#include "reactor.h"
 #include "filesystem.h"
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/mysql_protocol.h"
 #include "plugin_config.h"
 #include "utils.h"
+#include "worker_pool.h"
 #include "mysqlrouter/routing.h"
 
 #include <array>
@@ -41,6 +44,7 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <vector>
 
 #ifndef _WIN32
 #  include <arpa/inet.h>
@@ -201,7 +205,7 @@ public:
   /** @brief Sets maximum active connections
    *
    * Sets maximum of active connections. Maximum must be between 1 and
-   * 65535.
+   * routing::kMaxConnectionsLimit.
    *
    * Throws std::invalid_argument when an invalid value was provided.
    *
@@ -229,6 +233,9 @@ public:
   bool block_client_host(const std::array<uint8_t, 16> &client_ip_array,
                          const std::string &client_ip_str, int server = -1);
 
+  /** @brief Returns whether a client host reached max_connect_errors */
+  bool is_client_host_blocked(const std::array<uint8_t, 16> &client_ip_array) const;
+
   /** @brief Returns list of blocked client hosts
    *
    * Returns list of the blocked client hosts.
@@ -243,6 +250,258 @@ public:
     return max_connections_;
   }
 
+  /** @brief Sets the I/O model used to service client connections
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when the I/O model is not valid or not
+   * supported on this platform.
+   *
+   * @param io_model I/O model
+   */
+  void set_io_model(routing::IoModel io_model);
+
+  /** @brief Returns the I/O model used to service client connections */
+  routing::IoModel get_io_model() const noexcept {
+    return io_model_;
+  }
+
+  /** @brief Sets the number of threads accepting TCP connections
+   *
+   * With more than one thread, every acceptor thread listens on a socket
+   * of its own bound to the same address using SO_REUSEPORT, and the
+   * kernel distributes incoming connections over them. The named socket
+   * is always served by the first acceptor thread.
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when the number is out of range or
+   * SO_REUSEPORT is not supported on this platform.
+   *
+   * @param threads number of acceptor threads
+   */
+  void set_acceptor_threads(unsigned int threads);
+
+  /** @brief Returns the number of threads accepting TCP connections */
+  unsigned int get_acceptor_threads() const noexcept {
+    return acceptor_threads_;
+  }
+
+  /** @brief Sets the size of the queue of connections waiting to be accepted
+   *
+   * The value is passed to listen() for every listening socket and capped
+   * by the operating system (`net.core.somaxconn` on Linux).
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when the value is out of range.
+   *
+   * @param backlog size of the queue, between 1 and 65535
+   */
+  void set_listen_backlog(int backlog);
+
+  /** @brief Returns the size of the queue of connections waiting to be accepted */
+  int get_listen_backlog() const noexcept {
+    return listen_backlog_;
+  }
+
+  /** @brief Sets the size of the pool of threads servicing client connections
+   *
+   * With `max_threads` set to 0, which is the default, every client
+   * connection is serviced by a thread of its own, started when the
+   * connection is accepted. Otherwise connections are handed over to a pool
+   * which keeps between `min_threads` and `max_threads` threads around.
+   *
+   * A thread of the pool services its connection until it is closed, so
+   * with io_model=thread `max_threads` caps the number of concurrent
+   * connections of the route, below `max_connections`. When all threads are
+   * busy, clients wait without getting a greeting; those not serviced
+   * within the client connect timeout get error 1040 (Too many connections).
+   *
+   * With io_model=epoll and io_model=io_uring, the threads of the pool
+   * only connect clients to their destinations before handing them to the
+   * reactor, and `max_threads` set to 0 means
+   * routing::kDefaultReactorConnectThreads.
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when min_threads is greater than max_threads.
+   *
+   * @param min_threads number of threads kept when idle
+   * @param max_threads maximum number of threads; 0 disables the pool
+   */
+  void set_worker_threads(unsigned int min_threads, unsigned int max_threads);
+
+  /** @brief Sets the number of connections kept ready per destination
+   *
+   * When not 0, connections to the destinations are established ahead of
+   * time, as many as the rate of client connections asks for but at most
+   * `size` per destination. New clients get one of these instead of
+   * waiting for a connection to be established.
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when the size is out of range.
+   *
+   * @param size maximum number of connections per destination; 0 disables
+   */
+  void set_preconnect_pool_size(unsigned int size);
+
+  /** @brief Returns the maximum number of connections kept ready per destination */
+  unsigned int get_preconnect_pool_size() const noexcept {
+    return preconnect_pool_size_;
+  }
+
+  /** @brief Sets the time after which connections kept ready are closed
+   *
+   * The server closes connections which did not authenticate within its
+   * `connect_timeout`, so `max_age` has to be shorter. When a server closes
+   * connections kept ready earlier, they are kept for a shorter time and a
+   * warning is logged.
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when max_age is not positive.
+   *
+   * @param max_age time after which connections which were not used are closed
+   */
+  void set_preconnect_max_age(std::chrono::seconds max_age);
+
+  /** @brief Returns the time after which connections kept ready are closed */
+  std::chrono::seconds get_preconnect_max_age() const noexcept {
+    return preconnect_max_age_;
+  }
+
+  /** @brief Sets the number of destinations connected to at the same time
+   *
+   * When a destination does not answer within routing::kConnectRaceDelay,
+   * the next one is connected to as well, up to `size` destinations, and
+   * the client gets the first connection established. Does not apply to
+   * the first-available mode, which keeps trying destinations in order.
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when the size is out of range.
+   *
+   * @param size number of destinations; 1 tries them one after the other
+   */
+  void set_connect_race_size(unsigned int size);
+
+  /** @brief Returns the number of destinations connected to at the same time */
+  unsigned int get_connect_race_size() const noexcept {
+    return connect_race_size_;
+  }
+
+  /** @brief Sets how the destination of a client connection is picked
+   *
+   * With routing::RoutingStrategy::kUndefined, the default of the mode
+   * is used: first-available for read-write routes with a static list of
+   * destinations, round-robin otherwise.
+   *
+   * Must be called before set_destinations_from_csv() or
+   * set_destinations_from_uri().
+   *
+   * @param routing_strategy routing strategy
+   */
+  void set_routing_strategy(routing::RoutingStrategy routing_strategy) noexcept {
+    routing_strategy_ = routing_strategy;
+  }
+
+  /** @brief Returns how the destination of a client connection is picked */
+  routing::RoutingStrategy get_routing_strategy() const noexcept {
+    return routing_strategy_;
+  }
+
+  /** @brief Sets how quarantined destinations are checked for recovery
+   *
+   * @param quarantine_probe quarantine probe
+   */
+  void set_quarantine_probe(routing::QuarantineProbe quarantine_probe) noexcept {
+    quarantine_probe_ = quarantine_probe;
+  }
+
+  /** @brief Returns how quarantined destinations are checked for recovery */
+  routing::QuarantineProbe get_quarantine_probe() const noexcept {
+    return quarantine_probe_;
+  }
+
+  /** @brief Sets the maximum number of connections routed to one destination
+   *
+   * @param max maximum number of connections; 0 for no maximum
+   */
+  void set_max_connections_per_destination(unsigned int max) noexcept {
+    max_connections_per_destination_ = max;
+  }
+
+  /** @brief Returns the maximum number of connections routed to one destination */
+  unsigned int get_max_connections_per_destination() const noexcept {
+    return max_connections_per_destination_;
+  }
+
+  /** @brief Lets clients wait for a free slot when max_connections are active
+   *
+   * Must be called before start().
+   *
+   * Throws std::invalid_argument when timeout is not positive.
+   *
+   * @param size maximum number of waiting clients; 0 rejects them right away
+   * @param timeout maximum time a client waits
+   */
+  void set_admission_queue(unsigned int size, std::chrono::seconds timeout);
+
+  /** @brief Returns the maximum number of clients waiting for a free slot */
+  unsigned int get_admission_queue_size() const noexcept {
+    return admission_queue_size_;
+  }
+
+  /** @brief Returns the queue of clients waiting for a free slot
+   *
+   * @return the queue, or nullptr when the route was not started with one
+   */
+  const AdmissionQueue *get_admission_queue() const noexcept {
+    return admission_queue_.get();
+  }
+
+  /** @brief Returns the metrics of the queue of clients waiting for a free slot
+   *
+   * @return the metrics, all zero when the route was not started with a queue
+   */
+  AdmissionQueue::Stats get_admission_queue_stats() const;
+
+  /** @brief Returns the pool servicing client connections
+   *
+   * @return the pool, or nullptr when the route was not started with one
+   */
+  const WorkerPool *get_worker_pool() const noexcept {
+    return worker_pool_.get();
+  }
+
+  /** @brief Returns the metrics of the pool servicing client connections
+   *
+   * @return the metrics, all zero when the route was not started with a pool
+   */
+  WorkerPool::Stats get_worker_pool_stats() const;
+
+  /** @brief Returns the counters of the outlier detection of the destinations
+   *
+   * @return the counters, all zero when no destinations were set
+   */
+  OutlierDetector::Stats get_outlier_stats() const;
+
+  /** @brief Counters of a thread accepting connections */
+  struct AcceptorStats {
+    /** @brief Number of connections accepted */
+    uint64_t accepted;
+  };
+
+  /** @brief Returns the counters of the acceptor threads
+   *
+   * @return one entry per acceptor thread started, the first one being
+   *         the thread which also accepts on the named socket; empty until
+   *         the route accepts connections
+   */
+  std::vector<AcceptorStats> get_acceptor_stats() const;
+
 private:
   /** @brief Sets up the TCP service
    *
@@ -282,8 +541,104 @@ private:
    */
   void routing_select_thread(int client, const sockaddr_storage &client_addr) noexcept;
 
+  /** @brief Connects a client with a destination server
+   *
+   * When no destination is available, the client is sent an error and
+   * its socket is closed.
+   *
+   * @param client socket descriptor of the client connection
+   * @param client_key key of the client, see client_key()
+   * @param address set to the address of the server, if not nullptr
+   * @return socket descriptor of the server or routing::kInvalidSocket
+   */
+  int connect_server(int client, uint64_t client_key, mysqlrouter::TCPAddress *address = nullptr) noexcept;
+
+  /** @brief Tears down a routed connection
+   *
+   * Blocks the client host when the handshake was not finished, closes
+   * both sockets and logs the bytes transferred.
+   *
+   * @param client socket descriptor of the client connection
+   * @param client_addr IP address as sockaddr_storage struct
+   * @param server socket descriptor of the server connection
+   * @param handshake_done whether the handshake was finished
+   * @param bytes_up bytes sent from server to client
+   * @param bytes_down bytes sent from client to server
+   * @param extra_msg reason the connection was closed (for logging)
+   */
+  void close_connection(int client, const sockaddr_storage &client_addr, int server,
+                        bool handshake_done, size_t bytes_up, size_t bytes_down,
+                        const std::string &extra_msg) noexcept;
+
   void start_acceptor();
 
+  /** @brief Accepts client connections until the route is stopped
+   *
+   * Runs in every acceptor thread.
+   *
+   * @param shard number of the acceptor thread, indexing its counters
+   * @param service_tcp TCP socket to accept connections on or kInvalidSocket
+   * @param service_named_socket named socket to accept connections on or kInvalidSocket
+   */
+  void accept_connections(size_t shard, int service_tcp, int service_named_socket);
+
+  /** @brief Checks a freshly accepted client and hands it over for routing
+   *
+   * @param sock_client socket of the client
+   * @param client_addr address of the client
+   * @param is_tcp whether the client connected over TCP
+   */
+  void handle_accepted_client(int sock_client, const sockaddr_storage &client_addr, bool is_tcp);
+
+  /** @brief Hands over a client with a free connection slot for routing
+   *
+   * @param sock_client socket of the client
+   * @param client_addr address of the client
+   * @param is_tcp whether the client connected over TCP
+   */
+  void dispatch_client(int sock_client, const sockaddr_storage &client_addr, bool is_tcp);
+
+  /** @brief Sends "Too many connections" to a client and closes it */
+  void reject_client(int sock_client);
+
+  /** @brief Passes on the slot of a connection which closed or never got established
+   *
+   * Called on every path on which a client dispatched with a free slot does
+   * not become an active connection, or stops being one, so that the next
+   * client waiting in the admission queue gets the slot.
+   */
+  void connection_slot_unused() noexcept;
+
+  /** @brief Logs the metrics of the admission queue, the worker pool and the outlier detection
+   *
+   * Called every routing::kStatsLogInterval while the route runs, and once
+   * when it stopped. While it runs, only what changed since the last log
+   * is logged.
+   *
+   * @param stopped whether the route stopped
+   */
+  void log_stats(bool stopped);
+
+  /** @brief Opens the listening sockets of acceptor threads 2 to N
+   *
+   * @param info address the first TCP listening socket is bound to
+   */
+  void setup_tcp_service_shards(const struct addrinfo *info);
+
+#ifdef __linux__
+  /** @brief Starts the reactor used with io_model=epoll or io_model=io_uring
+   *
+   * Throws std::runtime_error on errors.
+   */
+  void start_reactor();
+
+  /** @brief Connects a client to a destination and hands both to the reactor
+   *
+   * Runs in a thread of the worker pool.
+   */
+  void connect_reactor_client(int sock_client, const sockaddr_storage &client_addr);
+#endif
+
   /** @brief return a short string suitable to be used as a thread name
    * @param config_name configuration name (e.g: "routing", "routing:test_default_x_ro", etc)
    * @param prefix thread name prefix (e.g. "RtS")
@@ -321,14 +676,24 @@ private:
   const mysql_harness::Path bind_named_socket_;
   /** @brief Socket descriptor of the TCP service */
   int service_tcp_;
+  /** @brief Number of threads accepting connections */
+  unsigned int acceptor_threads_;
+  /** @brief Size of the queue of connections waiting to be accepted */
+  int listen_backlog_;
+  /** @brief SO_REUSEPORT sockets of the TCP service for acceptor threads 2 to N */
+  std::vector<int> service_tcp_shards_;
+  /** @brief Connections accepted by each of the acceptor_threads_ threads */
+  std::unique_ptr<std::atomic<uint64_t>[]> accepted_;
+  /** @brief Number of acceptor threads started; set once all of them are */
+  std::atomic<size_t> acceptors_started_;
   /** @brief Socket descriptor of the named socket service */
   int service_named_socket_;
   /** @brief Destination object to use when getting next connection */
   std::unique_ptr<RouteDestination> destination_;
   /** @brief Whether we were asked to stop */
   std::atomic<bool> stopping_;
-  /** @brief Number of active routes */
-  std::atomic<uint16_t> info_active_routes_;
+  /** @brief Number of active routes; compared with max_connections_ */
+  std::atomic<int> info_active_routes_;
   /** @brief Number of handled routes */
   std::atomic<uint64_t> info_handled_routes_;
 
@@ -338,13 +703,67 @@ private:
 
   /** @brief TCP (and UNIX socket) service thread */
   std::thread thread_acceptor_;
+  /** @brief Threads accepting on service_tcp_shards_ */
+  std::vector<std::thread> thread_acceptor_shards_;
   /** @brief object handling the operations on network sockets */
   routing::SocketOperationsBase* socket_operations_;
   /** @brief object to handle protocol specific stuff */
   std::unique_ptr<BaseProtocol> protocol_;
+  /** @brief I/O model used to service client connections */
+  routing::IoModel io_model_;
+  /** @brief Number of threads the worker pool keeps when idle */
+  unsigned int min_worker_threads_;
+  /** @brief Maximum number of threads of the worker pool; 0 if not pooled */
+  unsigned int max_worker_threads_;
+  /** @brief Maximum number of connections kept ready per destination */
+  unsigned int preconnect_pool_size_;
+  /** @brief Time after which connections kept ready are closed */
+  std::chrono::seconds preconnect_max_age_;
+
+  /** @brief Number of destinations connected to at the same time */
+  unsigned int connect_race_size_;
+  /** @brief How the destination of a client connection is picked */
+  routing::RoutingStrategy routing_strategy_;
+  /** @brief How quarantined destinations are checked for recovery */
+  routing::QuarantineProbe quarantine_probe_;
+  /** @brief Maximum number of connections routed to one destination; 0 for no maximum */
+  unsigned int max_connections_per_destination_;
+  /** @brief Maximum number of clients waiting for a free slot; 0 if not queued */
+  unsigned int admission_queue_size_;
+  /** @brief Maximum time a client waits for a free slot */
+  std::chrono::seconds admission_queue_timeout_;
+  /** @brief Clients waiting for a free slot when admission_queue_size_ > 0 */
+  std::unique_ptr<AdmissionQueue> admission_queue_;
+  /** @brief Threads servicing client connections when max_worker_threads_ > 0
+   *
+   * With io_model=epoll and io_model=io_uring the threads only connect to
+   * the destinations.
+   */
+  std::unique_ptr<WorkerPool> worker_pool_;
+
+  /** @brief Activity counted by the metrics when log_stats() last logged them */
+  struct LoggedStats {
+    uint64_t admission_queue;
+    uint64_t worker_pool;
+    uint64_t outlier_detection;
+    uint64_t accepted;
+  };
+  LoggedStats logged_stats_;
+#ifdef __linux__
+  /** @brief Reactor servicing the connections when using io_model=epoll or io_model=io_uring
+   *
+   * Declared last so it is stopped before anything it uses is destroyed.
+   */
+  std::unique_ptr<Reactor> reactor_;
+#endif
 
 #ifdef FRIEND_TEST
   FRIEND_TEST(RoutingTests, bug_24841281);
+  FRIEND_TEST(RoutingTests, AcceptorThreads);
+  FRIEND_TEST(RoutingTests, ListenBacklog);
+  FRIEND_TEST(RoutingTests, WorkerPool);
+  FRIEND_TEST(RoutingTests, AdmissionQueueSlotOfFailedConnect);
+  FRIEND_TEST(RoutingTests, PreconnectPool);
   FRIEND_TEST(RoutingTests, make_thread_name);
   FRIEND_TEST(ClassicProtocolRoutingTest, NoValidDestinations);
 #ifndef _WIN32
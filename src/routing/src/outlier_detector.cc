@@ -0,0 +1,171 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "outlier_detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+using mysqlrouter::TCPAddress;
+
+std::vector<OutlierDetector::Ejection> OutlierDetector::record_success(const TCPAddress &address,
+                                                                       std::chrono::microseconds latency,
+                                                                       size_t pool_size,
+                                                                       clock_type::time_point now) {
+  std::vector<Ejection> ejections;
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.successes;
+  Destination &dest = destinations_[address];
+  ++dest.successes;
+  dest.consecutive_failures = 0;
+  double sample = static_cast<double>(latency.count());
+  if (dest.latency == 0) {
+    dest.latency = sample;
+  } else {
+    dest.latency += routing::kLatencyWeight * (sample - dest.latency);
+  }
+  evaluate(pool_size, now, &ejections);
+  return ejections;
+}
+
+std::vector<OutlierDetector::Ejection> OutlierDetector::record_failure(const TCPAddress &address,
+                                                                       size_t pool_size,
+                                                                       clock_type::time_point now) {
+  std::vector<Ejection> ejections;
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.failures;
+  Destination &dest = destinations_[address];
+  ++dest.failures;
+  // connections handed out before the ejection may still fail
+  if (++dest.consecutive_failures >= routing::kOutlierConsecutiveFailures && dest.ejected_until <= now) {
+    dest.consecutive_failures = 0;
+    if (eject(address, dest, pool_size, now, &ejections)) {
+      ++stats_.consecutive_failure_ejections;
+    }
+  }
+  evaluate(pool_size, now, &ejections);
+  return ejections;
+}
+
+bool OutlierDetector::is_ejected(const TCPAddress &address, clock_type::time_point now) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = destinations_.find(address);
+  return it != destinations_.end() && it->second.ejected_until > now;
+}
+
+OutlierDetector::Stats OutlierDetector::get_stats(clock_type::time_point now) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.ejected = num_ejected(now);
+  return stats;
+}
+
+size_t OutlierDetector::num_ejected(clock_type::time_point now) const {
+  return static_cast<size_t>(std::count_if(destinations_.begin(), destinations_.end(),
+      [now](const std::pair<const TCPAddress, Destination> &it) { return it.second.ejected_until > now; }));
+}
+
+bool OutlierDetector::eject(const TCPAddress &address, Destination &dest, size_t pool_size,
+                            clock_type::time_point now, std::vector<Ejection> *ejections) {
+  // the last destination is kept even when failing: clients get errors either way
+  size_t max_ejected = pool_size < 2 ? 0 : std::max<size_t>(1, pool_size * routing::kOutlierMaxEjectionPercent / 100);
+  if (num_ejected(now) >= std::min(max_ejected, pool_size - 1)) {
+    ++stats_.ejections_skipped;
+    return false;
+  }
+
+  ++dest.times_ejected;
+  auto duration = std::min<std::chrono::milliseconds>(base_ejection_time_ * dest.times_ejected,
+                                                      routing::kOutlierMaxEjectionTime);
+  dest.ejected_until = now + duration;
+  ejections->push_back(Ejection{address, duration});
+  return true;
+}
+
+void OutlierDetector::evaluate(size_t pool_size, clock_type::time_point now, std::vector<Ejection> *ejections) {
+  if (next_evaluation_ == clock_type::time_point()) {
+    next_evaluation_ = now + interval_;
+  }
+  if (now < next_evaluation_) {
+    return;
+  }
+  next_evaluation_ = now + interval_;
+
+  // only destinations in rotation with enough connections are compared
+  std::vector<std::pair<const TCPAddress *, Destination *>> active;
+  for (auto &it : destinations_) {
+    Destination &dest = it.second;
+    if (dest.ejected_until <= now && dest.successes + dest.failures >= routing::kOutlierMinRequests) {
+      active.emplace_back(&it.first, &dest);
+    }
+  }
+
+  if (active.size() >= routing::kOutlierMinDestinations) {
+    std::vector<double> rates;
+    for (auto &it : active) {
+      rates.push_back(static_cast<double>(it.second->successes) /
+                      static_cast<double>(it.second->successes + it.second->failures));
+    }
+    double mean = 0;
+    for (double rate : rates) {
+      mean += rate;
+    }
+    mean /= static_cast<double>(rates.size());
+    double variance = 0;
+    for (double rate : rates) {
+      variance += (rate - mean) * (rate - mean);
+    }
+    double threshold = mean - std::min(routing::kOutlierSuccessRateStdevFactor *
+                                       std::sqrt(variance / static_cast<double>(rates.size())),
+                                       routing::kOutlierSuccessRateMargin);
+
+    std::vector<double> latencies;
+    for (auto &it : active) {
+      if (it.second->latency > 0) {
+        latencies.push_back(it.second->latency);
+      }
+    }
+    double median = 0;
+    if (latencies.size() >= routing::kOutlierMinDestinations) {
+      std::nth_element(latencies.begin(), latencies.begin() + latencies.size() / 2, latencies.end());
+      median = latencies[latencies.size() / 2];
+    }
+
+    for (size_t i = 0; i < active.size(); ++i) {
+      Destination &dest = *active[i].second;
+      if (rates[i] < threshold) {
+        if (eject(*active[i].first, dest, pool_size, now, ejections)) {
+          ++stats_.success_rate_ejections;
+        }
+      } else if (median > 0 && dest.latency > routing::kOutlierLatencyFactor * median) {
+        if (eject(*active[i].first, dest, pool_size, now, ejections)) {
+          ++stats_.latency_ejections;
+        }
+      }
+    }
+  }
+
+  for (auto &it : destinations_) {
+    Destination &dest = it.second;
+    // healthy again: the next ejection is shorter
+    if (dest.times_ejected > 0 && dest.ejected_until <= now && dest.successes > 0 && dest.failures == 0) {
+      --dest.times_ejected;
+    }
+    dest.successes = 0;
+    dest.failures = 0;
+  }
+}
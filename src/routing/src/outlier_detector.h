@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_OUTLIER_DETECTOR_INCLUDED
+#define ROUTING_OUTLIER_DETECTOR_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/routing.h"
+
+/** @class OutlierDetector
+ * @brief Finds destinations which fail or are slow compared to the others
+ *
+ * Connections handed to a destination end up as a success, when the
+ * server greeted the client in time, or as a failure, when the server
+ * did not greet, refused the client with an error or disconnected it
+ * right after the handshake. A destination is ejected when
+ *
+ * - it failed routing::kOutlierConsecutiveFailures times in a row,
+ * - its success rate during the last routing::kOutlierInterval was more
+ *   than routing::kOutlierSuccessRateStdevFactor standard deviations, or
+ *   more than routing::kOutlierSuccessRateMargin, below the mean of all
+ *   destinations, or
+ * - its average greeting latency is more than routing::kOutlierLatencyFactor
+ *   times the median of all destinations.
+ *
+ * Ejections last routing::kOutlierBaseEjectionTime times the number of
+ * times the destination was ejected, up to routing::kOutlierMaxEjectionTime.
+ * Never more than routing::kOutlierMaxEjectionPercent of the destinations
+ * are ejected at the same time, and never all of them.
+ *
+ * The detector only decides; the caller takes ejected destinations out of
+ * rotation. Thread-safe.
+ */
+class OutlierDetector {
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  /** @brief A destination to take out of rotation */
+  struct Ejection {
+    mysqlrouter::TCPAddress address;
+    std::chrono::milliseconds duration;
+  };
+
+  /** @brief Counters for monitoring */
+  struct Stats {
+    /** @brief Number of connections reported as success */
+    uint64_t successes = 0;
+    /** @brief Number of connections reported as failure */
+    uint64_t failures = 0;
+    /** @brief Ejections after consecutive failures */
+    uint64_t consecutive_failure_ejections = 0;
+    /** @brief Ejections for a low success rate */
+    uint64_t success_rate_ejections = 0;
+    /** @brief Ejections for a high greeting latency */
+    uint64_t latency_ejections = 0;
+    /** @brief Outliers left in rotation because too many were ejected */
+    uint64_t ejections_skipped = 0;
+    /** @brief Destinations ejected right now */
+    size_t ejected = 0;
+
+    uint64_t ejections() const noexcept {
+      return consecutive_failure_ejections + success_rate_ejections + latency_ejections;
+    }
+  };
+
+  /** @brief Constructor
+   *
+   * @param interval time between two evaluations of success rates and latencies
+   * @param base_ejection_time time of the first ejection of a destination
+   */
+  OutlierDetector(std::chrono::milliseconds interval = routing::kOutlierInterval,
+                  std::chrono::milliseconds base_ejection_time = routing::kOutlierBaseEjectionTime)
+      : interval_(interval), base_ejection_time_(base_ejection_time) {}
+
+  /** @brief Records that a destination greeted a client in time
+   *
+   * @param address the destination
+   * @param latency time from connecting to the greeting
+   * @param pool_size number of destinations
+   * @param now current time
+   * @return destinations to eject
+   */
+  std::vector<Ejection> record_success(const mysqlrouter::TCPAddress &address,
+                                       std::chrono::microseconds latency, size_t pool_size,
+                                       clock_type::time_point now = clock_type::now());
+
+  /** @brief Records that a destination failed a client
+   *
+   * @param address the destination
+   * @param pool_size number of destinations
+   * @param now current time
+   * @return destinations to eject
+   */
+  std::vector<Ejection> record_failure(const mysqlrouter::TCPAddress &address, size_t pool_size,
+                                       clock_type::time_point now = clock_type::now());
+
+  /** @brief Returns whether a destination is ejected */
+  bool is_ejected(const mysqlrouter::TCPAddress &address,
+                  clock_type::time_point now = clock_type::now()) const;
+
+  /** @brief Returns the counters */
+  Stats get_stats(clock_type::time_point now = clock_type::now()) const;
+
+ private:
+  struct Destination {
+    /** @brief Successes in the current interval */
+    uint64_t successes = 0;
+    /** @brief Failures in the current interval */
+    uint64_t failures = 0;
+    unsigned int consecutive_failures = 0;
+    /** @brief Moving average of the greeting latency in microseconds; 0 when unknown */
+    double latency = 0;
+    /** @brief Number of times ejected; lowered again by intervals without failures */
+    unsigned int times_ejected = 0;
+    clock_type::time_point ejected_until;
+  };
+
+  /** @brief Ejects a destination unless too many are ejected already
+   *
+   * @return whether it was ejected
+   */
+  bool eject(const mysqlrouter::TCPAddress &address, Destination &dest, size_t pool_size,
+             clock_type::time_point now, std::vector<Ejection> *ejections);
+
+  /** @brief Compares success rates and latencies when an interval is over */
+  void evaluate(size_t pool_size, clock_type::time_point now, std::vector<Ejection> *ejections);
+
+  size_t num_ejected(clock_type::time_point now) const;
+
+  const std::chrono::milliseconds interval_;
+  const std::chrono::milliseconds base_ejection_time_;
+  /** @brief End of the current interval; starts with the first connection */
+  clock_type::time_point next_evaluation_;
+
+  std::map<mysqlrouter::TCPAddress, Destination> destinations_;
+  Stats stats_;
+  mutable std::mutex mutex_;
+};
+
+#endif  // ROUTING_OUTLIER_DETECTOR_INCLUDED
@@ -47,15 +47,36 @@ RoutingPluginConfig::RoutingPluginConfig(const mysql_harness::ConfigSection *sec
       named_socket(get_option_named_socket(section, "socket")),
       connect_timeout(get_uint_option<uint16_t>(section, "connect_timeout", 1)),
       mode(get_option_mode(section, "mode")),
-      max_connections(get_uint_option<uint16_t>(section, "max_connections", 1)),
+      max_connections(static_cast<int>(get_uint_option<uint32_t>(section, "max_connections", 1,
+                                                                 static_cast<uint32_t>(routing::kMaxConnectionsLimit)))),
       max_connect_errors(get_uint_option<uint32_t>(section, "max_connect_errors", 1, UINT32_MAX)),
       client_connect_timeout(get_uint_option<uint32_t>(section, "client_connect_timeout", 2, 31536000)),
-      net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)) {
+      net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)),
+      io_model(get_option_io_model(section, "io_model")),
+      acceptor_threads(get_uint_option<uint16_t>(section, "acceptor_threads", 1,
+                                                 static_cast<uint16_t>(routing::kMaxAcceptorThreads))),
+      listen_backlog(get_uint_option<uint16_t>(section, "listen_backlog", 1)),
+      min_worker_threads(get_uint_option<uint16_t>(section, "min_worker_threads", 0)),
+      max_worker_threads(get_uint_option<uint16_t>(section, "max_worker_threads", 0)),
+      preconnect_pool_size(get_uint_option<uint16_t>(section, "preconnect_pool_size", 0,
+                                                     static_cast<uint16_t>(routing::kMaxPreconnectPoolSize))),
+      preconnect_max_age(get_uint_option<uint32_t>(section, "preconnect_max_age", 1, 31536000)),
+      connect_race_size(get_uint_option<uint16_t>(section, "connect_race_size", 1,
+                                                  static_cast<uint16_t>(routing::kMaxConnectRaceSize))),
+      routing_strategy(get_option_routing_strategy(section, "routing_strategy")),
+      quarantine_probe(get_option_quarantine_probe(section, "quarantine_probe")),
+      max_connections_per_destination(get_uint_option<uint16_t>(section, "max_connections_per_destination", 0)),
+      admission_queue_size(get_uint_option<uint16_t>(section, "admission_queue_size", 0)),
+      admission_queue_timeout(get_uint_option<uint16_t>(section, "admission_queue_timeout", 1, 3600)) {
 
   // either bind_address or socket needs to be set, or both
   if (!bind_address.port && !named_socket.is_set()) {
     throw invalid_argument("either bind_address or socket option needs to be supplied, or both");
   }
+
+  if (min_worker_threads > max_worker_threads) {
+    throw invalid_argument(get_log_prefix("min_worker_threads") + " must not be greater than max_worker_threads");
+  }
 }
 
 
@@ -68,6 +89,18 @@ string RoutingPluginConfig::get_default(const string &option) {
       {"max_connect_errors", to_string(routing::kDefaultMaxConnectErrors)},
       {"client_connect_timeout", to_string(std::chrono::duration_cast<std::chrono::seconds>(routing::kDefaultClientConnectTimeout).count())},
       {"net_buffer_length", to_string(routing::kDefaultNetBufferLength)},
+      {"io_model", routing::kDefaultIoModel},
+      {"acceptor_threads", to_string(routing::kDefaultAcceptorThreads)},
+      {"listen_backlog", to_string(routing::kDefaultListenBacklog)},
+      {"min_worker_threads", to_string(routing::kDefaultMinWorkerThreads)},
+      {"max_worker_threads", to_string(routing::kDefaultMaxWorkerThreads)},
+      {"preconnect_pool_size", to_string(routing::kDefaultPreconnectPoolSize)},
+      {"preconnect_max_age", to_string(routing::kDefaultPreconnectMaxAge.count())},
+      {"connect_race_size", to_string(routing::kDefaultConnectRaceSize)},
+      {"quarantine_probe", routing::kDefaultQuarantineProbe},
+      {"max_connections_per_destination", to_string(routing::kDefaultMaxConnectionsPerDestination)},
+      {"admission_queue_size", to_string(routing::kDefaultAdmissionQueueSize)},
+      {"admission_queue_timeout", to_string(routing::kDefaultAdmissionQueueTimeout.count())},
   };
 
   auto it = defaults.find(option);
@@ -108,6 +141,57 @@ routing::AccessMode RoutingPluginConfig::get_option_mode(
   return result;
 }
 
+routing::IoModel RoutingPluginConfig::get_option_io_model(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string valid;
+  routing::get_io_model_names(&valid);
+
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::IoModel result = routing::get_io_model(value);
+  if (result == routing::IoModel::kUndefined) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
+routing::RoutingStrategy RoutingPluginConfig::get_option_routing_strategy(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string value = get_option_string(section, option);
+  if (value.empty()) {
+    // the mode decides
+    return routing::RoutingStrategy::kUndefined;
+  }
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::RoutingStrategy result = routing::get_routing_strategy(value);
+  if (result == routing::RoutingStrategy::kUndefined) {
+    string valid;
+    routing::get_routing_strategy_names(&valid);
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
+routing::QuarantineProbe RoutingPluginConfig::get_option_quarantine_probe(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string valid;
+  routing::get_quarantine_probe_names(&valid);
+
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::QuarantineProbe result = routing::get_quarantine_probe(value);
+  if (result == routing::QuarantineProbe::kUndefined) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
 Protocol::Type RoutingPluginConfig::get_protocol(const mysql_harness::ConfigSection *section,
                                                  const std::string &option) {
   std::string name;
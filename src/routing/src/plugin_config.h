@@ -78,11 +78,42 @@ public:
   const unsigned int client_connect_timeout;
   /** @brief Size of buffer to receive packets */
   const unsigned int net_buffer_length;
+  /** @brief `io_model` option read from configuration section */
+  const routing::IoModel io_model;
+  /** @brief `acceptor_threads` option read from configuration section */
+  const unsigned int acceptor_threads;
+  /** @brief `listen_backlog` option read from configuration section */
+  const int listen_backlog;
+  /** @brief `min_worker_threads` option read from configuration section */
+  const unsigned int min_worker_threads;
+  /** @brief `max_worker_threads` option read from configuration section */
+  const unsigned int max_worker_threads;
+  /** @brief `preconnect_pool_size` option read from configuration section */
+  const unsigned int preconnect_pool_size;
+  /** @brief `preconnect_max_age` option read from configuration section */
+  const unsigned int preconnect_max_age;
+  /** @brief `connect_race_size` option read from configuration section */
+  const unsigned int connect_race_size;
+  /** @brief `routing_strategy` option read from configuration section */
+  const routing::RoutingStrategy routing_strategy;
+  /** @brief `quarantine_probe` option read from configuration section */
+  const routing::QuarantineProbe quarantine_probe;
+  /** @brief `max_connections_per_destination` option read from configuration section */
+  const unsigned int max_connections_per_destination;
+  /** @brief `admission_queue_size` option read from configuration section */
+  const unsigned int admission_queue_size;
+  /** @brief `admission_queue_timeout` option read from configuration section */
+  const unsigned int admission_queue_timeout;
 
 protected:
 
 private:
   routing::AccessMode get_option_mode(const mysql_harness::ConfigSection *section, const std::string &option);
+  routing::IoModel get_option_io_model(const mysql_harness::ConfigSection *section, const std::string &option);
+  routing::QuarantineProbe get_option_quarantine_probe(const mysql_harness::ConfigSection *section,
+                                                       const std::string &option);
+  routing::RoutingStrategy get_option_routing_strategy(const mysql_harness::ConfigSection *section,
+                                                       const std::string &option);
   std::string get_option_destinations(const mysql_harness::ConfigSection *section, const std::string &option,
                                       const Protocol::Type &protocol_type);
   Protocol::Type get_protocol(const mysql_harness::ConfigSection *section, const std::string &option);
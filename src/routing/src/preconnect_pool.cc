@@ -0,0 +1,325 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "preconnect_pool.h"
+
+#include "common.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#  include <poll.h>
+#endif
+
+using mysqlrouter::TCPAddress;
+
+constexpr std::chrono::milliseconds PreconnectPool::kRefillInterval;
+constexpr std::chrono::milliseconds PreconnectPool::kDefaultMaxAge;
+// well below the server's default max_connect_errors of 100
+const uint64_t PreconnectPool::kMaxUnusedPerRequest = 10;
+
+// weight of the last interval in the smoothed demand
+static const double kRateWeight = 0.3;
+// demand below which a destination gets no sockets
+static const double kMinRate = 0.05;
+// the server's connect_timeout is at least 2 seconds; sockets closed by
+// the server earlier were closed for other reasons
+static const std::chrono::milliseconds kMinServerConnectTimeout{2000};
+
+PreconnectPool::PreconnectPool(routing::SocketOperationsBase *socket_operations, size_t max_size,
+                               std::chrono::milliseconds connect_timeout,
+                               std::chrono::milliseconds max_age)
+    : socket_operations_(socket_operations),
+      max_size_(max_size),
+      connect_timeout_(connect_timeout),
+      max_age_(max_age),
+      stopping_(false),
+      stats_{0, 0, 0, 0} {}
+
+PreconnectPool::~PreconnectPool() {
+  stop();
+}
+
+void PreconnectPool::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!refill_thread_.joinable()) {
+    stopping_ = false;
+    refill_thread_ = std::thread(&PreconnectPool::run, this);
+  }
+}
+
+void PreconnectPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    refill_cond_.notify_all();
+  }
+  if (refill_thread_.joinable()) {
+    refill_thread_.join();
+  }
+
+  std::vector<int> unused;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &it : destinations_) {
+      for (auto &sock : it.second.sockets) {
+        unused.push_back(sock.fd);
+      }
+    }
+    destinations_.clear();
+  }
+  close_unused(unused);
+}
+
+int PreconnectPool::take(const TCPAddress &addr) noexcept {
+  std::vector<int> unused;
+  int fd = -1;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = destinations_.find(addr.str());
+    if (it == destinations_.end()) {
+      it = destinations_.emplace(addr.str(), make_destination(addr, false)).first;
+    }
+    Destination &dest = it->second;
+    ++dest.requests;
+
+    auto now = clock_type::now();
+    while (!dest.sockets.empty()) {
+      PooledSocket sock = dest.sockets.front();
+      dest.sockets.pop_front();
+
+      if (is_alive(dest, sock, now)) {
+        fd = sock.fd;
+        break;
+      }
+      unused.push_back(sock.fd);
+      ++stats_.discarded;
+    }
+    // the client authenticates, which clears the server's count of
+    // connect errors of the Router host
+    dest.unused_since_request = 0;
+
+    if (fd >= 0) {
+      ++stats_.hits;
+    } else {
+      ++stats_.misses;
+    }
+  }
+  close_unused(unused);
+  return fd;
+}
+
+void PreconnectPool::discard(const TCPAddress &addr) noexcept {
+  std::vector<int> unused;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = destinations_.find(addr.str());
+    if (it == destinations_.end()) {
+      it = destinations_.emplace(addr.str(), make_destination(addr, true)).first;
+    }
+    it->second.paused = true;
+    for (auto &sock : it->second.sockets) {
+      unused.push_back(sock.fd);
+      ++stats_.discarded;
+    }
+    it->second.sockets.clear();
+  }
+  close_unused(unused);
+}
+
+void PreconnectPool::resume(const TCPAddress &addr) noexcept {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = destinations_.find(addr.str());
+  if (it != destinations_.end()) {
+    it->second.paused = false;
+  }
+}
+
+void PreconnectPool::close_unused(const std::vector<int> &fds) noexcept {
+  for (int fd : fds) {
+    socket_operations_->close(fd);
+  }
+}
+
+PreconnectPool::Destination PreconnectPool::make_destination(const TCPAddress &addr, bool paused) const {
+  return Destination{addr, {}, 0, 0.0, paused, 0, max_age_};
+}
+
+size_t PreconnectPool::size(const TCPAddress &addr) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = destinations_.find(addr.str());
+  return it == destinations_.end() ? 0 : it->second.sockets.size();
+}
+
+PreconnectPool::Stats PreconnectPool::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+bool PreconnectPool::is_alive(Destination &dest, const PooledSocket &sock, clock_type::time_point now) noexcept {
+  auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - sock.connected_at);
+  if (age > dest.max_age) {
+    return false;
+  }
+
+  // the greeting of the server makes the socket readable; a closed or
+  // failed connection is reported with the other flags
+  struct pollfd fds[] = {
+#ifdef POLLRDHUP
+    { sock.fd, POLLIN | POLLRDHUP, 0 },
+#else
+    { sock.fd, POLLIN, 0 },
+#endif
+  };
+  if (socket_operations_->poll(fds, 1, std::chrono::milliseconds(0)) < 0) {
+    return false;
+  }
+  short dead = POLLHUP | POLLERR | POLLNVAL;
+#ifdef POLLRDHUP
+  dead |= POLLRDHUP;
+#endif
+  if ((fds[0].revents & dead) == 0) {
+    return true;
+  }
+
+  if (age >= kMinServerConnectTimeout) {
+    // the server's connect_timeout is shorter than the max age
+    auto max_age = std::max(kMinServerConnectTimeout / 2, age / 2);
+    if (max_age < dest.max_age) {
+      log_warning("%s closed a connection kept ready after %lldms; keeping connections for at most %lldms. "
+                  "preconnect_max_age must be below connect_timeout of the server",
+                  dest.addr.str().c_str(), static_cast<long long>(age.count()),
+                  static_cast<long long>(max_age.count()));
+      dest.max_age = max_age;
+    }
+  }
+  return false;
+}
+
+void PreconnectPool::run() noexcept {
+  mysql_harness::rename_thread("RtP:preconnect");
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    refill_cond_.wait_for(lock, kRefillInterval, [this] { return stopping_; });
+    if (stopping_) break;
+
+    lock.unlock();
+    refill();
+    lock.lock();
+  }
+}
+
+void PreconnectPool::refill() noexcept {
+  std::vector<std::pair<TCPAddress, size_t>> missing;
+  std::vector<int> unused;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto now = clock_type::now();
+    for (auto it = destinations_.begin(); it != destinations_.end();) {
+      Destination &dest = it->second;
+
+      for (auto sock = dest.sockets.begin(); sock != dest.sockets.end();) {
+        if (is_alive(dest, *sock, now)) {
+          ++sock;
+        } else {
+          unused.push_back(sock->fd);
+          ++stats_.discarded;
+          ++dest.unused_since_request;
+          sock = dest.sockets.erase(sock);
+        }
+      }
+
+      dest.rate = (1.0 - kRateWeight) * dest.rate + kRateWeight * static_cast<double>(dest.requests);
+      dest.requests = 0;
+
+      if (dest.paused) {
+        // quarantined; the quarantine probes it
+        ++it;
+        continue;
+      }
+
+      if (dest.rate < kMinRate) {
+        if (dest.sockets.empty()) {
+          it = destinations_.erase(it);
+        } else {
+          ++it;
+        }
+        continue;
+      }
+
+      if (dest.unused_since_request >= kMaxUnusedPerRequest) {
+        // the demand did not last; wait until it is asked for again
+        ++it;
+        continue;
+      }
+
+      // twice the demand of an interval, so that bursts find a socket too
+      size_t target = std::min(max_size_, static_cast<size_t>(std::ceil(2.0 * dest.rate)));
+      if (dest.sockets.size() < target) {
+        missing.emplace_back(dest.addr, target - dest.sockets.size());
+      }
+      ++it;
+    }
+  }
+  close_unused(unused);
+
+  // a destination which does not answer does not delay the others
+  std::vector<TCPAddress> addrs;
+  for (auto &it : missing) {
+    addrs.insert(addrs.end(), it.second, it.first);
+  }
+  if (addrs.empty()) {
+    return;
+  }
+  std::vector<int> fds = socket_operations_->connect_all(addrs, connect_timeout_, false);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = clock_type::now();
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      if (fds[i] < 0) {
+        // the destination is handled by quarantine, if it is down
+        log_debug("preconnect to %s failed", addrs[i].str().c_str());
+        continue;
+      }
+      auto dest = destinations_.find(addrs[i].str());
+      if (!stopping_ && dest != destinations_.end() && !dest->second.paused) {
+        dest->second.sockets.push_back({fds[i], now});
+        ++stats_.connected;
+        fds[i] = -1;
+      }
+    }
+  }
+
+  unused.clear();
+  for (int fd : fds) {
+    if (fd >= 0) {
+      unused.push_back(fd);
+    }
+  }
+  close_unused(unused);
+}
@@ -0,0 +1,210 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_PRECONNECT_POOL_INCLUDED
+#define ROUTING_PRECONNECT_POOL_INCLUDED
+
+/** @file
+ * @brief Defining the class PreconnectPool
+ *
+ * Used by RouteDestination when a route is configured with
+ * `preconnect_pool_size` to hand out TCP connections to destinations which
+ * were established ahead of time.
+ */
+
+#include "mysqlrouter/datatypes.h"
+#include "mysqlrouter/routing.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** @class PreconnectPool
+ *  @brief Keeps connected sockets to destinations ready for use
+ *
+ *  A background thread connects to every destination sockets were asked
+ *  for, so that take() can return a connected socket right away instead of
+ *  resolving the address and waiting for the TCP handshake.
+ *
+ *  How many sockets are kept per destination follows the rate take() is
+ *  called for it: enough to cover twice the demand of one refill interval,
+ *  at most `max_size`. Destinations which are no longer asked for are
+ *  emptied again.
+ *
+ *  The MySQL server sends its greeting right after accepting a connection
+ *  and closes the connection when the client does not answer within its
+ *  `connect_timeout`. Sockets are therefore closed when they are older than
+ *  `max_age`, which has to stay below the server's `connect_timeout`. When
+ *  the server closes a pooled socket before, the pool warns and keeps the
+ *  sockets of that destination for a shorter time.
+ *
+ *  Sockets closed without being taken are counted by the server as
+ *  aborted connects and towards `max_connect_errors` of the Router host,
+ *  until a connection of the host authenticates. A destination is not
+ *  refilled after kMaxUnusedPerRequest sockets were closed unused since
+ *  it was last asked for, so that the pool alone can not get the Router
+ *  host blocked.
+ *
+ *  Refills connect to all destinations at the same time, see
+ *  routing::SocketOperationsBase::connect_all().
+ *
+ *  No sockets are kept for destinations which are discarded, until they
+ *  are resumed.
+ */
+class PreconnectPool {
+ public:
+  /** @brief How often the pool is refilled and demand is sampled */
+  static constexpr std::chrono::milliseconds kRefillInterval{100};
+
+  /** @brief Default time after which sockets which were not taken are closed */
+  static constexpr std::chrono::milliseconds kDefaultMaxAge{5000};
+
+  /** @brief Sockets closed unused after which a destination is not refilled until it is asked for */
+  static const uint64_t kMaxUnusedPerRequest;
+
+  /** @brief Usage metrics of the pool */
+  struct Stats {
+    /** @brief Number of take() calls which returned a socket */
+    uint64_t hits;
+    /** @brief Number of take() calls which found no socket */
+    uint64_t misses;
+    /** @brief Number of sockets connected by the pool */
+    uint64_t connected;
+    /** @brief Number of sockets closed without being used */
+    uint64_t discarded;
+  };
+
+  /** @brief Constructor
+   *
+   * @param socket_operations object used to connect to destinations
+   * @param max_size maximum number of sockets kept per destination
+   * @param connect_timeout timeout connecting to a destination
+   * @param max_age time after which sockets which were not taken are closed
+   */
+  PreconnectPool(routing::SocketOperationsBase *socket_operations, size_t max_size,
+                 std::chrono::milliseconds connect_timeout,
+                 std::chrono::milliseconds max_age = kDefaultMaxAge);
+
+  /** @brief Destructor; stops the pool and closes the sockets it keeps */
+  ~PreconnectPool();
+
+  PreconnectPool(const PreconnectPool &) = delete;
+  PreconnectPool &operator=(const PreconnectPool &) = delete;
+
+  /** @brief Starts the thread filling the pool */
+  void start();
+
+  /** @brief Stops the thread filling the pool */
+  void stop();
+
+  /** @brief Takes a connected socket to a destination out of the pool
+   *
+   * Every call counts as demand for the destination, whether a socket
+   * was available or not.
+   *
+   * @param addr destination
+   * @return socket descriptor, or -1 when none is available
+   */
+  int take(const mysqlrouter::TCPAddress &addr) noexcept;
+
+  /** @brief Closes all sockets kept for a destination and stops refilling it
+   *
+   * Used when the destination became unavailable.
+   *
+   * @param addr destination
+   */
+  void discard(const mysqlrouter::TCPAddress &addr) noexcept;
+
+  /** @brief Refills a destination again after discard()
+   *
+   * @param addr destination
+   */
+  void resume(const mysqlrouter::TCPAddress &addr) noexcept;
+
+  /** @brief Returns number of sockets currently kept for a destination */
+  size_t size(const mysqlrouter::TCPAddress &addr) const;
+
+  /** @brief Returns the usage metrics of the pool */
+  Stats get_stats() const;
+
+  size_t get_max_size() const noexcept {
+    return max_size_;
+  }
+
+  std::chrono::milliseconds get_max_age() const noexcept {
+    return max_age_;
+  }
+
+ private:
+  using clock_type = std::chrono::steady_clock;
+
+  struct PooledSocket {
+    int fd;
+    clock_type::time_point connected_at;
+  };
+
+  struct Destination {
+    mysqlrouter::TCPAddress addr;
+    std::deque<PooledSocket> sockets;
+    /** @brief take() calls since the last refill */
+    uint64_t requests;
+    /** @brief Smoothed number of take() calls per refill interval */
+    double rate;
+    /** @brief Set by discard(), cleared by resume() */
+    bool paused;
+    /** @brief Sockets closed without being taken since the last take() */
+    uint64_t unused_since_request;
+    /** @brief max_age_, or less when the server closed sockets before */
+    std::chrono::milliseconds max_age;
+  };
+
+  /** @brief Main loop of the thread filling the pool */
+  void run() noexcept;
+
+  /** @brief Expires sockets, updates demand and connects what is missing */
+  void refill() noexcept;
+
+  /** @brief Returns whether a pooled socket is still usable; called holding mutex_ */
+  bool is_alive(Destination &dest, const PooledSocket &sock, clock_type::time_point now) noexcept;
+
+  /** @brief Closes sockets which were not taken; called without holding mutex_ */
+  void close_unused(const std::vector<int> &fds) noexcept;
+
+  /** @brief Returns a new entry for a destination */
+  Destination make_destination(const mysqlrouter::TCPAddress &addr, bool paused) const;
+
+  routing::SocketOperationsBase *socket_operations_;
+  const size_t max_size_;
+  const std::chrono::milliseconds connect_timeout_;
+  const std::chrono::milliseconds max_age_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable refill_cond_;
+  std::map<std::string, Destination> destinations_;
+  bool stopping_;
+  std::thread refill_thread_;
+
+  Stats stats_;
+};
+
+#endif // ROUTING_PRECONNECT_POOL_INCLUDED
@@ -0,0 +1,37 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef __linux__
+
+#include "reactor.h"
+
+bool ends_with_complete_message(BaseProtocol::Type protocol_type,
+                                const uint8_t *data, size_t size) noexcept {
+  size_t offset = 0;
+  while (offset + 4 <= size) {
+    size_t length = static_cast<size_t>(data[offset]) |
+                    static_cast<size_t>(data[offset + 1]) << 8 |
+                    static_cast<size_t>(data[offset + 2]) << 16;
+    if (protocol_type == BaseProtocol::Type::kXProtocol) {
+      length |= static_cast<size_t>(data[offset + 3]) << 24;
+    }
+    offset += 4 + length;
+  }
+  return offset == size;
+}
+
+#endif // __linux__
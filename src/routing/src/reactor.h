@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_REACTOR_INCLUDED
+#define ROUTING_REACTOR_INCLUDED
+
+/** @file
+ * @brief Defining the interface Reactor
+ *
+ * Implemented by EpollReactor and UringReactor, which MySQLRouting uses
+ * for routes configured with `io_model=epoll` and `io_model=io_uring`.
+ *
+ * Only available on Linux.
+ */
+
+#ifdef __linux__
+
+#include "protocol/base_protocol.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/socket.h>
+
+/** @class Reactor
+ *  @brief Forwards the data of established connections using a fixed set of threads
+ */
+class Reactor {
+ public:
+  virtual ~Reactor() = default;
+
+  /** @brief Starts the reactor threads
+   *
+   * Throws std::runtime_error when the reactor could not be set up.
+   */
+  virtual void start() = 0;
+
+  /** @brief Stops the reactor threads
+   *
+   * Connections still open are closed using the close handler of the reactor.
+   */
+  virtual void stop() = 0;
+
+  /** @brief Hands a connected client/server socket pair to the reactor
+   *
+   * @param client socket descriptor of the client connection
+   * @param server socket descriptor of the server connection
+   * @param client_addr address of the client
+   * @return false when the reactor is not running (sockets are untouched)
+   */
+  virtual bool add_connection(int client, int server, const sockaddr_storage &client_addr) = 0;
+
+  /** @brief Returns number of reactor threads */
+  virtual size_t size() const noexcept = 0;
+};
+
+/** @brief Returns whether data read while handshaking ends with a complete message
+ *
+ * Classic protocol packets start with a 3 byte payload length and the
+ * sequence id, X protocol messages with a 4 byte length. The protocol code
+ * expects to get the remaining part of a message it started to read right
+ * away, which reactors can not wait for.
+ *
+ * @param protocol_type protocol of the route
+ * @param data data read from a socket
+ * @param size number of bytes in data
+ */
+bool ends_with_complete_message(BaseProtocol::Type protocol_type,
+                                const uint8_t *data, size_t size) noexcept;
+
+#endif // __linux__
+
+#endif // ROUTING_REACTOR_INCLUDED
@@ -19,10 +19,15 @@
 #include "mysqlrouter/utils.h"
 #include "config.h"
 #include "logger.h"
+#include "networking/caching_resolver.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <climits>
+#include <mutex>
+#include <vector>
 
 #ifndef _WIN32
 # ifdef __sun
@@ -34,6 +39,8 @@
 # include <netinet/tcp.h>
 # include <sys/socket.h>
 # include <poll.h>
+# include <sys/resource.h>
+# include <unistd.h>
 #else
 # define WIN32_LEAN_AND_MEAN
 # include <windows.h>
@@ -49,11 +56,47 @@ namespace routing {
 
 const int kDefaultWaitTimeout = 0; // 0 = no timeout used
 const int kDefaultMaxConnections = 512;
+const int kMaxConnectionsLimit = 1048576;
+const unsigned int kReservedFileDescriptors = 256;
 const std::chrono::seconds kDefaultDestinationConnectionTimeout { 1 };
 const std::string kDefaultBindAddress = "127.0.0.1";
 const unsigned int kDefaultNetBufferLength = 16384;  // Default defined in latest MySQL Server
 const unsigned long long kDefaultMaxConnectErrors = 100;  // Similar to MySQL Server
 const std::chrono::seconds kDefaultClientConnectTimeout { 9 }; // Default connect_timeout MySQL Server minus 1
+const double kLatencyWeight = 0.3;
+const std::chrono::seconds kLatencyMaxAge { 10 };
+const std::chrono::seconds kStatsLogInterval { 60 };
+const std::chrono::seconds kOutlierInterval { 10 };
+const unsigned int kOutlierConsecutiveFailures = 5;
+const unsigned int kOutlierMinRequests = 10;
+const unsigned int kOutlierMinDestinations = 3;
+const double kOutlierSuccessRateStdevFactor = 1.9;
+const double kOutlierSuccessRateMargin = 0.1;
+const double kOutlierLatencyFactor = 3.0;
+const unsigned int kOutlierMaxEjectionPercent = 30;
+const std::chrono::seconds kOutlierBaseEjectionTime { 30 };
+const std::chrono::seconds kOutlierMaxEjectionTime { 300 };
+const std::chrono::seconds kOutlierEarlyDisconnect { 1 };
+const std::string kDefaultQuarantineProbe = "connect";
+const std::chrono::milliseconds kQuarantineProbeInterval { 500 };
+const std::chrono::milliseconds kMaxQuarantineProbeInterval { 10 * 1000 };
+const std::string kDefaultIoModel = "thread";
+const unsigned int kDefaultAcceptorThreads = 1;
+const unsigned int kMaxAcceptorThreads = 256;
+const int kDefaultListenBacklog = 1024;
+const unsigned int kDefaultMinWorkerThreads = 0;
+const unsigned int kDefaultMaxWorkerThreads = 0;
+const unsigned int kDefaultReactorConnectThreads = 16;
+const unsigned int kDefaultPreconnectPoolSize = 0;
+const unsigned int kMaxPreconnectPoolSize = 1024;
+const std::chrono::seconds kDefaultPreconnectMaxAge { 5 };
+const unsigned int kDefaultMaxConnectionsPerDestination = 0;
+const unsigned int kDefaultAdmissionQueueSize = 0;
+const std::chrono::seconds kDefaultAdmissionQueueTimeout { 5 };
+const std::chrono::milliseconds kAdmissionQueueSweepInterval { 100 };
+const unsigned int kDefaultConnectRaceSize = 2;
+const unsigned int kMaxConnectRaceSize = 16;
+const std::chrono::milliseconds kConnectRaceDelay { 250 };
 
 // unused constant
 // const int kMaxConnectTimeout = INT_MAX / 1000;
@@ -86,6 +129,91 @@ std::string get_access_mode_name(AccessMode access_mode) noexcept {
   return kAccessModeNames[static_cast<int>(access_mode)];
 }
 
+const char* const kIoModelNames[] = {
+  nullptr, "thread", "epoll", "io_uring"
+};
+
+constexpr size_t kIoModelCount =
+    sizeof(kIoModelNames)/sizeof(*kIoModelNames);
+
+IoModel get_io_model(const std::string& value) {
+  for (unsigned int i = 1 ; i < kIoModelCount ; ++i)
+    if (strcmp(kIoModelNames[i], value.c_str()) == 0)
+      return static_cast<IoModel>(i);
+  return IoModel::kUndefined;
+}
+
+void get_io_model_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kIoModelCount) {
+    valid->append(kIoModelNames[i]);
+    if (++i < kIoModelCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_io_model_name(IoModel io_model) noexcept {
+  if (io_model == IoModel::kUndefined) return std::string();
+  return kIoModelNames[static_cast<int>(io_model)];
+}
+
+const char* const kRoutingStrategyNames[] = {
+  nullptr, "round-robin", "first-available", "least-connections", "lowest-latency",
+  "consistent-hash"
+};
+
+constexpr size_t kRoutingStrategyCount =
+    sizeof(kRoutingStrategyNames)/sizeof(*kRoutingStrategyNames);
+
+RoutingStrategy get_routing_strategy(const std::string& value) {
+  for (unsigned int i = 1 ; i < kRoutingStrategyCount ; ++i)
+    if (strcmp(kRoutingStrategyNames[i], value.c_str()) == 0)
+      return static_cast<RoutingStrategy>(i);
+  return RoutingStrategy::kUndefined;
+}
+
+void get_routing_strategy_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kRoutingStrategyCount) {
+    valid->append(kRoutingStrategyNames[i]);
+    if (++i < kRoutingStrategyCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_routing_strategy_name(RoutingStrategy routing_strategy) noexcept {
+  if (routing_strategy == RoutingStrategy::kUndefined) return std::string();
+  return kRoutingStrategyNames[static_cast<int>(routing_strategy)];
+}
+
+const char* const kQuarantineProbeNames[] = {
+  nullptr, "connect", "greeting"
+};
+
+constexpr size_t kQuarantineProbeCount =
+    sizeof(kQuarantineProbeNames)/sizeof(*kQuarantineProbeNames);
+
+QuarantineProbe get_quarantine_probe(const std::string& value) {
+  for (unsigned int i = 1 ; i < kQuarantineProbeCount ; ++i)
+    if (strcmp(kQuarantineProbeNames[i], value.c_str()) == 0)
+      return static_cast<QuarantineProbe>(i);
+  return QuarantineProbe::kUndefined;
+}
+
+void get_quarantine_probe_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kQuarantineProbeCount) {
+    valid->append(kQuarantineProbeNames[i]);
+    if (++i < kQuarantineProbeCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_quarantine_probe_name(QuarantineProbe quarantine_probe) noexcept {
+  if (quarantine_probe == QuarantineProbe::kUndefined) return std::string();
+  return kQuarantineProbeNames[static_cast<int>(quarantine_probe)];
+}
+
 void set_socket_blocking(int sock, bool blocking) {
 
   assert(!(sock < 0));
@@ -109,6 +237,52 @@ SocketOperations* SocketOperations::instance() {
   return &instance_;
 }
 
+/** @brief Guards reserved_file_descriptors */
+static std::mutex reserved_file_descriptors_mutex;
+/** @brief File descriptors reserved by the routes of the process */
+static uint64_t reserved_file_descriptors = kReservedFileDescriptors;
+
+uint64_t reserve_file_descriptors(uint64_t count, uint64_t *total_reserved) {
+  std::lock_guard<std::mutex> lock(reserved_file_descriptors_mutex);
+  reserved_file_descriptors += count;
+  const uint64_t reserved = reserved_file_descriptors;
+  *total_reserved = reserved;
+#ifndef _WIN32
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+    log_warning("getrlimit(RLIMIT_NOFILE) failed: %s", get_message_error(errno).c_str());
+    return reserved;
+  }
+  if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < reserved) {
+    rlim_t wanted = static_cast<rlim_t>(reserved);
+    if (limit.rlim_max != RLIM_INFINITY && limit.rlim_max < wanted) {
+      wanted = limit.rlim_max;
+    }
+    if (wanted > limit.rlim_cur) {
+      rlim_t previous = limit.rlim_cur;
+      limit.rlim_cur = wanted;
+      if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        log_warning("setrlimit(RLIMIT_NOFILE, %llu) failed: %s", static_cast<unsigned long long>(wanted),
+                    get_message_error(errno).c_str());
+        return previous;
+      }
+      log_info("raised limit of open files from %llu to %llu", static_cast<unsigned long long>(previous),
+               static_cast<unsigned long long>(wanted));
+    }
+  }
+  return limit.rlim_cur == RLIM_INFINITY ? UINT64_MAX : static_cast<uint64_t>(limit.rlim_cur);
+#else
+  // Windows has no per-process limit on sockets
+  return UINT64_MAX;
+#endif
+}
+
+void release_file_descriptors(uint64_t count) {
+  std::lock_guard<std::mutex> lock(reserved_file_descriptors_mutex);
+  assert(reserved_file_descriptors >= kReservedFileDescriptors + count);
+  reserved_file_descriptors -= count;
+}
+
 int SocketOperations::poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout_ms) {
 #ifdef _WIN32
   return ::WSAPoll(fds, nfds, timeout_ms.count());
@@ -160,103 +334,375 @@ int SocketOperations::connect_non_blocking_status(int sock, int &so_error) {
 }
 
 int SocketOperations::get_mysql_socket(TCPAddress addr, std::chrono::milliseconds connect_timeout_ms, bool log) noexcept {
-  struct addrinfo *servinfo, *info, hints;
+  size_t winner = 0;
+  return connect_race({addr}, connect_timeout_ms, kConnectRaceDelay, &winner, nullptr, log);
+}
+
+namespace {
+
+/** @brief Socket address a server name resolved to */
+struct ResolvedAddress {
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+};
+
+} // namespace
+
+// hostnames are resolved through the cache shared with the metadata cache,
+// so that a slow resolver does not delay every connection
+static std::vector<ResolvedAddress> resolve(const TCPAddress &addr, bool log) {
+  std::vector<mysql_harness::IPAddress> ips;
+  try {
+    ips = mysql_harness::CachingResolver::instance().hostname(addr.addr);
+  } catch (const std::exception &exc) {
+    if (log) {
+      log_debug("Failed getting address information for '%s' (%s)", addr.addr.c_str(), exc.what());
+    }
+  }
 
+  struct addrinfo hints;
   memset(&hints, 0, sizeof hints);
   hints.ai_family = AF_UNSPEC;
   hints.ai_socktype = SOCK_STREAM;
-  bool timeout_expired = false;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+  std::string port = to_string(addr.port);
+
+  std::vector<ResolvedAddress> result;
+  for (const auto &ip : ips) {
+    // numeric address, only fills in the socket address
+    struct addrinfo *info = nullptr;
+    if (::getaddrinfo(ip.str().c_str(), port.c_str(), &hints, &info) != 0 || info == nullptr) {
+      continue;
+    }
+    ResolvedAddress resolved;
+    memcpy(&resolved.addr, info->ai_addr, info->ai_addrlen);
+    resolved.addr_len = static_cast<socklen_t>(info->ai_addrlen);
+    ::freeaddrinfo(info);
+    result.push_back(resolved);
+  }
+  return result;
+}
 
-  int err;
-  if ((err = ::getaddrinfo(addr.addr.c_str(), to_string(addr.port).c_str(), &hints, &servinfo)) != 0) {
-    if (log) {
-#ifndef _WIN32
-      std::string errstr{(err == EAI_SYSTEM) ? get_message_error(get_errno()) : gai_strerror(err)};
-#else
-      std::string errstr = get_message_error(err);
-#endif
-      log_debug("Failed getting address information for '%s' (%s)", addr.addr.c_str(), errstr.c_str());
+// set blocking; MySQL protocol is blocking and we do not take advantage of
+// any non-blocking possibilities
+static bool setup_connected_socket(int sock) {
+  set_socket_blocking(sock, true);
+
+  int opt_nodelay = 1;
+  if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+                 reinterpret_cast<const char*>(&opt_nodelay), // cast keeps Windows happy (const void* on Unix)
+                 static_cast<socklen_t>(sizeof(int))) == -1) {
+    log_debug("Failed setting TCP_NODELAY on client socket");
+    return false;
+  }
+  return true;
+}
+
+int SocketOperations::connect_race(const std::vector<TCPAddress> &addrs, std::chrono::milliseconds connect_timeout,
+                                   std::chrono::milliseconds delay, size_t *winner, std::vector<size_t> *failed,
+                                   bool log) noexcept {
+  using clock_type = std::chrono::steady_clock;
+
+  struct Candidate {
+    size_t dest;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+  };
+  struct Attempt {
+    int fd;
+    size_t candidate;
+  };
+
+  std::vector<Candidate> candidates;
+  std::vector<size_t> pending_per_dest(addrs.size(), 0);
+  for (size_t i = 0; i < addrs.size(); ++i) {
+    for (const auto &resolved : resolve(addrs[i], log)) {
+      candidates.push_back({i, resolved.addr, resolved.addr_len});
+      ++pending_per_dest[i];
+    }
+
+    if (pending_per_dest[i] == 0 && failed) {
+      failed->push_back(i);
     }
-    return -1;
   }
 
-  std::shared_ptr<void> exit_guard(nullptr, [&](void*){if (servinfo) freeaddrinfo(servinfo);});
+  int last_error = 0;
+  bool timeout_expired = false;
+  auto fail = [&](size_t candidate, int err) {
+    last_error = err;
+    size_t dest = candidates[candidate].dest;
+    if (--pending_per_dest[dest] == 0 && failed) {
+      failed->push_back(dest);
+    }
+  };
 
   int sock = routing::kInvalidSocket;
+  size_t won = 0;
+  std::vector<Attempt> attempts;
+  std::vector<struct pollfd> fds;
+  size_t next = 0;
+  auto next_start = clock_type::now();
+  // the race as a whole times out, not each connect
+  const auto deadline = next_start + connect_timeout;
+
+  while (sock == routing::kInvalidSocket && (next < candidates.size() || !attempts.empty())) {
+    auto now = clock_type::now();
+
+    if (now >= deadline && attempts.empty()) {
+      // servers not tried yet are out of time as well
+      log_warning("Timeout reached trying to connect to MySQL Server %s: %s",
+                  addrs[candidates[next].dest].str().c_str(), get_message_error(ETIMEDOUT).c_str());
+      timeout_expired = true;
+      fail(next, ETIMEDOUT);
+      ++next;
+      continue;
+    }
 
-  for (info = servinfo; info != nullptr; info = info->ai_next) {
-    if ((sock = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol)) == -1) {
-      log_error("Failed opening socket: %s", get_message_error(get_errno()).c_str());
-    } else {
-      bool connection_is_good = true;
-
-      set_socket_blocking(sock, false);
+    // start the next connect when the previous ones did not answer in time
+    if (next < candidates.size() && now < deadline && (now >= next_start || attempts.empty())) {
+      const Candidate &candidate = candidates[next];
+      const TCPAddress &addr = addrs[candidate.dest];
+      int fd = ::socket(candidate.addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+      if (fd == -1) {
+        log_error("Failed opening socket: %s", get_message_error(get_errno()).c_str());
+        fail(next, get_errno());
+      } else {
+        set_socket_blocking(fd, false);
 
-      if (::connect(sock, info->ai_addr, info->ai_addrlen) < 0) {
-        switch (this->get_errno()) {
+        if (::connect(fd, reinterpret_cast<const struct sockaddr *>(&candidate.addr), candidate.addr_len) == 0) {
+          sock = fd;
+          won = next;
+        } else {
+          switch (this->get_errno()) {
 #ifdef _WIN32
-          case WSAEINPROGRESS:
-          case WSAEWOULDBLOCK:
+            case WSAEINPROGRESS:
+            case WSAEWOULDBLOCK:
 #else
-          case EINPROGRESS:
+            case EINPROGRESS:
 #endif
-            if (0 != connect_non_blocking_wait(sock, connect_timeout_ms)) {
-              log_warning("Timeout reached trying to connect to MySQL Server %s: %s", addr.str().c_str(), get_message_error(get_errno()).c_str());
-              connection_is_good = false;
-              timeout_expired = (get_errno() == ETIMEDOUT);
+              attempts.push_back({fd, next});
               break;
-            }
-
-            {
-              int so_error = 0;
-              if (0 != connect_non_blocking_status(sock, so_error)) {
-                connection_is_good = false;
-                break;
-              }
-            }
-
-            // success, we can continue
-            break;
-          default:
-            log_debug("Failed connect() to %s: %s", addr.str().c_str(), get_message_error(get_errno()).c_str());
-            connection_is_good = false;
-            break;
+            default:
+              log_debug("Failed connect() to %s: %s", addr.str().c_str(), get_message_error(get_errno()).c_str());
+              fail(next, get_errno());
+              this->close(fd);
+              break;
+          }
         }
-      } else {
-        // everything is fine, we are connected
       }
+      ++next;
+      next_start = now + delay;
+      continue;
+    }
+
+    // wait for a connect to finish, to time out or for the next one to start
+    auto wake = deadline;
+    if (next < candidates.size()) {
+      wake = std::min(wake, next_start);
+    }
+    auto wait = std::chrono::milliseconds(0);
+    if (wake > now) {
+      // round up, poll() would return just before the deadline
+      wait = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now) + std::chrono::milliseconds(1);
+    }
 
-      if (connection_is_good) {
-        break;
+    fds.clear();
+    for (const auto &attempt : attempts) {
+      fds.push_back({attempt.fd, POLLOUT, 0});
+    }
+    int res = poll(fds.data(), static_cast<nfds_t>(fds.size()), wait);
+    if (res < 0 && get_errno() != EINTR) {
+      log_debug("Failed waiting for connect(): %s", get_message_error(get_errno()).c_str());
+      for (const auto &attempt : attempts) {
+        fail(attempt.candidate, get_errno());
+        this->close(attempt.fd);
       }
+      attempts.clear();
+      continue;
+    }
 
-      // some error, close the socket again and try the next one
-      this->close(sock);
+    now = clock_type::now();
+    // backwards, so that erasing keeps attempts and fds in step
+    for (size_t i = attempts.size(); i-- > 0;) {
+      const Attempt attempt = attempts[i];
+      const TCPAddress &addr = addrs[candidates[attempt.candidate].dest];
+
+      if (res > 0 && fds[i].revents != 0) {
+        int so_error = 0;
+        if (connect_non_blocking_status(attempt.fd, so_error) == 0) {
+          if (sock == routing::kInvalidSocket) {
+            sock = attempt.fd;
+            won = attempt.candidate;
+          } else {
+            // connected at the same time as the winner
+            this->close(attempt.fd);
+          }
+        } else {
+          log_debug("Failed connect() to %s: %s", addr.str().c_str(), get_message_error(so_error).c_str());
+          fail(attempt.candidate, so_error);
+          this->close(attempt.fd);
+          // no need to wait for the next one
+          next_start = now;
+        }
+        attempts.erase(attempts.begin() + static_cast<long>(i));
+      } else if (now >= deadline) {
+        log_warning("Timeout reached trying to connect to MySQL Server %s: %s", addr.str().c_str(),
+                    get_message_error(ETIMEDOUT).c_str());
+        timeout_expired = true;
+        fail(attempt.candidate, ETIMEDOUT);
+        this->close(attempt.fd);
+        attempts.erase(attempts.begin() + static_cast<long>(i));
+        next_start = now;
+      }
     }
   }
 
-  if (info == nullptr) {
+  // the connects which lost the race did not fail, they were just slower
+  for (const auto &attempt : attempts) {
+    this->close(attempt.fd);
+  }
+
+  if (sock == routing::kInvalidSocket) {
     // all connects failed.
+    set_errno(last_error);
     return timeout_expired ? -2 : -1;
   }
 
-  // set blocking; MySQL protocol is blocking and we do not take advantage of
-  // any non-blocking possibilities
-  set_socket_blocking(sock, true);
-
-  int opt_nodelay = 1;
-  if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
-                 reinterpret_cast<const char*>(&opt_nodelay), // cast keeps Windows happy (const void* on Unix)
-                 static_cast<socklen_t>(sizeof(int))) == -1) {
-    log_debug("Failed setting TCP_NODELAY on client socket");
+  if (!setup_connected_socket(sock)) {
     this->close(sock);
 
     return -1;
   }
 
+  *winner = candidates[won].dest;
   return sock;
 }
 
+std::vector<int> SocketOperations::connect_all(const std::vector<TCPAddress> &addrs,
+                                               std::chrono::milliseconds connect_timeout, bool log) noexcept {
+  using clock_type = std::chrono::steady_clock;
+
+  struct Server {
+    std::vector<ResolvedAddress> candidates;
+    size_t next;
+    int fd;
+    clock_type::time_point deadline;
+  };
+
+  std::vector<int> socks(addrs.size(), -1);
+  std::vector<Server> servers;
+  for (const auto &addr : addrs) {
+    servers.push_back({resolve(addr, log), 0, routing::kInvalidSocket, clock_type::time_point()});
+  }
+
+  // starts a connect to the next address of the server; false when none is left
+  auto start_next = [&](size_t i) {
+    Server &server = servers[i];
+    while (server.next < server.candidates.size()) {
+      const ResolvedAddress &candidate = server.candidates[server.next++];
+      int fd = ::socket(candidate.addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+      if (fd == -1) {
+        log_error("Failed opening socket: %s", get_message_error(get_errno()).c_str());
+        continue;
+      }
+      set_socket_blocking(fd, false);
+
+      if (::connect(fd, reinterpret_cast<const struct sockaddr *>(&candidate.addr), candidate.addr_len) == 0) {
+        socks[i] = fd;
+        return false;
+      }
+      switch (this->get_errno()) {
+#ifdef _WIN32
+        case WSAEINPROGRESS:
+        case WSAEWOULDBLOCK:
+#else
+        case EINPROGRESS:
+#endif
+          server.fd = fd;
+          server.deadline = clock_type::now() + connect_timeout;
+          return true;
+        default:
+          if (log) {
+            log_debug("Failed connect() to %s: %s", addrs[i].str().c_str(), get_message_error(get_errno()).c_str());
+          }
+          this->close(fd);
+          break;
+      }
+    }
+    return false;
+  };
+
+  std::vector<size_t> connecting;
+  for (size_t i = 0; i < servers.size(); ++i) {
+    if (start_next(i)) {
+      connecting.push_back(i);
+    }
+  }
+
+  std::vector<struct pollfd> fds;
+  while (!connecting.empty()) {
+    auto now = clock_type::now();
+    auto wake = servers[connecting.front()].deadline;
+    fds.clear();
+    for (size_t i : connecting) {
+      wake = std::min(wake, servers[i].deadline);
+      fds.push_back({servers[i].fd, POLLOUT, 0});
+    }
+    auto wait = std::chrono::milliseconds(0);
+    if (wake > now) {
+      // round up, poll() would return just before the deadline
+      wait = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now) + std::chrono::milliseconds(1);
+    }
+
+    int res = poll(fds.data(), static_cast<nfds_t>(fds.size()), wait);
+    if (res < 0 && get_errno() != EINTR) {
+      log_debug("Failed waiting for connect(): %s", get_message_error(get_errno()).c_str());
+      for (size_t i : connecting) {
+        this->close(servers[i].fd);
+      }
+      break;
+    }
+
+    now = clock_type::now();
+    std::vector<size_t> still_connecting;
+    for (size_t n = 0; n < connecting.size(); ++n) {
+      size_t i = connecting[n];
+      Server &server = servers[i];
+      if (res > 0 && fds[n].revents != 0) {
+        int so_error = 0;
+        if (connect_non_blocking_status(server.fd, so_error) == 0) {
+          socks[i] = server.fd;
+          continue;
+        }
+        if (log) {
+          log_debug("Failed connect() to %s: %s", addrs[i].str().c_str(), get_message_error(so_error).c_str());
+        }
+      } else if (now >= server.deadline) {
+        if (log) {
+          log_warning("Timeout reached trying to connect to MySQL Server %s: %s", addrs[i].str().c_str(),
+                      get_message_error(ETIMEDOUT).c_str());
+        }
+      } else {
+        still_connecting.push_back(i);
+        continue;
+      }
+      this->close(server.fd);
+      if (start_next(i)) {
+        still_connecting.push_back(i);
+      }
+    }
+    std::swap(connecting, still_connecting);
+  }
+
+  for (auto &sock : socks) {
+    if (sock >= 0 && !setup_connected_socket(sock)) {
+      this->close(sock);
+      sock = -1;
+    }
+  }
+  return socks;
+}
+
 ssize_t SocketOperations::write(int fd, void *buffer, size_t nbyte) {
 #ifndef _WIN32
   return ::write(fd, buffer, nbyte);
@@ -319,4 +765,14 @@ int SocketOperations::listen(int fd, int n) {
   return ::listen(fd, n);
 }
 
+#ifdef __linux__
+int SocketOperations::pipe(int fds[2]) {
+  return ::pipe2(fds, O_CLOEXEC);
+}
+
+ssize_t SocketOperations::splice(int fd_in, int fd_out, size_t nbyte) {
+  return ::splice(fd_in, nullptr, fd_out, nullptr, nbyte, SPLICE_F_MOVE);
+}
+#endif
+
 } // routing
@@ -183,6 +183,17 @@ static void start(const ConfigSection *section) {
                    name,                       config.max_connections,
                    destination_connect_timeout, config.max_connect_errors,
                    client_connect_timeout);
+    r.set_io_model(config.io_model);
+    r.set_acceptor_threads(config.acceptor_threads);
+    r.set_listen_backlog(config.listen_backlog);
+    r.set_worker_threads(config.min_worker_threads, config.max_worker_threads);
+    r.set_preconnect_pool_size(config.preconnect_pool_size);
+    r.set_preconnect_max_age(std::chrono::seconds(config.preconnect_max_age));
+    r.set_connect_race_size(config.connect_race_size);
+    r.set_routing_strategy(config.routing_strategy);
+    r.set_quarantine_probe(config.quarantine_probe);
+    r.set_max_connections_per_destination(config.max_connections_per_destination);
+    r.set_admission_queue(config.admission_queue_size, std::chrono::seconds(config.admission_queue_timeout));
     try {
       // don't allow rootless URIs as we did already in the get_option_destinations()
       r.set_destinations_from_uri(URI(config.destinations, false));
@@ -0,0 +1,124 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "splicer.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cerrno>
+
+const size_t Splicer::kChunkSize;
+
+Splicer::Splicer(BaseProtocol *protocol, routing::SocketOperationsBase *socket_operations)
+    : protocol_(protocol), socket_operations_(socket_operations),
+      pipe_{routing::kInvalidSocket, routing::kInvalidSocket}, disabled_(false) {
+  assert(protocol_ != nullptr);
+  assert(socket_operations_ != nullptr);
+}
+
+Splicer::~Splicer() {
+  close_pipe();
+}
+
+bool Splicer::open_pipe() noexcept {
+  if (socket_operations_->pipe(pipe_) == -1) {
+    const int last_errno = socket_operations_->get_errno();
+    if (last_errno != ENOSYS) {
+      log_debug("pipe() failed, not using splice(): (%d %s)",
+          last_errno, get_message_error(last_errno).c_str());
+    }
+    pipe_[0] = pipe_[1] = routing::kInvalidSocket;
+    disabled_ = true;
+    return false;
+  }
+  return true;
+}
+
+void Splicer::close_pipe() noexcept {
+  if (pipe_[0] != routing::kInvalidSocket) {
+    socket_operations_->close(pipe_[0]);
+    socket_operations_->close(pipe_[1]);
+    pipe_[0] = pipe_[1] = routing::kInvalidSocket;
+  }
+}
+
+int Splicer::copy_packets(int sender, int receiver, bool sender_is_readable,
+                          RoutingProtocolBuffer &buffer, int *curr_pktnr,
+                          bool &handshake_done, size_t *report_bytes_read,
+                          bool from_server) {
+  assert(report_bytes_read);
+
+  if (handshake_done && !disabled_ && sender_is_readable &&
+      (is_splicing() || open_pipe())) {
+    int res = splice_packets(sender, receiver, report_bytes_read);
+    if (res != 1) {
+      return res;
+    }
+    // splice() not supported for this connection; nothing was read yet
+    close_pipe();
+    disabled_ = true;
+  }
+
+  return protocol_->copy_packets(sender, receiver, sender_is_readable, buffer,
+                                 curr_pktnr, handshake_done, report_bytes_read,
+                                 from_server);
+}
+
+int Splicer::splice_packets(int sender, int receiver, size_t *report_bytes_read) {
+  ssize_t res = socket_operations_->splice(sender, pipe_[1], kChunkSize);
+  if (res <= 0) {
+    if (res == -1) {
+      const int last_errno = socket_operations_->get_errno();
+      if (last_errno == EINVAL || last_errno == ENOSYS) {
+        log_debug("fd=%d splice() not supported, copying data instead", sender);
+        return 1;
+      }
+      log_debug("fd=%d read failed: (%d %s)",
+          sender,
+          last_errno, get_message_error(last_errno).c_str());
+    } else {
+      // the caller assumes that errno == 0 on plain connection closes.
+      socket_operations_->set_errno(0);
+    }
+    return -1;
+  }
+
+  const size_t bytes_read = static_cast<size_t>(res);
+
+  // drain the pipe completely; blocks like write_all() until the receiver
+  // took all the data
+  size_t pending = bytes_read;
+  while (pending > 0) {
+    if ((res = socket_operations_->splice(pipe_[0], receiver, pending)) <= 0) {
+      const int last_errno = socket_operations_->get_errno();
+
+      log_debug("fd=%d write error: %s",
+          receiver,
+          get_message_error(last_errno).c_str());
+      if (res == 0) {
+        socket_operations_->set_errno(EPIPE);
+      }
+      return -1;
+    }
+    pending -= static_cast<size_t>(res);
+  }
+
+  *report_bytes_read = bytes_read;
+
+  return 0;
+}
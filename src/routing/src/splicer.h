@@ -0,0 +1,97 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_SPLICER_INCLUDED
+#define ROUTING_SPLICER_INCLUDED
+
+#include "mysqlrouter/routing.h"
+#include "protocol/base_protocol.h"
+
+/** @class Splicer
+ *  @brief Forwards data of a connection without copying it to user space
+ *
+ * Once the handshake is done, the router does not look at the data it
+ * forwards anymore. From then on, Splicer moves the data from the sender
+ * into a pipe and from the pipe to the receiver using splice(), so it
+ * never leaves the kernel.
+ *
+ * Before the handshake is done, or when splice() is not supported for the
+ * sockets or the platform, the data is forwarded using
+ * BaseProtocol::copy_packets().
+ *
+ * The pipe is created when it is first needed and is always drained
+ * before copy_packets() returns, so one pipe serves both directions of a
+ * connection.
+ */
+class Splicer {
+ public:
+  /** @brief Maximum number of bytes moved with one splice() from the sender
+   *
+   * Default capacity of a pipe on Linux.
+   */
+  static const size_t kChunkSize = 65536;
+
+  /** @brief Constructor
+   *
+   * @param protocol protocol used until the handshake is done
+   * @param socket_operations object handling the operations on network sockets
+   */
+  Splicer(BaseProtocol *protocol, routing::SocketOperationsBase *socket_operations);
+
+  ~Splicer();
+
+  Splicer(const Splicer &) = delete;
+  Splicer &operator=(const Splicer &) = delete;
+
+  /** @brief Reads from sender and writes it to receiver
+   *
+   * Same contract as BaseProtocol::copy_packets().
+   *
+   * @return 0 on success; -1 on error
+   */
+  int copy_packets(int sender, int receiver, bool sender_is_readable,
+                   RoutingProtocolBuffer &buffer, int *curr_pktnr,
+                   bool &handshake_done, size_t *report_bytes_read,
+                   bool from_server);
+
+  /** @brief Returns whether data was forwarded using splice() */
+  bool is_splicing() const noexcept {
+    return pipe_[0] != routing::kInvalidSocket;
+  }
+
+ private:
+  /** @brief Creates the pipe; disables splicing on errors */
+  bool open_pipe() noexcept;
+
+  /** @brief Closes the pipe and falls back to copy_packets() */
+  void close_pipe() noexcept;
+
+  /** @brief Moves data from sender to receiver through the pipe
+   *
+   * @return 0 on success; -1 on error; 1 when splice() is not supported
+   *         for the sender and no data was moved
+   */
+  int splice_packets(int sender, int receiver, size_t *report_bytes_read);
+
+  BaseProtocol *protocol_;
+  routing::SocketOperationsBase *socket_operations_;
+  int pipe_[2];
+  /** @brief Set when splice() turned out not to be usable */
+  bool disabled_;
+};
+
+#endif // ROUTING_SPLICER_INCLUDED
@@ -0,0 +1,1064 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifdef HAVE_IO_URING
+
+#include "uring_reactor.h"
+
+#include "common.h"
+#include "logger.h"
+#include "mysqlrouter/utils.h"
+#include "protocol/protocol.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using mysqlrouter::string_format;
+using mysqlrouter::to_string;
+using std::string;
+
+namespace {
+
+/** @brief Number of entries of the submission ring of a reactor thread */
+constexpr unsigned kRingEntries = 1024;
+
+/** @brief Number of buffers each reactor thread provides to the kernel
+ *
+ * A buffer is only taken by a receive which got data, and given back once
+ * the data was sent or copied; idle connections don't hold any.
+ */
+constexpr unsigned kBuffersPerThread = 256;
+
+/** @brief Buffers sent as they are while at least this many are left
+ *
+ * A receiver which does not read keeps the buffer being sent to it.
+ * When buffers run low, data is copied and the buffer given back right
+ * away, so that slow receivers can't starve the other connections.
+ */
+constexpr unsigned kMinFreeBuffers = kBuffersPerThread / 4;
+
+/** @brief Group id of the provided buffers */
+constexpr uint16_t kBufferGroup = 0;
+
+/** @brief How often connections are checked for an expired client_connect_timeout */
+const std::chrono::milliseconds kTimeoutCheckInterval { 1000 };
+
+/** @brief How long a stopping reactor thread waits for cancelled operations */
+const std::chrono::milliseconds kDrainTimeout { 5000 };
+
+// user_data of the operations not belonging to a connection; operations
+// on the sockets of a connection carry the address of the endpoint, with
+// the kind of operation in the lowest bit
+constexpr uint64_t kWakeupTag = 1;
+constexpr uint64_t kTimeoutTag = 2;
+constexpr uint64_t kProvideTag = 3;
+constexpr uint64_t kCancelTag = 4;
+constexpr uint64_t kMaxTag = kCancelTag;
+
+constexpr uint64_t kOpRecv = 0;
+constexpr uint64_t kOpSend = 1;
+
+int io_uring_setup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                  flags, nullptr, 0));
+}
+
+/** @class UringSocketOperations
+ * @brief Socket operations given to the protocol object of a reactor thread
+ *
+ * Only used while handshaking. Writes to the sockets of the connection
+ * being served are appended to the pending data of the receiver, which
+ * the reactor thread sends through the ring.
+ *
+ * Reads return the data the reactor thread received and handed over using
+ * set_input(); the sockets themselves are never read from.
+ */
+class UringSocketOperations : public routing::SocketOperationsBase {
+ public:
+  explicit UringSocketOperations(routing::SocketOperationsBase *socket_operations)
+      : so_(socket_operations), connection_(nullptr),
+        input_fd_(-1), input_(nullptr), input_size_(0) {}
+
+  void set_connection(UringReactor::Connection *connection) noexcept {
+    connection_ = connection;
+  }
+
+  /** @brief Sets what the next reads from fd return
+   *
+   * @param fd socket descriptor the data was received from
+   * @param data data received from fd
+   * @param size number of bytes in data
+   */
+  void set_input(int fd, const uint8_t *data, size_t size) noexcept {
+    input_fd_ = fd;
+    input_ = data;
+    input_size_ = size;
+  }
+
+  void clear() noexcept {
+    set_connection(nullptr);
+    set_input(-1, nullptr, 0);
+  }
+
+  bool has_input() const noexcept {
+    return input_size_ > 0;
+  }
+
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, std::chrono::milliseconds connect_timeout,
+                       bool log = true) noexcept override {
+    return so_->get_mysql_socket(addr, connect_timeout, log);
+  }
+
+  int connect_race(const std::vector<mysqlrouter::TCPAddress> &addrs, std::chrono::milliseconds connect_timeout,
+                   std::chrono::milliseconds delay, size_t *winner, std::vector<size_t> *failed,
+                   bool log = true) noexcept override {
+    return so_->connect_race(addrs, connect_timeout, delay, winner, failed, log);
+  }
+
+  ssize_t write(int fd, void *buffer, size_t nbyte) override {
+    UringReactor::Connection::Endpoint *endpoint = get_endpoint(fd);
+    if (endpoint == nullptr) {
+      return so_->write(fd, buffer, nbyte);
+    }
+
+    auto data = reinterpret_cast<const uint8_t*>(buffer);
+    endpoint->pending.insert(endpoint->pending.end(), data, data + nbyte);
+
+    return static_cast<ssize_t>(nbyte);
+  }
+
+  ssize_t read(int fd, void *buffer, size_t nbyte) override {
+    if (fd != input_fd_ || input_size_ == 0) {
+      // the rest did not arrive yet; the reactor thread only hands over
+      // complete messages, so this is not expected
+      so_->set_errno(EAGAIN);
+      return -1;
+    }
+
+    const size_t size = std::min(nbyte, input_size_);
+    std::memcpy(buffer, input_, size);
+    input_ += size;
+    input_size_ -= size;
+    return static_cast<ssize_t>(size);
+  }
+
+  void close(int fd) override {
+    so_->close(fd);
+  }
+
+  void shutdown(int fd) override {
+    so_->shutdown(fd);
+  }
+
+  void freeaddrinfo(addrinfo *ai) override {
+    so_->freeaddrinfo(ai);
+  }
+
+  int getaddrinfo(const char *node, const char *service, const addrinfo *hints, addrinfo **res) override {
+    return so_->getaddrinfo(node, service, hints, res);
+  }
+
+  int bind(int fd, const struct sockaddr *addr, socklen_t len) override {
+    return so_->bind(fd, addr, len);
+  }
+
+  int socket(int domain, int type, int protocol) override {
+    return so_->socket(domain, type, protocol);
+  }
+
+  int setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen) override {
+    return so_->setsockopt(fd, level, optname, optval, optlen);
+  }
+
+  int listen(int fd, int n) override {
+    return so_->listen(fd, n);
+  }
+
+  int get_errno() override {
+    return so_->get_errno();
+  }
+
+  void set_errno(int e) override {
+    so_->set_errno(e);
+  }
+
+  int poll(struct pollfd *fds, nfds_t nfds, std::chrono::milliseconds timeout) override {
+    return so_->poll(fds, nfds, timeout);
+  }
+
+ private:
+  UringReactor::Connection::Endpoint *get_endpoint(int fd) noexcept {
+    if (connection_ == nullptr) {
+      return nullptr;
+    } else if (fd == connection_->client.fd) {
+      return &connection_->client;
+    } else if (fd == connection_->server.fd) {
+      return &connection_->server;
+    }
+    return nullptr;
+  }
+
+  routing::SocketOperationsBase *so_;
+  UringReactor::Connection *connection_;
+
+  int input_fd_;
+  const uint8_t *input_;
+  size_t input_size_;
+};
+
+} // namespace
+
+UringReactor::Connection::Endpoint::Endpoint(Connection *conn, int socket)
+    : connection(conn), fd(socket),
+      receiving(false), sending(false), starved(false),
+      send_buffer(-1), send_data(nullptr), send_size(0) {}
+
+UringReactor::Connection::Connection(int client_fd, int server_fd, const sockaddr_storage &addr)
+    : client(this, client_fd),
+      server(this, server_fd),
+      client_addr(addr),
+      pktnr(0),
+      handshake_done(false),
+      bytes_up(0),
+      bytes_down(0),
+      last_activity(std::chrono::steady_clock::now()),
+      closed(false),
+      inflight(0) {}
+
+/** @class UringReactor::Worker
+ *  @brief A reactor thread with its own ring, buffers and connections
+ */
+class UringReactor::Worker {
+ public:
+  Worker(const std::string &thread_name, BaseProtocol::Type protocol_type,
+         routing::SocketOperationsBase *socket_operations,
+         unsigned int net_buffer_length,
+         std::chrono::milliseconds client_connect_timeout,
+         const CloseHandler &close_handler)
+      : thread_name_(thread_name),
+        protocol_type_(protocol_type),
+        socket_operations_(socket_operations),
+        uring_socket_operations_(socket_operations),
+        protocol_(Protocol::create(protocol_type, &uring_socket_operations_)),
+        buffer_(net_buffer_length),
+        buffer_size_(net_buffer_length),
+        buffers_(static_cast<size_t>(net_buffer_length) * kBuffersPerThread),
+        buffers_available_(0),
+        client_connect_timeout_(client_connect_timeout),
+        close_handler_(close_handler),
+        ring_fd_(-1),
+        sq_ring_(MAP_FAILED), sq_ring_size_(0),
+        cq_ring_(MAP_FAILED), cq_ring_size_(0),
+        sqes_(nullptr), sqes_size_(0),
+        sq_tail_local_(0),
+        event_fd_(-1),
+        stopping_(false),
+        submitted_(0),
+        enter_calls_(0) {
+    std::memset(&timeout_, 0, sizeof(timeout_));
+    timeout_.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(kTimeoutCheckInterval).count();
+  }
+
+  ~Worker() {
+    stop();
+    // closing the ring cancels what is still queued; the connections
+    // and buffers are released only afterwards
+    close_ring();
+    if (event_fd_ >= 0) ::close(event_fd_);
+  }
+
+  // throws std::runtime_error
+  void start() {
+    setup_ring();
+    if ((event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+      throw std::runtime_error("eventfd() failed: " + get_message_error(errno));
+    }
+
+    // kernels before 5.7 don't know IORING_OP_PROVIDE_BUFFERS
+    provide_buffers(0, kBuffersPerThread);
+    int res;
+    while ((res = enter(1)) == -EINTR) {}
+    reap();
+    if (res >= 0 && (completions_.empty() || completions_[0].res < 0)) {
+      res = completions_.empty() ? -EIO : completions_[0].res;
+    }
+    completions_.clear();
+    if (res < 0) {
+      throw std::runtime_error("providing buffers to io_uring failed: " + get_message_error(-res));
+    }
+    buffers_available_ = kBuffersPerThread;
+
+    thread_ = std::thread(&Worker::run, this);
+  }
+
+  void stop() {
+    stopping_.store(true);
+    if (thread_.joinable()) {
+      wakeup();
+      thread_.join();
+    }
+  }
+
+  bool add(std::unique_ptr<Connection> connection) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_incoming_);
+      if (stopping_.load()) {
+        return false;
+      }
+      incoming_.push_back(std::move(connection));
+    }
+    wakeup();
+    return true;
+  }
+
+  uint64_t get_submitted() const noexcept {
+    return submitted_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t get_enter_calls() const noexcept {
+    return enter_calls_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /** @brief Result of an operation, copied out of the completion ring */
+  struct Completion {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+  };
+
+  void setup_ring() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    // no IORING_SETUP_SQPOLL: the thread submits a whole batch with the
+    // io_uring_enter() it waits for completions with anyway
+    ring_fd_ = io_uring_setup(kRingEntries, &params);
+    if (ring_fd_ == -1) {
+      throw std::runtime_error("io_uring_setup() failed: " + get_message_error(errno));
+    }
+
+    // without these, completions could get lost or receives and sends
+    // would block kernel worker threads
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_FAST_POLL)) {
+      close_ring();
+      throw std::runtime_error("io_uring of this kernel is too old");
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ != MAP_FAILED) {
+      cq_ring_ = single_mmap ? sq_ring_ : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    }
+    if (cq_ring_ != MAP_FAILED) {
+      sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+      void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQES);
+      if (sqes != MAP_FAILED) {
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+      }
+    }
+    if (sqes_ == nullptr) {
+      const int last_errno = errno;
+      close_ring();
+      throw std::runtime_error("mapping io_uring failed: " + get_message_error(last_errno));
+    }
+
+    auto sq = static_cast<uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_tail_local_ = *sq_tail_;
+
+    auto cq = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  void close_ring() noexcept {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+      sqes_ = nullptr;
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = MAP_FAILED;
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+      sq_ring_ = MAP_FAILED;
+    }
+    if (ring_fd_ != -1) {
+      ::close(ring_fd_);
+      ring_fd_ = -1;
+    }
+  }
+
+  /** @brief Submits the queued operations
+   *
+   * @param min_complete number of completions to wait for
+   * @return result of io_uring_enter(); negative errno on errors
+   */
+  int enter(unsigned min_complete) noexcept {
+    __atomic_store_n(sq_tail_, sq_tail_local_, __ATOMIC_RELEASE);
+    const unsigned to_submit = sq_tail_local_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    enter_calls_.fetch_add(1, std::memory_order_relaxed);
+    int res = io_uring_enter(ring_fd_, to_submit, min_complete,
+                             min_complete > 0 ? IORING_ENTER_GETEVENTS : 0);
+    return res < 0 ? -errno : res;
+  }
+
+  /** @brief Returns a cleared submission queue entry
+   *
+   * Entries are submitted by the next enter(). The ring only fills up
+   * when handling many completions at once; then what is queued so far is
+   * submitted right away.
+   */
+  io_uring_sqe *get_sqe() noexcept {
+    while (sq_tail_local_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      int res = enter(0);
+      if (res == -EBUSY) {
+        // completions the kernel could not post yet are in the way
+        reap();
+      } else if (res < 0 && res != -EINTR && res != -EAGAIN) {
+        log_error("[%s] io_uring_enter() failed: %s", thread_name_.c_str(), get_message_error(-res).c_str());
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+
+    const unsigned index = sq_tail_local_ & sq_mask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sq_tail_local_;
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    return sqe;
+  }
+
+  /** @brief Moves the completions posted by the kernel to completions_ */
+  void reap() {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      completions_.push_back({cqe.user_data, cqe.res, cqe.flags});
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+  void wakeup() noexcept {
+    uint64_t one = 1;
+    if (::write(event_fd_, &one, sizeof(one)) < 0) {
+      // counter is already non-zero, the reactor thread will wake up anyway
+    }
+  }
+
+  void arm_wakeup() noexcept {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = event_fd_;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = kWakeupTag;
+  }
+
+  void arm_timeout() noexcept {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&timeout_);
+    sqe->len = 1;
+    sqe->user_data = kTimeoutTag;
+  }
+
+  /** @brief Gives count buffers starting with id first to the kernel */
+  void provide_buffers(unsigned first, unsigned count) noexcept {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(&buffers_[static_cast<size_t>(first) * buffer_size_]);
+    sqe->len = buffer_size_;
+    sqe->off = first;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = kProvideTag;
+  }
+
+  void cancel(uint64_t user_data) noexcept {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = kCancelTag;
+  }
+
+  static uint64_t make_user_data(Connection::Endpoint *endpoint, uint64_t op) noexcept {
+    return reinterpret_cast<uint64_t>(endpoint) | op;
+  }
+
+  void queue_recv(Connection::Endpoint &sender) noexcept {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sender.fd;
+    sqe->len = buffer_size_;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = make_user_data(&sender, kOpRecv);
+
+    sender.receiving = true;
+    ++sender.connection->inflight;
+  }
+
+  void queue_send(Connection::Endpoint &receiver) noexcept {
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = receiver.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(receiver.send_data);
+    sqe->len = static_cast<uint32_t>(std::min(receiver.send_size, static_cast<size_t>(INT_MAX)));
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = make_user_data(&receiver, kOpSend);
+
+    receiver.sending = true;
+    ++receiver.connection->inflight;
+  }
+
+  void start_send(Connection::Endpoint &receiver, int buffer, const uint8_t *data, size_t size) noexcept {
+    receiver.send_buffer = buffer;
+    receiver.send_data = data;
+    receiver.send_size = size;
+    queue_send(receiver);
+  }
+
+  /** @brief Releases what the last send of an endpoint was sending */
+  void release_send(Connection::Endpoint &receiver) {
+    if (receiver.send_buffer >= 0) {
+      returned_.push_back(receiver.send_buffer);
+      receiver.send_buffer = -1;
+    } else {
+      RoutingProtocolBuffer().swap(receiver.outgoing);
+    }
+    receiver.send_data = nullptr;
+    receiver.send_size = 0;
+  }
+
+  void run() noexcept {
+    mysql_harness::rename_thread(thread_name_.c_str());
+
+    arm_wakeup();
+    arm_timeout();
+
+    while (!stopping_.load()) {
+      // submits everything queued while handling the previous batch
+      int res = enter(1);
+      if (res < 0 && res != -EINTR && res != -EAGAIN && res != -EBUSY) {
+        log_error("[%s] io_uring_enter() failed: %s", thread_name_.c_str(), get_message_error(-res).c_str());
+        break;
+      }
+      reap();
+      handle_completions();
+    }
+
+    // close whatever is left
+    {
+      std::lock_guard<std::mutex> lock(mutex_incoming_);
+      for (auto &connection : incoming_) {
+        Connection *c = connection.get();
+        connections_.emplace(c, std::move(connection));
+      }
+      incoming_.clear();
+    }
+    for (auto &it : connections_) {
+      if (!it.second->closed) {
+        it.second->extra_msg = "route stopped";
+        close_connection(*it.second);
+      }
+    }
+
+    // the kernel may still use the buffers of cancelled operations
+    const auto deadline = std::chrono::steady_clock::now() + kDrainTimeout;
+    release_closed();
+    while (!closed_.empty()) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        log_warning("[%s] %zu connections still had operations queued when stopping",
+                    thread_name_.c_str(), closed_.size());
+        break;
+      }
+      int res = enter(1);
+      if (res < 0 && res != -EINTR && res != -EAGAIN && res != -EBUSY) {
+        break;
+      }
+      reap();
+      handle_completions();
+    }
+  }
+
+  void handle_completions() {
+    for (size_t i = 0; i < completions_.size(); ++i) {
+      // handling a completion may make room in the ring by reaping more
+      const Completion completion = completions_[i];
+
+      if (completion.user_data == kWakeupTag) {
+        uint64_t value;
+        while (::read(event_fd_, &value, sizeof(value)) > 0) {}
+        register_incoming();
+        arm_wakeup();
+      } else if (completion.user_data == kTimeoutTag) {
+        close_timed_out(std::chrono::steady_clock::now());
+        arm_timeout();
+      } else if (completion.user_data == kProvideTag) {
+        if (completion.res < 0) {
+          log_error("[%s] providing buffers to io_uring failed: %s", thread_name_.c_str(),
+                    get_message_error(-completion.res).c_str());
+        }
+      } else if (completion.user_data > kMaxTag) {
+        auto endpoint = reinterpret_cast<Connection::Endpoint*>(completion.user_data & ~kOpSend);
+        if ((completion.user_data & kOpSend) != 0) {
+          on_send(*endpoint, completion);
+        } else {
+          on_recv(*endpoint, completion);
+        }
+      }
+    }
+    completions_.clear();
+
+    return_buffers();
+    release_closed();
+  }
+
+  void register_incoming() {
+    std::vector<std::unique_ptr<Connection>> incoming;
+    {
+      std::lock_guard<std::mutex> lock(mutex_incoming_);
+      incoming.swap(incoming_);
+    }
+
+    for (auto &it : incoming) {
+      Connection &connection = *it;
+      connections_.emplace(&connection, std::move(it));
+
+      // receives and sends wait for blocking sockets to get ready in the
+      // kernel instead of failing with EAGAIN
+      routing::set_socket_blocking(connection.client.fd, true);
+      routing::set_socket_blocking(connection.server.fd, true);
+
+      pump(connection);
+    }
+  }
+
+  /** @brief Queues the sends and receives a connection can do next */
+  void pump(Connection &connection) {
+    for (Connection::Endpoint *endpoint : {&connection.server, &connection.client}) {
+      if (!endpoint->sending && !endpoint->pending.empty()) {
+        endpoint->outgoing.swap(endpoint->pending);
+        start_send(*endpoint, -1, &endpoint->outgoing[0], endpoint->outgoing.size());
+      }
+    }
+
+    // don't receive more from a sender while its receiver has data to send
+    for (Connection::Endpoint *sender : {&connection.server, &connection.client}) {
+      Connection::Endpoint &receiver = sender == &connection.server ? connection.client : connection.server;
+      if (!sender->receiving && !sender->starved && !receiver.sending && receiver.pending.empty()) {
+        queue_recv(*sender);
+      }
+    }
+  }
+
+  void on_recv(Connection::Endpoint &sender, const Completion &completion) {
+    Connection &connection = *sender.connection;
+    sender.receiving = false;
+    --connection.inflight;
+
+    int buffer = -1;
+    if (completion.flags & IORING_CQE_F_BUFFER) {
+      buffer = static_cast<int>(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+      --buffers_available_;
+    }
+
+    if (connection.closed) {
+      if (buffer >= 0) {
+        returned_.push_back(buffer);
+      }
+      return;
+    }
+
+    const bool from_server = &sender == &connection.server;
+    if (completion.res == -ENOBUFS) {
+      // received again once buffers are given back
+      sender.starved = true;
+      starved_.push_back(&sender);
+      return;
+    } else if (completion.res < 0) {
+      connection.extra_msg = string(from_server ? "Copy server->client failed: " : "Copy client->server failed: ") +
+                             get_message_error(-completion.res);
+      close_connection(connection);
+      return;
+    } else if (completion.res == 0) {
+      if (!from_server && !connection.handshake_done) {
+        connection.extra_msg = string("Copy client->server failed: unexpected connection close");
+      }
+      close_connection(connection);
+      return;
+    }
+
+    assert(buffer >= 0);
+    forward(sender, buffer, static_cast<size_t>(completion.res));
+    if (!connection.closed) {
+      pump(connection);
+    }
+  }
+
+  /** @brief Forwards what was received from a sender into a provided buffer */
+  void forward(Connection::Endpoint &sender, int buffer, size_t size) {
+    Connection &connection = *sender.connection;
+    const bool from_server = &sender == &connection.server;
+    Connection::Endpoint &receiver = from_server ? connection.client : connection.server;
+    const uint8_t *data = &buffers_[static_cast<size_t>(buffer) * buffer_size_];
+
+    // ClassicProtocol::copy_packets() does the same before reading
+    if (!connection.handshake_done && connection.pktnr == 2) {
+      connection.handshake_done = true;
+    }
+
+    if (connection.handshake_done) {
+      (from_server ? connection.bytes_up : connection.bytes_down) += size;
+      if (receiver.sending || !receiver.pending.empty()) {
+        receiver.pending.insert(receiver.pending.end(), data, data + size);
+        returned_.push_back(buffer);
+      } else if (buffers_available_ >= kMinFreeBuffers) {
+        start_send(receiver, buffer, data, size);
+      } else {
+        receiver.outgoing.assign(data, data + size);
+        returned_.push_back(buffer);
+        start_send(receiver, -1, &receiver.outgoing[0], size);
+      }
+      return;
+    }
+
+    sender.partial.insert(sender.partial.end(), data, data + size);
+    returned_.push_back(buffer);
+
+    // messages too big for the buffer are left to the protocol code
+    if (sender.partial.size() < buffer_.size() &&
+        !ends_with_complete_message(protocol_type_, &sender.partial[0], sender.partial.size())) {
+      return;
+    }
+
+    RoutingProtocolBuffer input;
+    input.swap(sender.partial);
+    uring_socket_operations_.set_connection(&connection);
+    uring_socket_operations_.set_input(sender.fd, &input[0], input.size());
+    uring_socket_operations_.set_errno(0);
+
+    size_t bytes_forwarded = 0;
+    while (uring_socket_operations_.has_input()) {
+      size_t bytes_read = 0;
+      if (protocol_->copy_packets(sender.fd, receiver.fd, true, buffer_, &connection.pktnr,
+                                  connection.handshake_done, &bytes_read, from_server) == -1) {
+        const int last_errno = uring_socket_operations_.get_errno();
+        uring_socket_operations_.clear();
+        if (last_errno > 0) {
+          connection.extra_msg = string(from_server ? "Copy server->client failed: " : "Copy client->server failed: ") +
+                                 get_message_error(last_errno);
+        }
+        close_connection(connection);
+        return;
+      }
+      bytes_forwarded += bytes_read;
+      (from_server ? connection.bytes_up : connection.bytes_down) += bytes_read;
+    }
+    uring_socket_operations_.clear();
+
+    // parts of a message trickling in don't keep a handshake alive
+    if (bytes_forwarded > 0) {
+      connection.last_activity = std::chrono::steady_clock::now();
+    }
+  }
+
+  void on_send(Connection::Endpoint &receiver, const Completion &completion) {
+    Connection &connection = *receiver.connection;
+    receiver.sending = false;
+    --connection.inflight;
+
+    if (connection.closed) {
+      release_send(receiver);
+      return;
+    }
+
+    if (completion.res <= 0) {
+      const int last_errno = completion.res < 0 ? -completion.res : EPIPE;
+      connection.extra_msg = string("Write to fd=" + to_string(receiver.fd) +
+                                    " failed: " + get_message_error(last_errno));
+      release_send(receiver);
+      close_connection(connection);
+      return;
+    }
+
+    receiver.send_data += completion.res;
+    receiver.send_size -= static_cast<size_t>(completion.res);
+    if (receiver.send_size > 0) {
+      queue_send(receiver);
+      return;
+    }
+
+    release_send(receiver);
+    pump(connection);
+  }
+
+  /** @brief Gives the buffers released since the last call back to the kernel */
+  void return_buffers() {
+    if (returned_.empty()) {
+      return;
+    }
+
+    // neighbouring buffers are given back with one operation
+    std::sort(returned_.begin(), returned_.end());
+    size_t first = 0;
+    for (size_t i = 1; i <= returned_.size(); ++i) {
+      if (i == returned_.size() || returned_[i] != returned_[i - 1] + 1) {
+        provide_buffers(static_cast<unsigned>(returned_[first]), static_cast<unsigned>(i - first));
+        first = i;
+      }
+    }
+    buffers_available_ += static_cast<unsigned>(returned_.size());
+    returned_.clear();
+
+    // the buffers are provided before the receives are submitted
+    std::vector<Connection::Endpoint*> starved;
+    starved.swap(starved_);
+    for (Connection::Endpoint *endpoint : starved) {
+      endpoint->starved = false;
+      pump(*endpoint->connection);
+    }
+  }
+
+  /** @brief Frees the closed connections whose operations all completed */
+  void release_closed() {
+    closed_.erase(std::remove_if(closed_.begin(), closed_.end(), [this](Connection *connection) {
+      if (connection->inflight > 0) {
+        return false;
+      }
+      connections_.erase(connection);
+      return true;
+    }), closed_.end());
+  }
+
+  void close_timed_out(std::chrono::steady_clock::time_point now) {
+    for (auto &it : connections_) {
+      Connection &connection = *it.second;
+      if (!connection.closed && !connection.handshake_done &&
+          now - connection.last_activity >= client_connect_timeout_) {
+        connection.extra_msg = string("client auth timed out");
+        close_connection(connection);
+      }
+    }
+  }
+
+  void close_connection(Connection &connection) {
+    connection.closed = true;
+    closed_.push_back(&connection);
+
+    for (Connection::Endpoint *endpoint : {&connection.server, &connection.client}) {
+      // the data being sent stays around until the send completed
+      if (endpoint->receiving) {
+        cancel(make_user_data(endpoint, kOpRecv));
+      }
+      if (endpoint->sending) {
+        cancel(make_user_data(endpoint, kOpSend));
+      }
+      if (endpoint->starved) {
+        starved_.erase(std::remove(starved_.begin(), starved_.end(), endpoint), starved_.end());
+        endpoint->starved = false;
+      }
+
+      routing::set_socket_blocking(endpoint->fd, false);
+
+      // deliver what the socket takes right away; waiting for a slow peer
+      // would stall all other connections of this thread
+      if (!endpoint->pending.empty()) {
+        size_t written = 0;
+        if (!endpoint->sending) {
+          ssize_t res = socket_operations_->write(endpoint->fd, &endpoint->pending[0], endpoint->pending.size());
+          written = res < 0 ? 0 : static_cast<size_t>(res);
+        }
+        if (written < endpoint->pending.size()) {
+          log_debug("[%s] fd=%d dropping %zu bytes which could not be delivered before closing",
+                    thread_name_.c_str(), endpoint->fd, endpoint->pending.size() - written);
+        }
+        RoutingProtocolBuffer().swap(endpoint->pending);
+      }
+      RoutingProtocolBuffer().swap(endpoint->partial);
+    }
+
+    close_handler_(connection);
+  }
+
+  const std::string thread_name_;
+  const BaseProtocol::Type protocol_type_;
+  routing::SocketOperationsBase *socket_operations_;
+  UringSocketOperations uring_socket_operations_;
+  std::unique_ptr<BaseProtocol> protocol_;
+  /** @brief Buffer given to copy_packets() while handshaking */
+  RoutingProtocolBuffer buffer_;
+
+  /** @brief Size of each provided buffer */
+  const unsigned int buffer_size_;
+  /** @brief Memory of the buffers provided to the kernel */
+  std::vector<uint8_t> buffers_;
+  /** @brief Number of provided buffers the kernel did not fill yet */
+  unsigned buffers_available_;
+  /** @brief Buffers to give back to the kernel */
+  std::vector<int> returned_;
+  /** @brief Senders whose receive found no buffer */
+  std::vector<Connection::Endpoint*> starved_;
+
+  const std::chrono::milliseconds client_connect_timeout_;
+  const CloseHandler &close_handler_;
+
+  int ring_fd_;
+  void *sq_ring_;
+  size_t sq_ring_size_;
+  void *cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe *sqes_;
+  size_t sqes_size_;
+  unsigned *sq_head_;
+  unsigned *sq_tail_;
+  unsigned *sq_array_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  /** @brief Tail of the submission ring including the entries not submitted yet */
+  unsigned sq_tail_local_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe *cqes_;
+  std::vector<Completion> completions_;
+  struct __kernel_timespec timeout_;
+
+  int event_fd_;
+  std::atomic<bool> stopping_;
+  std::thread thread_;
+
+  std::atomic<uint64_t> submitted_;
+  std::atomic<uint64_t> enter_calls_;
+
+  std::unordered_map<Connection*, std::unique_ptr<Connection>> connections_;
+  /** @brief Closed connections freed once no operation refers to them anymore */
+  std::vector<Connection*> closed_;
+
+  std::mutex mutex_incoming_;
+  std::vector<std::unique_ptr<Connection>> incoming_;
+};
+
+UringReactor::UringReactor(const std::string &thread_name, size_t num_threads,
+                           BaseProtocol::Type protocol_type,
+                           routing::SocketOperationsBase *socket_operations,
+                           unsigned int net_buffer_length,
+                           std::chrono::milliseconds client_connect_timeout,
+                           CloseHandler close_handler)
+    : thread_name_(thread_name),
+      close_handler_(close_handler),
+      next_worker_(0),
+      running_(false) {
+  if (num_threads == 0) {
+    throw std::invalid_argument("UringReactor needs at least one thread");
+  }
+
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new Worker(thread_name, protocol_type, socket_operations,
+                                     net_buffer_length, client_connect_timeout,
+                                     close_handler_));
+  }
+}
+
+UringReactor::~UringReactor() {
+  stop();
+}
+
+void UringReactor::start() {
+  try {
+    for (auto &worker : workers_) {
+      worker->start();
+    }
+  } catch (const std::runtime_error &exc) {
+    for (auto &worker : workers_) {
+      worker->stop();
+    }
+    throw std::runtime_error(string_format("[%s] %s", thread_name_.c_str(), exc.what()));
+  }
+  running_.store(true);
+}
+
+void UringReactor::stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  for (auto &worker : workers_) {
+    worker->stop();
+  }
+}
+
+bool UringReactor::add_connection(int client, int server, const sockaddr_storage &client_addr) {
+  if (!running_.load()) {
+    return false;
+  }
+
+  std::unique_ptr<Connection> connection(new Connection(client, server, client_addr));
+  const size_t ndx = next_worker_.fetch_add(1) % workers_.size();
+
+  return workers_[ndx]->add(std::move(connection));
+}
+
+UringReactor::Stats UringReactor::get_stats() const noexcept {
+  Stats stats { 0, 0 };
+  for (auto &worker : workers_) {
+    stats.submitted += worker->get_submitted();
+    stats.enter_calls += worker->get_enter_calls();
+  }
+  return stats;
+}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,186 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_URING_REACTOR_INCLUDED
+#define ROUTING_URING_REACTOR_INCLUDED
+
+/** @file
+ * @brief Defining the class UringReactor
+ *
+ * UringReactor is used by MySQLRouting when a route is configured with
+ * `io_model=io_uring`. Like EpollReactor, it spreads the client/server
+ * socket pairs of the route over a fixed number of reactor threads; each
+ * thread drives the sockets of its connections through an io_uring of
+ * its own.
+ *
+ * The ring is not hidden behind routing::SocketOperationsBase: its calls
+ * block the calling thread until they are done, so nothing could be
+ * batched behind them. Only the handshake code, which is written against
+ * SocketOperationsBase, goes through an adapter implementing it.
+ *
+ * Only available on Linux when the build found <linux/io_uring.h>
+ * (HAVE_IO_URING); needs Linux 5.7 or later at runtime.
+ */
+
+#ifdef HAVE_IO_URING
+
+#include "mysqlrouter/routing.h"
+#include "protocol/base_protocol.h"
+#include "reactor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+/** @class UringReactor
+ *  @brief Multiplexes routed connections over a fixed set of io_uring threads
+ *
+ *  Every socket has a receive queued on the ring of its thread. Data is
+ *  received into buffers provided to the kernel up front
+ *  (IORING_OP_PROVIDE_BUFFERS), so idle connections don't hold any buffer.
+ *  Once the handshake is done, a buffer is sent to the receiver as it is
+ *  and given back to the kernel when the send completed. While
+ *  handshaking, the data is passed through BaseProtocol::copy_packets()
+ *  like with the other I/O models.
+ *
+ *  A sender is not read from again before what it sent was written to its
+ *  receiver. All receives, sends and returned buffers queued while
+ *  handling a batch of completions are submitted with one system call.
+ */
+class UringReactor : public Reactor {
+ public:
+  /** @brief State of a client connection and its server connection */
+  struct Connection {
+    /** @brief One side of the connection */
+    struct Endpoint {
+      Endpoint(Connection *conn, int socket);
+
+      Connection *connection;
+      int fd;
+      /** @brief Whether a receive is queued for the socket */
+      bool receiving;
+      /** @brief Whether a send is queued for the socket */
+      bool sending;
+      /** @brief Whether the last receive failed for lack of buffers */
+      bool starved;
+      /** @brief Provided buffer being sent, or -1 when sending `outgoing` */
+      int send_buffer;
+      /** @brief Part of the data being sent which was not sent yet */
+      const uint8_t *send_data;
+      size_t send_size;
+      /** @brief Data being sent when it is not in a provided buffer */
+      RoutingProtocolBuffer outgoing;
+      /** @brief Data written to this socket by the protocol code which was not sent yet */
+      RoutingProtocolBuffer pending;
+      /** @brief Start of a handshake message read from this socket whose remaining part did not arrive yet */
+      RoutingProtocolBuffer partial;
+    };
+
+    Connection(int client_fd, int server_fd, const sockaddr_storage &addr);
+
+    Endpoint client;
+    Endpoint server;
+    sockaddr_storage client_addr;
+    int pktnr;
+    bool handshake_done;
+    size_t bytes_up;
+    size_t bytes_down;
+    /** @brief Last time data was forwarded (used for client_connect_timeout) */
+    std::chrono::steady_clock::time_point last_activity;
+    /** @brief Reason the connection was closed (for logging) */
+    std::string extra_msg;
+    bool closed;
+    /** @brief Number of operations queued for the sockets whose completion was not reaped yet */
+    unsigned inflight;
+  };
+
+  /** @brief Called once for each connection when it is closed
+   *
+   * The handler owns the sockets of the connection from then on; it is
+   * expected to shut them down and close them. It runs in the reactor
+   * thread and the sockets are non-blocking, so that whatever the handler
+   * writes to them can not stall the other connections of the thread.
+   * Data still pending for them was written as far as the sockets took it
+   * without blocking; the rest is dropped.
+   */
+  using CloseHandler = std::function<void(Connection &connection)>;
+
+  /** @brief Operations done by the reactor threads */
+  struct Stats {
+    /** @brief Number of operations submitted to the rings */
+    uint64_t submitted;
+    /** @brief Number of io_uring_enter() calls */
+    uint64_t enter_calls;
+  };
+
+  /** @brief Constructor
+   *
+   * @param thread_name name given to the reactor threads
+   * @param num_threads number of reactor threads
+   * @param protocol_type protocol of the route
+   * @param socket_operations object handling the operations on network sockets
+   * @param net_buffer_length size of the buffers data is received into
+   * @param client_connect_timeout timeout waiting for the handshake to finish
+   * @param close_handler called when a connection is closed
+   */
+  UringReactor(const std::string &thread_name, size_t num_threads,
+               BaseProtocol::Type protocol_type,
+               routing::SocketOperationsBase *socket_operations,
+               unsigned int net_buffer_length,
+               std::chrono::milliseconds client_connect_timeout,
+               CloseHandler close_handler);
+
+  ~UringReactor();
+
+  /** @brief Starts the reactor threads
+   *
+   * Throws std::runtime_error when io_uring could not be set up (kernel
+   * too old, disabled by the administrator or by a seccomp profile).
+   */
+  void start() override;
+
+  void stop() override;
+
+  bool add_connection(int client, int server, const sockaddr_storage &client_addr) override;
+
+  size_t size() const noexcept override {
+    return workers_.size();
+  }
+
+  /** @brief Returns the operations done by all reactor threads so far */
+  Stats get_stats() const noexcept;
+
+ private:
+  class Worker;
+
+  std::string thread_name_;
+  CloseHandler close_handler_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<size_t> next_worker_;
+  std::atomic<bool> running_;
+};
+
+#endif // HAVE_IO_URING
+
+#endif // ROUTING_URING_REACTOR_INCLUDED
@@ -19,7 +19,9 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <cmath>
 #include <cstring>
+#include <random>
 #include <stdexcept>
 #include <stdlib.h>
 
@@ -50,23 +52,28 @@ void *get_in_addr(struct sockaddr *addr) {
 std::pair<std::string, int > get_peer_name(int sock) {
   socklen_t sock_len;
   struct sockaddr_storage addr;
-  char result_addr[105];  // For IPv4, IPv6 and Unix socket
-  int port;
 
   sock_len = static_cast<socklen_t>(sizeof addr);
   getpeername(sock, (struct sockaddr*)&addr, &sock_len);
 
-  if (addr.ss_family == AF_INET6) {
+  return get_peer_name(&addr);
+}
+
+std::pair<std::string, int > get_peer_name(const sockaddr_storage *addr) {
+  char result_addr[105];  // For IPv4, IPv6 and Unix socket
+  int port;
+
+  if (addr->ss_family == AF_INET6) {
     // IPv6
-    auto *sin6 = (struct sockaddr_in6 *)&addr;
+    auto *sin6 = (const struct sockaddr_in6 *)addr;
     port = ntohs(sin6->sin6_port);
     inet_ntop(AF_INET6, &sin6->sin6_addr, result_addr, static_cast<socklen_t>(sizeof result_addr));
-  } else if (addr.ss_family == AF_INET) {
+  } else if (addr->ss_family == AF_INET) {
     // IPv4
-    auto *sin4 = (struct sockaddr_in *)&addr;
+    auto *sin4 = (const struct sockaddr_in *)addr;
     port = ntohs(sin4->sin_port);
     inet_ntop(AF_INET, &sin4->sin_addr, result_addr, static_cast<socklen_t>(sizeof result_addr));
-  } else if (addr.ss_family == AF_UNIX) {
+  } else if (addr->ss_family == AF_UNIX) {
     // Unix socket, no good way to find peer
     return std::make_pair(std::string("unix socket"), 0);
   }
@@ -149,3 +156,100 @@ std::string get_message_error(int errcode)
   return msgerr;
 #endif
 }
+
+uint64_t hash_bytes(const void *data, size_t size) {
+  // FNV-1a, with the finalizer of splitmix64 to spread close inputs
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+uint64_t client_key(const sockaddr_storage &addr) {
+  std::array<uint8_t, 16> ip = in_addr_to_array(addr);
+  return hash_bytes(ip.data(), ip.size());
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b != 0) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+std::vector<size_t> smooth_weighted_round_robin(const std::vector<float> &weights, size_t max_length,
+                                                double *max_error) {
+  std::vector<uint64_t> scaled;
+  uint64_t divisor = 0;
+  for (float weight : weights) {
+    uint64_t w = weight > 0 ? static_cast<uint64_t>(std::max(1.0, std::round(weight * 10.0))) : 10;
+    scaled.push_back(w);
+    divisor = gcd(divisor, w);
+  }
+  uint64_t total = 0;
+  for (auto &w : scaled) {
+    w /= divisor;
+    total += w;
+  }
+  max_length = std::max(max_length, weights.size());
+  if (total > max_length) {
+    uint64_t scaled_total = 0;
+    for (auto &w : scaled) {
+      w = std::max<uint64_t>(1, w * max_length / total);
+      scaled_total += w;
+    }
+    total = scaled_total;
+  }
+
+  if (max_error) {
+    double weight_total = 0;
+    for (float weight : weights) {
+      weight_total += weight > 0 ? weight : 1.0;
+    }
+    *max_error = 0;
+    for (size_t i = 0; i < weights.size(); ++i) {
+      double wanted = (weights[i] > 0 ? weights[i] : 1.0) / weight_total;
+      double got = static_cast<double>(scaled[i]) / static_cast<double>(total);
+      *max_error = std::max(*max_error, std::fabs(got - wanted) / wanted);
+    }
+  }
+
+  // each round, every index gains its weight; the one ahead is picked and
+  // falls behind by the sum of weights
+  std::vector<size_t> order;
+  order.reserve(static_cast<size_t>(total));
+  std::vector<int64_t> current(scaled.size(), 0);
+  for (uint64_t n = 0; n < total; ++n) {
+    size_t best = 0;
+    for (size_t i = 0; i < scaled.size(); ++i) {
+      current[i] += static_cast<int64_t>(scaled[i]);
+      if (current[i] > current[best]) {
+        best = i;
+      }
+    }
+    current[best] -= static_cast<int64_t>(total);
+    order.push_back(best);
+  }
+  return order;
+}
+
+std::chrono::milliseconds backoff_with_jitter(unsigned int failures, std::chrono::milliseconds initial,
+                                              std::chrono::milliseconds max) {
+  std::chrono::milliseconds wait = std::min(initial, max);
+  for (unsigned int i = 0; i < failures && wait < max; ++i) {
+    wait = std::min(wait * 2, max);
+  }
+  if (wait.count() < 2) {
+    return wait;
+  }
+  static thread_local std::minstd_rand random(std::random_device{}());
+  auto half = wait.count() / 2;
+  return std::chrono::milliseconds(half + static_cast<long long>(random() % static_cast<unsigned long long>(wait.count() - half + 1)));
+}
@@ -19,6 +19,7 @@
 #define UTILS_ROUTING_INCLUDED
 
 #include <array>
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -54,6 +55,17 @@ void * get_in_addr(struct sockaddr *addr);
  */
 std::pair<std::string, int > get_peer_name(int sock);
 
+/**
+ * Get address of peer from its socket address
+ *
+ * Same as get_peer_name(int) but using an address as returned by
+ * accept() or getpeername().
+ *
+ * @param addr socket address of the peer
+ * @return std::pair with std::string and uint16_t
+ */
+std::pair<std::string, int > get_peer_name(const sockaddr_storage *addr);
+
 /**
  * Splits a string using a delimiter
  *
@@ -77,6 +89,59 @@ std::vector<std::string> split_string(const std::string& data, const char delimi
  */
 std::array<uint8_t, 16> in_addr_to_array(const sockaddr_storage& addr);
 
+/** @brief Returns a 64-bit hash of the given bytes
+ *
+ * The hash is the same on every platform and run, so that it can be used
+ * to place things consistently.
+ *
+ * @param data bytes to hash
+ * @param size number of bytes
+ * @return hash value
+ */
+uint64_t hash_bytes(const void *data, size_t size);
+
+/** @brief Returns the key identifying a client for the consistent-hash strategy
+ *
+ * Hash of the client's IP address as returned by in_addr_to_array().
+ *
+ * @param addr address of the client
+ * @return hash value
+ */
+uint64_t client_key(const sockaddr_storage &addr);
+
 std::string get_message_error(int errcode);
 
+/** @brief Computes the order of smooth weighted round-robin
+ *
+ * Every index appears as often as its weight asks for, spread as evenly
+ * as possible over the order. Weights are used with a precision of 0.1
+ * (smaller ones count as 0.1) and scaled down so that the order has at
+ * most `max_length` entries (but every index at least once); weights not
+ * greater than 0 count as 1. Both change the ratios between the weights,
+ * by how much is reported through `max_error`.
+ *
+ * @param weights weight of each index
+ * @param max_length maximum length of the order
+ * @param max_error if not nullptr, set to the largest difference between
+ *        the share of the order an index got and the share its weight asks
+ *        for, relative to the latter (0.5 means off by 50%)
+ * @return indexes into weights, in the order they get connections
+ */
+std::vector<size_t> smooth_weighted_round_robin(const std::vector<float> &weights, size_t max_length,
+                                                double *max_error = nullptr);
+
+/** @brief Returns the time to wait before the next attempt, with exponential backoff
+ *
+ * The time doubles with every failed attempt, up to `max`. It is then
+ * picked at random from its upper half, so that attempts started at the
+ * same time spread out.
+ *
+ * @param failures number of attempts which failed so far
+ * @param initial time to wait before the first attempt
+ * @param max maximum time to wait
+ * @return time to wait, between half of the backed off time and all of it
+ */
+std::chrono::milliseconds backoff_with_jitter(unsigned int failures, std::chrono::milliseconds initial,
+                                              std::chrono::milliseconds max);
+
 #endif // UTILS_ROUTING_INCLUDED
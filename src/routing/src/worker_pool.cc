@@ -0,0 +1,246 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "worker_pool.h"
+
+#include "common.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+WorkerPool::WorkerPool(const std::string &thread_name, size_t min_size, size_t max_size,
+                       size_t max_queue_size, std::chrono::milliseconds idle_timeout,
+                       std::chrono::milliseconds queue_timeout)
+    : thread_name_(thread_name),
+      min_size_(min_size),
+      max_size_(max_size),
+      max_queue_size_(max_queue_size),
+      idle_timeout_(idle_timeout),
+      queue_timeout_(queue_timeout),
+      idle_(0),
+      busy_(0),
+      stopping_(false),
+      max_queue_depth_(0),
+      tasks_started_(0),
+      tasks_rejected_(0),
+      tasks_expired_(0),
+      total_wait_(0),
+      max_wait_(0) {
+  if (max_size_ == 0 || min_size_ > max_size_) {
+    throw std::invalid_argument("WorkerPool: min_size must not be greater than max_size, max_size must be > 0");
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  try {
+    for (size_t i = 0; i < min_size_; ++i) {
+      spawn_worker();
+    }
+    if (queue_timeout_.count() > 0) {
+      expiry_thread_ = std::thread(&WorkerPool::expire_tasks, this);
+    }
+  } catch (...) {
+    stopping_ = true;
+    lock.unlock();
+    stop();
+    throw;
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  stop();
+}
+
+void WorkerPool::spawn_worker() {
+  workers_.emplace_back();
+  auto self = std::prev(workers_.end());
+  try {
+    // run() waits for mutex_ held by the caller, so 'self' is set
+    // before it is used
+    *self = std::thread(&WorkerPool::run, this, self);
+  } catch (...) {
+    workers_.erase(self);
+    throw;
+  }
+}
+
+bool WorkerPool::submit(Task task, Task on_expired) {
+  Workers exited;
+  bool accepted = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto &it : exited_) {
+      exited.splice(exited.end(), workers_, it);
+    }
+    exited_.clear();
+
+    // every thread not running a task yet takes one task, the others wait
+    // in the queue
+    if (stopping_ || queue_.size() >= max_size_ - busy_ + max_queue_size_) {
+      ++tasks_rejected_;
+      accepted = false;
+    } else {
+      queue_.push_back({std::move(task), std::move(on_expired), std::chrono::steady_clock::now()});
+
+      if (queue_.size() > workers_.size() - busy_ && workers_.size() < max_size_) {
+        try {
+          spawn_worker();
+        } catch (const std::system_error &) {
+          // the task waits for one of the running threads, if there is any
+          if (workers_.empty()) {
+            queue_.pop_back();
+            ++tasks_rejected_;
+            accepted = false;
+          }
+        }
+      }
+
+      if (accepted) {
+        max_queue_depth_ = std::max(max_queue_depth_, waiting_tasks());
+        task_cond_.notify_one();
+        expiry_cond_.notify_one();
+      }
+    }
+  }
+
+  for (auto &thr : exited) {
+    thr.join();
+  }
+
+  return accepted;
+}
+
+void WorkerPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    task_cond_.notify_all();
+    expiry_cond_.notify_all();
+  }
+
+  if (expiry_thread_.joinable()) {
+    expiry_thread_.join();
+  }
+
+  // submit() is not called anymore, so workers_ does not change
+  for (auto &thr : workers_) {
+    if (thr.joinable()) thr.join();
+  }
+  workers_.clear();
+  exited_.clear();
+}
+
+size_t WorkerPool::waiting_tasks() const noexcept {
+  // threads which are not busy take a task each
+  const size_t free_threads = workers_.size() - exited_.size() - busy_;
+  return queue_.size() > free_threads ? queue_.size() - free_threads : 0;
+}
+
+WorkerPool::Stats WorkerPool::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Stats stats;
+  stats.threads = workers_.size() - exited_.size();
+  stats.idle_threads = idle_;
+  stats.queue_depth = waiting_tasks();
+  stats.max_queue_depth = max_queue_depth_;
+  stats.tasks_started = tasks_started_;
+  stats.tasks_rejected = tasks_rejected_;
+  stats.tasks_expired = tasks_expired_;
+  stats.total_wait = total_wait_;
+  stats.max_wait = max_wait_;
+
+  return stats;
+}
+
+void WorkerPool::run(Workers::iterator self) {
+  mysql_harness::rename_thread(thread_name_.c_str());
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (!queue_.empty()) {
+      QueuedTask queued = std::move(queue_.front());
+      queue_.pop_front();
+
+      auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - queued.queued_at);
+      total_wait_ += wait;
+      max_wait_ = std::max(max_wait_, wait);
+      ++tasks_started_;
+      ++busy_;
+
+      lock.unlock();
+      queued.task();
+      // release what the task captured before taking the lock again
+      queued.task = nullptr;
+      lock.lock();
+
+      --busy_;
+      continue;
+    }
+
+    if (stopping_) break;
+
+    ++idle_;
+    bool has_work = task_cond_.wait_for(lock, idle_timeout_, [this] {
+      return !queue_.empty() || stopping_;
+    });
+    --idle_;
+
+    if (!has_work && workers_.size() - exited_.size() > min_size_) {
+      // joined by the next submit() or by stop()
+      exited_.push_back(self);
+      break;
+    }
+  }
+}
+
+void WorkerPool::expire_tasks() {
+  mysql_harness::rename_thread(thread_name_.c_str());
+
+  std::vector<QueuedTask> expired;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (queue_.empty()) {
+      expiry_cond_.wait(lock);
+      continue;
+    }
+
+    // the queue is in the order tasks were submitted
+    const auto now = std::chrono::steady_clock::now();
+    while (!queue_.empty() && now - queue_.front().queued_at >= queue_timeout_) {
+      expired.push_back(std::move(queue_.front()));
+      queue_.pop_front();
+      ++tasks_expired_;
+    }
+
+    if (expired.empty()) {
+      expiry_cond_.wait_until(lock, queue_.front().queued_at + queue_timeout_);
+      continue;
+    }
+
+    lock.unlock();
+    for (auto &queued : expired) {
+      if (queued.on_expired) {
+        queued.on_expired();
+      }
+    }
+    expired.clear();
+    lock.lock();
+  }
+}
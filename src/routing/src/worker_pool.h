@@ -0,0 +1,183 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef ROUTING_WORKER_POOL_INCLUDED
+#define ROUTING_WORKER_POOL_INCLUDED
+
+/** @file
+ * @brief Defining the class WorkerPool
+ *
+ * Used by MySQLRouting when a route is configured with `max_worker_threads`
+ * to service client connections with a bounded set of reused threads
+ * instead of a new thread per connection.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** @class WorkerPool
+ *  @brief Bounded pool of threads running tasks handed over through a queue
+ *
+ *  The pool starts with `min_size` threads. When a task is submitted and no
+ *  thread is idle, a new thread is started until `max_size` threads are
+ *  running; beyond that tasks wait in a queue of at most `max_queue_size`
+ *  entries. Threads above `min_size` exit after being idle for
+ *  `idle_timeout`.
+ *
+ *  With a `queue_timeout`, tasks which waited that long without a thread
+ *  becoming free are taken out of the queue and their `on_expired`
+ *  handler is run instead, by a thread of its own.
+ */
+class WorkerPool {
+ public:
+  using Task = std::function<void()>;
+
+  /** @brief Snapshot of the metrics of the pool */
+  struct Stats {
+    /** @brief Number of running threads */
+    size_t threads;
+    /** @brief Number of threads waiting for a task */
+    size_t idle_threads;
+    /** @brief Number of tasks waiting for a thread */
+    size_t queue_depth;
+    /** @brief Highest number of tasks waiting for a thread so far */
+    size_t max_queue_depth;
+    /** @brief Number of tasks taken by a thread so far */
+    uint64_t tasks_started;
+    /** @brief Number of tasks rejected as the queue was full */
+    uint64_t tasks_rejected;
+    /** @brief Number of tasks which waited longer than the queue timeout */
+    uint64_t tasks_expired;
+    /** @brief Sum of the time tasks waited in the queue */
+    std::chrono::microseconds total_wait;
+    /** @brief Longest time a task waited in the queue */
+    std::chrono::microseconds max_wait;
+  };
+
+  /** @brief Constructor
+   *
+   * Starts `min_size` threads. Throws std::invalid_argument when the sizes
+   * are inconsistent and std::system_error when threads can not be started.
+   *
+   * @param thread_name name given to the threads of the pool
+   * @param min_size number of threads kept running when idle
+   * @param max_size maximum number of threads
+   * @param max_queue_size maximum number of tasks waiting for a thread
+   * @param idle_timeout time after which idle threads above min_size exit
+   * @param queue_timeout maximum time a task waits for a thread; 0 for no limit
+   */
+  WorkerPool(const std::string &thread_name, size_t min_size, size_t max_size, size_t max_queue_size,
+             std::chrono::milliseconds idle_timeout = std::chrono::seconds(60),
+             std::chrono::milliseconds queue_timeout = std::chrono::milliseconds(0));
+
+  /** @brief Destructor; stops the pool */
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  /** @brief Hands over a task to the pool
+   *
+   * @param task task to run
+   * @param on_expired run instead of the task when it waited longer than
+   *        the queue timeout
+   * @return false when the pool is stopped or the queue is full; the task
+   *         is not run then
+   */
+  bool submit(Task task, Task on_expired = nullptr);
+
+  /** @brief Stops the pool
+   *
+   * Tasks which are queued already are still run. Waits until all threads
+   * have finished; must not be called concurrently with submit().
+   */
+  void stop();
+
+  /** @brief Returns the metrics of the pool */
+  Stats get_stats() const;
+
+  size_t get_min_size() const noexcept {
+    return min_size_;
+  }
+
+  size_t get_max_size() const noexcept {
+    return max_size_;
+  }
+
+ private:
+  struct QueuedTask {
+    Task task;
+    Task on_expired;
+    std::chrono::steady_clock::time_point queued_at;
+  };
+
+  using Workers = std::list<std::thread>;
+
+  /** @brief Starts a thread; must be called with mutex_ held */
+  void spawn_worker();
+
+  /** @brief Returns number of queued tasks no thread is free for
+   *
+   * Must be called with mutex_ held.
+   */
+  size_t waiting_tasks() const noexcept;
+
+  /** @brief Main loop of a thread of the pool */
+  void run(Workers::iterator self);
+
+  /** @brief Main loop of the thread taking expired tasks out of the queue */
+  void expire_tasks();
+
+  const std::string thread_name_;
+  const size_t min_size_;
+  const size_t max_size_;
+  const size_t max_queue_size_;
+  const std::chrono::milliseconds idle_timeout_;
+  const std::chrono::milliseconds queue_timeout_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable task_cond_;
+  /** @brief Wakes up expiry_thread_ when tasks are queued or the pool stops */
+  std::condition_variable expiry_cond_;
+  std::thread expiry_thread_;
+  std::deque<QueuedTask> queue_;
+  Workers workers_;
+  /** @brief Threads which have exited and still need to be joined */
+  std::vector<Workers::iterator> exited_;
+  /** @brief Number of threads waiting for a task */
+  size_t idle_;
+  /** @brief Number of threads running a task */
+  size_t busy_;
+  bool stopping_;
+
+  size_t max_queue_depth_;
+  uint64_t tasks_started_;
+  uint64_t tasks_rejected_;
+  uint64_t tasks_expired_;
+  std::chrono::microseconds total_wait_;
+  std::chrono::microseconds max_wait_;
+};
+
+#endif // ROUTING_WORKER_POOL_INCLUDED
@@ -104,7 +104,7 @@ TEST_F(Bug21771595, InvalidSetterDestinationConnectTimeout) {
 TEST_F(Bug21771595, InvalidMaxConnections) {
   MySQLRouting r(routing::AccessMode::kReadOnly, 7001, Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(), "test");
   ASSERT_THROW(r.set_max_connections(-1), std::invalid_argument);
-  ASSERT_THROW(r.set_max_connections(UINT16_MAX+1), std::invalid_argument);
+  ASSERT_THROW(r.set_max_connections(routing::kMaxConnectionsLimit + 1), std::invalid_argument);
   try {
     r.set_max_connections(0);
   } catch (const std::invalid_argument &exc) {
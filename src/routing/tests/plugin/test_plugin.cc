@@ -79,9 +79,23 @@ protected:
     socket = rundir + "/unix_socket";
     mode = "read-only";
     connect_timeout = "1";
+    max_connections = "512";
     client_connect_timeout = "9";
     max_connect_errors = "100";
     protocol = "classic";
+    io_model = "thread";
+    acceptor_threads = "1";
+    listen_backlog = "1024";
+    min_worker_threads = "0";
+    max_worker_threads = "0";
+    preconnect_pool_size = "0";
+    preconnect_max_age = "5";
+    connect_race_size = "2";
+    routing_strategy = "";
+    quarantine_probe = "connect";
+    max_connections_per_destination = "0";
+    admission_queue_size = "0";
+    admission_queue_timeout = "5";
   }
 
   bool in_missing(std::vector<std::string> missing, std::string needle) {
@@ -106,9 +120,23 @@ protected:
         {"destinations",            std::ref(destinations)},
         {"mode",                    std::ref(mode)},
         {"connect_timeout",         std::ref(connect_timeout)},
+        {"max_connections",         std::ref(max_connections)},
         {"client_connect_timeout",  std::ref(client_connect_timeout)},
         {"max_connect_errors",      std::ref(max_connect_errors)},
-        {"protocol",                std::ref(protocol)}
+        {"protocol",                std::ref(protocol)},
+        {"io_model",                std::ref(io_model)},
+        {"acceptor_threads",        std::ref(acceptor_threads)},
+        {"listen_backlog",          std::ref(listen_backlog)},
+        {"min_worker_threads",      std::ref(min_worker_threads)},
+        {"max_worker_threads",      std::ref(max_worker_threads)},
+        {"preconnect_pool_size",    std::ref(preconnect_pool_size)},
+        {"preconnect_max_age",      std::ref(preconnect_max_age)},
+        {"connect_race_size",       std::ref(connect_race_size)},
+        {"routing_strategy",        std::ref(routing_strategy)},
+        {"quarantine_probe",        std::ref(quarantine_probe)},
+        {"max_connections_per_destination", std::ref(max_connections_per_destination)},
+        {"admission_queue_size", std::ref(admission_queue_size)},
+        {"admission_queue_timeout", std::ref(admission_queue_timeout)}
       };
       for (auto& option: routing_config_options) {
         if (!in_missing(missing, option.first)) {
@@ -152,6 +180,20 @@ protected:
   string client_connect_timeout;
   string max_connect_errors;
   string protocol;
+  string io_model;
+  string acceptor_threads;
+  string listen_backlog;
+  string min_worker_threads;
+  string max_worker_threads;
+  string preconnect_pool_size;
+  string preconnect_max_age;
+  string connect_race_size;
+  string routing_strategy;
+  string quarantine_probe;
+  string max_connections;
+  string max_connections_per_destination;
+  string admission_queue_size;
+  string admission_queue_timeout;
 
   std::unique_ptr<Path> config_path;
   std::string cmd;
@@ -553,6 +595,105 @@ TEST_F(RoutingPluginTests, InvalidProtocolName) {
               HasSubstr("Configuration error: Invalid protocol name: 'invalid'"));
 }
 
+TEST_F(RoutingPluginTests, InvalidIoModel) {
+  io_model = "select";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output,
+              HasSubstr("option io_model in [routing:tests] is invalid; valid are thread, epoll, io_uring (was 'select')"));
+}
+
+TEST_F(RoutingPluginTests, AcceptorThreadsSetIncorrectly) {
+  acceptor_threads = "0";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option acceptor_threads in [routing:tests] needs value between 1 and 256 inclusive, was '0'"));
+}
+
+TEST_F(RoutingPluginTests, ListenBacklogSetIncorrectly) {
+  listen_backlog = "0";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option listen_backlog in [routing:tests] needs value between 1 and 65535 inclusive, was '0'"));
+}
+
+TEST_F(RoutingPluginTests, MinWorkerThreadsGreaterThanMax) {
+  min_worker_threads = "8";
+  max_worker_threads = "4";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option min_worker_threads in [routing:tests] must not be greater than max_worker_threads"));
+}
+
+TEST_F(RoutingPluginTests, PreconnectPoolSizeSetIncorrectly) {
+  preconnect_pool_size = "1025";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option preconnect_pool_size in [routing:tests] needs value between 0 and 1024 inclusive, was '1025'"));
+}
+
+TEST_F(RoutingPluginTests, PreconnectMaxAgeSetIncorrectly) {
+  preconnect_max_age = "0";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option preconnect_max_age in [routing:tests] needs value between 1 and 31536000 inclusive, was '0'"));
+}
+
+TEST_F(RoutingPluginTests, ConnectRaceSizeSetIncorrectly) {
+  connect_race_size = "0";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option connect_race_size in [routing:tests] needs value between 1 and 16 inclusive, was '0'"));
+}
+
+TEST_F(RoutingPluginTests, InvalidRoutingStrategy) {
+  routing_strategy = "random";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option routing_strategy in [routing:tests] is invalid; valid are round-robin, first-available, "
+      "least-connections, lowest-latency, consistent-hash (was 'random')"));
+}
+
+TEST_F(RoutingPluginTests, InvalidQuarantineProbe) {
+  quarantine_probe = "ping";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option quarantine_probe in [routing:tests] is invalid; valid are connect, greeting (was 'ping')"));
+}
+
+TEST_F(RoutingPluginTests, MaxConnectionsPerDestinationSetIncorrectly) {
+  max_connections_per_destination = "-1";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option max_connections_per_destination in [routing:tests] needs value between 0 and 65535 inclusive, was '-1'"));
+}
+
+TEST_F(RoutingPluginTests, MaxConnectionsSetIncorrectly) {
+  max_connections = "1048577";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option max_connections in [routing:tests] needs value between 1 and 1048576 inclusive, was '1048577'"));
+}
+
+TEST_F(RoutingPluginTests, AdmissionQueueTimeoutSetIncorrectly) {
+  admission_queue_size = "10";
+  admission_queue_timeout = "0";
+  reset_config();
+  auto cmd_result = cmd_exec(cmd, true);
+  ASSERT_THAT(cmd_result.output, HasSubstr(
+      "option admission_queue_timeout in [routing:tests] needs value between 1 and 3600 inclusive, was '0'"));
+}
+
 int main(int argc, char *argv[]) {
   init_windows_sockets();
   g_origin = Path(argv[0]).dirname();
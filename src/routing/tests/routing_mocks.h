@@ -17,8 +17,16 @@
 
 #ifdef _WIN32
 #  include "Winsock2.h"
+#else
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
 #endif
 
+#include <cstdint>
+#include <cstring>
+
 //ignore GMock warnings
 #ifdef __clang__
 #  ifndef __has_warning
@@ -104,3 +112,31 @@ class MockSocketOperations : public routing::SocketOperationsBase {
 #ifdef __clang__
 #  pragma clang diagnostic pop
 #endif
+
+#ifndef _WIN32
+/** @brief Opens a listening socket on an ephemeral port of the loopback interface
+ *
+ * @param port set to the port the socket listens on
+ * @param backlog backlog of the listening socket
+ * @return socket descriptor, or -1 on errors
+ */
+inline int listen_on_loopback(uint16_t *port, int backlog = 128) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, backlog) != 0 ||
+      getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+#endif
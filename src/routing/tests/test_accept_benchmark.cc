@@ -0,0 +1,132 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Measures how many client connections a route accepts per second.
+ *
+ * The benchmark is disabled by default; run it with
+ *
+ *   test_routing_accept_benchmark --gtest_also_run_disabled_tests
+ *
+ * The destination of the route refuses connections, so every client is
+ * accepted, answered with an error packet and disconnected by the router.
+ * That keeps the destination out of the measurement.
+ */
+
+#include "mysql_routing.h"
+#include "mysqlrouter/routing.h"
+
+#include "gmock/gmock.h"
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const uint16_t kRouterPort = 4449;
+// nothing listens here
+static const uint16_t kDestinationPort = 4425;
+
+static const size_t kClientThreads = 8;
+static const std::chrono::seconds kDuration{5};
+
+// connects to the router and waits until it closes the connection
+static bool connect_and_wait_for_close(uint16_t port) {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) return false;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  bool result = false;
+  if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0) {
+    char buf[256];
+    ssize_t res;
+    while ((res = read(sock, buf, sizeof(buf))) > 0) {}
+    result = (res == 0);
+  }
+  close(sock);
+  return result;
+}
+
+TEST(AcceptBenchmark, DISABLED_ConnectionsPerSecond) {
+  MySQLRouting routing(routing::AccessMode::kReadWrite, kRouterPort,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       "routing:benchmark", routing::kDefaultMaxConnections,
+                       routing::kDefaultDestinationConnectionTimeout, UINT32_MAX);
+  routing.set_destinations_from_csv("127.0.0.1:" + std::to_string(kDestinationPort));
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  // wait for the route to listen
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!connect_and_wait_for_close(kRouterPort)) {
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline) << "route did not start";
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  std::atomic<uint64_t> connections{0};
+  std::atomic<uint64_t> failures{0};
+  std::vector<std::thread> clients;
+
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + kDuration;
+  for (size_t i = 0; i < kClientThreads; ++i) {
+    clients.emplace_back([&] {
+      while (std::chrono::steady_clock::now() < end) {
+        if (connect_and_wait_for_close(kRouterPort)) {
+          ++connections;
+        } else {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto &thr : clients) {
+    thr.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(
+      std::chrono::steady_clock::now() - start);
+
+  routing.stop();
+  router_thread.join();
+
+  std::cout << "[ RESULT   ] " << connections.load() << " connections in " << elapsed.count()
+            << "s with " << kClientThreads << " clients: "
+            << static_cast<uint64_t>(static_cast<double>(connections.load()) / elapsed.count())
+            << " connections/s (" << failures.load() << " failed)" << std::endl;
+
+  EXPECT_GT(connections.load(), 0u);
+}
+
+#endif // _WIN32
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "admission_queue.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+
+// records what the queue did with the clients
+class AdmissionQueueTest : public ::testing::Test {
+ protected:
+  AdmissionQueue::Handler recorder(std::vector<int> *socks) {
+    return [this, socks](const AdmissionQueue::Client &client) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      socks->push_back(client.sock);
+      cond_.notify_all();
+    };
+  }
+
+  bool push(AdmissionQueue &queue, int sock) {
+    sockaddr_storage addr;
+    std::memset(&addr, 0, sizeof(addr));
+    return queue.push(sock, addr, true);
+  }
+
+  // waits until `socks` has `count` entries and returns a copy
+  std::vector<int> wait_for(const std::vector<int> &socks, size_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait_for(lock, std::chrono::seconds(5), [&socks, count] { return socks.size() >= count; });
+    return socks;
+  }
+
+  std::vector<int> admitted_;
+  std::vector<int> rejected_;
+  std::atomic<bool> has_room_{false};
+  std::mutex mutex_;
+  std::condition_variable cond_;
+};
+
+TEST_F(AdmissionQueueTest, AdmitsInOrderOfArrival) {
+  AdmissionQueue queue("test", 10, milliseconds(10000), recorder(&admitted_), recorder(&rejected_),
+                       [this] { return has_room_.load(); });
+  queue.start();
+
+  ASSERT_TRUE(push(queue, 1));
+  ASSERT_TRUE(push(queue, 2));
+  ASSERT_TRUE(push(queue, 3));
+  EXPECT_FALSE(queue.empty());
+
+  queue.slot_freed();
+  EXPECT_THAT(wait_for(admitted_, 1), ::testing::ElementsAre(1));
+  queue.slot_freed();
+  queue.slot_freed();
+  EXPECT_THAT(wait_for(admitted_, 3), ::testing::ElementsAre(1, 2, 3));
+  EXPECT_TRUE(queue.empty());
+
+  queue.stop();
+  AdmissionQueue::Stats stats = queue.get_stats();
+  EXPECT_EQ(3u, stats.queued);
+  EXPECT_EQ(3u, stats.admitted);
+  EXPECT_EQ(3u, stats.max_length);
+  EXPECT_EQ(0u, stats.length);
+  EXPECT_TRUE(rejected_.empty());
+}
+
+TEST_F(AdmissionQueueTest, SlotsAreNotSavedUpWithoutWaitingClients) {
+  AdmissionQueue queue("test", 10, milliseconds(200), recorder(&admitted_), recorder(&rejected_),
+                       [this] { return has_room_.load(); });
+  queue.start();
+
+  queue.slot_freed();
+  ASSERT_TRUE(push(queue, 1));
+
+  // nobody freed a slot after the client arrived: it times out
+  EXPECT_THAT(wait_for(rejected_, 1), ::testing::ElementsAre(1));
+  EXPECT_TRUE(admitted_.empty());
+  EXPECT_EQ(1u, queue.get_stats().timed_out);
+}
+
+TEST_F(AdmissionQueueTest, RejectsWhenFull) {
+  AdmissionQueue queue("test", 2, milliseconds(10000), recorder(&admitted_), recorder(&rejected_),
+                       [this] { return has_room_.load(); });
+  queue.start();
+
+  EXPECT_TRUE(push(queue, 1));
+  EXPECT_TRUE(push(queue, 2));
+  EXPECT_FALSE(push(queue, 3));
+  EXPECT_EQ(1u, queue.get_stats().rejected);
+
+  // clients still waiting are rejected on stop
+  queue.stop();
+  EXPECT_THAT(rejected_, ::testing::ElementsAre(1, 2));
+  EXPECT_TRUE(admitted_.empty());
+  EXPECT_FALSE(push(queue, 4));
+}
+
+TEST_F(AdmissionQueueTest, AdmitsWhenRoomWithoutSlotFreed) {
+  AdmissionQueue queue("test", 10, milliseconds(10000), recorder(&admitted_), recorder(&rejected_),
+                       [this] { return has_room_.load(); });
+  queue.start();
+
+  ASSERT_TRUE(push(queue, 1));
+  ASSERT_TRUE(push(queue, 2));
+  has_room_ = true;
+  EXPECT_THAT(wait_for(admitted_, 2), ::testing::ElementsAre(1, 2));
+
+  AdmissionQueue::Stats stats = queue.get_stats();
+  EXPECT_EQ(2u, stats.admitted);
+  EXPECT_GT(stats.max_wait.count(), 0);
+  EXPECT_GE(stats.total_wait, stats.max_wait);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
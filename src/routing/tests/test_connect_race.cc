@@ -0,0 +1,220 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "destination.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using mysqlrouter::TCPAddress;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+TEST(ConnectRaceTest, DefaultTriesServersInOrder) {
+  MockSocketOperations so;
+  so.get_mysql_socket_fail(2);
+
+  size_t winner = 0;
+  std::vector<size_t> failed;
+  int fd = so.routing::SocketOperationsBase::connect_race(
+      {TCPAddress("41", 3306), TCPAddress("42", 3306), TCPAddress("43", 3306)},
+      std::chrono::seconds(1), std::chrono::milliseconds(10), &winner, &failed);
+  EXPECT_EQ(43, fd);
+  EXPECT_EQ(2u, winner);
+  EXPECT_THAT(failed, ElementsAre(0u, 1u));
+  EXPECT_EQ(3, so.get_mysql_socket_call_cnt());
+}
+
+TEST(ConnectRaceTest, FailedServersAreQuarantined) {
+  MockSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.add("43", 3306);
+  dest.set_connect_race_size(2);
+
+  // 41 fails, 42 wins, 43 is not tried
+  so.get_mysql_socket_fail(1);
+  int error = 0;
+  TCPAddress address;
+  EXPECT_EQ(42, dest.get_server_socket(std::chrono::seconds(1), &error, &address));
+  EXPECT_EQ(TCPAddress("42", 3306), address);
+  EXPECT_EQ(2, so.get_mysql_socket_call_cnt());
+  EXPECT_EQ(1u, dest.size_quarantine());
+
+  // round-robin continues after the winner
+  EXPECT_EQ(43, dest.get_server_socket(std::chrono::seconds(1), &error));
+
+  // all fail
+  so.get_mysql_socket_fail(3);
+  EXPECT_EQ(-1, dest.get_server_socket(std::chrono::seconds(1), &error));
+  EXPECT_EQ(ECONNREFUSED, error);
+  EXPECT_EQ(3u, dest.size_quarantine());
+}
+
+#ifndef _WIN32
+class ConnectRaceSocketTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    uint16_t port = 0;
+    listener_ = listen_on_loopback(&port, 128);
+    ASSERT_GE(listener_, 0);
+    good_ = TCPAddress("127.0.0.1", port);
+
+    // a port nobody listens on refuses connections
+    int closed = listen_on_loopback(&port, 1);
+    ASSERT_GE(closed, 0);
+    close(closed);
+    refused_ = TCPAddress("127.0.0.1", port);
+
+    // once its backlog is full, a listener drops further SYNs and connects
+    // to it hang like to an unreachable host
+    blackhole_ = listen_on_loopback(&port, 0);
+    ASSERT_GE(blackhole_, 0);
+    for (int i = 0; i < 2; ++i) {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      routing::set_socket_blocking(fd, false);
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons(port);
+      connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+      fillers_.push_back(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    blackholed_ = TCPAddress("127.0.0.1", port);
+  }
+
+  virtual void TearDown() {
+    for (int fd : fillers_) {
+      close(fd);
+    }
+    close(blackhole_);
+    close(listener_);
+  }
+
+  routing::SocketOperations *so_ = routing::SocketOperations::instance();
+  int listener_;
+  int blackhole_;
+  std::vector<int> fillers_;
+  TCPAddress good_;
+  TCPAddress refused_;
+  TCPAddress blackholed_;
+};
+
+TEST_F(ConnectRaceSocketTest, RefusedServerFails) {
+  size_t winner = 0;
+  std::vector<size_t> failed;
+  int fd = so_->connect_race({refused_, good_}, std::chrono::seconds(5), routing::kConnectRaceDelay,
+                             &winner, &failed);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  EXPECT_EQ(1u, winner);
+  EXPECT_THAT(failed, ElementsAre(0u));
+}
+
+TEST_F(ConnectRaceSocketTest, UnresponsiveServerIsOvertaken) {
+  auto start = std::chrono::steady_clock::now();
+  size_t winner = 0;
+  std::vector<size_t> failed;
+  int fd = so_->connect_race({blackholed_, good_}, std::chrono::seconds(5), std::chrono::milliseconds(50),
+                             &winner, &failed);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  EXPECT_EQ(1u, winner);
+  // the unresponsive server lost the race, it did not fail
+  EXPECT_THAT(failed, IsEmpty());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST_F(ConnectRaceSocketTest, UnresponsiveServersTimeOut) {
+  size_t winner = 0;
+  std::vector<size_t> failed;
+  int fd = so_->connect_race({blackholed_, refused_}, std::chrono::milliseconds(200),
+                             std::chrono::milliseconds(50), &winner, &failed);
+  EXPECT_EQ(-2, fd);
+  EXPECT_EQ(ETIMEDOUT, errno);
+  EXPECT_THAT(failed, ElementsAre(1u, 0u));
+}
+
+TEST_F(ConnectRaceSocketTest, RaceTimesOutAsAWhole) {
+  auto start = std::chrono::steady_clock::now();
+  size_t winner = 0;
+  std::vector<size_t> failed;
+  // the third server is not tried before the race timed out
+  int fd = so_->connect_race({blackholed_, blackholed_, blackholed_}, std::chrono::milliseconds(300),
+                             std::chrono::milliseconds(200), &winner, &failed);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(-2, fd);
+  EXPECT_EQ(ETIMEDOUT, errno);
+  EXPECT_THAT(failed, UnorderedElementsAre(0u, 1u, 2u));
+  EXPECT_LT(elapsed, std::chrono::milliseconds(450));
+}
+
+TEST_F(ConnectRaceSocketTest, DestinationRacesServers) {
+  RouteDestination dest(Protocol::Type::kClassicProtocol, so_);
+  dest.add(blackholed_);
+  dest.add(good_);
+
+  auto start = std::chrono::steady_clock::now();
+  int error = 0;
+  TCPAddress address;
+  int fd = dest.get_server_socket(std::chrono::seconds(5), &error, &address);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  EXPECT_EQ(good_, address);
+  EXPECT_EQ(0u, dest.size_quarantine());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST_F(ConnectRaceSocketTest, ConnectAllWaitsInParallel) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int> fds = so_->connect_all({blackholed_, good_, refused_, blackholed_, good_},
+                                          std::chrono::milliseconds(300));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(5u, fds.size());
+  EXPECT_LT(fds[0], 0);
+  EXPECT_GE(fds[1], 0);
+  EXPECT_LT(fds[2], 0);
+  EXPECT_LT(fds[3], 0);
+  EXPECT_GE(fds[4], 0);
+  for (int fd : fds) {
+    if (fd >= 0) close(fd);
+  }
+  // both unresponsive servers timed out at the same time
+  EXPECT_LT(elapsed, std::chrono::milliseconds(550));
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
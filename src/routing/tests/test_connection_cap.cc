@@ -0,0 +1,194 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_first_available.h"
+#include "destination.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+using mysqlrouter::TCPAddress;
+using std::chrono::milliseconds;
+
+// every connection gets its own socket: server * 100 + number of the connection
+class CountingSocketOperations : public MockSocketOperations {
+ public:
+  int get_mysql_socket(TCPAddress addr, milliseconds connect_timeout, bool log = true) noexcept override {
+    int sock = MockSocketOperations::get_mysql_socket(addr, connect_timeout, log);
+    return sock < 0 ? sock : sock * 100 + next_++;
+  }
+
+ private:
+  int next_ = 0;
+};
+
+// runs out of file descriptors while `out_of_fds` is set
+class FdExhaustedSocketOperations : public CountingSocketOperations {
+ public:
+  int get_mysql_socket(TCPAddress addr, milliseconds connect_timeout, bool log = true) noexcept override {
+    if (out_of_fds) {
+      set_errno(EMFILE);
+      return -1;
+    }
+    return CountingSocketOperations::get_mysql_socket(addr, connect_timeout, log);
+  }
+
+  bool out_of_fds = false;
+};
+
+static int server_of(int sock) {
+  return sock < 0 ? sock : sock / 100;
+}
+
+TEST(ConnectionCapTest, SpillsOverToDestinationsBelowTheCap) {
+  CountingSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.set_max_connections_per_destination(2);
+
+  int error = 0;
+  std::vector<int> socks;
+  for (int i = 0; i < 4; ++i) {
+    socks.push_back(dest.get_server_socket(milliseconds(100), &error));
+    ASSERT_GE(socks.back(), 0);
+  }
+  EXPECT_EQ(2u, dest.get_open_connections(TCPAddress("41", 3306)));
+  EXPECT_EQ(2u, dest.get_open_connections(TCPAddress("42", 3306)));
+  EXPECT_FALSE(dest.below_connection_cap(TCPAddress("41", 3306)));
+
+  // all full: waits for the connect timeout
+  auto started = std::chrono::steady_clock::now();
+  EXPECT_EQ(-1, dest.get_server_socket(milliseconds(100), &error));
+  EXPECT_GE(std::chrono::steady_clock::now() - started, milliseconds(100));
+
+  // a closed connection makes room on its server only
+  dest.connection_closed(socks[0]);
+  EXPECT_EQ(server_of(socks[0]), server_of(dest.get_server_socket(milliseconds(100), &error)));
+  EXPECT_EQ(-1, dest.get_server_socket(milliseconds(0), &error));
+}
+
+TEST(ConnectionCapTest, WaitsForAConnectionToClose) {
+  CountingSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.set_max_connections_per_destination(1);
+
+  int error = 0;
+  int first = dest.get_server_socket(milliseconds(100), &error);
+  ASSERT_EQ(41, server_of(first));
+
+  std::thread closer([&dest, first] {
+    std::this_thread::sleep_for(milliseconds(50));
+    dest.connection_closed(first);
+  });
+  EXPECT_EQ(41, server_of(dest.get_server_socket(milliseconds(5000), &error)));
+  closer.join();
+}
+
+TEST(ConnectionCapTest, FailedConnectsGiveTheirSlotBack) {
+  CountingSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.set_connect_race_size(1);
+  dest.set_max_connections_per_destination(1);
+
+  int error = 0;
+  so.get_mysql_socket_fail(1);
+  int sock = dest.get_server_socket(milliseconds(100), &error);
+  ASSERT_GE(sock, 0);
+  EXPECT_EQ(1u, dest.size_quarantine());
+  EXPECT_EQ(0u, dest.get_open_connections(TCPAddress("41", 3306)));
+  EXPECT_EQ(1u, dest.get_open_connections(TCPAddress("42", 3306)));
+}
+
+TEST(ConnectionCapTest, OutOfFileDescriptorsGivesTheSlotBack) {
+  FdExhaustedSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.set_max_connections_per_destination(1);
+
+  int error = 0;
+  so.out_of_fds = true;
+  EXPECT_EQ(-1, dest.get_server_socket(milliseconds(100), &error));
+  EXPECT_EQ(EMFILE, error);
+  EXPECT_EQ(0u, dest.get_open_connections(TCPAddress("41", 3306)));
+  EXPECT_EQ(0u, dest.size_quarantine());
+
+  so.out_of_fds = false;
+  EXPECT_EQ(41, server_of(dest.get_server_socket(milliseconds(100), &error)));
+}
+
+TEST(ConnectionCapTest, PooledSessionsAreCountedOnce) {
+  CountingSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.set_max_connections_per_destination(2);
+
+  int error = 0;
+  int sock = dest.get_server_socket(milliseconds(100), &error);
+  dest.connection_opened(sock, TCPAddress("41", 3306));
+  EXPECT_EQ(1u, dest.get_open_connections(TCPAddress("41", 3306)));
+
+  // handed to the pool and taken again
+  dest.connection_closed(sock);
+  EXPECT_EQ(0u, dest.get_open_connections(TCPAddress("41", 3306)));
+  dest.connection_opened(sock, TCPAddress("41", 3306));
+  EXPECT_EQ(1u, dest.get_open_connections(TCPAddress("41", 3306)));
+}
+
+TEST(ConnectionCapTest, NotCountedWithoutCap) {
+  CountingSocketOperations so;
+  RouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+
+  int error = 0;
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(41, server_of(dest.get_server_socket(milliseconds(100), &error)));
+  }
+  EXPECT_EQ(0u, dest.get_open_connections(TCPAddress("41", 3306)));
+}
+
+TEST(ConnectionCapTest, FirstAvailableKeepsTheActiveServer) {
+  CountingSocketOperations so;
+  DestFirstAvailable dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.set_max_connections_per_destination(1);
+
+  int error = 0;
+  int first = dest.get_server_socket(milliseconds(100), &error);
+  EXPECT_EQ(41, server_of(first));
+  // 41 is full, not down
+  EXPECT_EQ(42, server_of(dest.get_server_socket(milliseconds(100), &error)));
+  EXPECT_TRUE(dest.is_available(TCPAddress("41", 3306)));
+  EXPECT_EQ(-1, dest.get_server_socket(milliseconds(100), &error));
+
+  dest.connection_closed(first);
+  EXPECT_EQ(41, server_of(dest.get_server_socket(milliseconds(100), &error)));
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,172 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_consistent_hash.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+#include "utils.h"
+
+#include "gmock/gmock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+using mysqlrouter::TCPAddress;
+
+static const size_t kClients = 3000;
+
+static bool any(size_t) { return true; }
+
+static uint64_t key_of(size_t client) {
+  return hash_bytes(&client, sizeof(client));
+}
+
+// server each client is placed on
+static std::vector<TCPAddress> place(const ConsistentHashRing &ring) {
+  std::vector<TCPAddress> placed;
+  for (size_t client = 0; client < kClients; ++client) {
+    placed.push_back(ring.servers().at(ring.lookup(key_of(client), 1, any).at(0)));
+  }
+  return placed;
+}
+
+class ConsistentHashRingTest : public ::testing::Test {
+ protected:
+  std::vector<TCPAddress> servers_{TCPAddress("10.0.0.1", 3306), TCPAddress("10.0.0.2", 3306),
+                                   TCPAddress("10.0.0.3", 3306)};
+};
+
+TEST_F(ConsistentHashRingTest, SpreadsClients) {
+  ConsistentHashRing ring;
+  ring.assign(servers_);
+
+  std::vector<TCPAddress> placed = place(ring);
+  for (auto &server : servers_) {
+    auto count = std::count(placed.begin(), placed.end(), server);
+    EXPECT_GT(count, static_cast<long>(kClients / 5)) << server.str();
+  }
+  // stable
+  EXPECT_EQ(placed, place(ring));
+}
+
+TEST_F(ConsistentHashRingTest, FewClientsMoveWhenServersChange) {
+  ConsistentHashRing ring;
+  ring.assign(servers_);
+  std::vector<TCPAddress> before = place(ring);
+
+  // a server joins: only clients moving to it move
+  TCPAddress added("10.0.0.4", 3306);
+  std::vector<TCPAddress> servers = servers_;
+  servers.insert(servers.begin(), added);
+  ring.assign(servers);
+  std::vector<TCPAddress> after = place(ring);
+  size_t moved = 0;
+  for (size_t i = 0; i < kClients; ++i) {
+    if (!(before[i] == after[i])) {
+      ++moved;
+      EXPECT_EQ(added, after[i]);
+    }
+  }
+  EXPECT_GT(moved, kClients / 8);
+  EXPECT_LT(moved, kClients * 3 / 8);
+
+  // and they go back when it leaves
+  ring.assign(servers_);
+  EXPECT_EQ(before, place(ring));
+}
+
+TEST_F(ConsistentHashRingTest, SkipsUnusableServersDeterministically) {
+  ConsistentHashRing ring;
+  ring.assign(servers_);
+
+  for (size_t client = 0; client < 100; ++client) {
+    std::vector<size_t> order = ring.lookup(key_of(client), 3, any);
+    ASSERT_EQ(3u, order.size());
+
+    // without the client's server, the next one on the ring takes over
+    size_t failed = order[0];
+    std::vector<size_t> skipped = ring.lookup(key_of(client), 3, [failed](size_t i) { return i != failed; });
+    EXPECT_EQ(std::vector<size_t>(order.begin() + 1, order.end()), skipped);
+  }
+  EXPECT_TRUE(ring.lookup(key_of(0), 3, [](size_t) { return false; }).empty());
+
+  ConsistentHashRing empty;
+  EXPECT_TRUE(empty.lookup(key_of(0), 3, any).empty());
+}
+
+TEST(ClientKeyTest, KeyedByAddress) {
+  sockaddr_storage addr1;
+  sockaddr_storage addr2;
+  memset(&addr1, 0, sizeof(addr1));
+  memset(&addr2, 0, sizeof(addr2));
+  sockaddr_in *in1 = reinterpret_cast<sockaddr_in *>(&addr1);
+  sockaddr_in *in2 = reinterpret_cast<sockaddr_in *>(&addr2);
+  in1->sin_family = in2->sin_family = AF_INET;
+  inet_pton(AF_INET, "192.168.1.10", &in1->sin_addr);
+  inet_pton(AF_INET, "192.168.1.10", &in2->sin_addr);
+  // the port differs for every connection of a client
+  in1->sin_port = htons(40000);
+  in2->sin_port = htons(40001);
+  EXPECT_EQ(client_key(addr1), client_key(addr2));
+
+  inet_pton(AF_INET, "192.168.1.11", &in2->sin_addr);
+  EXPECT_NE(client_key(addr1), client_key(addr2));
+}
+
+TEST(DestConsistentHashTest, ClientsKeepTheirServer) {
+  MockSocketOperations so;
+  DestConsistentHash dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.add("43", 3306);
+  dest.set_connect_race_size(1);
+
+  int error = 0;
+  std::vector<int> servers;
+  for (size_t client = 0; client < 50; ++client) {
+    servers.push_back(dest.get_server_socket(std::chrono::seconds(1), &error, nullptr, key_of(client)));
+  }
+  for (size_t client = 0; client < 50; ++client) {
+    EXPECT_EQ(servers[client], dest.get_server_socket(std::chrono::seconds(1), &error, nullptr, key_of(client)));
+  }
+
+  // the server of client 0 fails and is quarantined; only its clients move
+  so.get_mysql_socket_fail(1);
+  int replacement = dest.get_server_socket(std::chrono::seconds(1), &error, nullptr, key_of(0));
+  EXPECT_NE(servers[0], replacement);
+  EXPECT_EQ(1u, dest.size_quarantine());
+  for (size_t client = 0; client < 50; ++client) {
+    int fd = dest.get_server_socket(std::chrono::seconds(1), &error, nullptr, key_of(client));
+    if (servers[client] == servers[0]) {
+      EXPECT_NE(servers[0], fd);
+    } else {
+      EXPECT_EQ(servers[client], fd);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
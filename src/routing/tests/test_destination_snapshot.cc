@@ -0,0 +1,142 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "destination.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using mysqlrouter::TCPAddress;
+using ::testing::AnyOf;
+using ::testing::ElementsAre;
+
+class QuarantiningRouteDestination : public RouteDestination {
+ public:
+  using RouteDestination::RouteDestination;
+
+  void add_to_quarantine(const size_t index) noexcept override {
+    RouteDestination::add_to_quarantine(index);
+  }
+
+  void cleanup_quarantine() noexcept override {
+    RouteDestination::cleanup_quarantine();
+  }
+};
+
+TEST(DestinationSnapshotTest, PublishedSnapshotsDoNotChange) {
+  QuarantiningRouteDestination dest;
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+
+  RouteDestination::SnapshotPtr before = dest.snapshot();
+  dest.add_to_quarantine(0);
+  dest.remove("42", 3306);
+  dest.add("43", 3306);
+
+  EXPECT_THAT(before->destinations, ElementsAre(TCPAddress("41", 3306), TCPAddress("42", 3306)));
+  EXPECT_EQ(0u, before->num_quarantined);
+  EXPECT_FALSE(before->is_quarantined(0));
+
+  RouteDestination::SnapshotPtr after = dest.snapshot();
+  EXPECT_THAT(after->destinations, ElementsAre(TCPAddress("41", 3306), TCPAddress("43", 3306)));
+  EXPECT_TRUE(after->is_quarantined(0));
+  EXPECT_FALSE(after->is_quarantined(1));
+  EXPECT_NE(before->version, after->version);
+}
+
+TEST(DestinationSnapshotTest, QuarantineFollowsRemovedDestinations) {
+  QuarantiningRouteDestination dest;
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.add("43", 3306);
+  dest.add_to_quarantine(2);
+  uint64_t version = dest.snapshot()->version;
+
+  // the quarantine does not change the list of destinations
+  EXPECT_EQ(version, dest.snapshot()->version);
+
+  // 43 moves to index 1 and stays quarantined
+  dest.remove("41", 3306);
+  EXPECT_EQ(1u, dest.size_quarantine());
+  EXPECT_FALSE(dest.snapshot()->is_quarantined(0));
+  EXPECT_TRUE(dest.snapshot()->is_quarantined(1));
+  EXPECT_FALSE(dest.is_available(TCPAddress("43", 3306)));
+
+  dest.remove("43", 3306);
+  EXPECT_EQ(0u, dest.size_quarantine());
+
+  dest.add_to_quarantine(0);
+  dest.clear();
+  EXPECT_EQ(0u, dest.size_quarantine());
+  EXPECT_EQ(0u, dest.size());
+}
+
+TEST(DestinationSnapshotTest, CleanupQuarantine) {
+  MockSocketOperations so;
+  QuarantiningRouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.add_to_quarantine(0);
+  dest.add_to_quarantine(1);
+
+  // 41 is still down
+  so.get_mysql_socket_fail(1);
+  dest.cleanup_quarantine();
+  EXPECT_EQ(1u, dest.size_quarantine());
+  EXPECT_TRUE(dest.snapshot()->is_quarantined(0));
+  EXPECT_TRUE(dest.is_available(TCPAddress("42", 3306)));
+}
+
+TEST(DestinationSnapshotTest, ConnectWhileDestinationsChange) {
+  MockSocketOperations so;
+  QuarantiningRouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.add("43", 3306);
+
+  std::atomic<bool> stop(false);
+  std::thread updater([&] {
+    while (!stop) {
+      dest.add("44", 3306);
+      dest.add_to_quarantine(0);
+      dest.remove("44", 3306);
+      dest.remove("41", 3306);
+      dest.add("41", 3306);
+    }
+  });
+
+  for (int i = 0; i < 10000; ++i) {
+    int error = 0;
+    int fd = dest.get_server_socket(std::chrono::seconds(1), &error);
+    ASSERT_THAT(fd, AnyOf(41, 42, 43, 44));
+  }
+  stop = true;
+  updater.join();
+
+  EXPECT_EQ(3u, dest.size());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,164 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_least_connections.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <chrono>
+#include <vector>
+
+using mysqlrouter::TCPAddress;
+using ::testing::ElementsAre;
+
+static bool any(size_t) { return true; }
+
+TEST(ConnectionLoadTest, OrdersByConnections) {
+  ConnectionLoad<size_t> load;
+  load.add(0);
+  load.add(1);
+  load.add(2);
+
+  load.opened(10, 0);
+  load.opened(11, 0);
+  load.opened(12, 1);
+  EXPECT_EQ(2u, load.connections(0));
+  EXPECT_EQ(1u, load.connections(1));
+  EXPECT_THAT(load.least_loaded(3, any), ElementsAre(2u, 1u, 0u));
+  EXPECT_THAT(load.least_loaded(1, [](size_t i) { return i != 2; }), ElementsAre(1u));
+
+  load.closed(10);
+  load.closed(11);
+  EXPECT_EQ(0u, load.connections(0));
+  // 2 was picked before 0, which comes first now
+  EXPECT_THAT(load.least_loaded(3, any), ElementsAre(0u, 2u, 1u));
+}
+
+TEST(ConnectionLoadTest, TiesGoToLeastRecentlyPicked) {
+  ConnectionLoad<size_t> load;
+  load.add(0);
+  load.add(1);
+  load.add(2);
+
+  // nothing connected yet; the destinations take turns
+  EXPECT_THAT(load.least_loaded(1, any), ElementsAre(0u));
+  EXPECT_THAT(load.least_loaded(1, any), ElementsAre(1u));
+  EXPECT_THAT(load.least_loaded(1, any), ElementsAre(2u));
+  EXPECT_THAT(load.least_loaded(1, any), ElementsAre(0u));
+}
+
+TEST(ConnectionLoadTest, UnknownSocketsAreIgnored) {
+  ConnectionLoad<size_t> load;
+  load.opened(10, 0);
+  load.closed(11);
+  load.closed(10);
+  load.closed(10);
+  EXPECT_EQ(0u, load.connections(0));
+
+  // a socket number reused without close being reported moves over
+  load.opened(10, 0);
+  load.opened(10, 1);
+  EXPECT_EQ(0u, load.connections(0));
+  EXPECT_EQ(1u, load.connections(1));
+}
+
+class DestLeastConnectionsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    dest_.add("41", 3306);
+    dest_.add("42", 3306);
+    dest_.add("43", 3306);
+    dest_.set_connect_race_size(1);
+  }
+
+  int connect() {
+    int error = 0;
+    return dest_.get_server_socket(std::chrono::seconds(1), &error);
+  }
+
+  MockSocketOperations so_;
+  DestLeastConnections dest_{Protocol::Type::kClassicProtocol, &so_};
+};
+
+TEST_F(DestLeastConnectionsTest, PicksLeastLoaded) {
+  EXPECT_EQ(41, connect());
+  EXPECT_EQ(42, connect());
+  EXPECT_EQ(43, connect());
+  EXPECT_EQ(1u, dest_.get_connections(TCPAddress("42", 3306)));
+
+  // 42 was the only one to lose its connection
+  dest_.connection_closed(42);
+  EXPECT_EQ(0u, dest_.get_connections(TCPAddress("42", 3306)));
+  EXPECT_EQ(42, connect());
+}
+
+TEST_F(DestLeastConnectionsTest, SkipsQuarantined) {
+  so_.get_mysql_socket_fail(1);
+  EXPECT_EQ(42, connect());
+  EXPECT_EQ(1u, dest_.size_quarantine());
+
+  // 41 has no connections, but stays quarantined
+  EXPECT_EQ(43, connect());
+  dest_.connection_closed(42);
+  dest_.connection_closed(43);
+  EXPECT_EQ(42, connect());
+  EXPECT_EQ(0u, dest_.get_connections(TCPAddress("41", 3306)));
+}
+
+TEST_F(DestLeastConnectionsTest, CountsConnectionsOpenedElsewhere) {
+  // e.g. sessions taken from the connection pool
+  dest_.connection_opened(100, TCPAddress("41", 3306));
+  dest_.connection_opened(101, TCPAddress("42", 3306));
+  dest_.connection_opened(102, TCPAddress("99", 3306));  // not a destination
+  EXPECT_EQ(43, connect());
+
+  dest_.connection_closed(100);
+  EXPECT_EQ(41, connect());
+}
+
+TEST_F(DestLeastConnectionsTest, CountsFollowRemovedDestinations) {
+  EXPECT_EQ(41, connect());
+  EXPECT_EQ(42, connect());
+  EXPECT_EQ(43, connect());
+  dest_.connection_closed(43);
+
+  // 42 and 43 move up in the list, their connections stay with them
+  dest_.remove("41", 3306);
+  EXPECT_EQ(1u, dest_.get_connections(TCPAddress("42", 3306)));
+  EXPECT_EQ(0u, dest_.get_connections(TCPAddress("43", 3306)));
+  EXPECT_EQ(43, connect());
+}
+
+TEST_F(DestLeastConnectionsTest, CountsSurviveClear) {
+  EXPECT_EQ(41, connect());
+  EXPECT_EQ(42, connect());
+
+  // 41 is still connected to
+  dest_.clear();
+  dest_.add("43", 3306);
+  dest_.add("41", 3306);
+  EXPECT_EQ(43, connect());
+  dest_.connection_closed(41);
+  EXPECT_EQ(41, connect());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,146 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "dest_lowest_latency.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using mysqlrouter::TCPAddress;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+TEST(LatencyEstimateTest, MovingAverage) {
+  LatencyEstimate<int> latency(0.5, milliseconds(60000));
+  EXPECT_EQ(microseconds(0), latency.get(1));
+
+  latency.record(1, microseconds(1000));
+  EXPECT_EQ(microseconds(1000), latency.get(1));
+  latency.record(1, microseconds(2000));
+  EXPECT_EQ(microseconds(1500), latency.get(1));
+  latency.record(1, microseconds(500));
+  EXPECT_EQ(microseconds(1000), latency.get(1));
+}
+
+TEST(LatencyEstimateTest, MeasurementsGetOutdated) {
+  LatencyEstimate<int> latency(0.5, milliseconds(50));
+  latency.record(1, microseconds(1000));
+  std::this_thread::sleep_for(milliseconds(100));
+  EXPECT_EQ(microseconds(0), latency.get(1));
+
+  // a new measurement starts a new average
+  latency.record(1, microseconds(3000));
+  EXPECT_EQ(microseconds(3000), latency.get(1));
+}
+
+TEST(LatencyEstimateTest, PicksFasterOfTwo) {
+  LatencyEstimate<int> latency;
+  latency.record(10, microseconds(100));
+  latency.record(20, microseconds(200));
+  latency.record(30, microseconds(300));
+
+  EXPECT_EQ(0u, latency.pick({30}));
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_EQ(0u, latency.pick({10, 30}));
+  }
+
+  // the slowest of the three loses against whichever it is paired with
+  std::vector<int> picked(3, 0);
+  for (int i = 0; i < 300; ++i) {
+    ++picked[latency.pick({10, 20, 30})];
+  }
+  EXPECT_GT(picked[0], 0);
+  EXPECT_GT(picked[1], 0);
+  EXPECT_EQ(0, picked[2]);
+}
+
+#ifndef _WIN32
+TEST(DestLowestLatencyTest, PrefersServersGreetingFast) {
+  uint16_t port = 0;
+  int greeting = listen_on_loopback(&port);
+  ASSERT_GE(greeting, 0);
+  TCPAddress fast("127.0.0.1", port);
+  // connects to this one succeed, but it never greets
+  int silent = listen_on_loopback(&port);
+  ASSERT_GE(silent, 0);
+  TCPAddress slow("127.0.0.1", port);
+
+  std::atomic<bool> stop(false);
+  std::vector<int> accepted;
+  std::thread greeter([&] {
+    while (!stop) {
+      struct pollfd fds[] = {{greeting, POLLIN, 0}};
+      if (poll(fds, 1, 10) == 1) {
+        int fd = accept(greeting, nullptr, nullptr);
+        if (fd >= 0) {
+          ssize_t written = write(fd, "\x01", 1);
+          (void)written;
+          accepted.push_back(fd);
+        }
+      }
+    }
+  });
+
+  DestLowestLatency dest(Protocol::Type::kClassicProtocol, routing::SocketOperations::instance(),
+                         milliseconds(100));
+  dest.add(slow);
+  dest.add(fast);
+  dest.set_connect_race_size(1);
+
+  std::vector<TCPAddress> picked;
+  for (int i = 0; i < 8; ++i) {
+    int error = 0;
+    TCPAddress address;
+    int fd = dest.get_server_socket(std::chrono::seconds(1), &error, &address);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    picked.push_back(address);
+  }
+  stop = true;
+  greeter.join();
+  for (int fd : accepted) {
+    close(fd);
+  }
+  close(greeting);
+  close(silent);
+
+  EXPECT_GE(dest.get_latency(slow), milliseconds(100));
+  EXPECT_LT(dest.get_latency(fast), milliseconds(100));
+  // once both were measured, the fast server gets all connections
+  EXPECT_THAT(std::vector<TCPAddress>(picked.end() - 4, picked.end()), ::testing::Each(fast));
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
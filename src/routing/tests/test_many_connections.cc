@@ -0,0 +1,246 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/**
+ * Holds many idle connections open through an epoll route.
+ *
+ * The test with 100k connections is disabled by default; run it with
+ *
+ *   test_routing_many_connections --gtest_also_run_disabled_tests
+ *
+ * It needs a hard limit of open files of at least 400k, as clients, route
+ * and backends all live in this process. Clients use several loopback
+ * addresses and the route several backend ports so that the ephemeral
+ * ports do not run out.
+ */
+
+#include "mysql_routing.h"
+#include "mysqlrouter/routing.h"
+
+#include "gmock/gmock.h"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const uint16_t kRouterPort = 4459;
+static const uint16_t kBackendPort = 4460;
+static const size_t kBackends = 5;
+// connections from one loopback address
+static const size_t kClientsPerAddress = 20000;
+
+static int listen_on(uint16_t port) {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1 ||
+      listen(sock, 4096) == -1) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+// connects from 127.0.0.(1 + i / kClientsPerAddress)
+static int connect_to_router(size_t i) {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock < 0) return -1;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + static_cast<uint32_t>(i / kClientsPerAddress));
+  if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+    close(sock);
+    return -1;
+  }
+  addr.sin_port = htons(kRouterPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static size_t resident_bytes() {
+  long size = 0;
+  long pages = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%ld %ld", &size, &pages) != 2) {
+      pages = 0;
+    }
+    fclose(statm);
+  }
+  return static_cast<size_t>(pages) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// accepts and keeps connections without ever sending anything
+class MockBackends {
+ public:
+  MockBackends() {
+    for (size_t i = 0; i < kBackends; ++i) {
+      int sock = listen_on(static_cast<uint16_t>(kBackendPort + i));
+      if (sock < 0) {
+        continue;
+      }
+      listeners_.push_back(sock);
+      threads_.emplace_back([this, sock] {
+        int conn;
+        while ((conn = accept(sock, nullptr, nullptr)) >= 0) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          accepted_.push_back(conn);
+        }
+      });
+    }
+  }
+
+  ~MockBackends() {
+    for (int sock : listeners_) {
+      shutdown(sock, SHUT_RDWR);
+    }
+    for (auto &thr : threads_) {
+      thr.join();
+    }
+    for (int sock : listeners_) {
+      close(sock);
+    }
+    for (int sock : accepted_) {
+      close(sock);
+    }
+  }
+
+  bool ready() const {
+    return listeners_.size() == kBackends;
+  }
+
+  size_t accepted() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return accepted_.size();
+  }
+
+  std::string destinations() const {
+    std::string csv;
+    for (size_t i = 0; i < kBackends; ++i) {
+      csv += (i ? "," : "") + std::string("127.0.0.1:") + std::to_string(kBackendPort + i);
+    }
+    return csv;
+  }
+
+ private:
+  std::vector<int> listeners_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::vector<int> accepted_;
+};
+
+// opens `count` connections and returns the resident memory per connection
+static size_t hold_connections(size_t count) {
+  uint64_t reserved;
+  // clients and backends of this process
+  if (routing::reserve_file_descriptors(2 * count, &reserved) < reserved) {
+    std::cout << "[ WARNING  ] limit of open files may be too low" << std::endl;
+  }
+
+  MockBackends backends;
+  EXPECT_TRUE(backends.ready());
+
+  MySQLRouting routing(routing::AccessMode::kReadOnly, kRouterPort,
+                       Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+                       "routing:many", static_cast<int>(count) + 1,
+                       routing::kDefaultDestinationConnectionTimeout, routing::kDefaultMaxConnectErrors,
+                       std::chrono::seconds(600));
+  routing.set_io_model(routing::IoModel::kEpoll);
+  routing.set_destinations_from_csv(backends.destinations());
+  std::thread router_thread(&MySQLRouting::start, &routing);
+
+  std::vector<int> clients;
+  // wait for the route to listen
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  int sock;
+  while ((sock = connect_to_router(0)) < 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_GE(sock, 0) << "route did not start";
+  clients.push_back(sock);
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (backends.accepted() < 1 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  clients.reserve(count);
+
+  size_t resident_before = resident_bytes();
+  for (size_t i = 1; i < count && clients.back() >= 0; ++i) {
+    clients.push_back(connect_to_router(i));
+  }
+  EXPECT_GE(clients.back(), 0) << "connecting failed after " << clients.size() << " connections";
+
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+  while (backends.accepted() < count && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(count, backends.accepted());
+  size_t resident_after = resident_bytes();
+  size_t per_connection = (resident_after - std::min(resident_before, resident_after)) / count;
+
+  std::cout << "[ RESULT   ] " << backends.accepted() << " connections routed, "
+            << per_connection << " bytes resident per connection" << std::endl;
+
+  for (int client : clients) {
+    if (client >= 0) {
+      close(client);
+    }
+  }
+  routing.stop();
+  router_thread.join();
+  routing::release_file_descriptors(2 * count);
+
+  return per_connection;
+}
+
+TEST(ManyConnections, HoldsIdleConnections) {
+  hold_connections(1000);
+}
+
+TEST(ManyConnections, DISABLED_Holds100kIdleConnections) {
+  EXPECT_LT(hold_connections(100000), 4096u);
+}
+
+#endif // __linux__
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
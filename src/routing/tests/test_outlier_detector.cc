@@ -0,0 +1,231 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "destination.h"
+#include "mysqlrouter/routing.h"
+#include "outlier_detector.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using mysqlrouter::TCPAddress;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+static const milliseconds kInterval(1000);
+static const milliseconds kEjectionTime(5000);
+
+class OutlierDetectorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i < 10; ++i) {
+      servers_.push_back(TCPAddress("10.0.0." + std::to_string(i + 1), 3306));
+    }
+    now_ = OutlierDetector::clock_type::now();
+  }
+
+  // the given number of connections to each server, failing every
+  // other one on `failing`
+  std::vector<OutlierDetector::Ejection> spread(OutlierDetector &detector, size_t num_servers, int connections,
+                                                const TCPAddress &failing, microseconds latency) {
+    std::vector<OutlierDetector::Ejection> ejections;
+    for (int i = 0; i < connections; ++i) {
+      for (size_t s = 0; s < num_servers; ++s) {
+        auto ejected = (servers_[s] == failing && i % 2 == 1)
+                           ? detector.record_failure(servers_[s], num_servers, now_)
+                           : detector.record_success(servers_[s], latency, num_servers, now_);
+        ejections.insert(ejections.end(), ejected.begin(), ejected.end());
+      }
+    }
+    return ejections;
+  }
+
+  std::vector<TCPAddress> servers_;
+  OutlierDetector::clock_type::time_point now_;
+};
+
+TEST_F(OutlierDetectorTest, ConsecutiveFailures) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  for (unsigned int i = 1; i < routing::kOutlierConsecutiveFailures; ++i) {
+    EXPECT_TRUE(detector.record_failure(servers_[0], 3, now_).empty());
+  }
+  // a success starts counting again
+  detector.record_success(servers_[0], microseconds(100), 3, now_);
+  for (unsigned int i = 1; i < routing::kOutlierConsecutiveFailures; ++i) {
+    EXPECT_TRUE(detector.record_failure(servers_[0], 3, now_).empty());
+  }
+  auto ejections = detector.record_failure(servers_[0], 3, now_);
+  ASSERT_EQ(1u, ejections.size());
+  EXPECT_EQ(servers_[0], ejections[0].address);
+  EXPECT_EQ(kEjectionTime, ejections[0].duration);
+  EXPECT_TRUE(detector.is_ejected(servers_[0], now_));
+  EXPECT_FALSE(detector.is_ejected(servers_[0], now_ + kEjectionTime));
+
+  OutlierDetector::Stats stats = detector.get_stats(now_);
+  EXPECT_EQ(1u, stats.consecutive_failure_ejections);
+  EXPECT_EQ(1u, stats.ejections());
+  EXPECT_EQ(1u, stats.ejected);
+  EXPECT_EQ(2 * (routing::kOutlierConsecutiveFailures - 1) + 1, stats.failures);
+  EXPECT_EQ(1u, stats.successes);
+}
+
+TEST_F(OutlierDetectorTest, SuccessRate) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  // half of the connections to servers_[3] fail, none in a row
+  EXPECT_TRUE(spread(detector, 10, 20, servers_[3], microseconds(1000)).empty());
+
+  now_ += kInterval;
+  auto ejections = detector.record_success(servers_[0], microseconds(1000), 10, now_);
+  ASSERT_EQ(1u, ejections.size());
+  EXPECT_EQ(servers_[3], ejections[0].address);
+  EXPECT_EQ(1u, detector.get_stats(now_).success_rate_ejections);
+}
+
+TEST_F(OutlierDetectorTest, SuccessRateWithThreeDestinations) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  // only sqrt(2) standard deviations below the mean
+  EXPECT_TRUE(spread(detector, 3, 20, servers_[1], microseconds(1000)).empty());
+
+  now_ += kInterval;
+  auto ejections = detector.record_success(servers_[0], microseconds(1000), 3, now_);
+  ASSERT_EQ(1u, ejections.size());
+  EXPECT_EQ(servers_[1], ejections[0].address);
+  EXPECT_EQ(1u, detector.get_stats(now_).success_rate_ejections);
+}
+
+TEST_F(OutlierDetectorTest, SuccessRateToleratesFewFailures) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  for (int i = 0; i < 20; ++i) {
+    for (size_t s = 0; s < 3; ++s) {
+      if (s == 1 && i == 10) {
+        detector.record_failure(servers_[s], 3, now_);
+      } else {
+        detector.record_success(servers_[s], microseconds(1000), 3, now_);
+      }
+    }
+  }
+
+  now_ += kInterval;
+  EXPECT_TRUE(detector.record_success(servers_[0], microseconds(1000), 3, now_).empty());
+}
+
+TEST_F(OutlierDetectorTest, SuccessRateNeedsEnoughConnections) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  spread(detector, 10, routing::kOutlierMinRequests - 1, servers_[3], microseconds(1000));
+  now_ += kInterval;
+  EXPECT_TRUE(detector.record_success(servers_[0], microseconds(1000), 10, now_).empty());
+}
+
+TEST_F(OutlierDetectorTest, Latency) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  spread(detector, 3, 20, TCPAddress(), microseconds(1000));
+  for (unsigned int i = 0; i < routing::kOutlierMinRequests; ++i) {
+    detector.record_success(servers_[3], microseconds(10000), 4, now_);
+  }
+
+  now_ += kInterval;
+  auto ejections = detector.record_success(servers_[0], microseconds(1000), 4, now_);
+  ASSERT_EQ(1u, ejections.size());
+  EXPECT_EQ(servers_[3], ejections[0].address);
+  EXPECT_EQ(1u, detector.get_stats(now_).latency_ejections);
+}
+
+TEST_F(OutlierDetectorTest, EjectionsAreCapped) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  // the only server is never ejected
+  for (unsigned int i = 0; i < routing::kOutlierConsecutiveFailures; ++i) {
+    EXPECT_TRUE(detector.record_failure(servers_[0], 1, now_).empty());
+  }
+  EXPECT_EQ(1u, detector.get_stats(now_).ejections_skipped);
+
+  // out of 4 servers, one may be ejected
+  for (unsigned int i = 0; i < routing::kOutlierConsecutiveFailures; ++i) {
+    detector.record_failure(servers_[1], 4, now_);
+    detector.record_failure(servers_[2], 4, now_);
+  }
+  EXPECT_TRUE(detector.is_ejected(servers_[1], now_));
+  EXPECT_FALSE(detector.is_ejected(servers_[2], now_));
+
+  OutlierDetector::Stats stats = detector.get_stats(now_);
+  EXPECT_EQ(1u, stats.ejections());
+  EXPECT_EQ(2u, stats.ejections_skipped);
+  EXPECT_EQ(1u, stats.ejected);
+}
+
+TEST_F(OutlierDetectorTest, RepeatedEjectionsLastLonger) {
+  OutlierDetector detector(kInterval, kEjectionTime);
+
+  for (int round = 1; round <= 2; ++round) {
+    std::vector<OutlierDetector::Ejection> ejections;
+    for (unsigned int i = 0; i < routing::kOutlierConsecutiveFailures; ++i) {
+      ejections = detector.record_failure(servers_[0], 3, now_);
+    }
+    ASSERT_EQ(1u, ejections.size());
+    EXPECT_EQ(kEjectionTime * round, ejections[0].duration);
+    now_ += ejections[0].duration;
+  }
+}
+
+class EjectingRouteDestination : public RouteDestination {
+ public:
+  using RouteDestination::RouteDestination;
+
+  void cleanup_quarantine() noexcept override {
+    RouteDestination::cleanup_quarantine();
+  }
+};
+
+TEST(DestinationOutlierTest, EjectedUntilEjectionEnds) {
+  MockSocketOperations so;
+  EjectingRouteDestination dest(Protocol::Type::kClassicProtocol, &so);
+  dest.add("41", 3306);
+  dest.add("42", 3306);
+  dest.add("43", 3306);
+
+  TCPAddress failing("41", 3306);
+  for (unsigned int i = 0; i < routing::kOutlierConsecutiveFailures; ++i) {
+    dest.report_failure(failing);
+  }
+  EXPECT_FALSE(dest.is_available(failing));
+  EXPECT_EQ(1u, dest.get_outlier_stats().ejected);
+
+  // the server answers, but stays out of rotation
+  dest.cleanup_quarantine();
+  EXPECT_FALSE(dest.is_available(failing));
+
+  int error = 0;
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_NE(41, dest.get_server_socket(milliseconds(1000), &error));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
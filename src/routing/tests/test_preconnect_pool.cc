@@ -0,0 +1,214 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "preconnect_pool.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using mysqlrouter::TCPAddress;
+
+static bool call_until(std::function<bool()> f) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!f()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+// listening socket on an ephemeral port; connections are left in the
+// backlog, which is enough for connect() to succeed
+class PreconnectPoolTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener_, 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, bind(listener_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)));
+    ASSERT_EQ(0, listen(listener_, 128));
+
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(listener_, reinterpret_cast<struct sockaddr *>(&addr), &len));
+    addr_ = TCPAddress("127.0.0.1", ntohs(addr.sin_port));
+  }
+
+  virtual void TearDown() {
+    close(listener_);
+  }
+
+  uint16_t local_port_of_peer(int fd) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) return 0;
+    return ntohs(addr.sin_port);
+  }
+
+  routing::SocketOperationsBase *so_ = routing::SocketOperations::instance();
+  int listener_;
+  TCPAddress addr_;
+};
+
+TEST_F(PreconnectPoolTest, EmptyPoolMisses) {
+  PreconnectPool pool(so_, 4, std::chrono::milliseconds(1000));
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  PreconnectPool::Stats stats = pool.get_stats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+}
+
+TEST_F(PreconnectPoolTest, FillsOnDemand) {
+  PreconnectPool pool(so_, 4, std::chrono::milliseconds(1000));
+  pool.start();
+
+  // nothing is connected before a destination was asked for
+  std::this_thread::sleep_for(2 * PreconnectPool::kRefillInterval);
+  EXPECT_EQ(0u, pool.size(addr_));
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  ASSERT_TRUE(call_until([&] { return pool.size(addr_) > 0; }));
+
+  int fd = pool.take(addr_);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(addr_.port, local_port_of_peer(fd));
+  close(fd);
+
+  PreconnectPool::Stats stats = pool.get_stats();
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_GE(stats.connected, 1u);
+}
+
+TEST_F(PreconnectPoolTest, SizeFollowsDemand) {
+  const size_t kMaxSize = 4;
+  PreconnectPool pool(so_, kMaxSize, std::chrono::milliseconds(1000));
+  pool.start();
+
+  // a high rate fills the pool up to its maximum size
+  for (int i = 0; i < 20; ++i) {
+    int fd = pool.take(addr_);
+    if (fd >= 0) close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(call_until([&] { return pool.size(addr_) == kMaxSize; }));
+  std::this_thread::sleep_for(2 * PreconnectPool::kRefillInterval);
+  EXPECT_LE(pool.size(addr_), kMaxSize);
+}
+
+TEST_F(PreconnectPoolTest, OldSocketsAreClosed) {
+  PreconnectPool pool(so_, 4, std::chrono::milliseconds(1000), std::chrono::milliseconds(50));
+  pool.start();
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  ASSERT_TRUE(call_until([&] { return pool.get_stats().connected > 0; }));
+
+  // without demand, sockets expire and are not replaced
+  ASSERT_TRUE(call_until([&] { return pool.size(addr_) == 0 && pool.get_stats().discarded > 0; }));
+}
+
+TEST_F(PreconnectPoolTest, UnusedSocketsStopRefill) {
+  PreconnectPool pool(so_, 4, std::chrono::milliseconds(1000), std::chrono::milliseconds(50));
+  pool.start();
+
+  // a burst of demand which does not last
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(-1, pool.take(addr_));
+  }
+  ASSERT_TRUE(call_until([&] { return pool.get_stats().discarded >= PreconnectPool::kMaxUnusedPerRequest; }));
+
+  // the server counts every socket closed unused as a connect error of the
+  // Router host; no more are connected until the destination is asked for
+  std::this_thread::sleep_for(2 * PreconnectPool::kRefillInterval);
+  uint64_t connected = pool.get_stats().connected;
+  std::this_thread::sleep_for(3 * PreconnectPool::kRefillInterval);
+  EXPECT_EQ(connected, pool.get_stats().connected);
+
+  pool.take(addr_);
+  EXPECT_TRUE(call_until([&] { return pool.get_stats().connected > connected; }));
+}
+
+TEST_F(PreconnectPoolTest, DiscardedDestinationIsNotRefilled) {
+  PreconnectPool pool(so_, 4, std::chrono::milliseconds(1000));
+  pool.start();
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  ASSERT_TRUE(call_until([&] { return pool.size(addr_) > 0; }));
+
+  pool.discard(addr_);
+  EXPECT_EQ(0u, pool.size(addr_));
+  // demand keeps coming, e.g. from connects racing the quarantine
+  for (int i = 0; i < 3; ++i) {
+    pool.take(addr_);
+    std::this_thread::sleep_for(2 * PreconnectPool::kRefillInterval);
+    EXPECT_EQ(0u, pool.size(addr_));
+  }
+
+  pool.resume(addr_);
+  pool.take(addr_);
+  EXPECT_TRUE(call_until([&] { return pool.size(addr_) > 0; }));
+}
+
+TEST_F(PreconnectPoolTest, DiscardClosesSockets) {
+  PreconnectPool pool(so_, 4, std::chrono::milliseconds(1000));
+  pool.start();
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  ASSERT_TRUE(call_until([&] { return pool.size(addr_) > 0; }));
+
+  size_t pooled = pool.size(addr_);
+  pool.discard(addr_);
+  EXPECT_GE(pool.get_stats().discarded, pooled);
+}
+
+TEST_F(PreconnectPoolTest, ClosedSocketIsNotHandedOut) {
+  PreconnectPool pool(so_, 1, std::chrono::milliseconds(1000));
+  pool.start();
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  ASSERT_TRUE(call_until([&] { return pool.size(addr_) == 1; }));
+
+  // the destination goes away: the connection in the backlog is reset and
+  // new connections are refused
+  close(listener_);
+  listener_ = socket(AF_INET, SOCK_STREAM, 0);
+
+  EXPECT_EQ(-1, pool.take(addr_));
+  EXPECT_GE(pool.get_stats().discarded, 1u);
+  EXPECT_EQ(0u, pool.get_stats().hits);
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,197 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "destination.h"
+#include "mysqlrouter/routing.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using mysqlrouter::TCPAddress;
+using std::chrono::milliseconds;
+
+#ifndef _WIN32
+class ProbingRouteDestination : public RouteDestination {
+ public:
+  using RouteDestination::RouteDestination;
+  using RouteDestination::probe_quarantined;
+
+  void add_to_quarantine(const size_t index) noexcept override {
+    RouteDestination::add_to_quarantine(index);
+  }
+
+  void cleanup_quarantine() noexcept override {
+    RouteDestination::cleanup_quarantine();
+  }
+};
+
+/** @brief Servers answering connects in different ways */
+class QuarantineProbeTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    uint16_t port = 0;
+    greeting_ = listen_on_loopback(&port);
+    ASSERT_GE(greeting_, 0);
+    greeting_addr_ = TCPAddress("127.0.0.1", port);
+    refusing_ = listen_on_loopback(&port);
+    ASSERT_GE(refusing_, 0);
+    refusing_addr_ = TCPAddress("127.0.0.1", port);
+    // connects to these succeed, but they never greet
+    for (int i = 0; i < 2; ++i) {
+      silent_.push_back(listen_on_loopback(&port));
+      ASSERT_GE(silent_.back(), 0);
+      silent_addrs_.push_back(TCPAddress("127.0.0.1", port));
+    }
+    // nothing listens here
+    int closed = listen_on_loopback(&port);
+    ASSERT_GE(closed, 0);
+    close(closed);
+    closed_addr_ = TCPAddress("127.0.0.1", port);
+
+    server_ = std::thread([this] {
+      // header, protocol version 10 and the start of the server version
+      static const char kGreeting[] = "\x0a\x00\x00\x00\x0a" "5.7.21";
+      // header, 0xff and error code 1040 (too many connections)
+      static const char kError[] = "\x03\x00\x00\x00\xff\x10\x04";
+      while (!stop_) {
+        struct pollfd fds[] = {{greeting_, POLLIN, 0}, {refusing_, POLLIN, 0}};
+        if (poll(fds, 2, 10) <= 0) {
+          continue;
+        }
+        for (int i = 0; i < 2; ++i) {
+          if (fds[i].revents == 0) {
+            continue;
+          }
+          int fd = accept(fds[i].fd, nullptr, nullptr);
+          if (fd >= 0) {
+            ssize_t written = i == 0 ? write(fd, kGreeting, sizeof(kGreeting) - 1)
+                                     : write(fd, kError, sizeof(kError) - 1);
+            (void)written;
+            accepted_.push_back(fd);
+          }
+        }
+      }
+    });
+  }
+
+  void TearDown() override {
+    stop_ = true;
+    if (server_.joinable()) {
+      server_.join();
+    }
+    for (int fd : accepted_) {
+      close(fd);
+    }
+    close(greeting_);
+    close(refusing_);
+    for (int fd : silent_) {
+      close(fd);
+    }
+  }
+
+  void add_all(ProbingRouteDestination &dest) {
+    dest.add(greeting_addr_);
+    dest.add(refusing_addr_);
+    for (auto &addr : silent_addrs_) {
+      dest.add(addr);
+    }
+    dest.add(closed_addr_);
+    for (size_t i = 0; i < dest.size(); ++i) {
+      dest.add_to_quarantine(i);
+    }
+  }
+
+  int greeting_ = -1;
+  int refusing_ = -1;
+  std::vector<int> silent_;
+  TCPAddress greeting_addr_;
+  TCPAddress refusing_addr_;
+  std::vector<TCPAddress> silent_addrs_;
+  TCPAddress closed_addr_;
+
+  std::atomic<bool> stop_{false};
+  std::thread server_;
+  std::vector<int> accepted_;
+};
+
+TEST_F(QuarantineProbeTest, ConnectProbe) {
+  ProbingRouteDestination dest(Protocol::Type::kClassicProtocol);
+  add_all(dest);
+  ASSERT_EQ(5u, dest.size_quarantine());
+
+  dest.cleanup_quarantine();
+  EXPECT_TRUE(dest.is_available(greeting_addr_));
+  EXPECT_TRUE(dest.is_available(refusing_addr_));
+  EXPECT_TRUE(dest.is_available(silent_addrs_[0]));
+  EXPECT_TRUE(dest.is_available(silent_addrs_[1]));
+  EXPECT_FALSE(dest.is_available(closed_addr_));
+}
+
+TEST_F(QuarantineProbeTest, GreetingProbe) {
+  ProbingRouteDestination dest(Protocol::Type::kClassicProtocol);
+  dest.set_quarantine_probe(routing::QuarantineProbe::kGreeting);
+  add_all(dest);
+
+  auto started = std::chrono::steady_clock::now();
+  dest.cleanup_quarantine();
+  auto elapsed = std::chrono::steady_clock::now() - started;
+
+  EXPECT_TRUE(dest.is_available(greeting_addr_));
+  EXPECT_FALSE(dest.is_available(refusing_addr_));
+  EXPECT_FALSE(dest.is_available(silent_addrs_[0]));
+  EXPECT_FALSE(dest.is_available(silent_addrs_[1]));
+  EXPECT_FALSE(dest.is_available(closed_addr_));
+  // the silent servers were waited for at the same time
+  EXPECT_LT(elapsed, milliseconds(1900));
+}
+
+TEST_F(QuarantineProbeTest, ProbesBackOff) {
+  ProbingRouteDestination dest(Protocol::Type::kClassicProtocol);
+  dest.add(greeting_addr_);
+  dest.add(closed_addr_);
+  dest.add_to_quarantine(0);
+  dest.add_to_quarantine(1);
+
+  // not due yet
+  dest.probe_quarantined(true);
+  EXPECT_EQ(2u, dest.size_quarantine());
+
+  std::this_thread::sleep_for(routing::kQuarantineProbeInterval + milliseconds(100));
+  dest.probe_quarantined(true);
+  EXPECT_TRUE(dest.is_available(greeting_addr_));
+  EXPECT_FALSE(dest.is_available(closed_addr_));
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
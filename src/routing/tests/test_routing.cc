@@ -23,6 +23,9 @@
 
 #include "routing_mocks.h"
 #include "protocol/classic_protocol.h"
+#include "utils.h"
+
+#include <algorithm>
 
 #ifdef _WIN32
 #  define WIN32_LEAN_AND_MEAN
@@ -32,6 +35,8 @@
 #else
 #  include <sys/un.h>
 #  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
 #  ifdef __sun
 #    include <fcntl.h>
 #  else
@@ -82,6 +87,69 @@ TEST_F(RoutingTests, GetAccessLiteralName) {
   ASSERT_THAT(get_access_mode_name(AccessMode::kReadOnly), StrEq("read-only"));
 }
 
+TEST_F(RoutingTests, IoModelLiteralNames) {
+  using routing::IoModel;
+  using routing::get_io_model;
+  using routing::get_io_model_name;
+  ASSERT_THAT(get_io_model("thread"), Eq(IoModel::kThread));
+  ASSERT_THAT(get_io_model("epoll"), Eq(IoModel::kEpoll));
+  ASSERT_THAT(get_io_model("select"), Eq(IoModel::kUndefined));
+  ASSERT_THAT(get_io_model_name(IoModel::kThread), StrEq("thread"));
+  ASSERT_THAT(get_io_model("io_uring"), Eq(IoModel::kIoUring));
+  ASSERT_THAT(get_io_model_name(IoModel::kEpoll), StrEq("epoll"));
+  ASSERT_THAT(get_io_model_name(IoModel::kIoUring), StrEq("io_uring"));
+  ASSERT_THAT(get_io_model(routing::kDefaultIoModel), Eq(IoModel::kThread));
+}
+
+TEST_F(RoutingTests, SmoothWeightedRoundRobin) {
+  using ::testing::ElementsAre;
+
+  // same or no weights: plain round-robin
+  ASSERT_THAT(smooth_weighted_round_robin({1, 1, 1}, 100), ElementsAre(0u, 1u, 2u));
+  ASSERT_THAT(smooth_weighted_round_robin({0, 0}, 100), ElementsAre(0u, 1u));
+  ASSERT_THAT(smooth_weighted_round_robin({2.5f, 2.5f}, 100), ElementsAre(0u, 1u));
+
+  // heavier servers get more connections, interleaved with the others
+  ASSERT_THAT(smooth_weighted_round_robin({5, 1, 1}, 100), ElementsAre(0u, 0u, 1u, 0u, 2u, 0u, 0u));
+  ASSERT_THAT(smooth_weighted_round_robin({1.5f, 0.5f}, 100), ElementsAre(0u, 0u, 1u, 0u));
+
+  // the order is bounded, every server keeps a place in it
+  std::vector<size_t> order = smooth_weighted_round_robin({1000, 1}, 10);
+  ASSERT_EQ(order.size(), 10u);
+  ASSERT_EQ(std::count(order.begin(), order.end(), 1u), 1);
+
+  // how far the order is off from the weights is reported
+  double error = 1;
+  smooth_weighted_round_robin({5, 1, 1}, 100, &error);
+  ASSERT_DOUBLE_EQ(error, 0);
+  smooth_weighted_round_robin({1000, 1}, 10, &error);
+  ASSERT_GT(error, 10);
+  smooth_weighted_round_robin({1, 0.01f}, 100, &error);
+  ASSERT_GT(error, 1);
+
+  ASSERT_TRUE(smooth_weighted_round_robin({}, 100).empty());
+}
+
+TEST_F(RoutingTests, BackoffWithJitter) {
+  using std::chrono::milliseconds;
+
+  for (int i = 0; i < 20; ++i) {
+    // doubling with every failure, jittered over the upper half
+    milliseconds wait = backoff_with_jitter(0, milliseconds(100), milliseconds(1000));
+    ASSERT_GE(wait, milliseconds(50));
+    ASSERT_LE(wait, milliseconds(100));
+    wait = backoff_with_jitter(2, milliseconds(100), milliseconds(1000));
+    ASSERT_GE(wait, milliseconds(200));
+    ASSERT_LE(wait, milliseconds(400));
+
+    // up to the maximum
+    wait = backoff_with_jitter(100, milliseconds(100), milliseconds(1000));
+    ASSERT_GE(wait, milliseconds(500));
+    ASSERT_LE(wait, milliseconds(1000));
+  }
+  ASSERT_EQ(milliseconds(0), backoff_with_jitter(3, milliseconds(0), milliseconds(1000)));
+}
+
 TEST_F(RoutingTests, Defaults) {
   ASSERT_EQ(routing::kDefaultWaitTimeout, 0);
   ASSERT_EQ(routing::kDefaultMaxConnections, 512);
@@ -422,6 +490,298 @@ TEST_F(RoutingTests, bug_24841281) {
   thd.join();
 }
 
+TEST_F(RoutingTests, WorkerPool) {
+  const uint16_t server_port = 4426;
+  const uint16_t router_port = 4450;
+
+  MockServer server(server_port);
+  server.start();
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, router_port,
+               Protocol::Type::kXProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  routing.set_worker_threads(1, 2);
+  routing.set_destinations_from_csv("127.0.0.1:"+std::to_string(server_port));
+  std::thread thd(&MySQLRouting::start, &routing);
+
+  server.stop_after_n_accepts(3);
+
+  int sock1 = -1;
+  call_until([&sock1, router_port]() -> bool { sock1 = connect_local(router_port); return sock1 > 0; });
+  int sock2 = connect_local(router_port);
+  EXPECT_THAT(sock1, Gt(0));
+  EXPECT_THAT(sock2, Gt(0));
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 2; });
+  EXPECT_EQ(2, routing.info_active_routes_.load());
+
+  // both threads of the pool are busy, the third connection has to wait
+  int sock3 = connect_local(router_port);
+  EXPECT_THAT(sock3, Gt(0));
+  call_until([&routing]() -> bool { return routing.get_worker_pool()->get_stats().queue_depth == 1; });
+  EXPECT_EQ(1u, routing.get_worker_pool()->get_stats().queue_depth);
+  EXPECT_EQ(2, routing.info_active_routes_.load());
+
+  disconnect(sock1);
+  call_until([&server]() -> bool { return server.num_connections_ == 2 && server.num_accepts_ == 3; });
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 2 &&
+                                           routing.get_worker_pool()->get_stats().queue_depth == 0; });
+  EXPECT_EQ(2, routing.info_active_routes_.load());
+
+  WorkerPool::Stats stats = routing.get_worker_pool_stats();
+  EXPECT_EQ(2u, stats.threads);
+  EXPECT_EQ(3u, stats.tasks_started);
+  EXPECT_EQ(0u, stats.tasks_rejected);
+  EXPECT_EQ(1u, stats.max_queue_depth);
+  EXPECT_GT(stats.max_wait.count(), 0);
+
+  disconnect(sock2);
+  disconnect(sock3);
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 0; });
+  EXPECT_EQ(0, routing.info_active_routes_.load());
+
+  routing.stop();
+  server.stop();
+  thd.join();
+
+  EXPECT_EQ(0u, routing.get_worker_pool()->get_stats().threads);
+}
+
+TEST_F(RoutingTests, AdmissionQueueSlotOfFailedConnect) {
+  const uint16_t server_port = 4429;
+  const uint16_t router_port = 4456;
+
+  MockServer server(server_port);
+  server.start();
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, router_port,
+               Protocol::Type::kXProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute", 1);
+  routing.set_admission_queue(2, std::chrono::seconds(10));
+  routing.set_destinations_from_csv("127.0.0.1:"+std::to_string(server_port));
+  std::thread thd(&MySQLRouting::start, &routing);
+
+  int sock1 = -1;
+  call_until([&sock1, router_port]() -> bool { sock1 = connect_local(router_port); return sock1 > 0; });
+  ASSERT_THAT(sock1, Gt(0));
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 1; });
+
+  // both wait for the slot of the first client
+  int sock2 = connect_local(router_port);
+  int sock3 = connect_local(router_port);
+  EXPECT_THAT(sock2, Gt(0));
+  EXPECT_THAT(sock3, Gt(0));
+  call_until([&routing]() -> bool { return routing.get_admission_queue_stats().length == 2; });
+  EXPECT_EQ(2u, routing.get_admission_queue_stats().length);
+
+  // connecting the admitted clients fails; the second one gets the slot
+  // the first one did not use
+  server.stop();
+  disconnect(sock1);
+  call_until([&routing]() -> bool { return routing.get_admission_queue_stats().admitted == 2; });
+
+  AdmissionQueue::Stats stats = routing.get_admission_queue_stats();
+  EXPECT_EQ(0u, stats.length);
+  EXPECT_EQ(2u, stats.queued);
+  EXPECT_EQ(2u, stats.admitted);
+  EXPECT_EQ(0u, stats.timed_out);
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 0; });
+  EXPECT_EQ(0, routing.info_active_routes_.load());
+
+  routing::SocketOperations::instance()->close(sock2);
+  routing::SocketOperations::instance()->close(sock3);
+  routing.stop();
+  thd.join();
+}
+
+TEST_F(RoutingTests, PreconnectPool) {
+  const uint16_t server_port = 4427;
+  const uint16_t router_port = 4452;
+
+  MockServer server(server_port);
+  server.start();
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, router_port,
+               Protocol::Type::kXProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  routing.set_preconnect_pool_size(2);
+  routing.set_destinations_from_csv("127.0.0.1:"+std::to_string(server_port));
+  std::thread thd(&MySQLRouting::start, &routing);
+
+  int sock = -1;
+  call_until([&sock, router_port]() -> bool { sock = connect_local(router_port); return sock > 0; });
+  ASSERT_THAT(sock, Gt(0));
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 1; });
+  disconnect(sock);
+
+  // the first client asked for a connection; the pool gets one ready
+  const PreconnectPool *pool = routing.destination_->get_preconnect_pool();
+  ASSERT_NE(nullptr, pool);
+  TCPAddress dest("127.0.0.1", server_port);
+  call_until([pool, &dest]() -> bool { return pool->size(dest) > 0; });
+  ASSERT_GT(pool->size(dest), 0u);
+
+  sock = connect_local(router_port);
+  ASSERT_THAT(sock, Gt(0));
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 1; });
+  EXPECT_EQ(1, routing.info_active_routes_.load());
+  EXPECT_EQ(1u, pool->get_stats().hits);
+  disconnect(sock);
+
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 0; });
+  routing.stop();
+  server.stop();
+  thd.join();
+}
+
+TEST_F(RoutingTests, InvalidPreconnectPoolSize) {
+  MySQLRouting routing(routing::AccessMode::kReadWrite, 4453,
+               Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  EXPECT_EQ(0u, routing.get_preconnect_pool_size());
+  EXPECT_THROW(routing.set_preconnect_pool_size(routing::kMaxPreconnectPoolSize + 1), std::invalid_argument);
+  EXPECT_EQ(routing::kDefaultPreconnectMaxAge, routing.get_preconnect_max_age());
+  EXPECT_THROW(routing.set_preconnect_max_age(std::chrono::seconds(0)), std::invalid_argument);
+}
+
+TEST_F(RoutingTests, InvalidWorkerThreads) {
+  MySQLRouting routing(routing::AccessMode::kReadWrite, 4451,
+               Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  EXPECT_THROW(routing.set_worker_threads(2, 1), std::invalid_argument);
+  EXPECT_THROW(routing.set_worker_threads(1, 0), std::invalid_argument);
+  EXPECT_NO_THROW(routing.set_worker_threads(0, 0));
+  EXPECT_EQ(nullptr, routing.get_worker_pool());
+  EXPECT_EQ(0u, routing.get_worker_pool_stats().tasks_started);
+  EXPECT_EQ(0u, routing.get_outlier_stats().successes);
+}
+
+#ifdef SO_REUSEPORT
+TEST_F(RoutingTests, AcceptorThreads) {
+  const uint16_t server_port = 4423;
+  const uint16_t router_port = 4445;
+  const int kConnections = 16;
+
+  MockServer server(server_port);
+  server.start();
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, router_port,
+               Protocol::Type::kXProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  routing.set_acceptor_threads(4);
+  routing.set_destinations_from_csv("127.0.0.1:"+std::to_string(server_port));
+  std::thread thd(&MySQLRouting::start, &routing);
+
+  server.stop_after_n_accepts(kConnections);
+
+  // every acceptor thread listens on a socket of its own
+  call_until([&routing]() -> bool { return routing.get_acceptor_stats().size() == 4; });
+  ASSERT_EQ(4u, routing.get_acceptor_stats().size());
+
+  std::vector<int> socks;
+  call_until([&socks, router_port]() -> bool {
+    int sock = connect_local(router_port);
+    if (sock > 0) socks.push_back(sock);
+    return sock > 0;
+  });
+  while (socks.size() < static_cast<size_t>(kConnections)) {
+    int sock = connect_local(router_port);
+    EXPECT_THAT(sock, Gt(0));
+    socks.push_back(sock);
+  }
+
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == kConnections; });
+  EXPECT_EQ(kConnections, routing.info_active_routes_.load());
+
+  uint64_t accepted = 0;
+  for (const MySQLRouting::AcceptorStats &acceptor : routing.get_acceptor_stats()) {
+    accepted += acceptor.accepted;
+  }
+  EXPECT_EQ(static_cast<uint64_t>(kConnections), accepted);
+
+  for (int sock : socks) {
+    disconnect(sock);
+  }
+  call_until([&routing]() -> bool { return routing.info_active_routes_.load() == 0; });
+  EXPECT_EQ(0, routing.info_active_routes_.load());
+
+  routing.stop();
+  server.stop();
+  thd.join();
+}
+#endif
+
+#ifdef __linux__
+TEST_F(RoutingTests, ListenBacklog) {
+  const uint16_t router_port = 4447;
+
+  MySQLRouting routing(routing::AccessMode::kReadWrite, router_port,
+               Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  EXPECT_EQ(routing::kDefaultListenBacklog, routing.get_listen_backlog());
+  routing.set_listen_backlog(16);
+  EXPECT_EQ(16, routing.get_listen_backlog());
+  routing.set_destinations_from_csv("127.0.0.1:4424");
+  std::thread thd(&MySQLRouting::start, &routing);
+
+  // service_tcp_ is set up before the acceptor threads start
+  call_until([&routing]() -> bool { return !routing.get_acceptor_stats().empty(); });
+  ASSERT_FALSE(routing.get_acceptor_stats().empty());
+  ASSERT_NE(routing::kInvalidSocket, routing.service_tcp_);
+
+  // accepted sockets inherit TCP_NODELAY from the listening socket
+  int nodelay = 0;
+  socklen_t len = static_cast<socklen_t>(sizeof(nodelay));
+  ASSERT_EQ(0, getsockopt(routing.service_tcp_, IPPROTO_TCP, TCP_NODELAY, &nodelay, &len));
+  EXPECT_NE(0, nodelay);
+
+  routing.stop();
+  thd.join();
+}
+#endif
+
+TEST_F(RoutingTests, InvalidListenBacklog) {
+  MySQLRouting routing(routing::AccessMode::kReadWrite, 4448,
+               Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  EXPECT_THROW(routing.set_listen_backlog(0), std::invalid_argument);
+  EXPECT_THROW(routing.set_listen_backlog(65536), std::invalid_argument);
+}
+
+TEST_F(RoutingTests, InvalidAcceptorThreads) {
+  MySQLRouting routing(routing::AccessMode::kReadWrite, 4446,
+               Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  EXPECT_EQ(1u, routing.get_acceptor_threads());
+  EXPECT_THROW(routing.set_acceptor_threads(0), std::invalid_argument);
+  EXPECT_THROW(routing.set_acceptor_threads(routing::kMaxAcceptorThreads + 1), std::invalid_argument);
+}
+
+TEST_F(RoutingTests, ReleaseFileDescriptors) {
+  uint64_t reserved;
+  routing::reserve_file_descriptors(0, &reserved);
+  uint64_t total_reserved;
+  routing::reserve_file_descriptors(100, &total_reserved);
+  EXPECT_EQ(reserved + 100, total_reserved);
+  routing::release_file_descriptors(100);
+  routing::reserve_file_descriptors(0, &total_reserved);
+  EXPECT_EQ(reserved, total_reserved);
+
+  // a stopped route gives back what it reserved
+  MySQLRouting routing(routing::AccessMode::kReadWrite, 4457,
+               Protocol::Type::kClassicProtocol, "127.0.0.1", mysql_harness::Path(),
+               "routing:testroute");
+  routing.set_destinations_from_csv("127.0.0.1:4424");
+  std::thread thd(&MySQLRouting::start, &routing);
+  call_until([&routing]() -> bool { return !routing.get_acceptor_stats().empty(); });
+  routing::reserve_file_descriptors(0, &total_reserved);
+  EXPECT_LT(reserved, total_reserved);
+
+  routing.stop();
+  thd.join();
+  routing::reserve_file_descriptors(0, &total_reserved);
+  EXPECT_EQ(reserved, total_reserved);
+}
+
 TEST_F(RoutingTests, set_destinations_from_uri) {
 
   MySQLRouting routing(routing::AccessMode::kReadWrite, 7001, Protocol::Type::kXProtocol);
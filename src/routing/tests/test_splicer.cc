@@ -0,0 +1,168 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "splicer.h"
+#include "mysqlrouter/routing.h"
+#include "protocol/classic_protocol.h"
+#include "routing_mocks.h"
+
+#include "gmock/gmock.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using ::testing::_;
+using ::testing::Return;
+
+class SplicerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    socket_operations_ = routing::SocketOperations::instance();
+    protocol_.reset(new ClassicProtocol(socket_operations_));
+  }
+
+  routing::SocketOperationsBase *socket_operations_;
+  std::unique_ptr<BaseProtocol> protocol_;
+};
+
+#ifndef _WIN32
+TEST_F(SplicerTest, HandshakeIsCopied) {
+  int sender[2], receiver[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sender));
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, receiver));
+
+  // greeting with sequence id 0
+  std::vector<uint8_t> greeting(4 + 10, 0x01);
+  greeting[0] = 10;
+  greeting[1] = greeting[2] = greeting[3] = 0;
+  ASSERT_EQ(static_cast<ssize_t>(greeting.size()),
+            ::write(sender[0], greeting.data(), greeting.size()));
+
+  Splicer splicer(protocol_.get(), socket_operations_);
+  RoutingProtocolBuffer buffer(1024);
+  int pktnr = 0;
+  bool handshake_done = false;
+  size_t bytes_read = 0;
+
+  ASSERT_EQ(0, splicer.copy_packets(sender[1], receiver[1], true, buffer, &pktnr,
+                                    handshake_done, &bytes_read, true));
+  EXPECT_EQ(greeting.size(), bytes_read);
+  EXPECT_FALSE(handshake_done);
+  EXPECT_FALSE(splicer.is_splicing());
+
+  std::vector<uint8_t> received(greeting.size());
+  ASSERT_EQ(static_cast<ssize_t>(received.size()),
+            ::read(receiver[0], received.data(), received.size()));
+  EXPECT_EQ(greeting, received);
+
+  for (int fd : {sender[0], sender[1], receiver[0], receiver[1]}) {
+    ::close(fd);
+  }
+}
+
+TEST_F(SplicerTest, DataIsSplicedAfterHandshake) {
+  int sender[2], receiver[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sender));
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, receiver));
+
+  std::vector<uint8_t> data(1024 * 1024);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i % 251);
+  }
+
+  // the receiving end is read concurrently as the data does not fit the
+  // socket buffers
+  std::vector<uint8_t> received;
+  std::thread reader([&] {
+    uint8_t chunk[4096];
+    ssize_t res;
+    while ((res = ::read(receiver[0], chunk, sizeof(chunk))) > 0) {
+      received.insert(received.end(), chunk, chunk + res);
+    }
+  });
+  std::thread writer([&] {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      ssize_t res = ::write(sender[0], &data[offset], data.size() - offset);
+      if (res <= 0) break;
+      offset += static_cast<size_t>(res);
+    }
+    ::shutdown(sender[0], SHUT_WR);
+  });
+
+  Splicer splicer(protocol_.get(), socket_operations_);
+  RoutingProtocolBuffer buffer(1024);
+  int pktnr = 0;
+  bool handshake_done = true;
+  size_t bytes_read = 0;
+  size_t total = 0;
+
+  int res;
+  while ((res = splicer.copy_packets(sender[1], receiver[1], true, buffer, &pktnr,
+                                     handshake_done, &bytes_read, true)) == 0) {
+    // 1024 is the size of the buffer, only splice() moves more at once
+    EXPECT_TRUE(splicer.is_splicing());
+    total += bytes_read;
+  }
+  // end of file is reported like a closed connection
+  EXPECT_EQ(-1, res);
+  EXPECT_EQ(0, socket_operations_->get_errno());
+
+  writer.join();
+  ::shutdown(receiver[1], SHUT_WR);
+  reader.join();
+
+  EXPECT_EQ(data.size(), total);
+  EXPECT_TRUE(data == received);
+
+  for (int fd : {sender[0], sender[1], receiver[0], receiver[1]}) {
+    ::close(fd);
+  }
+}
+#endif
+
+TEST_F(SplicerTest, FallsBackWithoutSpliceSupport) {
+  // MockSocketOperations does not implement pipe()/splice()
+  MockSocketOperations mock_socket_operations;
+  ClassicProtocol protocol(&mock_socket_operations);
+  Splicer splicer(&protocol, &mock_socket_operations);
+
+  RoutingProtocolBuffer buffer(1024);
+  int pktnr = 0;
+  bool handshake_done = true;
+  size_t bytes_read = 0;
+
+  EXPECT_CALL(mock_socket_operations, read(1, _, 1024)).WillOnce(Return(200));
+  EXPECT_CALL(mock_socket_operations, write(2, _, 200)).WillOnce(Return(200));
+  EXPECT_CALL(mock_socket_operations, close(_)).Times(0);
+
+  ASSERT_EQ(0, splicer.copy_packets(1, 2, true, buffer, &pktnr, handshake_done,
+                                    &bytes_read, true));
+  EXPECT_EQ(200u, bytes_read);
+  EXPECT_FALSE(splicer.is_splicing());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
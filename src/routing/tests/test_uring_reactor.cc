@@ -0,0 +1,363 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "uring_reactor.h"
+#include "mysqlrouter/routing.h"
+#include "protocol/protocol.h"
+
+#include "gmock/gmock.h"
+
+#ifdef HAVE_IO_URING
+
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using ::testing::StrEq;
+
+static const unsigned int kNetBufferLength = 1024;
+
+// builds a classic protocol packet with the given sequence id
+static std::vector<uint8_t> make_packet(uint8_t pktnr, size_t payload_size, uint8_t fill = 0x01) {
+  std::vector<uint8_t> packet(4 + payload_size, fill);
+  packet[0] = static_cast<uint8_t>(payload_size & 0xff);
+  packet[1] = static_cast<uint8_t>((payload_size >> 8) & 0xff);
+  packet[2] = static_cast<uint8_t>((payload_size >> 16) & 0xff);
+  packet[3] = pktnr;
+  return packet;
+}
+
+static bool write_all(int fd, const std::vector<uint8_t> &data) {
+  size_t offset = 0;
+  while (offset < data.size()) {
+    ssize_t res = ::write(fd, &data[offset], data.size() - offset);
+    if (res < 0) {
+      return false;
+    }
+    offset += static_cast<size_t>(res);
+  }
+  return true;
+}
+
+// reads exactly size bytes, giving up when nothing arrives for 5 seconds
+static std::vector<uint8_t> read_exact(int fd, size_t size) {
+  std::vector<uint8_t> result(size);
+  size_t offset = 0;
+  while (offset < size) {
+    struct pollfd fds[] = { { fd, POLLIN, 0 } };
+    if (::poll(fds, 1, 5000) <= 0) {
+      break;
+    }
+    ssize_t res = ::read(fd, &result[offset], size - offset);
+    if (res <= 0) {
+      break;
+    }
+    offset += static_cast<size_t>(res);
+  }
+  result.resize(offset);
+  return result;
+}
+
+class UringReactorTest : public ::testing::Test {
+ protected:
+  struct ClosedConnection {
+    bool handshake_done;
+    size_t bytes_up;
+    size_t bytes_down;
+    std::string extra_msg;
+    bool non_blocking;
+  };
+
+  virtual void SetUp() {
+    reactor_.reset(new UringReactor("RtU:test", 2, Protocol::Type::kClassicProtocol,
+                                    routing::SocketOperations::instance(),
+                                    kNetBufferLength, std::chrono::seconds(2),
+                                    [this](UringReactor::Connection &connection) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_.push_back({connection.handshake_done, connection.bytes_up,
+                         connection.bytes_down, connection.extra_msg,
+                         (fcntl(connection.server.fd, F_GETFL) & O_NONBLOCK) != 0 &&
+                         (fcntl(connection.client.fd, F_GETFL) & O_NONBLOCK) != 0});
+      ::close(connection.client.fd);
+      ::close(connection.server.fd);
+      cond_closed_.notify_all();
+    }));
+    try {
+      reactor_->start();
+    } catch (const std::runtime_error &exc) {
+      // io_uring may be disabled by the kernel or a seccomp profile
+      std::cout << "[ SKIPPED  ] " << exc.what() << std::endl;
+      reactor_.reset();
+    }
+  }
+
+  virtual void TearDown() {
+    if (reactor_) {
+      reactor_->stop();
+    }
+    for (int fd : fds_) {
+      ::close(fd);
+    }
+  }
+
+  // the reactor gets one end of two socket pairs, the test plays the
+  // client and the server using the other ends
+  void add_connection(int &client, int &server) {
+    int client_pair[2];
+    int server_pair[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, client_pair));
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, server_pair));
+
+    sockaddr_storage addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.ss_family = AF_UNIX;
+    ASSERT_TRUE(reactor_->add_connection(client_pair[1], server_pair[1], addr));
+
+    client = client_pair[0];
+    server = server_pair[0];
+    fds_.push_back(client);
+    fds_.push_back(server);
+  }
+
+  bool wait_closed(size_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_closed_.wait_for(lock, std::chrono::seconds(10),
+                                 [this, count] { return closed_.size() >= count; });
+  }
+
+  void handshake(int client, int server) {
+    auto greeting = make_packet(0, 70);
+    auto response = make_packet(1, 40);
+    auto ok = make_packet(2, 7);
+
+    ASSERT_TRUE(write_all(server, greeting));
+    ASSERT_EQ(greeting, read_exact(client, greeting.size()));
+    ASSERT_TRUE(write_all(client, response));
+    ASSERT_EQ(response, read_exact(server, response.size()));
+    ASSERT_TRUE(write_all(server, ok));
+    ASSERT_EQ(ok, read_exact(client, ok.size()));
+  }
+
+  std::unique_ptr<UringReactor> reactor_;
+  std::mutex mutex_;
+  std::condition_variable cond_closed_;
+  std::vector<ClosedConnection> closed_;
+  std::vector<int> fds_;
+};
+
+TEST_F(UringReactorTest, ForwardsHandshakeAndData) {
+  if (!reactor_) return;
+
+  int client, server;
+  add_connection(client, server);
+  handshake(client, server);
+
+  // more than fits the socket buffers, so the reactor has to deal with
+  // a receiver which is backed up
+  std::vector<uint8_t> result_set(1024 * 1024);
+  for (size_t i = 0; i < result_set.size(); ++i) {
+    result_set[i] = static_cast<uint8_t>(i % 251);
+  }
+  std::thread writer([&] { write_all(server, result_set); });
+  auto received = read_exact(client, result_set.size());
+  writer.join();
+  ASSERT_EQ(result_set.size(), received.size());
+  ASSERT_TRUE(result_set == received);
+
+  auto query = make_packet(0, 100 * 1024, 0x03);
+  std::thread client_writer([&] { write_all(client, query); });
+  ASSERT_EQ(query, read_exact(server, query.size()));
+  client_writer.join();
+
+  ::shutdown(client, SHUT_RDWR);
+  ASSERT_TRUE(wait_closed(1));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  EXPECT_TRUE(closed_[0].handshake_done);
+  EXPECT_EQ(74u + 11u + result_set.size(), closed_[0].bytes_up);
+  EXPECT_EQ(44u + query.size(), closed_[0].bytes_down);
+}
+
+TEST_F(UringReactorTest, ManyConnectionsShareSystemCalls) {
+  if (!reactor_) return;
+
+  const size_t kConnections = 50;
+  std::vector<std::pair<int, int>> connections(kConnections);
+
+  for (auto &connection : connections) {
+    add_connection(connection.first, connection.second);
+  }
+  for (auto &connection : connections) {
+    handshake(connection.first, connection.second);
+  }
+
+  // all clients send before any server reads
+  auto query = make_packet(0, 200, 0x03);
+  for (auto &connection : connections) {
+    ASSERT_TRUE(write_all(connection.first, query));
+  }
+  for (auto &connection : connections) {
+    ASSERT_EQ(query, read_exact(connection.second, query.size()));
+  }
+
+  // receives, sends and returned buffers are submitted together
+  UringReactor::Stats stats = reactor_->get_stats();
+  EXPECT_GT(stats.submitted, 2 * stats.enter_calls);
+
+  for (auto &connection : connections) {
+    ::shutdown(connection.second, SHUT_RDWR);
+  }
+
+  ASSERT_TRUE(wait_closed(kConnections));
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &closed : closed_) {
+    EXPECT_TRUE(closed.handshake_done);
+  }
+}
+
+TEST_F(UringReactorTest, BackedUpReceiverDoesNotStallOthers) {
+  if (!reactor_) return;
+
+  int client, server;
+  add_connection(client, server);
+  handshake(client, server);
+
+  // the client does not read what the server sends
+  std::vector<uint8_t> result_set(4 * 1024 * 1024, 0x05);
+  std::thread writer([&] {
+    size_t offset = 0;
+    ssize_t res;
+    while (offset < result_set.size() &&
+           (res = ::send(server, &result_set[offset], result_set.size() - offset, MSG_NOSIGNAL)) > 0) {
+      offset += static_cast<size_t>(res);
+    }
+  });
+
+  for (int i = 0; i < 4; ++i) {
+    int other_client, other_server;
+    add_connection(other_client, other_server);
+    handshake(other_client, other_server);
+  }
+
+  ::shutdown(client, SHUT_RDWR);
+  ASSERT_TRUE(wait_closed(1));
+  ::shutdown(server, SHUT_RDWR);
+  writer.join();
+}
+
+TEST_F(UringReactorTest, ClientAuthTimeout) {
+  if (!reactor_) return;
+
+  int client, server;
+  add_connection(client, server);
+
+  auto greeting = make_packet(0, 70);
+  ASSERT_TRUE(write_all(server, greeting));
+  ASSERT_EQ(greeting, read_exact(client, greeting.size()));
+
+  // client never answers
+  ASSERT_TRUE(wait_closed(1));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  EXPECT_FALSE(closed_[0].handshake_done);
+  EXPECT_THAT(closed_[0].extra_msg, StrEq("client auth timed out"));
+  // what the handler sends to the server must not stall the reactor thread
+  EXPECT_TRUE(closed_[0].non_blocking);
+}
+
+TEST_F(UringReactorTest, WrongPacketNumberWhileHandshaking) {
+  if (!reactor_) return;
+
+  int client, server;
+  add_connection(client, server);
+
+  auto greeting = make_packet(0, 70);
+  ASSERT_TRUE(write_all(server, greeting));
+  ASSERT_EQ(greeting, read_exact(client, greeting.size()));
+  ASSERT_TRUE(write_all(client, make_packet(1, 40)));
+  ASSERT_EQ(44u, read_exact(server, 44).size());
+  ASSERT_TRUE(write_all(server, make_packet(5, 7)));
+
+  ASSERT_TRUE(wait_closed(1));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  EXPECT_FALSE(closed_[0].handshake_done);
+}
+
+TEST_F(UringReactorTest, PartialHandshakePacketWaitsForTheRest) {
+  if (!reactor_) return;
+
+  int client, server;
+  add_connection(client, server);
+  int other_client, other_server;
+  add_connection(other_client, other_server);
+  int third_client, third_server;
+  add_connection(third_client, third_server);
+
+  // not even the header of the greeting is complete
+  auto greeting = make_packet(0, 70);
+  ASSERT_TRUE(write_all(server, std::vector<uint8_t>(greeting.begin(), greeting.begin() + 2)));
+
+  // the other connections, one of them served by the same thread, go on
+  handshake(other_client, other_server);
+  handshake(third_client, third_server);
+
+  ASSERT_TRUE(write_all(server, std::vector<uint8_t>(greeting.begin() + 2, greeting.begin() + 30)));
+  struct pollfd fds[] = { { client, POLLIN, 0 } };
+  EXPECT_EQ(0, ::poll(fds, 1, 100));
+
+  ASSERT_TRUE(write_all(server, std::vector<uint8_t>(greeting.begin() + 30, greeting.end())));
+  ASSERT_EQ(greeting, read_exact(client, greeting.size()));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  EXPECT_TRUE(closed_.empty());
+}
+
+TEST_F(UringReactorTest, StopClosesConnections) {
+  if (!reactor_) return;
+
+  int client, server;
+  add_connection(client, server);
+  add_connection(client, server);
+
+  reactor_->stop();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ASSERT_EQ(2u, closed_.size());
+  EXPECT_THAT(closed_[0].extra_msg, StrEq("route stopped"));
+  EXPECT_THAT(closed_[1].extra_msg, StrEq("route stopped"));
+
+  sockaddr_storage addr;
+  std::memset(&addr, 0, sizeof(addr));
+  EXPECT_FALSE(reactor_->add_connection(client, server, addr));
+}
+
+#endif // HAVE_IO_URING
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+/*
+  Copyright (c) 2018, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; version 2 of the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "worker_pool.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+// lets tasks block until the test releases them
+class Gate {
+ public:
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++waiting_;
+    cond_.notify_all();
+    cond_.wait(lock, [this] { return open_; });
+    --waiting_;
+  }
+
+  void open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = true;
+    cond_.notify_all();
+  }
+
+  bool wait_for_waiters(int n) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_.wait_for(lock, std::chrono::seconds(5), [this, n] { return waiting_ == n; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  int waiting_ = 0;
+  bool open_ = false;
+};
+
+static bool call_until(std::function<bool()> f) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!f()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+
+TEST(WorkerPoolTest, InvalidSizes) {
+  EXPECT_THROW(WorkerPool("test", 0, 0, 1), std::invalid_argument);
+  EXPECT_THROW(WorkerPool("test", 2, 1, 1), std::invalid_argument);
+}
+
+TEST(WorkerPoolTest, MinThreadsAreStarted) {
+  WorkerPool pool("test", 3, 4, 1);
+  EXPECT_TRUE(call_until([&pool] { return pool.get_stats().idle_threads == 3; }));
+  EXPECT_EQ(3u, pool.get_stats().threads);
+}
+
+TEST(WorkerPoolTest, RunsAllTasks) {
+  std::atomic<int> done{0};
+  {
+    WorkerPool pool("test", 0, 4, 1000);
+    for (int i = 0; i < 1000; ++i) {
+      ASSERT_TRUE(pool.submit([&done] { ++done; }));
+    }
+    pool.stop();
+
+    WorkerPool::Stats stats = pool.get_stats();
+    EXPECT_EQ(1000u, stats.tasks_started);
+    EXPECT_EQ(0u, stats.tasks_rejected);
+    EXPECT_EQ(0u, stats.threads);
+  }
+  EXPECT_EQ(1000, done.load());
+}
+
+TEST(WorkerPoolTest, ThreadsAreReused) {
+  WorkerPool pool("test", 0, 4, 10);
+  for (int i = 0; i < 50; ++i) {
+    std::atomic<bool> done{false};
+    ASSERT_TRUE(pool.submit([&done] { done = true; }));
+    ASSERT_TRUE(call_until([&done] { return done.load(); }));
+    // the thread becomes idle before it takes the next task
+    ASSERT_TRUE(call_until([&pool] { return pool.get_stats().idle_threads == pool.get_stats().threads; }));
+  }
+  EXPECT_EQ(1u, pool.get_stats().threads);
+}
+
+TEST(WorkerPoolTest, QueueIsBounded) {
+  Gate gate;
+  WorkerPool pool("test", 0, 2, 1);
+  // the threads are joined when the pool is destroyed
+  std::shared_ptr<void> exit_guard(nullptr, [&gate](void *) { gate.open(); });
+
+  EXPECT_TRUE(pool.submit([&gate] { gate.wait(); }));
+  EXPECT_TRUE(pool.submit([&gate] { gate.wait(); }));
+  ASSERT_TRUE(gate.wait_for_waiters(2));
+
+  // both threads are busy: one task fits into the queue
+  std::atomic<bool> queued_task_done{false};
+  EXPECT_TRUE(pool.submit([&queued_task_done] { queued_task_done = true; }));
+  EXPECT_FALSE(pool.submit([] { FAIL() << "rejected task must not run"; }));
+
+  WorkerPool::Stats stats = pool.get_stats();
+  EXPECT_EQ(2u, stats.threads);
+  EXPECT_EQ(1u, stats.queue_depth);
+  EXPECT_EQ(1u, stats.max_queue_depth);
+  EXPECT_EQ(1u, stats.tasks_rejected);
+
+  gate.open();
+  EXPECT_TRUE(call_until([&queued_task_done] { return queued_task_done.load(); }));
+
+  pool.stop();
+  stats = pool.get_stats();
+  EXPECT_EQ(3u, stats.tasks_started);
+  EXPECT_EQ(0u, stats.queue_depth);
+  EXPECT_GT(stats.max_wait.count(), 0);
+  EXPECT_GE(stats.total_wait, stats.max_wait);
+}
+
+TEST(WorkerPoolTest, IdleThreadsAboveMinExit) {
+  Gate gate;
+  WorkerPool pool("test", 1, 3, 0, std::chrono::milliseconds(50));
+  // the threads are joined when the pool is destroyed
+  std::shared_ptr<void> exit_guard(nullptr, [&gate](void *) { gate.open(); });
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(pool.submit([&gate] { gate.wait(); }));
+  }
+  ASSERT_TRUE(gate.wait_for_waiters(3));
+  EXPECT_EQ(3u, pool.get_stats().threads);
+
+  gate.open();
+  EXPECT_TRUE(call_until([&pool] { return pool.get_stats().threads == 1; }));
+
+  // exited threads are joined by the next submit()
+  std::atomic<bool> done{false};
+  EXPECT_TRUE(pool.submit([&done] { done = true; }));
+  EXPECT_TRUE(call_until([&done] { return done.load(); }));
+  EXPECT_EQ(1u, pool.get_stats().threads);
+}
+
+TEST(WorkerPoolTest, TasksWaitingTooLongExpire) {
+  Gate gate;
+  WorkerPool pool("test", 1, 1, 2, std::chrono::seconds(60), std::chrono::milliseconds(50));
+  std::shared_ptr<void> exit_guard(nullptr, [&gate](void *) { gate.open(); });
+
+  EXPECT_TRUE(pool.submit([&gate] { gate.wait(); }));
+  ASSERT_TRUE(gate.wait_for_waiters(1));
+
+  std::atomic<bool> ran{false};
+  std::atomic<bool> expired{false};
+  EXPECT_TRUE(pool.submit([&ran] { ran = true; }, [&expired] { expired = true; }));
+  EXPECT_TRUE(call_until([&expired] { return expired.load(); }));
+
+  WorkerPool::Stats stats = pool.get_stats();
+  EXPECT_EQ(1u, stats.tasks_expired);
+  EXPECT_EQ(0u, stats.queue_depth);
+
+  gate.open();
+  pool.stop();
+  EXPECT_FALSE(ran);
+}
+
+TEST(WorkerPoolTest, SubmitAfterStopIsRejected) {
+  WorkerPool pool("test", 1, 1, 1);
+  pool.stop();
+  EXPECT_FALSE(pool.submit([] {}));
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -34,6 +34,7 @@ public:
                        int connection_timeout = kDefaultConnectionTimeout) override;
   virtual void disconnect() override;
   virtual bool is_connected() noexcept override { return connected_; }
+  virtual bool ping() noexcept override { return connected_; }
 
   virtual void execute(const std::string &sql) override;
   virtual void query(const std::string &sql, const RowProcessor &processor) override;